@@ -0,0 +1,106 @@
+#include <string>
+
+#include "../src/ast.h"
+#include "../src/eval.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "bench.h"
+#include "inputs.h"
+
+// ExprPtr tree vs flat arena AST, on deeply nested and wide inputs
+
+constexpr size_t NESTING_DEPTH = 2000;
+// Over the default limit, so raise it
+constexpr size_t MAX_DEPTH = bench::inputs::NO_DEPTH_LIMIT;
+constexpr size_t CHAIN_LENGTH = 10000;
+
+// 1 + (2 - (3 + (...)))
+static std::string nested_source() {
+    std::string src;
+    for (size_t i = 0; i < NESTING_DEPTH; ++i) {
+        src += std::to_string(i) + (i % 2 == 0 ? " + (" : " - (");
+    }
+    src += "0";
+    src.append(NESTING_DEPTH, ')');
+    return src;
+}
+
+// 1 * 2 + 3 * 4 + ...
+static std::string chain_source() {
+    std::string src = "0";
+    for (size_t i = 1; i < CHAIN_LENGTH; ++i) {
+        src += (i % 2 == 0 ? " + " : " * ") + std::to_string(i % 7);
+    }
+    return src;
+}
+
+static TokenVec lex_source(std::string const& src) {
+    size_t num_errs = 0;
+    return lift(lex(src, num_errs)).value();
+}
+
+static void run_parse_tree(bench::State& state, TokenVec const& toks) {
+    for (auto _ : state) {
+        auto expr = parse(toks, MAX_DEPTH);
+        bench::do_not_optimize(expr);
+    }
+}
+static void run_parse_flat(bench::State& state, TokenVec const& toks) {
+    for (auto _ : state) {
+        auto flat = ast::parse(toks, MAX_DEPTH);
+        bench::do_not_optimize(flat);
+    }
+    state.counters["nodes"] =
+        static_cast<double>(ast::parse(toks, MAX_DEPTH)->size());
+}
+static void run_eval_tree(bench::State& state, TokenVec const& toks) {
+    const ExprPtr expr = std::move(parse(toks, MAX_DEPTH).value());
+    rt::Heap heap;
+    const eval::Visitor_Eval visitor(heap);
+    for (auto _ : state) {
+        auto value = visit_expr(*expr, visitor);
+        bench::do_not_optimize(value);
+    }
+}
+static void run_eval_flat(bench::State& state, TokenVec const& toks) {
+    const ast::Ast flat = std::move(ast::parse(toks, MAX_DEPTH).value());
+    rt::Heap heap;
+    for (auto _ : state) {
+        auto value = eval::evaluate(flat, heap);
+        bench::do_not_optimize(value);
+    }
+}
+
+static void BM_parse_tree_nested(bench::State& state) {
+    run_parse_tree(state, lex_source(nested_source()));
+}
+static void BM_parse_flat_nested(bench::State& state) {
+    run_parse_flat(state, lex_source(nested_source()));
+}
+static void BM_eval_tree_nested(bench::State& state) {
+    run_eval_tree(state, lex_source(nested_source()));
+}
+static void BM_eval_flat_nested(bench::State& state) {
+    run_eval_flat(state, lex_source(nested_source()));
+}
+static void BM_parse_tree_chain(bench::State& state) {
+    run_parse_tree(state, lex_source(chain_source()));
+}
+static void BM_parse_flat_chain(bench::State& state) {
+    run_parse_flat(state, lex_source(chain_source()));
+}
+static void BM_eval_tree_chain(bench::State& state) {
+    run_eval_tree(state, lex_source(chain_source()));
+}
+static void BM_eval_flat_chain(bench::State& state) {
+    run_eval_flat(state, lex_source(chain_source()));
+}
+
+BENCHMARK(BM_parse_tree_nested);
+BENCHMARK(BM_parse_flat_nested);
+BENCHMARK(BM_eval_tree_nested);
+BENCHMARK(BM_eval_flat_nested);
+BENCHMARK(BM_parse_tree_chain);
+BENCHMARK(BM_parse_flat_chain);
+BENCHMARK(BM_eval_tree_chain);
+BENCHMARK(BM_eval_flat_chain);
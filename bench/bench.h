@@ -0,0 +1,118 @@
+#pragma once
+/**
+ * Minimal benchmark harness for the interpreter
+ * Modeled after Google Benchmark: a benchmark is a function taking a State,
+ * whose range-for loop is the timed region. The runner picks the iteration
+ * count, and reports time and heap allocations per iteration.
+ **/
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// Heap allocations since program start, counted by the global operator new
+// replacement in bench_main.cpp
+struct AllocCounters {
+    size_t count = 0;
+    size_t bytes = 0;
+};
+[[nodiscard]]
+AllocCounters alloc_counters();
+
+class State {
+  public:
+    explicit State(const size_t max_iterations)
+        : max_iterations(max_iterations) {}
+
+    struct Iterator {
+        State* state;
+        size_t remaining;
+
+        bool operator!=(Iterator const&) {
+            if (remaining == 0) {
+                state->stop_timer();
+                return false;
+            }
+            return true;
+        }
+        void operator++() { --remaining; }
+        // The value is unused, only the loop count matters
+        int operator*() const { return 0; }
+    };
+
+    Iterator begin() {
+        start_timer();
+        return Iterator{this, max_iterations};
+    }
+    Iterator end() { return Iterator{this, 0}; }
+
+    [[nodiscard]]
+    size_t iterations() const {
+        return max_iterations;
+    }
+
+    // Extra per-benchmark numbers to report, e.g. node counts.
+    // Printed as-is, not divided by iterations.
+    std::map<std::string, double> counters;
+
+    // Filled in by the timed loop
+    std::chrono::nanoseconds elapsed{0};
+    AllocCounters allocs;
+
+  private:
+    size_t max_iterations;
+    std::chrono::steady_clock::time_point start;
+    AllocCounters allocs_at_start;
+
+    void start_timer() {
+        allocs_at_start = alloc_counters();
+        start = std::chrono::steady_clock::now();
+    }
+    void stop_timer() {
+        elapsed = std::chrono::steady_clock::now() - start;
+        const AllocCounters now = alloc_counters();
+        allocs.count = now.count - allocs_at_start.count;
+        allocs.bytes = now.bytes - allocs_at_start.bytes;
+    }
+};
+
+using BenchFn = void (*)(State&);
+
+struct Registration {
+    std::string name;
+    BenchFn fn;
+};
+std::vector<Registration>& registry();
+
+struct Registrar {
+    Registrar(const char* name, BenchFn fn) { registry().push_back({name, fn}); }
+};
+
+// Report `items` processed per iteration as a per-second `counter`,
+// e.g. "tokens/s"
+inline void set_rate(State& state, std::string const& counter,
+                     const size_t items) {
+    const double seconds =
+        std::chrono::duration<double>(state.elapsed).count() /
+        static_cast<double>(state.iterations());
+    state.counters[counter] = static_cast<double>(items) / seconds;
+}
+
+// Report `bytes` processed per iteration as an "MB/s" counter
+inline void set_throughput(State& state, const size_t bytes) {
+    set_rate(state, "MB/s", bytes);
+    state.counters["MB/s"] /= 1024.0 * 1024.0;
+}
+
+// Keep the compiler from optimizing away a computed value
+template <typename T> inline void do_not_optimize(T const& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+} // namespace bench
+
+#define BENCHMARK(fn) static const bench::Registrar fn##_registrar(#fn, fn)
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <format>
+#include <map>
+#include <new>
+#include <optional>
+#include <print>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bench.h"
+
+// Count every heap allocation, so benchmarks can report allocs/iteration
+static std::atomic<size_t> g_alloc_count = 0;
+static std::atomic<size_t> g_alloc_bytes = 0;
+
+void* operator new(const size_t size) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+bench::AllocCounters bench::alloc_counters() {
+    return {g_alloc_count.load(std::memory_order_relaxed),
+            g_alloc_bytes.load(std::memory_order_relaxed)};
+}
+
+std::vector<bench::Registration>& bench::registry() {
+    static std::vector<Registration> benchmarks;
+    return benchmarks;
+}
+
+// Grow the iteration count until a run takes at least this long
+constexpr auto MIN_BENCH_TIME = std::chrono::milliseconds(200);
+
+struct Result {
+    std::string name;
+    size_t iterations;
+    double ns_per_iter;
+    double allocs_per_iter;
+    std::map<std::string, double> counters;
+};
+
+struct Options {
+    std::string_view filter;
+    bool json = false;
+    // Runs at the calibrated iteration count, the median one is reported
+    size_t repetitions = 1;
+};
+
+// Calibrate the iteration count, then time `repetitions` runs of it
+static Result run_benchmark(bench::Registration const& bench,
+                            const size_t repetitions) {
+    size_t iterations = 1;
+    std::vector<bench::State> runs;
+    for (;;) {
+        bench::State state(iterations);
+        bench.fn(state);
+
+        if (state.elapsed < MIN_BENCH_TIME && iterations < (1ull << 30)) {
+            // Aim a bit past the target, growing at most 10x per step
+            using Millis = std::chrono::duration<double, std::milli>;
+            const double ratio =
+                1.4 * Millis(MIN_BENCH_TIME).count() /
+                std::max(0.001, Millis(state.elapsed).count());
+            iterations = static_cast<size_t>(static_cast<double>(iterations) *
+                                             std::clamp(ratio, 2.0, 10.0));
+            continue;
+        }
+        runs.push_back(std::move(state));
+        break;
+    }
+    while (runs.size() < repetitions) {
+        bench::State state(iterations);
+        bench.fn(state);
+        runs.push_back(std::move(state));
+    }
+
+    std::ranges::sort(runs, {}, &bench::State::elapsed);
+    bench::State& median = runs[runs.size() / 2];
+    const double iters = static_cast<double>(iterations);
+    return Result{bench.name, iterations,
+                  static_cast<double>(median.elapsed.count()) / iters,
+                  static_cast<double>(median.allocs.count) / iters,
+                  std::move(median.counters)};
+}
+
+static void print_row(Result const& result) {
+    std::print("{:<40} {:>12} {:>14.1f} {:>12.1f}", result.name,
+               result.iterations, result.ns_per_iter, result.allocs_per_iter);
+    for (auto const& [counter, value] : result.counters) {
+        std::print("  {}={}", counter, value);
+    }
+    std::println("");
+}
+
+// Names and counters are plain ASCII, quotes and backslashes are enough
+static std::string json_string(const std::string_view str) {
+    std::string out = "\"";
+    for (const char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+static std::string json_number(const double value) {
+    return std::isfinite(value) ? std::format("{}", value) : "null";
+}
+
+// Google Benchmark-like layout, one object per benchmark
+static void print_json(std::vector<Result> const& results,
+                       Options const& options) {
+#ifdef __OPTIMIZE__
+    constexpr bool optimized = true;
+#else
+    constexpr bool optimized = false;
+#endif
+    std::println("{{");
+    std::println("  \"context\": {{");
+    std::println("    \"num_cpus\": {},", std::thread::hardware_concurrency());
+    std::println("    \"optimized\": {},", optimized);
+    std::println("    \"repetitions\": {}", options.repetitions);
+    std::println("  }},");
+    std::println("  \"benchmarks\": [");
+    for (size_t i = 0; i < results.size(); ++i) {
+        Result const& result = results[i];
+        std::print("    {{\"name\": {}, \"iterations\": {}, "
+                   "\"ns_per_iter\": {}, \"allocs_per_iter\": {}",
+                   json_string(result.name), result.iterations,
+                   json_number(result.ns_per_iter),
+                   json_number(result.allocs_per_iter));
+        for (auto const& [counter, value] : result.counters) {
+            std::print(", {}: {}", json_string(counter), json_number(value));
+        }
+        std::println("}}{}", i + 1 < results.size() ? "," : "");
+    }
+    std::println("  ]");
+    std::println("}}");
+}
+
+static std::optional<Options> parse_options(const int argc, char* argv[]) {
+    constexpr std::string_view REPETITIONS_FLAG = "--repetitions=";
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--json") {
+            options.json = true;
+        } else if (arg.starts_with(REPETITIONS_FLAG)) {
+            const std::string_view num = arg.substr(REPETITIONS_FLAG.size());
+            const auto [end, ec] = std::from_chars(
+                num.data(), num.data() + num.size(), options.repetitions);
+            if (ec != std::errc() || end != num.data() + num.size() ||
+                options.repetitions == 0) {
+                return std::nullopt;
+            }
+        } else if (arg.starts_with("--") || !options.filter.empty()) {
+            return std::nullopt;
+        } else {
+            options.filter = arg;
+        }
+    }
+    return options;
+}
+
+// Usage: interp_bench [name filter] [--json] [--repetitions=N]
+int main(const int argc, char* argv[]) {
+    const auto options = parse_options(argc, argv);
+    if (!options.has_value()) {
+        std::println(stderr, "Usage: {} [name filter] [--json] "
+                             "[--repetitions=N]",
+                     argv[0]);
+        return 1;
+    }
+
+    if (!options->json) {
+        std::println("{:<40} {:>12} {:>14} {:>12}", "Benchmark", "Iterations",
+                     "ns/iter", "allocs/iter");
+    }
+    std::vector<Result> results;
+    for (auto const& bench : bench::registry()) {
+        if (!bench.name.contains(options->filter)) {
+            continue;
+        }
+        results.push_back(run_benchmark(bench, options->repetitions));
+        if (!options->json) {
+            print_row(results.back());
+        }
+    }
+    if (options->json) {
+        print_json(results, *options);
+    }
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include <string>
+
+#include "../src/cache.h"
+#include "../src/driver.h"
+#include "bench.h"
+#include "inputs.h"
+
+// The same source evaluated over and over in one session, compiled every
+// time vs looked up in a cache::Cache
+
+static void run_session(bench::State& state, const driver::EBackend backend,
+                        const bool cached) {
+    const std::string src = bench::inputs::wide_chain(200);
+    const driver::Options options{.backend = backend};
+    cache::Cache cache;
+    driver::Session session;
+    session.cache = cached ? &cache : nullptr;
+    for (auto _ : state) {
+        driver::evaluate(src, options, session);
+        bench::do_not_optimize(session.output);
+    }
+    bench::set_throughput(state, src.size());
+}
+
+#define CACHE_BENCHMARKS(name, backend)                                        \
+    static void BM_session_uncached_##name(bench::State& state) {              \
+        run_session(state, driver::EBackend::backend, false);                 \
+    }                                                                          \
+    static void BM_session_cached_##name(bench::State& state) {                \
+        run_session(state, driver::EBackend::backend, true);                  \
+    }                                                                          \
+    BENCHMARK(BM_session_uncached_##name);                                     \
+    BENCHMARK(BM_session_cached_##name)
+
+CACHE_BENCHMARKS(tree, Tree);
+CACHE_BENCHMARKS(vm, VM);
+CACHE_BENCHMARKS(flat, Flat);
@@ -0,0 +1,103 @@
+#include <string>
+
+#include "../src/ast.h"
+#include "../src/eval.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/runtime.h"
+#include "../src/vm.h"
+#include "bench.h"
+#include "inputs.h"
+
+// "w0" + "w1" + ... chains of string literals, evaluated and then printed,
+// so the time includes reading the result. Reported as ns/term.
+
+constexpr size_t SHORT_CHAIN = 10000;
+constexpr size_t LONG_CHAIN = 100000;
+
+static std::string chain_source(const size_t terms) {
+    std::string src = "\"start\"";
+    for (size_t i = 0; i < terms; ++i) {
+        src += " + \"word_" + std::to_string(i % 1000) + "\"";
+    }
+    return src;
+}
+
+// Tokens point into `src`
+static TokenVec lex_source(std::string const& src) {
+    size_t num_errs = 0;
+    return lift(lex(src, num_errs)).value();
+}
+
+static void finish(bench::State& state, const size_t terms,
+                   const size_t out_bytes) {
+    state.counters["out_bytes"] = static_cast<double>(out_bytes);
+    state.counters["ns/term"] = static_cast<double>(state.elapsed.count()) /
+                                static_cast<double>(state.iterations()) /
+                                static_cast<double>(terms);
+}
+
+static void run_tree(bench::State& state, const size_t terms) {
+    const std::string src = chain_source(terms);
+    const ExprPtr expr = std::move(
+        parse(lex_source(src), bench::inputs::NO_DEPTH_LIMIT).value());
+    rt::Heap heap;
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        rt::append_value(out, eval::evaluate(*expr, heap).value());
+        heap.clear();
+    }
+    finish(state, terms, out.size());
+}
+
+static void run_vm(bench::State& state, const size_t terms) {
+    const std::string src = chain_source(terms);
+    const vm::Chunk chunk = vm::compile(
+        *parse(lex_source(src), bench::inputs::NO_DEPTH_LIMIT).value());
+    rt::Heap heap;
+    vm::VM machine(heap);
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        rt::append_value(out, machine.run(chunk).value());
+        heap.clear();
+    }
+    finish(state, terms, out.size());
+}
+
+static void run_flat(bench::State& state, const size_t terms) {
+    const std::string src = chain_source(terms);
+    const ast::Ast ast =
+        ast::parse(lex_source(src), bench::inputs::NO_DEPTH_LIMIT).value();
+    rt::Heap heap;
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        rt::append_value(out, eval::evaluate(ast, heap).value());
+        heap.clear();
+    }
+    finish(state, terms, out.size());
+}
+
+static void BM_concat_tree_10k(bench::State& state) {
+    run_tree(state, SHORT_CHAIN);
+}
+static void BM_concat_vm_10k(bench::State& state) {
+    run_vm(state, SHORT_CHAIN);
+}
+static void BM_concat_flat_10k(bench::State& state) {
+    run_flat(state, SHORT_CHAIN);
+}
+static void BM_concat_vm_100k(bench::State& state) {
+    run_vm(state, LONG_CHAIN);
+}
+static void BM_concat_flat_100k(bench::State& state) {
+    run_flat(state, LONG_CHAIN);
+}
+
+BENCHMARK(BM_concat_tree_10k);
+BENCHMARK(BM_concat_vm_10k);
+BENCHMARK(BM_concat_flat_10k);
+BENCHMARK(BM_concat_vm_100k);
+BENCHMARK(BM_concat_flat_100k);
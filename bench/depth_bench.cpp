@@ -0,0 +1,101 @@
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/ast.h"
+#include "../src/eval.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "bench.h"
+
+// Parse + evaluate of ever deeper nesting, recursive tree vs the explicit
+// stack flat AST. The tree only goes up to the default depth limit, past
+// ~5000 levels it overflows an 8 MB stack.
+
+// (-(-(...1 + 2...) * 3) * 3)
+static std::string nested_source(const size_t depth) {
+    std::string src;
+    for (size_t i = 0; i < depth; ++i) {
+        src += "(-";
+    }
+    src += "1 + 2";
+    for (size_t i = 0; i < depth; ++i) {
+        src += ") * 3";
+    }
+    return src;
+}
+
+// A paren and a minus per level, and a link for the *
+static size_t max_depth_for(const size_t depth) { return depth * 3; }
+
+static void eval_tree(std::string const& src, const size_t depth) {
+    TokenStream tokens(src);
+    rt::Heap heap;
+    auto value = eval::evaluate(
+        std::move(parse(tokens, max_depth_for(depth)).value()), heap);
+    bench::do_not_optimize(value);
+}
+
+static void eval_flat(std::string const& src, const size_t depth) {
+    TokenStream tokens(src);
+    rt::Heap heap;
+    auto value =
+        eval::evaluate(ast::parse(tokens, max_depth_for(depth)).value(), heap);
+    bench::do_not_optimize(value);
+}
+
+// ru_maxrss of a forked child after running fn once, in KB
+template <typename F> static long child_peak_rss_kb(F const& fn) {
+    const pid_t pid = fork();
+    if (pid == 0) {
+        fn();
+        _exit(0);
+    }
+    int status = 0;
+    rusage usage{};
+    wait4(pid, &status, 0, &usage);
+    return usage.ru_maxrss;
+}
+
+using EvalFn = void (*)(std::string const&, size_t);
+
+static void run_depth(bench::State& state, const EvalFn fn,
+                      const size_t depth) {
+    const std::string src = nested_source(depth);
+    // Before the timed loop, whose stack and heap pages a child would inherit.
+    // A child doing nothing is the baseline, the rest is what fn added.
+    const long baseline = child_peak_rss_kb([] {});
+    const long peak = child_peak_rss_kb([&] { fn(src, depth); });
+    for (auto _ : state) {
+        fn(src, depth);
+    }
+    state.counters["depth"] = static_cast<double>(depth);
+    state.counters["peak_rss_KB"] = static_cast<double>(peak - baseline);
+}
+
+static void BM_depth_tree_100(bench::State& state) {
+    run_depth(state, eval_tree, 100);
+}
+static void BM_depth_tree_1000(bench::State& state) {
+    run_depth(state, eval_tree, 1000);
+}
+static void BM_depth_flat_100(bench::State& state) {
+    run_depth(state, eval_flat, 100);
+}
+static void BM_depth_flat_1000(bench::State& state) {
+    run_depth(state, eval_flat, 1000);
+}
+static void BM_depth_flat_10000(bench::State& state) {
+    run_depth(state, eval_flat, 10000);
+}
+static void BM_depth_flat_100000(bench::State& state) {
+    run_depth(state, eval_flat, 100000);
+}
+
+BENCHMARK(BM_depth_tree_100);
+BENCHMARK(BM_depth_tree_1000);
+BENCHMARK(BM_depth_flat_100);
+BENCHMARK(BM_depth_flat_1000);
+BENCHMARK(BM_depth_flat_10000);
+BENCHMARK(BM_depth_flat_100000);
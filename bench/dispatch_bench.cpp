@@ -0,0 +1,68 @@
+#include <string>
+
+#include "../src/eval.h"
+#include "../src/lexer.h"
+#include "../src/optimize.h"
+#include "../src/parser.h"
+#include "../src/vm.h"
+#include "bench.h"
+
+// Walks over one Expr tree that mixes every node kind, where the work per
+// node is small enough for dispatching to it to be most of the cost.
+// Reported as ns/node.
+
+constexpr size_t TERMS = 5000;
+
+// -(1 * 2) - (3 / -4) + -(5 * 6) - (7 / -8) + ..., 12 nodes per term
+static const ExprPtr& mixed_tree() {
+    static const ExprPtr expr = [] {
+        std::string src = "0";
+        for (size_t i = 0; i < TERMS; ++i) {
+            const std::string a = std::to_string(i % 9 + 1);
+            src += " + -(" + a + " * 2) - (" + a + " / -4)";
+        }
+        size_t num_errs = 0;
+        return std::move(parse(lift(lex(src, num_errs)).value()).value());
+    }();
+    return expr;
+}
+
+static void set_ns_per_node(bench::State& state) {
+    const double nodes = static_cast<double>(opt::count_nodes(*mixed_tree()));
+    state.counters["nodes"] = nodes;
+    state.counters["ns/node"] =
+        static_cast<double>(state.elapsed.count()) /
+        static_cast<double>(state.iterations()) / nodes;
+}
+
+static void BM_dispatch_count(bench::State& state) {
+    Expr const& expr = *mixed_tree();
+    for (auto _ : state) {
+        auto nodes = opt::count_nodes(expr);
+        bench::do_not_optimize(nodes);
+    }
+    set_ns_per_node(state);
+}
+
+static void BM_dispatch_eval(bench::State& state) {
+    Expr const& expr = *mixed_tree();
+    rt::Heap heap;
+    for (auto _ : state) {
+        auto value = eval::evaluate(expr, heap);
+        bench::do_not_optimize(value);
+    }
+    set_ns_per_node(state);
+}
+
+static void BM_dispatch_compile(bench::State& state) {
+    Expr const& expr = *mixed_tree();
+    for (auto _ : state) {
+        auto chunk = vm::compile(expr);
+        bench::do_not_optimize(chunk);
+    }
+    set_ns_per_node(state);
+}
+
+BENCHMARK(BM_dispatch_count);
+BENCHMARK(BM_dispatch_eval);
+BENCHMARK(BM_dispatch_compile);
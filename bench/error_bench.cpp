@@ -0,0 +1,104 @@
+#include <string>
+#include <vector>
+
+#include "../src/eval.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "bench.h"
+
+// Small expressions that either all succeed or all fail the same way, so
+// the cost of producing and propagating an error can be compared with the
+// happy path. Reported as ns/expr.
+
+constexpr size_t EXPRS = 1000;
+
+// 1 + (2 * -3), or with nil in place of the 3: the error comes from a leaf
+// and goes up through every node above it
+static std::string eval_source(const size_t i, const bool fails) {
+    const std::string n = std::to_string(i % 9 + 1);
+    return n + " + (" + n + " * -" + (fails ? "nil" : n) + ")";
+}
+
+// (1 + (2 * 3)), or missing the last paren
+static std::string parse_source(const size_t i, const bool fails) {
+    return "(" + eval_source(i, false) + (fails ? "" : ")");
+}
+
+static TokenVec lex_source(std::string const& src) {
+    size_t num_errs = 0;
+    return lift(lex(src, num_errs)).value();
+}
+
+static const std::vector<ExprPtr>& exprs(const bool fails) {
+    static const auto build = [](const bool fails) {
+        std::vector<ExprPtr> exprs;
+        for (size_t i = 0; i < EXPRS; ++i) {
+            exprs.push_back(
+                std::move(parse(lex_source(eval_source(i, fails))).value()));
+        }
+        return exprs;
+    };
+    static const std::vector<ExprPtr> ok = build(false);
+    static const std::vector<ExprPtr> failing = build(true);
+    return fails ? failing : ok;
+}
+
+static const std::vector<TokenVec>& token_vecs(const bool fails) {
+    static const auto build = [](const bool fails) {
+        std::vector<TokenVec> tokens;
+        for (size_t i = 0; i < EXPRS; ++i) {
+            tokens.push_back(lex_source(parse_source(i, fails)));
+        }
+        return tokens;
+    };
+    static const std::vector<TokenVec> ok = build(false);
+    static const std::vector<TokenVec> failing = build(true);
+    return fails ? failing : ok;
+}
+
+static void set_ns_per_expr(bench::State& state) {
+    state.counters["ns/expr"] = static_cast<double>(state.elapsed.count()) /
+                                static_cast<double>(state.iterations()) /
+                                static_cast<double>(EXPRS);
+}
+
+static void run_eval(bench::State& state, const bool fails) {
+    const auto& all = exprs(fails);
+    rt::Heap heap;
+    size_t errors = 0;
+    for (auto _ : state) {
+        for (ExprPtr const& expr : all) {
+            auto value = eval::evaluate(*expr, heap);
+            errors += value.has_value() ? 0 : 1;
+            bench::do_not_optimize(value);
+        }
+    }
+    bench::do_not_optimize(errors);
+    state.counters["result bytes"] = sizeof(ValueResult);
+    set_ns_per_expr(state);
+}
+
+static void run_parse(bench::State& state, const bool fails) {
+    const auto& all = token_vecs(fails);
+    for (auto _ : state) {
+        for (TokenVec const& tokens : all) {
+            auto parsed = parse(tokens);
+            bench::do_not_optimize(parsed);
+        }
+    }
+    set_ns_per_expr(state);
+}
+
+static void BM_error_eval_ok(bench::State& state) { run_eval(state, false); }
+static void BM_error_eval_failing(bench::State& state) {
+    run_eval(state, true);
+}
+static void BM_error_parse_ok(bench::State& state) { run_parse(state, false); }
+static void BM_error_parse_failing(bench::State& state) {
+    run_parse(state, true);
+}
+
+BENCHMARK(BM_error_eval_ok);
+BENCHMARK(BM_error_eval_failing);
+BENCHMARK(BM_error_parse_ok);
+BENCHMARK(BM_error_parse_failing);
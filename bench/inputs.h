@@ -0,0 +1,66 @@
+#pragma once
+/**
+ * Synthetic inputs for the benchmarks
+ * Each generator builds one Lox expression stressing a single dimension,
+ * deterministically, so results stay comparable between commits.
+ **/
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace bench::inputs {
+
+// For inputs longer or deeper than grammar::DEFAULT_MAX_DEPTH allows.
+// They're sized so the recursive passes over the tree still fit on the
+// stack.
+constexpr size_t NO_DEPTH_LIMIT = SIZE_MAX;
+
+// 1 + (2 - (3 + (...))), `depth` levels of parens
+inline std::string deep_nesting(const size_t depth) {
+    std::string src;
+    for (size_t i = 0; i < depth; ++i) {
+        src += std::to_string(i % 10) + (i % 2 == 0 ? " + (" : " - (");
+    }
+    src += "0";
+    src.append(depth, ')');
+    return src;
+}
+
+// 0 * 1 + 2 * 3 + ..., `terms` operands in one flat chain
+inline std::string wide_chain(const size_t terms) {
+    std::string src = "0";
+    for (size_t i = 1; i < terms; ++i) {
+        src += (i % 2 == 0 ? " + " : " * ") + std::to_string(i % 7);
+    }
+    return src;
+}
+
+// true == (("lorem_0" + " sit") == "lorem_0 sit") == ..., `terms`
+// comparisons of concatenated string literals
+inline std::string string_heavy(const size_t terms) {
+    std::string src = "true";
+    for (size_t i = 0; i < terms; ++i) {
+        const std::string word = "lorem_ipsum_dolor_" + std::to_string(i);
+        src += " == ((\"" + word + "\" + \" sit amet\") == \"" + word +
+               " sit amet\")";
+    }
+    return src;
+}
+
+// 12.5 * 3.25 - 1000.125 / 7 + ..., `terms` number literals of varying
+// length
+inline std::string number_heavy(const size_t terms) {
+    static const char* const ops[] = {" * ", " - ", " / ", " + "};
+    std::string src = "1.5";
+    for (size_t i = 1; i < terms; ++i) {
+        src += ops[i % 4];
+        src += std::to_string(i * 7919 % 100003);
+        if (i % 3 != 0) {
+            src += "." + std::to_string(i * 31 % 1000 + 1);
+        }
+    }
+    return src;
+}
+
+} // namespace bench::inputs
@@ -0,0 +1,53 @@
+#include <string>
+
+#include "../src/lexer.h"
+#include "bench.h"
+
+// Lexing a source dominated by repeated identifiers and string literals
+
+constexpr size_t NUM_STATEMENTS = 20000;
+
+static std::string repetitive_source() {
+    static const char* const idents[] = {"customer_account_balance",
+                                         "total_number_of_requests", "i",
+                                         "response_status_message"};
+    static const char* const strings[] = {"\"internal server error\"",
+                                          "\"ok\"",
+                                          "\"the quick brown fox jumps\""};
+
+    std::string src;
+    for (size_t i = 0; i < NUM_STATEMENTS; ++i) {
+        src += "var ";
+        src += idents[i % 4];
+        src += " = ";
+        src += strings[i % 3];
+        src += " + ";
+        src += idents[(i + 1) % 4];
+        src += ";\n";
+    }
+    return src;
+}
+
+static void BM_lex_repetitive(bench::State& state) {
+    const std::string src = repetitive_source();
+    for (auto _ : state) {
+        size_t num_errs = 0;
+        auto tokens = lift(lex(src, num_errs));
+        bench::do_not_optimize(tokens);
+    }
+
+    size_t num_errs = 0;
+    const auto tokens = lift(lex(src, num_errs)).value();
+    // Deep-copying the tokens allocates exactly what they hold on to
+    const auto before = bench::alloc_counters();
+    const TokenVec copy = tokens;
+    const auto after = bench::alloc_counters();
+    bench::do_not_optimize(copy);
+
+    state.counters["tokens"] = static_cast<double>(tokens.size());
+    state.counters["sizeof_token"] = sizeof(TokenVariant);
+    state.counters["token_bytes"] =
+        static_cast<double>(after.bytes - before.bytes);
+}
+
+BENCHMARK(BM_lex_repetitive);
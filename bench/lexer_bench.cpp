@@ -0,0 +1,76 @@
+#include <string>
+
+#include "../src/lexer.h"
+#include "bench.h"
+
+// Lexer throughput on sources skewed towards one kind of input each,
+// i.e. one per scanning loop in lex()
+
+constexpr size_t SOURCE_BYTES = 4 * 1024 * 1024;
+
+static std::string repeat_to_size(std::string_view chunk) {
+    std::string src;
+    src.reserve(SOURCE_BYTES + chunk.size());
+    while (src.size() < SOURCE_BYTES) {
+        src += chunk;
+    }
+    return src;
+}
+
+static void run_lex(bench::State& state, std::string const& src) {
+    for (auto _ : state) {
+        size_t num_errs = 0;
+        auto tokens = lex(src, num_errs);
+        bench::do_not_optimize(tokens);
+    }
+    bench::set_throughput(state, src.size());
+}
+
+// Keywords and one/two-char operators, few bytes per token
+static void BM_lex_operators(bench::State& state) {
+    run_lex(state,
+            repeat_to_size("if (a<=b and c!=d or !e) { x = y >= z == true; }\n"
+                           "while (nil) return this.super_field / 2 * -1;\n"));
+}
+
+// Deeply indented code, long blank runs between tokens
+static void BM_lex_whitespace(bench::State& state) {
+    run_lex(state, repeat_to_size("                                    "
+                                  "var total\t\t=    count   +   1 ;\r\n"));
+}
+
+// Mostly comment bodies
+static void BM_lex_comments(bench::State& state) {
+    run_lex(state,
+            repeat_to_size("// Lorem ipsum dolor sit amet, consectetur adipiscing "
+                           "elit, sed do eiusmod tempor incididunt ut labore\n"
+                           "x = 1; // et dolore magna aliqua\n"));
+}
+
+// Mostly string literal contents, some spanning lines
+static void BM_lex_strings(bench::State& state) {
+    run_lex(state,
+            repeat_to_size("print \"The quick brown fox jumps over the lazy dog, "
+                           "again and again and again\";\n"
+                           "msg = \"first line\nsecond line of the message\";\n"));
+}
+
+// Number literals, mostly short enough for the exact fast path
+static void BM_lex_numbers(bench::State& state) {
+    run_lex(state, repeat_to_size("x = 12.5 * 3 + 1000.125 / 7 - 0.5;\n"
+                                  "y = 42 * 6.02 + 99999.75 - 1.0;\n"));
+}
+
+// Number literals too long for the fast path
+static void BM_lex_long_numbers(bench::State& state) {
+    run_lex(state,
+            repeat_to_size("pi = 3.14159265358979323846264338327950288;\n"
+                           "big = 123456789012345678901234567890.5;\n"));
+}
+
+BENCHMARK(BM_lex_operators);
+BENCHMARK(BM_lex_whitespace);
+BENCHMARK(BM_lex_comments);
+BENCHMARK(BM_lex_strings);
+BENCHMARK(BM_lex_numbers);
+BENCHMARK(BM_lex_long_numbers);
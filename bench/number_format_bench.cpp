@@ -0,0 +1,101 @@
+#include <bit>
+#include <cmath>
+#include <format>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/runtime.h"
+#include "bench.h"
+
+// Printing 2M doubles into one output buffer: std::format and a temporary
+// string per number, as print_value and the literal printers used to,
+// vs rt::append_number. Reported as ns/number.
+
+constexpr size_t NUM_NUMBERS = 2000000;
+
+// A third each of whole numbers, short decimals, and any finite double
+static const std::vector<double>& numbers() {
+    static const std::vector<double> all = [] {
+        std::mt19937_64 rng(42);
+        std::vector<double> all;
+        all.reserve(NUM_NUMBERS);
+        while (all.size() < NUM_NUMBERS) {
+            const uint64_t bits = rng();
+            switch (all.size() % 3) {
+            case 0:
+                all.push_back(static_cast<double>(bits % 100000));
+                break;
+            case 1:
+                all.push_back(static_cast<double>(bits % 100000) / 100.0);
+                break;
+            default:
+                if (const double num = std::bit_cast<double>(bits);
+                    std::isfinite(num)) {
+                    all.push_back(num);
+                }
+                break;
+            }
+        }
+        return all;
+    }();
+    return all;
+}
+
+static void set_ns_per_number(bench::State& state, std::string const& out) {
+    bench::do_not_optimize(out);
+    state.counters["bytes/number"] = static_cast<double>(out.size()) /
+                                     static_cast<double>(NUM_NUMBERS);
+    state.counters["ns/number"] = static_cast<double>(state.elapsed.count()) /
+                                  static_cast<double>(state.iterations()) /
+                                  static_cast<double>(NUM_NUMBERS);
+}
+
+static void BM_number_format_std_value(bench::State& state) {
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        for (const double num : numbers()) {
+            out += std::format("{}", num);
+            out += '\n';
+        }
+    }
+    set_ns_per_number(state, out);
+}
+
+static void BM_number_format_std_literal(bench::State& state) {
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        for (const double num : numbers()) {
+            out += num == std::trunc(num) ? std::format("{:.1f}", num)
+                                          : std::format("{}", num);
+            out += '\n';
+        }
+    }
+    set_ns_per_number(state, out);
+}
+
+static void run_append(bench::State& state, const rt::ENumberStyle style) {
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        for (const double num : numbers()) {
+            rt::append_number(out, num, style);
+            out += '\n';
+        }
+    }
+    set_ns_per_number(state, out);
+}
+
+static void BM_number_format_value(bench::State& state) {
+    run_append(state, rt::ENumberStyle::Value);
+}
+static void BM_number_format_literal(bench::State& state) {
+    run_append(state, rt::ENumberStyle::Literal);
+}
+
+BENCHMARK(BM_number_format_std_value);
+BENCHMARK(BM_number_format_std_literal);
+BENCHMARK(BM_number_format_value);
+BENCHMARK(BM_number_format_literal);
@@ -0,0 +1,58 @@
+#include <string>
+
+#include "../src/eval.h"
+#include "../src/lexer.h"
+#include "../src/optimize.h"
+#include "../src/parser.h"
+#include "bench.h"
+
+// Evaluating a constant expression as parsed vs after constant folding
+
+constexpr size_t CHAIN_LENGTH = 10000;
+
+// (0 * 1 + 2 * 3 + ...) == "total"
+static std::string constant_source() {
+    std::string src = "(0";
+    for (size_t i = 1; i < CHAIN_LENGTH; ++i) {
+        src += (i % 2 == 0 ? " + " : " * ") + std::to_string(i % 7);
+    }
+    return src + ") == \"total\"";
+}
+
+static ExprPtr parse_source(std::string const& src) {
+    size_t num_errs = 0;
+    return std::move(parse(lift(lex(src, num_errs)).value()).value());
+}
+
+static void run_eval(bench::State& state, Expr const& expr,
+                     const size_t nodes) {
+    rt::Heap heap;
+    const eval::Visitor_Eval visitor(heap);
+    for (auto _ : state) {
+        auto value = visit_expr(expr, visitor);
+        bench::do_not_optimize(value);
+    }
+    state.counters["nodes"] = static_cast<double>(nodes);
+}
+
+static void BM_fold_constants(bench::State& state) {
+    const ExprPtr expr = parse_source(constant_source());
+    for (auto _ : state) {
+        auto folded = opt::fold_constants(*expr);
+        bench::do_not_optimize(folded);
+    }
+}
+
+static void BM_fold_eval_unfolded(bench::State& state) {
+    const ExprPtr expr = parse_source(constant_source());
+    run_eval(state, *expr, opt::count_nodes(*expr));
+}
+
+static void BM_fold_eval_folded(bench::State& state) {
+    const ExprPtr expr = opt::fold_constants(*parse_source(constant_source()));
+    run_eval(state, *expr, opt::count_nodes(*expr));
+}
+
+BENCHMARK(BM_fold_constants);
+BENCHMARK(BM_fold_eval_unfolded);
+BENCHMARK(BM_fold_eval_folded);
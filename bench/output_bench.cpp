@@ -0,0 +1,109 @@
+#include <cstdio>
+#include <fcntl.h>
+#include <print>
+#include <string>
+#include <unistd.h>
+
+#include "../src/lexer.h"
+#include "../src/sink.h"
+#include "bench.h"
+
+// Printing a 1M-token tokenize listing: a println and a string per token
+// into stdio, vs formatting into a Sink. stdio is line buffered on a
+// terminal and fully buffered on a pipe or file, the Sink always writes
+// 64KiB blocks. Output goes to /dev/null, "writes" counts write calls.
+
+constexpr size_t NUM_TOKENS = 1000000;
+
+static const TokenVec& tokens() {
+    static const std::string src = [] {
+        std::string src;
+        // 10 tokens a line
+        for (size_t i = 0; src.size() < NUM_TOKENS * 4; ++i) {
+            src += "var x_" + std::to_string(i % 100) +
+                   " = (12.5 + y) * \"s\";\n";
+        }
+        return src;
+    }();
+    static const TokenVec tokens = [] {
+        size_t num_errs = 0;
+        TokenVec all = lift(lex(src, num_errs)).value();
+        all.resize(NUM_TOKENS - 1);
+        all.emplace_back(EndOfFile());
+        return all;
+    }();
+    return tokens;
+}
+
+struct DevNull {
+    int fd = ::open("/dev/null", O_WRONLY);
+    size_t writes = 0;
+
+    ~DevNull() { ::close(fd); }
+};
+
+// A stdio stream whose writes get counted on their way to /dev/null
+static std::FILE* counting_file(DevNull& dev_null, const int mode) {
+    cookie_io_functions_t io{};
+    io.write = [](void* cookie, const char* data, size_t size) -> ssize_t {
+        auto* target = static_cast<DevNull*>(cookie);
+        target->writes += 1;
+        return ::write(target->fd, data, size);
+    };
+    std::FILE* file = ::fopencookie(&dev_null, "w", io);
+    std::setvbuf(file, nullptr, mode, BUFSIZ);
+    return file;
+}
+
+static void report(bench::State& state, const size_t writes) {
+    state.counters["writes"] = static_cast<double>(writes);
+    state.counters["ns/token"] = static_cast<double>(state.elapsed.count()) /
+                                 static_cast<double>(state.iterations()) /
+                                 static_cast<double>(NUM_TOKENS);
+}
+
+static void run_println(bench::State& state, const int mode) {
+    const TokenVec& all = tokens();
+    DevNull dev_null;
+    size_t writes = 0;
+    for (auto _ : state) {
+        std::FILE* file = counting_file(dev_null, mode);
+        dev_null.writes = 0;
+        for (TokenVariant const& tok : all) {
+            std::visit(
+                [file](const auto& token) {
+                    std::println(file, "{}", impl::stringify_token(token));
+                },
+                tok);
+        }
+        std::fclose(file);
+        writes = dev_null.writes;
+    }
+    report(state, writes);
+}
+
+static void BM_output_println_terminal(bench::State& state) {
+    run_println(state, _IOLBF);
+}
+static void BM_output_println_pipe(bench::State& state) {
+    run_println(state, _IOFBF);
+}
+
+static void BM_output_sink(bench::State& state) {
+    const TokenVec& all = tokens();
+    DevNull dev_null;
+    size_t writes = 0;
+    for (auto _ : state) {
+        sink::Sink out(dev_null.fd);
+        for (TokenVariant const& tok : all) {
+            print_token_variant(tok, out);
+        }
+        out.flush();
+        writes = out.num_writes();
+    }
+    report(state, writes);
+}
+
+BENCHMARK(BM_output_println_terminal);
+BENCHMARK(BM_output_println_pipe);
+BENCHMARK(BM_output_sink);
@@ -0,0 +1,58 @@
+#include <string>
+
+#include "../src/lexer.h"
+#include "../src/parallel_lexer.h"
+#include "bench.h"
+
+// Sequential lex() vs lex_parallel() on 1..8 threads, on a ~10 MB program
+
+constexpr size_t NUM_LINES = 250000;
+
+static const std::string& large_source() {
+    static const std::string src = [] {
+        static const char* const lines[] = {
+            "var total_count = (total_count + 12.5) * factor_b;\n",
+            "print \"status: \" + response_message; // trailing \"comment\"\n",
+            "if (value_a >= 100 and !done) { counter = counter - 1; }\n",
+            "var text = \"a string\nspanning two lines\";\n",
+        };
+        std::string out;
+        for (size_t i = 0; i < NUM_LINES; ++i) {
+            out += lines[i % 4];
+        }
+        return out;
+    }();
+    return src;
+}
+
+static void BM_lex_sequential(bench::State& state) {
+    const std::string& src = large_source();
+    for (auto _ : state) {
+        size_t num_errs = 0;
+        auto tokens = lex(src, num_errs);
+        bench::do_not_optimize(tokens);
+    }
+    bench::set_throughput(state, src.size());
+}
+
+static void run_parallel(bench::State& state, const size_t num_threads) {
+    const std::string& src = large_source();
+    for (auto _ : state) {
+        size_t num_errs = 0;
+        auto tokens = lex_parallel(src, num_errs, num_threads);
+        bench::do_not_optimize(tokens);
+    }
+    bench::set_throughput(state, src.size());
+    state.counters["threads"] = static_cast<double>(num_threads);
+}
+
+static void BM_lex_parallel_1(bench::State& state) { run_parallel(state, 1); }
+static void BM_lex_parallel_2(bench::State& state) { run_parallel(state, 2); }
+static void BM_lex_parallel_4(bench::State& state) { run_parallel(state, 4); }
+static void BM_lex_parallel_8(bench::State& state) { run_parallel(state, 8); }
+
+BENCHMARK(BM_lex_sequential);
+BENCHMARK(BM_lex_parallel_1);
+BENCHMARK(BM_lex_parallel_2);
+BENCHMARK(BM_lex_parallel_4);
+BENCHMARK(BM_lex_parallel_8);
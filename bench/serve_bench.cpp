@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "../src/server.h"
+#include "bench.h"
+
+// Load generator for the serve command: an in-process SocketServer on a
+// temporary socket, sent one request at a time. Reports p50/p99 latency in
+// microseconds next to the usual time per request.
+
+namespace {
+const std::string PROGRAM = "(12.5 * 4 - 8) / 2 + 1 == 22 and \"ab\" + \"c\"";
+
+class RunningServer {
+  public:
+    RunningServer()
+        : path((std::filesystem::temp_directory_path() / "interp_bench.sock")
+                   .string()),
+          socket_server({}, 1) {
+        (void)socket_server.listen(path);
+        runner = std::thread([this] { socket_server.run(); });
+    }
+    ~RunningServer() {
+        socket_server.stop();
+        runner.join();
+    }
+
+    [[nodiscard]]
+    int connect() const {
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        path.copy(addr.sun_path, path.size());
+        (void)::connect(fd, reinterpret_cast<sockaddr const*>(&addr),
+                        sizeof(addr));
+        return fd;
+    }
+
+  private:
+    std::string path;
+    server::SocketServer socket_server;
+    std::thread runner;
+};
+
+// Send one request and read its whole response
+void round_trip(const int fd, std::string const& request,
+                std::string& response) {
+    (void)::write(fd, request.data(), request.size());
+    response.clear();
+    char buffer[4096];
+    size_t expected = std::string::npos;
+    while (response.size() != expected) {
+        const ssize_t got = ::read(fd, buffer, sizeof(buffer));
+        if (got <= 0) {
+            return;
+        }
+        response.append(buffer, got);
+        const size_t header_end = response.find('\n');
+        if (expected == std::string::npos && header_end != std::string::npos) {
+            size_t code = 0, out = 0, err = 0;
+            std::sscanf(response.c_str(), "%zu %zu %zu", &code, &out, &err);
+            expected = header_end + 1 + out + err;
+        }
+    }
+}
+
+void set_latencies(bench::State& state, std::vector<double>& latencies_us) {
+    std::ranges::sort(latencies_us);
+    const auto at = [&](const double q) {
+        return latencies_us[static_cast<size_t>(q * (latencies_us.size() - 1))];
+    };
+    state.counters["p50_us"] = at(0.50);
+    state.counters["p99_us"] = at(0.99);
+}
+
+// Times each request, including getting its connection from `connect`
+template <typename Connect, typename Release>
+void run_requests(bench::State& state, Connect connect, Release release) {
+    const std::string request =
+        std::to_string(PROGRAM.size()) + "\n" + PROGRAM;
+    std::string response;
+    std::vector<double> latencies_us;
+    latencies_us.reserve(state.iterations());
+    for (auto _ : state) {
+        const auto start = std::chrono::steady_clock::now();
+        const int fd = connect();
+        round_trip(fd, request, response);
+        release(fd);
+        latencies_us.push_back(
+            std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - start)
+                .count());
+    }
+    bench::do_not_optimize(response);
+    set_latencies(state, latencies_us);
+}
+} // namespace
+
+// One connection, so one warm session, for every request
+static void BM_serve_warm(bench::State& state) {
+    const RunningServer running;
+    const int fd = running.connect();
+    run_requests(state, [fd] { return fd; }, [](int) {});
+    ::close(fd);
+}
+
+// A new connection, and so a fresh session, for every request
+static void BM_serve_cold(bench::State& state) {
+    const RunningServer running;
+    run_requests(state, [&running] { return running.connect(); },
+                 [](const int fd) { ::close(fd); });
+}
+
+BENCHMARK(BM_serve_warm);
+BENCHMARK(BM_serve_cold);
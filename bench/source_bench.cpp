@@ -0,0 +1,120 @@
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "../src/lexer.h"
+#include "../src/source.h"
+#include "bench.h"
+
+// Tokenizing a large generated file.
+// Size in MB can be overridden with LOX_BENCH_MB.
+
+static size_t bench_file_bytes() {
+    const char* env = std::getenv("LOX_BENCH_MB");
+    const size_t mb = env != nullptr ? std::strtoul(env, nullptr, 10) : 32;
+    return mb * 1024 * 1024;
+}
+
+static std::string large_source() {
+    static const char* const lines[] = {
+        "var total_count = (total_count + 12.5) * factor_b;\n",
+        "print \"status: \" + response_message; // trailing comment\n",
+        "if (value_a >= 100 and !done) { counter = counter - 1; }\n",
+        "while (i < 1000) { i = i + 1; }\n",
+    };
+
+    const size_t target = bench_file_bytes();
+    std::string src;
+    src.reserve(target + 128);
+    for (size_t i = 0; src.size() < target; ++i) {
+        src += lines[i % 4];
+    }
+    return src;
+}
+
+// Write the generated source out once, for the file loading benchmarks
+static std::string large_source_file() {
+    const auto path =
+        std::filesystem::temp_directory_path() / "interp_bench_large.lox";
+    const std::string src = large_source();
+    if (!std::filesystem::exists(path) ||
+        std::filesystem::file_size(path) != src.size()) {
+        std::ofstream(path, std::ios::binary) << src;
+    }
+    return path.string();
+}
+
+// mmap + lex, what `tokenize` does
+static void BM_source_mmap_lex_large(bench::State& state) {
+    const std::string path = large_source_file();
+    size_t bytes = 0;
+    for (auto _ : state) {
+        const auto source = SourceBuffer::open(path).value();
+        size_t num_errs = 0;
+        auto tokens = lex(source.view(), num_errs);
+        bytes = source.view().size();
+        bench::do_not_optimize(tokens);
+    }
+    bench::set_throughput(state, bytes);
+}
+
+// Loading only: mmap vs the old stringstream copy
+static void BM_source_load_mmap(bench::State& state) {
+    const std::string path = large_source_file();
+    size_t bytes = 0;
+    for (auto _ : state) {
+        const auto source = SourceBuffer::open(path).value();
+        // Touch every page, so the mapping is actually read
+        size_t checksum = 0;
+        const std::string_view view = source.view();
+        for (size_t i = 0; i < view.size(); i += 4096) {
+            checksum += view[i];
+        }
+        bytes = view.size();
+        bench::do_not_optimize(checksum);
+    }
+    bench::set_throughput(state, bytes);
+}
+static void BM_source_load_stringstream(bench::State& state) {
+    const std::string path = large_source_file();
+    size_t bytes = 0;
+    for (auto _ : state) {
+        std::ifstream file(path);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        const std::string contents = buffer.str();
+        bytes = contents.size();
+        bench::do_not_optimize(contents);
+    }
+    bench::set_throughput(state, bytes);
+}
+
+static void BM_source_lex_large(bench::State& state) {
+    const std::string src = large_source();
+    for (auto _ : state) {
+        size_t num_errs = 0;
+        auto tokens = lex(src, num_errs);
+        bench::do_not_optimize(tokens);
+    }
+    bench::set_throughput(state, src.size());
+}
+
+// Upper bound: just reading every byte once
+static void BM_source_memcpy_large(bench::State& state) {
+    const std::string src = large_source();
+    std::string dest(src.size(), '\0');
+    for (auto _ : state) {
+        std::memcpy(dest.data(), src.data(), src.size());
+        bench::do_not_optimize(dest);
+    }
+    bench::set_throughput(state, src.size());
+}
+
+BENCHMARK(BM_source_lex_large);
+BENCHMARK(BM_source_mmap_lex_large);
+BENCHMARK(BM_source_load_mmap);
+BENCHMARK(BM_source_load_stringstream);
+BENCHMARK(BM_source_memcpy_large);
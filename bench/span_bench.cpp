@@ -0,0 +1,95 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../src/ast.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/source.h"
+#include "../src/token_buffer.h"
+#include "bench.h"
+#include "inputs.h"
+
+// What source spans cost: bytes per token and per node for carrying them,
+// and turning offsets back into lines once an error gets reported
+
+constexpr size_t NUM_LINES = 1000000;
+constexpr size_t NUM_LOOKUPS = 10000;
+
+// One operand per line, so every node is on a line of its own
+static const std::string& multiline_source() {
+    static const std::string src = [] {
+        std::string src = "1.5";
+        for (size_t i = 1; i < NUM_LINES; ++i) {
+            src += i % 2 == 0 ? "\n+ " : "\n* -";
+            src += std::to_string(i % 97);
+        }
+        return src;
+    }();
+    return src;
+}
+
+static void BM_span_token_bytes(bench::State& state) {
+    std::string const& src = multiline_source();
+    size_t token_bytes = 0;
+    size_t num_tokens = 0;
+    for (auto _ : state) {
+        const TokenBuffer tokens(src);
+        token_bytes = tokens.memory_bytes();
+        num_tokens = tokens.size();
+        bench::do_not_optimize(tokens);
+    }
+    state.counters["bytes/token"] =
+        static_cast<double>(token_bytes) / static_cast<double>(num_tokens);
+}
+
+static void BM_span_node_bytes(bench::State& state) {
+    size_t num_errs = 0;
+    const TokenVec tokens = lift(lex(multiline_source(), num_errs)).value();
+    ast::Ast ast;
+    for (auto _ : state) {
+        auto parsed = ast::parse(tokens, bench::inputs::NO_DEPTH_LIMIT);
+        bench::do_not_optimize(parsed);
+        ast = std::move(parsed.value());
+    }
+    // The offsets column is the only per-node cost of the flat AST
+    state.counters["flat bytes/node"] = static_cast<double>(
+        sizeof(ast::Node) + sizeof(decltype(ast.offsets)::value_type));
+    state.counters["Expr bytes"] = sizeof(Expr);
+    state.counters["nodes"] = static_cast<double>(ast.size());
+}
+
+// Paid once per source, and only if it reports something
+static void BM_span_line_index(bench::State& state) {
+    std::string const& src = multiline_source();
+    for (auto _ : state) {
+        LineIndex lines(src);
+        bench::do_not_optimize(lines.line_starts());
+    }
+    state.counters["ns/line"] = static_cast<double>(state.elapsed.count()) /
+                                static_cast<double>(state.iterations()) /
+                                static_cast<double>(NUM_LINES);
+}
+
+static void BM_span_locate(bench::State& state) {
+    std::string const& src = multiline_source();
+    LineIndex lines(src);
+    std::vector<uint32_t> offsets;
+    for (size_t i = 0; i < NUM_LOOKUPS; ++i) {
+        offsets.push_back(static_cast<uint32_t>(i * 7919 % src.size()));
+    }
+    bench::do_not_optimize(lines.line_starts());
+    for (auto _ : state) {
+        for (const uint32_t offset : offsets) {
+            bench::do_not_optimize(lines.locate(offset));
+        }
+    }
+    state.counters["ns/locate"] = static_cast<double>(state.elapsed.count()) /
+                                  static_cast<double>(state.iterations()) /
+                                  static_cast<double>(NUM_LOOKUPS);
+}
+
+BENCHMARK(BM_span_token_bytes);
+BENCHMARK(BM_span_node_bytes);
+BENCHMARK(BM_span_line_index);
+BENCHMARK(BM_span_locate);
@@ -0,0 +1,80 @@
+#include <string>
+
+#include "../src/eval.h"
+#include "../src/lexer.h"
+#include "../src/optimize.h"
+#include "../src/parser.h"
+#include "bench.h"
+#include "inputs.h"
+
+// lex(), parse() and eval::evaluate() on their own, per synthetic input.
+// Reported as tokens/s, nodes/s and evals/s, so stages and inputs of
+// different sizes compare directly.
+
+constexpr size_t NESTING_DEPTH = 900;
+constexpr size_t CHAIN_TERMS = 20000;
+constexpr size_t STRING_TERMS = 2000;
+constexpr size_t NUMBER_TERMS = 20000;
+
+static TokenVec lex_source(std::string const& src) {
+    size_t num_errs = 0;
+    return lift(lex(src, num_errs)).value();
+}
+
+static void run_lex(bench::State& state, std::string const& src) {
+    size_t num_tokens = 0;
+    for (auto _ : state) {
+        size_t num_errs = 0;
+        auto tokens = lex(src, num_errs);
+        num_tokens = tokens.size();
+        bench::do_not_optimize(tokens);
+    }
+    bench::set_rate(state, "tokens/s", num_tokens);
+    bench::set_throughput(state, src.size());
+}
+
+static void run_parse(bench::State& state, std::string const& src) {
+    const TokenVec tokens = lex_source(src);
+    for (auto _ : state) {
+        auto expr = parse(tokens);
+        bench::do_not_optimize(expr);
+    }
+    bench::set_rate(state, "nodes/s",
+                    opt::count_nodes(*parse(tokens).value()));
+}
+
+static void run_eval(bench::State& state, std::string const& src) {
+    const ExprPtr expr = std::move(parse(lex_source(src)).value());
+    const size_t nodes = opt::count_nodes(*expr);
+    rt::Heap heap;
+    const eval::Visitor_Eval visitor(heap);
+    for (auto _ : state) {
+        auto value = visit_expr(*expr, visitor);
+        bench::do_not_optimize(value);
+        // Strings made by the last run, so memory stays flat
+        heap.clear();
+    }
+    bench::set_rate(state, "evals/s", 1);
+    bench::set_rate(state, "nodes/s", nodes);
+}
+
+#define STAGE_BENCHMARKS(input, make_src)                                      \
+    static void BM_stage_lex_##input(bench::State& state) {                    \
+        run_lex(state, make_src);                                              \
+    }                                                                          \
+    static void BM_stage_parse_##input(bench::State& state) {                  \
+        run_parse(state, make_src);                                            \
+    }                                                                          \
+    static void BM_stage_eval_##input(bench::State& state) {                   \
+        run_eval(state, make_src);                                             \
+    }                                                                          \
+    BENCHMARK(BM_stage_lex_##input);                                           \
+    BENCHMARK(BM_stage_parse_##input);                                         \
+    BENCHMARK(BM_stage_eval_##input)
+
+STAGE_BENCHMARKS(deep, bench::inputs::deep_nesting(NESTING_DEPTH));
+STAGE_BENCHMARKS(chain, bench::inputs::wide_chain(CHAIN_TERMS));
+STAGE_BENCHMARKS(strings, bench::inputs::string_heavy(STRING_TERMS));
+STAGE_BENCHMARKS(numbers, bench::inputs::number_heavy(NUMBER_TERMS));
+
+#undef STAGE_BENCHMARKS
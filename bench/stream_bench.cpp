@@ -0,0 +1,56 @@
+#include <string>
+
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "bench.h"
+#include "inputs.h"
+
+// Lexing everything up front vs pulling tokens as the parser needs them,
+// on one long expression
+
+constexpr size_t NUM_TERMS = 200000;
+
+// 0 * 1 + 2 * 3 + ...
+static std::string long_expression() {
+    std::string src = "0";
+    for (size_t i = 1; i < NUM_TERMS; ++i) {
+        src += (i % 2 == 0 ? " + " : " * ") + std::to_string(i % 7);
+    }
+    return src;
+}
+
+static void report_bytes(bench::State& state, const size_t token_bytes) {
+    state.counters["token_KB"] = static_cast<double>(token_bytes) / 1024.0;
+    state.counters["alloc_MB/iter"] =
+        static_cast<double>(state.allocs.bytes) /
+        static_cast<double>(state.iterations()) / (1024.0 * 1024.0);
+}
+
+// What parse/evaluate used to do: lex(), lift(), then parse
+static void BM_parse_materialized(bench::State& state) {
+    const std::string src = long_expression();
+    size_t token_bytes = 0;
+    for (auto _ : state) {
+        size_t num_errs = 0;
+        const auto faulty_tokens = lex(src, num_errs);
+        const auto tokens = lift(faulty_tokens).value();
+        auto expr = parse(tokens, bench::inputs::NO_DEPTH_LIMIT);
+        token_bytes = faulty_tokens.capacity() * sizeof(faulty_tokens[0]) +
+                      tokens.capacity() * sizeof(tokens[0]);
+        bench::do_not_optimize(expr);
+    }
+    report_bytes(state, token_bytes);
+}
+
+static void BM_parse_streaming(bench::State& state) {
+    const std::string src = long_expression();
+    for (auto _ : state) {
+        TokenStream tokens(src);
+        auto expr = parse(tokens, bench::inputs::NO_DEPTH_LIMIT);
+        bench::do_not_optimize(expr);
+    }
+    report_bytes(state, TokenStream::LOOKAHEAD * sizeof(TokenVariant));
+}
+
+BENCHMARK(BM_parse_materialized);
+BENCHMARK(BM_parse_streaming);
@@ -0,0 +1,95 @@
+#include <string>
+
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/token_buffer.h"
+#include "bench.h"
+#include "inputs.h"
+
+// TokenVec of 40-byte variants vs the packed TokenBuffer columns,
+// in token bytes per source byte, and parsing from each
+
+constexpr size_t NUM_LINES = 50000;
+
+static std::string program_source() {
+    static const char* const lines[] = {
+        "var total_count = (total_count + 12.5) * factor_b;\n",
+        "print \"status: \" + response_message; // trailing comment\n",
+        "if (value_a >= 100 and !done) { counter = counter - 1; }\n",
+        "while (i < 1000) { i = i + 1; }\n",
+    };
+    std::string src;
+    for (size_t i = 0; i < NUM_LINES; ++i) {
+        src += lines[i % 4];
+    }
+    return src;
+}
+
+// One long expression, the parser doesn't know statements or variables yet
+static std::string expression_source() {
+    std::string src = "(1.5 + 2)";
+    for (size_t i = 0; i < NUM_LINES; ++i) {
+        src += i % 2 == 0 ? " * (\"abc\" == nil)" : " - -" + std::to_string(i);
+    }
+    return src;
+}
+
+static void report_density(bench::State& state, const size_t token_bytes,
+                           const size_t num_tokens, const size_t src_bytes) {
+    state.counters["tokens"] = static_cast<double>(num_tokens);
+    state.counters["bytes/token"] =
+        static_cast<double>(token_bytes) / static_cast<double>(num_tokens);
+    state.counters["token_bytes/src_byte"] =
+        static_cast<double>(token_bytes) / static_cast<double>(src_bytes);
+}
+
+static void BM_tokens_vec(bench::State& state) {
+    const std::string src = program_source();
+    size_t token_bytes = 0;
+    size_t num_tokens = 0;
+    for (auto _ : state) {
+        size_t num_errs = 0;
+        const auto tokens = lift(lex(src, num_errs)).value();
+        token_bytes = tokens.size() * sizeof(TokenVariant);
+        num_tokens = tokens.size();
+        bench::do_not_optimize(tokens);
+    }
+    report_density(state, token_bytes, num_tokens, src.size());
+}
+
+static void BM_tokens_buffer(bench::State& state) {
+    const std::string src = program_source();
+    size_t token_bytes = 0;
+    size_t num_tokens = 0;
+    for (auto _ : state) {
+        const TokenBuffer tokens(src);
+        token_bytes = tokens.memory_bytes();
+        num_tokens = tokens.size();
+        bench::do_not_optimize(tokens);
+    }
+    report_density(state, token_bytes, num_tokens, src.size());
+}
+
+static void BM_tokens_parse_vec(bench::State& state) {
+    const std::string src = expression_source();
+    size_t num_errs = 0;
+    const auto tokens = lift(lex(src, num_errs)).value();
+    for (auto _ : state) {
+        auto expr = parse(tokens, bench::inputs::NO_DEPTH_LIMIT);
+        bench::do_not_optimize(expr);
+    }
+}
+
+static void BM_tokens_parse_buffer(bench::State& state) {
+    const std::string src = expression_source();
+    const TokenBuffer tokens(src);
+    for (auto _ : state) {
+        auto expr = parse(tokens, bench::inputs::NO_DEPTH_LIMIT);
+        bench::do_not_optimize(expr);
+    }
+}
+
+BENCHMARK(BM_tokens_vec);
+BENCHMARK(BM_tokens_buffer);
+BENCHMARK(BM_tokens_parse_vec);
+BENCHMARK(BM_tokens_parse_buffer);
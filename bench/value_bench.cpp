@@ -0,0 +1,74 @@
+#include <string>
+
+#include "../src/ast.h"
+#include "../src/eval.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/runtime.h"
+#include "../src/vm.h"
+#include "bench.h"
+
+// Arithmetic-heavy evaluation, where the cost of a runtime Value dominates
+
+constexpr size_t NUM_TERMS = 10000;
+
+// (1 + 2) * 3 - (4 / 5) + ... with comparisons mixed in
+static std::string arith_source() {
+    std::string src = "1";
+    for (size_t i = 1; i < NUM_TERMS; ++i) {
+        const std::string num = std::to_string(i % 9 + 1);
+        switch (i % 4) {
+        case 0:
+            src += " + (" + num + " * " + num + ")";
+            break;
+        case 1:
+            src += " - " + num;
+            break;
+        case 2:
+            src += " * (" + num + " / 4)";
+            break;
+        case 3:
+            src += " + -" + num;
+            break;
+        }
+    }
+    return "(" + src + ") > 0 == true";
+}
+
+static TokenVec arith_tokens() {
+    size_t num_errs = 0;
+    return lift(lex(arith_source(), num_errs)).value();
+}
+
+static void BM_value_arith_tree(bench::State& state) {
+    const ExprPtr expr = std::move(parse(arith_tokens()).value());
+    rt::Heap heap;
+    const eval::Visitor_Eval visitor(heap);
+    for (auto _ : state) {
+        auto value = visit_expr(*expr, visitor);
+        bench::do_not_optimize(value);
+    }
+    state.counters["sizeof_value"] = sizeof(rt::Value);
+}
+static void BM_value_arith_flat(bench::State& state) {
+    const ast::Ast flat = std::move(ast::parse(arith_tokens()).value());
+    rt::Heap heap;
+    for (auto _ : state) {
+        auto value = eval::evaluate(flat, heap);
+        bench::do_not_optimize(value);
+    }
+}
+static void BM_value_arith_vm(bench::State& state) {
+    const ExprPtr expr = std::move(parse(arith_tokens()).value());
+    rt::Heap heap;
+    const vm::Chunk chunk = vm::compile(*expr);
+    vm::VM machine(heap);
+    for (auto _ : state) {
+        auto value = machine.run(chunk);
+        bench::do_not_optimize(value);
+    }
+}
+
+BENCHMARK(BM_value_arith_tree);
+BENCHMARK(BM_value_arith_flat);
+BENCHMARK(BM_value_arith_vm);
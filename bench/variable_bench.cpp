@@ -0,0 +1,211 @@
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "../src/eval.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/resolver.h"
+#include "../src/runtime.h"
+#include "../src/vm.h"
+#include "bench.h"
+
+using rt::Value;
+
+// A long program of blocks reading and assigning globals and locals, run by
+// a tree-walker that looks names up in one map per scope, as jlox does,
+// vs the resolved slots on the tree and the VM. Reported as ns/access.
+
+constexpr size_t NUM_GLOBALS = 16;
+constexpr size_t NUM_BLOCKS = 5000;
+// Reads, assignments and definitions in each block of variable_source()
+constexpr size_t ACCESSES_PER_BLOCK = 13;
+
+static std::string variable_source() {
+    std::string src;
+    for (size_t i = 0; i < NUM_GLOBALS; ++i) {
+        src += "var g" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+    }
+    for (size_t i = 0; i < NUM_BLOCKS; ++i) {
+        const std::string read = "g" + std::to_string(i % NUM_GLOBALS);
+        const std::string write = "g" + std::to_string((i * 7) % NUM_GLOBALS);
+        src += "{ var x = " + read + " + 1; var y = x * 2;\n"
+               "  { var z = x + y; y = z - x; }\n  " +
+               write + " = x - y; }\n";
+    }
+    return src + "print g0;\n";
+}
+
+static Program parse_source(std::string const& src) {
+    TokenStream tokens(src);
+    Program program = std::move(parse_program(tokens).value());
+    if (!resolve::resolve(program).has_value()) {
+        std::abort();
+    }
+    return program;
+}
+
+namespace {
+// One scope's variables by name, with the scope around it
+struct Environment {
+    std::unordered_map<std::string_view, Value> values;
+    Environment* enclosing = nullptr;
+
+    Value* find(const std::string_view name) {
+        for (Environment* env = this; env != nullptr; env = env->enclosing) {
+            if (const auto it = env->values.find(name);
+                it != env->values.end()) {
+                return &it->second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Tree-walker ignoring the resolved slots. The bench program never fails,
+// so errors abort.
+class NamedWalker {
+  public:
+    NamedWalker(rt::Heap& heap, std::string& out) : heap(heap), out(out) {}
+
+    void stmt(Stmt const& stmt, Environment& env) {
+        switch (stmt.kind) {
+        case EStmtKind::Expression:
+            (void)expr(*static_cast<Stmt_Expression const&>(stmt).expr, env);
+            return;
+        case EStmtKind::Print:
+            rt::append_value(
+                out, expr(*static_cast<Stmt_Print const&>(stmt).expr, env));
+            out += '\n';
+            return;
+        case EStmtKind::Var: {
+            auto const& var = static_cast<Stmt_Var const&>(stmt);
+            const Value val =
+                var.init != nullptr ? expr(*var.init, env) : Value();
+            env.values.insert_or_assign(var.name.view(), val);
+            return;
+        }
+        case EStmtKind::Block: {
+            Environment inner{{}, &env};
+            for (StmtPtr const& nested :
+                 static_cast<Stmt_Block const&>(stmt).stmts) {
+                this->stmt(*nested, inner);
+            }
+            return;
+        }
+        }
+    }
+
+    Value expr(Expr const& expr, Environment& env) {
+        Value val;
+        switch (expr.kind) {
+        case EExprKind::Literal:
+            return eval::literal_value(
+                static_cast<Expr_Literal const&>(expr).inner);
+        case EExprKind::Grouping:
+            return this->expr(*static_cast<Expr_Grouping const&>(expr).inner,
+                              env);
+        case EExprKind::Unary: {
+            auto const& unary = static_cast<Expr_Unary const&>(expr);
+            check(eval::apply_unary(unary.op, this->expr(*unary.inner, env),
+                                    val));
+            return val;
+        }
+        case EExprKind::Binary: {
+            auto const& binary = static_cast<Expr_Binary const&>(expr);
+            const Value left = this->expr(*binary.left, env);
+            const Value right = this->expr(*binary.right, env);
+            check(eval::apply_binary(binary.op, left, right, val, heap));
+            return val;
+        }
+        case EExprKind::Variable:
+            return *defined(
+                env.find(static_cast<Expr_Variable const&>(expr).name.view()));
+        case EExprKind::Assign: {
+            auto const& assign = static_cast<Expr_Assign const&>(expr);
+            val = this->expr(*assign.value, env);
+            *defined(env.find(assign.name.view())) = val;
+            return val;
+        }
+        }
+        std::abort();
+    }
+
+  private:
+    rt::Heap& heap;
+    std::string& out;
+
+    static void check(const rt::ERuntimeError err) {
+        if (err != rt::ERuntimeError::None) {
+            std::abort();
+        }
+    }
+    static Value* defined(Value* val) {
+        if (val == nullptr) {
+            std::abort();
+        }
+        return val;
+    }
+};
+} // namespace
+
+static void finish(bench::State& state, std::string const& out) {
+    bench::do_not_optimize(out);
+    state.counters["ns/access"] =
+        static_cast<double>(state.elapsed.count()) /
+        static_cast<double>(state.iterations()) /
+        static_cast<double>(NUM_BLOCKS * ACCESSES_PER_BLOCK);
+}
+
+static void BM_variables_named_env(bench::State& state) {
+    const std::string src = variable_source();
+    const Program program = parse_source(src);
+    rt::Heap heap;
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        Environment globals;
+        NamedWalker walker(heap, out);
+        for (StmtPtr const& stmt : program.stmts) {
+            walker.stmt(*stmt, globals);
+        }
+        heap.clear();
+    }
+    finish(state, out);
+}
+
+static void BM_variables_tree_slots(bench::State& state) {
+    const std::string src = variable_source();
+    const Program program = parse_source(src);
+    rt::Heap heap;
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        if (!eval::execute(program, heap, out).has_value()) {
+            std::abort();
+        }
+        heap.clear();
+    }
+    finish(state, out);
+}
+
+static void BM_variables_vm_slots(bench::State& state) {
+    const std::string src = variable_source();
+    const vm::Chunk chunk = vm::compile(parse_source(src));
+    rt::Heap heap;
+    vm::VM machine(heap);
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        if (!machine.run(chunk, out).has_value()) {
+            std::abort();
+        }
+        heap.clear();
+    }
+    finish(state, out);
+}
+
+BENCHMARK(BM_variables_named_env);
+BENCHMARK(BM_variables_tree_slots);
+BENCHMARK(BM_variables_vm_slots);
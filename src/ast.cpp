@@ -0,0 +1,408 @@
+#include "ast.h"
+
+#include <cassert>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "stats.h"
+
+using std::holds_alternative;
+
+using EBinOp = Expr_Binary::EBinaryOperator;
+using EUnaryOp = Expr_Unary::EUnaryOperator;
+
+namespace ast {
+NodeId Ast::push(const Node node, const uint32_t offset) {
+    const auto id = static_cast<NodeId>(nodes.size());
+    // Children first: keeps the arena in post-order
+    assert(node.kind == ENodeKind::Literal || node.lhs < id);
+    assert(node.kind != ENodeKind::Binary || node.rhs < id);
+    nodes.push_back(node);
+    offsets.push_back(offset);
+    return id;
+}
+
+NodeId Ast::add_literal(Expr_Literal::LiteralVariant literal,
+                        const uint32_t offset) {
+    const auto literal_idx = static_cast<NodeId>(literals.size());
+    literals.push_back(std::move(literal));
+    return push(Node{.kind = ENodeKind::Literal, .lhs = literal_idx}, offset);
+}
+NodeId Ast::add_grouping(const NodeId inner, const uint32_t offset) {
+    return push(Node{.kind = ENodeKind::Grouping, .lhs = inner}, offset);
+}
+NodeId Ast::add_unary(const EUnaryOp op, const NodeId inner,
+                      const uint32_t offset) {
+    return push(Node{.kind = ENodeKind::Unary,
+                     .op = static_cast<uint8_t>(op),
+                     .lhs = inner},
+                offset);
+}
+NodeId Ast::add_binary(const NodeId left, const EBinOp op, const NodeId right,
+                       const uint32_t offset) {
+    return push(Node{.kind = ENodeKind::Binary,
+                     .op = static_cast<uint8_t>(op),
+                     .lhs = left,
+                     .rhs = right},
+                offset);
+}
+
+using grammar::EParseError;
+using grammar::tok_matches;
+using NodeResult = expected<NodeId, grammar::ParseError>;
+
+// Precedence levels of binary operators, loosest first
+enum class ELevel : uint8_t { Equality, Comparison, Term, Factor, Unary };
+
+// Operator of `level` at `it`, if there's one
+template <typename It>
+static std::optional<EBinOp> binary_op_at(const ELevel level, It const& it) {
+    switch (level) {
+    case ELevel::Equality:
+        if (tok_matches<Equals>(it)) {
+            return EBinOp::EqEq;
+        } else if (tok_matches<NotEquals>(it)) {
+            return EBinOp::NotEq;
+        }
+        break;
+    case ELevel::Comparison:
+        if (tok_matches<Greater>(it)) {
+            return EBinOp::Greater;
+        } else if (tok_matches<GreaterOrEq>(it)) {
+            return EBinOp::GreaterOrEq;
+        } else if (tok_matches<Less>(it)) {
+            return EBinOp::Less;
+        } else if (tok_matches<LessOrEq>(it)) {
+            return EBinOp::LessOrEq;
+        }
+        break;
+    case ELevel::Term:
+        if (tok_matches<Minus>(it)) {
+            return EBinOp::Minus;
+        } else if (tok_matches<Plus>(it)) {
+            return EBinOp::Plus;
+        }
+        break;
+    case ELevel::Factor:
+        if (tok_matches<Slash>(it)) {
+            return EBinOp::Div;
+        } else if (tok_matches<Star>(it)) {
+            return EBinOp::Mul;
+        }
+        break;
+    case ELevel::Unary:
+        break;
+    }
+    return std::nullopt;
+}
+
+// The grammar:: recursive descent, turned inside out: each rule that would
+// be waiting on a recursive call is a Frame on a heap-allocated stack
+// instead. Tokens are checked in the same order, so errors match ::parse().
+template <typename It> class Parser {
+  public:
+    Parser(It it, It end_it, Ast& ast, const size_t max_depth)
+        : it(it), end_it(end_it), ast(ast), max_depth(max_depth) {}
+
+    NodeResult expression();
+
+  private:
+    enum class EFrame : uint8_t {
+        // equality() ... factor(), waiting on its (next) operand
+        Binary,
+        // unary() after a '!' or '-', waiting on its operand
+        Unary,
+        // primary() after a '(', waiting on the inner expression
+        Group,
+    };
+    struct Frame {
+        EFrame kind;
+        ELevel level = ELevel::Equality;
+        uint8_t op = 0;
+        bool has_left = false;
+        NodeId left = 0;
+        // Of the operator or paren
+        uint32_t offset = 0;
+    };
+
+    It it;
+    It end_it;
+    Ast& ast;
+    const size_t max_depth;
+    std::vector<Frame> stack;
+    // Unary and Group frames on the stack
+    size_t depth = 0;
+    // In links, of every node added so far, by NodeId, literals being 0.
+    // Checked against max_depth like ::parse() checks the trees it builds.
+    std::vector<size_t> heights;
+
+    // Push a Unary or Group frame
+    [[nodiscard]]
+    bool push_nested(const Frame frame) {
+        stack.push_back(frame);
+        depth += 1;
+        stats::note_depth(depth);
+        return depth <= max_depth;
+    }
+    // Note the height of node `id`, false if it's past max_depth
+    [[nodiscard]]
+    bool add_height(const NodeId id, const size_t height) {
+        assert(id == heights.size());
+        heights.push_back(height);
+        return grammar::fits_depth(height, max_depth);
+    }
+};
+
+template <typename It> NodeResult Parser<It>::expression() {
+    // Either looking for the start of an operand (descending), or holding a
+    // finished one in `node` and handing it to the frame below
+    bool descending = true;
+    // When descending, binary levels still to open
+    ELevel level = ELevel::Equality;
+    NodeId node = 0;
+
+    while (true) {
+        if (descending) {
+            // Same check as grammar::bounds_check()
+            if (it >= end_it) {
+                return std::unexpected(
+                    grammar::ParseError{.code = EParseError::EndOfInput});
+            }
+            for (; level < ELevel::Unary;
+                 level = static_cast<ELevel>(static_cast<uint8_t>(level) + 1)) {
+                stack.push_back(Frame{.kind = EFrame::Binary, .level = level});
+            }
+
+            const uint32_t offset = grammar::tok_span(it).offset;
+            if (tok_matches<Bang>(it) || tok_matches<Minus>(it)) {
+                const EUnaryOp op =
+                    tok_matches<Bang>(it) ? EUnaryOp::Bang : EUnaryOp::Minus;
+                it += 1;
+                if (!push_nested(Frame{.kind = EFrame::Unary,
+                                       .op = static_cast<uint8_t>(op),
+                                       .offset = offset})) {
+                    return std::unexpected(
+                        grammar::depth_error(max_depth, offset));
+                }
+                continue;
+            }
+
+            // primary()
+            using Literal = Expr_Literal;
+            TokenVariant const& tok = *it;
+            if (const auto* num = std::get_if<NumberLiteral>(&tok)) {
+                node = ast.add_literal(Literal::Number(num->value), offset);
+            } else if (const auto* str = std::get_if<StringLiteral>(&tok)) {
+                node = ast.add_literal(
+                    Literal::String(intern::IStr(str->literal)), offset);
+            } else if (holds_alternative<True>(tok)) {
+                node = ast.add_literal(Literal::True(), offset);
+            } else if (holds_alternative<False>(tok)) {
+                node = ast.add_literal(Literal::False(), offset);
+            } else if (holds_alternative<Nil>(tok)) {
+                node = ast.add_literal(Literal::Nil(), offset);
+            } else if (holds_alternative<LeftParen>(tok)) {
+                it += 1;
+                if (!push_nested(
+                        Frame{.kind = EFrame::Group, .offset = offset})) {
+                    return std::unexpected(
+                        grammar::depth_error(max_depth, offset));
+                }
+                level = ELevel::Equality;
+                continue;
+            } else {
+                // Same error as grammar::primary()
+                return std::unexpected(grammar::ParseError{
+                    .code = EParseError::UnexpectedToken,
+                    .token = static_cast<TokenKind>(tok.index()),
+                    .offset = offset});
+            }
+            (void)add_height(node, 0);
+            it += 1;
+            descending = false;
+            continue;
+        }
+
+        if (stack.empty()) {
+            return node;
+        }
+        Frame& top = stack.back();
+        switch (top.kind) {
+        case EFrame::Unary: {
+            const size_t height = grammar::nested_height(heights[node]);
+            node = ast.add_unary(static_cast<EUnaryOp>(top.op), node,
+                                 top.offset);
+            if (!add_height(node, height)) {
+                return std::unexpected(
+                    grammar::depth_error(max_depth, top.offset));
+            }
+            stack.pop_back();
+            depth -= 1;
+            break;
+        }
+        case EFrame::Group: {
+            if (it >= end_it || !tok_matches<RightParen>(it)) {
+                return std::unexpected(grammar::right_paren_error(it, end_it));
+            }
+            it += 1;
+            const size_t height = grammar::nested_height(heights[node]);
+            node = ast.add_grouping(node, top.offset);
+            if (!add_height(node, height)) {
+                return std::unexpected(
+                    grammar::depth_error(max_depth, top.offset));
+            }
+            stack.pop_back();
+            depth -= 1;
+            break;
+        }
+        case EFrame::Binary: {
+            if (top.has_left) {
+                const size_t height =
+                    grammar::binary_height(heights[top.left], heights[node]);
+                node = ast.add_binary(top.left, static_cast<EBinOp>(top.op),
+                                      node, top.offset);
+                if (!add_height(node, height)) {
+                    return std::unexpected(
+                        grammar::depth_error(max_depth, top.offset));
+                }
+            }
+            if (it < end_it) {
+                if (const auto op = binary_op_at(top.level, it)) {
+                    // Keep what we have as the left side, parse the right
+                    top.left = node;
+                    top.op = static_cast<uint8_t>(*op);
+                    top.has_left = true;
+                    top.offset = grammar::tok_span(it).offset;
+                    it += 1;
+                    level = static_cast<ELevel>(
+                        static_cast<uint8_t>(top.level) + 1);
+                    descending = true;
+                    break;
+                }
+            }
+            stack.pop_back();
+            break;
+        }
+        }
+    }
+}
+
+template <typename It>
+static expected<void, grammar::ParseError>
+parse_tokens(It const& begin, It const& end, const size_t max_depth, Ast& ast) {
+    ast.clear();
+    Parser<It> parser(begin, end, ast, max_depth);
+    const auto root = parser.expression();
+    if (!root) {
+        return std::unexpected(root.error());
+    }
+    ast.root = root.value();
+    return {};
+}
+
+expected<Ast, grammar::ParseError> parse(TokenVec const& tokens,
+                                         const size_t max_depth) {
+    Ast ast;
+    // Rough upper bound, most tokens end up as a node
+    ast.nodes.reserve(tokens.size());
+    ast.offsets.reserve(tokens.size());
+    const auto parsed =
+        parse_tokens(tokens.begin(), tokens.end(), max_depth, ast);
+    if (!parsed) {
+        return std::unexpected(parsed.error());
+    }
+    return ast;
+}
+
+expected<Ast, grammar::ParseError> parse(TokenStream& tokens,
+                                         const size_t max_depth) {
+    Ast ast;
+    const auto parsed = parse_into(tokens, ast, max_depth);
+    if (!parsed) {
+        return std::unexpected(parsed.error());
+    }
+    return ast;
+}
+
+expected<void, grammar::ParseError>
+parse_into(TokenStream& tokens, Ast& ast, const size_t max_depth) {
+    return parse_tokens(tokens.begin(), tokens.end(), max_depth, ast);
+}
+
+// Adds nodes in post-order, leaving the id of the last one in `added`
+class ArenaBuilder {
+  public:
+    explicit ArenaBuilder(Ast& ast) : ast(ast) {}
+
+    mutable NodeId added = 0;
+
+    void visit_literal(Expr_Literal const& literal) const {
+        added = ast.add_literal(literal.inner, literal.offset);
+    }
+    void visit_grouping(Expr_Grouping const& grouping) const {
+        visit_expr(*grouping.inner, *this);
+        added = ast.add_grouping(added, grouping.offset);
+    }
+    void visit_unary(Expr_Unary const& unary) const {
+        visit_expr(*unary.inner, *this);
+        added = ast.add_unary(unary.op, added, unary.offset);
+    }
+    void visit_binary(Expr_Binary const& binary) const {
+        visit_expr(*binary.left, *this);
+        const NodeId left = added;
+        visit_expr(*binary.right, *this);
+        added = ast.add_binary(left, binary.op, added, binary.offset);
+    }
+    // Only programs have variables, and those aren't flattened
+    void visit_variable(Expr_Variable const&) const {
+        throw std::invalid_argument("Flat ASTs have no variables");
+    }
+    void visit_assign(Expr_Assign const&) const {
+        throw std::invalid_argument("Flat ASTs have no variables");
+    }
+
+  private:
+    Ast& ast;
+};
+
+Ast from_expr(Expr const& expr) {
+    Ast ast;
+    const ArenaBuilder builder(ast);
+    visit_expr(expr, builder);
+    ast.root = builder.added;
+    return ast;
+}
+
+ExprPtr to_expr(Ast const& ast) {
+    if (ast.size() == 0) {
+        return nullptr;
+    }
+    // Each node's Expr, until its parent takes it
+    std::vector<ExprPtr> exprs(ast.size());
+    for (NodeId id = 0; id < ast.size(); ++id) {
+        Node const& node = ast[id];
+        switch (node.kind) {
+        case ENodeKind::Literal:
+            exprs[id] = std::make_unique<Expr_Literal>(ast.literals[node.lhs]);
+            break;
+        case ENodeKind::Grouping:
+            exprs[id] =
+                std::make_unique<Expr_Grouping>(std::move(exprs[node.lhs]));
+            break;
+        case ENodeKind::Unary:
+            exprs[id] = std::make_unique<Expr_Unary>(
+                node.unary_op(), std::move(exprs[node.lhs]));
+            break;
+        case ENodeKind::Binary:
+            exprs[id] = std::make_unique<Expr_Binary>(
+                std::move(exprs[node.lhs]), node.binary_op(),
+                std::move(exprs[node.rhs]));
+            break;
+        }
+        exprs[id]->offset = ast.offsets[id];
+    }
+    return std::move(exprs[ast.root]);
+}
+} // namespace ast
@@ -0,0 +1,111 @@
+#pragma once
+/**
+ * Flat, arena-style AST for the Lox interpreter
+ * All nodes of one tree live in a single vector and reference each other by
+ * 32-bit index, so the whole tree is a couple of allocations, is freed in one
+ * go and is laid out in parse order.
+ * Parse order is post-order (children always precede their parent), which
+ * lets consumers such as the evaluator run as a linear sweep.
+ **/
+
+#include <cstdint>
+#include <expected>
+#include <string>
+#include <vector>
+
+#include "lexer.h"
+#include "parser.h"
+
+namespace ast {
+using std::expected;
+using std::string;
+
+using NodeId = uint32_t;
+
+enum class ENodeKind : uint8_t { Literal, Grouping, Unary, Binary };
+
+struct Node {
+    ENodeKind kind;
+    // EUnaryOperator / EBinaryOperator, for Unary and Binary nodes
+    uint8_t op = 0;
+    // Literal: index into Ast::literals
+    // Grouping / Unary: inner node
+    // Binary: left node
+    NodeId lhs = 0;
+    // Binary: right node
+    NodeId rhs = 0;
+
+    [[nodiscard]]
+    Expr_Unary::EUnaryOperator unary_op() const {
+        return static_cast<Expr_Unary::EUnaryOperator>(op);
+    }
+    [[nodiscard]]
+    Expr_Binary::EBinaryOperator binary_op() const {
+        return static_cast<Expr_Binary::EBinaryOperator>(op);
+    }
+};
+static_assert(sizeof(Node) == 12);
+
+class Ast {
+  public:
+    std::vector<Node> nodes;
+    std::vector<Expr_Literal::LiteralVariant> literals;
+    // Source offset of each node, as in Expr::offset. A column of its own,
+    // so a Node stays 12 bytes and evaluation never touches it.
+    std::vector<uint32_t> offsets;
+    NodeId root = 0;
+
+    [[nodiscard]]
+    Node const& operator[](const NodeId id) const {
+        return nodes[id];
+    }
+    [[nodiscard]]
+    size_t size() const {
+        return nodes.size();
+    }
+
+    NodeId add_literal(Expr_Literal::LiteralVariant literal,
+                       uint32_t offset = 0);
+    NodeId add_grouping(NodeId inner, uint32_t offset = 0);
+    NodeId add_unary(Expr_Unary::EUnaryOperator op, NodeId inner,
+                     uint32_t offset = 0);
+    NodeId add_binary(NodeId left, Expr_Binary::EBinaryOperator op,
+                      NodeId right, uint32_t offset = 0);
+
+    // Empty again, keeping the arena's capacity for the next parse
+    void clear() {
+        nodes.clear();
+        literals.clear();
+        offsets.clear();
+        root = 0;
+    }
+
+  private:
+    NodeId push(Node node, uint32_t offset);
+};
+
+// Same grammar and errors as ::parse(), building into an arena instead.
+// Doesn't recurse: nesting only grows a small heap-allocated stack, so
+// max_depth can go far past what ::parse() survives.
+[[nodiscard]]
+expected<Ast, grammar::ParseError>
+parse(TokenVec const& tokens, size_t max_depth = grammar::DEFAULT_MAX_DEPTH);
+// Lex errors are left in tokens.errors()
+[[nodiscard]]
+expected<Ast, grammar::ParseError>
+parse(TokenStream& tokens, size_t max_depth = grammar::DEFAULT_MAX_DEPTH);
+// Same, but parses into an existing `ast`, reusing its arena
+[[nodiscard]]
+expected<void, grammar::ParseError>
+parse_into(TokenStream& tokens, Ast& ast,
+           size_t max_depth = grammar::DEFAULT_MAX_DEPTH);
+
+// The same tree as an arena. Recurses like the other Expr visitors.
+// Throws std::invalid_argument on variables, which only programs have.
+[[nodiscard]]
+Ast from_expr(Expr const& expr);
+// The same tree as Exprs, built bottom-up in one sweep without recursing.
+// Expects every node but the root to be the child of exactly one node.
+[[nodiscard]]
+ExprPtr to_expr(Ast const& ast);
+} // namespace ast
@@ -0,0 +1,263 @@
+#include "ast_file.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <vector>
+
+#include "intern.h"
+#include "runtime.h"
+
+using EBinOp = Expr_Binary::EBinaryOperator;
+using EUnaryOp = Expr_Unary::EUnaryOperator;
+
+namespace ast_file {
+namespace {
+constexpr char MAGIC[8] = {'\x7f', 'L', 'O', 'X', 'A', 'S', 'T', '\n'};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    ast::NodeId root;
+    uint32_t num_nodes;
+    uint32_t num_literals;
+    uint32_t string_bytes;
+    uint32_t num_lines;
+};
+
+// Indexed like Expr_Literal::LiteralVariant's alternatives
+enum class ELiteralTag : uint8_t { Number, String, True, False, Nil };
+
+struct LiteralRecord {
+    ELiteralTag tag;
+    uint8_t padding[3];
+    // String: length in the string table
+    uint32_t length;
+    // Number: the double's bits, String: offset in the string table
+    uint64_t payload;
+};
+
+// Nodes are read back with one memcpy, so the file layout is Node's
+static_assert(std::endian::native == std::endian::little);
+static_assert(sizeof(Header) == 32);
+static_assert(sizeof(LiteralRecord) == 16);
+static_assert(sizeof(ast::Node) == 12 && offsetof(ast::Node, kind) == 0 &&
+              offsetof(ast::Node, op) == 1 && offsetof(ast::Node, lhs) == 4 &&
+              offsetof(ast::Node, rhs) == 8);
+static_assert(std::is_trivially_copyable_v<ast::Node>);
+
+template <typename T> void put(string& out, T const& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+std::unexpected<string> invalid(string_view why) {
+    return std::unexpected(std::format("Invalid AST file: {}", why));
+}
+
+// Known kind and operator, children before their parent
+bool node_is_valid(ast::Node const& node, const ast::NodeId id,
+                   const size_t num_literals) {
+    switch (node.kind) {
+    case ast::ENodeKind::Literal:
+        return node.op == 0 && node.lhs < num_literals && node.rhs == 0;
+    case ast::ENodeKind::Grouping:
+        return node.op == 0 && node.lhs < id && node.rhs == 0;
+    case ast::ENodeKind::Unary:
+        return node.op <= static_cast<uint8_t>(EUnaryOp::Bang) &&
+               node.lhs < id && node.rhs == 0;
+    case ast::ENodeKind::Binary:
+        return node.op <= static_cast<uint8_t>(EBinOp::Div) && node.lhs < id &&
+               node.rhs < id;
+    }
+    return false;
+}
+} // namespace
+
+bool is_ast_file(const string_view bytes) {
+    return bytes.starts_with(string_view(MAGIC, sizeof(MAGIC)));
+}
+
+string serialize(ast::Ast const& ast,
+                 std::vector<uint32_t> const& line_starts) {
+    string strings;
+    std::vector<LiteralRecord> literals;
+    literals.reserve(ast.literals.size());
+    for (auto const& literal : ast.literals) {
+        LiteralRecord record{};
+        record.tag = static_cast<ELiteralTag>(literal.index());
+        if (const auto* num = std::get_if<Expr_Literal::Number>(&literal)) {
+            record.payload = std::bit_cast<uint64_t>(num->value);
+        } else if (const auto* str =
+                       std::get_if<Expr_Literal::String>(&literal)) {
+            record.payload = strings.size();
+            record.length = static_cast<uint32_t>(str->value.view().size());
+            strings += str->value.view();
+        }
+        literals.push_back(record);
+    }
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.root = ast.root;
+    header.num_nodes = static_cast<uint32_t>(ast.size());
+    header.num_literals = static_cast<uint32_t>(literals.size());
+    header.string_bytes = static_cast<uint32_t>(strings.size());
+    header.num_lines = static_cast<uint32_t>(line_starts.size());
+
+    string out;
+    out.reserve(sizeof(Header) +
+                ast.size() * (sizeof(ast::Node) + sizeof(uint32_t)) +
+                line_starts.size() * sizeof(uint32_t) +
+                literals.size() * sizeof(LiteralRecord) + strings.size());
+    put(out, header);
+    for (ast::Node const& node : ast.nodes) {
+        // Field by field, so the padding is written as zeros
+        put(out, node.kind);
+        put(out, node.op);
+        put(out, uint16_t{0});
+        put(out, node.lhs);
+        put(out, node.rhs);
+    }
+    for (const uint32_t offset : ast.offsets) {
+        put(out, offset);
+    }
+    for (const uint32_t start : line_starts) {
+        put(out, start);
+    }
+    for (LiteralRecord const& record : literals) {
+        put(out, record);
+    }
+    out += strings;
+    return out;
+}
+
+std::expected<void, string> deserialize(const string_view bytes,
+                                        ast::Ast& ast,
+                                        std::vector<uint32_t>& line_starts,
+                                        const size_t max_depth) {
+    ast.clear();
+    line_starts.clear();
+    Header header;
+    if (bytes.size() < sizeof(Header)) {
+        return invalid("too short");
+    }
+    std::memcpy(&header, bytes.data(), sizeof(Header));
+    if (!is_ast_file(bytes)) {
+        return invalid("bad magic");
+    }
+    if (header.version != FORMAT_VERSION) {
+        return invalid(std::format("version {}, expected {}", header.version,
+                                   FORMAT_VERSION));
+    }
+    const uint64_t nodes_bytes = uint64_t{header.num_nodes} * sizeof(ast::Node);
+    const uint64_t offsets_bytes =
+        uint64_t{header.num_nodes} * sizeof(uint32_t);
+    const uint64_t lines_bytes = uint64_t{header.num_lines} * sizeof(uint32_t);
+    const uint64_t literals_bytes =
+        uint64_t{header.num_literals} * sizeof(LiteralRecord);
+    if (bytes.size() != sizeof(Header) + nodes_bytes + offsets_bytes +
+                            lines_bytes + literals_bytes +
+                            header.string_bytes) {
+        return invalid("sizes don't match the header");
+    }
+    // Post-order, so the root comes last
+    if (header.num_nodes == 0 || header.root != header.num_nodes - 1) {
+        return invalid("bad root");
+    }
+
+    const char* const nodes_data = bytes.data() + sizeof(Header);
+    const char* const offsets_data = nodes_data + nodes_bytes;
+    const char* const lines_data = offsets_data + offsets_bytes;
+    const char* const literals_data = lines_data + lines_bytes;
+    const string_view strings(literals_data + literals_bytes,
+                              header.string_bytes);
+
+    // What LineIndex expects: the first line at 0, then increasing
+    line_starts.resize(header.num_lines);
+    std::memcpy(line_starts.data(), lines_data, lines_bytes);
+    if (line_starts.empty() || line_starts.front() != 0 ||
+        std::ranges::adjacent_find(line_starts, std::greater_equal()) !=
+            line_starts.end()) {
+        line_starts.clear();
+        return invalid("bad line starts");
+    }
+
+    ast.nodes.resize(header.num_nodes);
+    std::memcpy(ast.nodes.data(), nodes_data, nodes_bytes);
+    ast.offsets.resize(header.num_nodes);
+    std::memcpy(ast.offsets.data(), offsets_data, offsets_bytes);
+    // Every node but the root has exactly one parent: it's a tree
+    std::vector<uint32_t> parents(header.num_nodes, 0);
+    // As ::parse() counts them, literals being 0
+    std::vector<size_t> heights(header.num_nodes, 0);
+    for (ast::NodeId id = 0; id < header.num_nodes; ++id) {
+        ast::Node const& node = ast.nodes[id];
+        if (!node_is_valid(node, id, header.num_literals)) {
+            ast.clear();
+            return invalid(std::format("bad node {}", id));
+        }
+        if (node.kind != ast::ENodeKind::Literal) {
+            parents[node.lhs] += 1;
+            heights[id] = grammar::nested_height(heights[node.lhs]);
+        }
+        if (node.kind == ast::ENodeKind::Binary) {
+            parents[node.rhs] += 1;
+            heights[id] =
+                grammar::binary_height(heights[node.lhs], heights[node.rhs]);
+        }
+    }
+    // Valid, but too deep to walk recursively, see grammar::DEFAULT_MAX_DEPTH
+    if (!grammar::fits_depth(heights[header.root], max_depth)) {
+        ast.clear();
+        return std::unexpected(std::format(
+            "AST file nested too deeply, the limit is {}", max_depth));
+    }
+    for (ast::NodeId id = 0; id < header.root; ++id) {
+        if (parents[id] != 1) {
+            ast.clear();
+            return invalid(std::format("node {} isn't in the tree", id));
+        }
+    }
+
+    ast.literals.reserve(header.num_literals);
+    for (uint32_t i = 0; i < header.num_literals; ++i) {
+        LiteralRecord record;
+        std::memcpy(&record, literals_data + i * sizeof(LiteralRecord),
+                    sizeof(LiteralRecord));
+        using Literal = Expr_Literal;
+        switch (record.tag) {
+        case ELiteralTag::Number:
+            ast.literals.emplace_back(Literal::Number(
+                rt::canonical_number(std::bit_cast<double>(record.payload))));
+            break;
+        case ELiteralTag::String:
+            if (record.payload > strings.size() ||
+                record.length > strings.size() - record.payload) {
+                ast.clear();
+                return invalid(std::format("bad string literal {}", i));
+            }
+            ast.literals.emplace_back(Literal::String(
+                intern::IStr(strings.substr(record.payload, record.length))));
+            break;
+        case ELiteralTag::True:
+            ast.literals.emplace_back(Literal::True());
+            break;
+        case ELiteralTag::False:
+            ast.literals.emplace_back(Literal::False());
+            break;
+        case ELiteralTag::Nil:
+            ast.literals.emplace_back(Literal::Nil());
+            break;
+        default:
+            ast.clear();
+            return invalid(std::format("bad literal {}", i));
+        }
+    }
+    ast.root = header.root;
+    return {};
+}
+} // namespace ast_file
@@ -0,0 +1,53 @@
+#pragma once
+/**
+ * Binary AST files, written by the compile command
+ * A parsed (and possibly folded) expression in ast::Ast form, so evaluating
+ * it later skips lexing and parsing. Little-endian, laid out as
+ *   header:   magic, FORMAT_VERSION, root, node/literal/string-table/line
+ *             counts
+ *   nodes:    12 bytes each, exactly ast::Node, in post-order
+ *   offsets:  4 bytes per node, its source offset
+ *   lines:    4 bytes per line of the source, where it starts
+ *   literals: 16 bytes each, a tag then the number or a string table range
+ *   strings:  the contents of every string literal, back to back
+ * The source itself isn't kept, its line starts are enough to report errors
+ * at the right line.
+ * Loading validates everything before it's used, so a corrupt or truncated
+ * file is an error rather than a crash.
+ **/
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.h"
+
+namespace ast_file {
+using std::string;
+using std::string_view;
+
+// Bump on any layout change, older files are then refused
+constexpr uint32_t FORMAT_VERSION = 2;
+
+// Whether `bytes` starts like an AST file. Lox sources never do: the magic
+// starts with a byte the lexer rejects.
+[[nodiscard]]
+bool is_ast_file(string_view bytes);
+
+// `line_starts` of the source `ast` was parsed from, see LineIndex
+[[nodiscard]]
+string serialize(ast::Ast const& ast, std::vector<uint32_t> const& line_starts);
+
+// Into an existing `ast`, reusing its arena. The nodes are copied in one go
+// straight from `bytes`, and string literals interned from it directly.
+// The source's line starts go to `line_starts`. Trees deeper than
+// max_depth are refused, as ::parse() would have refused their source.
+[[nodiscard]]
+std::expected<void, string>
+deserialize(string_view bytes, ast::Ast& ast,
+            std::vector<uint32_t>& line_starts,
+            size_t max_depth = grammar::DEFAULT_MAX_DEPTH);
+} // namespace ast_file
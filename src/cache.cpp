@@ -0,0 +1,298 @@
+#include "cache.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <unistd.h>
+
+#include "intern.h"
+#include "runtime.h"
+#include "source.h"
+
+namespace cache {
+namespace {
+constexpr char MAGIC[4] = {'L', 'O', 'X', 'C'};
+// Numbers are written as-is, in little-endian order
+static_assert(std::endian::native == std::endian::little);
+
+template <typename T> void put(string& out, const T value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void put_bytes(string& out, const string_view bytes) {
+    put(out, static_cast<uint32_t>(bytes.size()));
+    out += bytes;
+}
+
+// Reads back what put() wrote. Any read past the end clears `ok`,
+// and reads nothing from then on.
+class Reader {
+  public:
+    explicit Reader(const string_view bytes) : bytes(bytes) {}
+
+    bool ok = true;
+
+    template <typename T> T get() {
+        T value{};
+        if (take(sizeof(T))) {
+            std::memcpy(&value, bytes.data() + pos - sizeof(T), sizeof(T));
+        }
+        return value;
+    }
+    string_view get_bytes() {
+        const auto size = get<uint32_t>();
+        return take(size) ? bytes.substr(pos - size, size) : string_view();
+    }
+    [[nodiscard]]
+    bool at_end() const {
+        return pos == bytes.size();
+    }
+
+  private:
+    string_view bytes;
+    size_t pos = 0;
+
+    bool take(const size_t size) {
+        ok = ok && bytes.size() - pos >= size;
+        if (ok) {
+            pos += size;
+        }
+        return ok;
+    }
+};
+} // namespace
+
+uint64_t hash_source(const string_view source) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const char c : source) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+string format_counters(Counters const& counters) {
+    return std::format("cache: hits={} misses={} disk_hits={} evictions={}",
+                       counters.hits, counters.misses, counters.disk_hits,
+                       counters.evictions);
+}
+
+string serialize(const string_view source, const uint64_t config,
+                 Compiled const& compiled) {
+    const auto* chunk = std::get_if<vm::Chunk>(&compiled.program);
+    if (chunk == nullptr &&
+        !std::holds_alternative<std::monostate>(compiled.program)) {
+        return "";
+    }
+
+    string out(MAGIC, sizeof(MAGIC));
+    put(out, INTERPRETER_VERSION);
+    put(out, config);
+    put(out, hash_source(source));
+    put(out, static_cast<uint64_t>(source.size()));
+    put(out, static_cast<int32_t>(compiled.exit_code));
+    put_bytes(out, compiled.err);
+    put(out, static_cast<uint8_t>(chunk != nullptr));
+    if (chunk == nullptr) {
+        return out;
+    }
+
+    put(out, static_cast<uint64_t>(chunk->max_stack));
+    put_bytes(out,
+              string_view(reinterpret_cast<const char*>(chunk->code.data()),
+                          chunk->code.size()));
+    put(out, static_cast<uint32_t>(chunk->constants.size()));
+    for (const rt::Value value : chunk->constants) {
+        put(out, value.type());
+        switch (value.type()) {
+        case rt::EValueType::Nil:
+            break;
+        case rt::EValueType::Bool:
+            put(out, static_cast<uint8_t>(value.get<bool>()));
+            break;
+        case rt::EValueType::Number:
+            put(out, value.get<double>());
+            break;
+        case rt::EValueType::String:
+            put_bytes(out, value.get<rt::StringPtr>()->flat());
+            break;
+        }
+    }
+    put(out, static_cast<uint32_t>(chunk->marks.size()));
+    for (const vm::SourceMark mark : chunk->marks) {
+        put(out, mark.pos);
+        put(out, mark.offset);
+    }
+    return out;
+}
+
+CompiledPtr deserialize(const string_view bytes, const string_view source,
+                        const uint64_t config) {
+    if (!bytes.starts_with(string_view(MAGIC, sizeof(MAGIC)))) {
+        return nullptr;
+    }
+    Reader in(bytes.substr(sizeof(MAGIC)));
+    if (in.get<uint32_t>() != INTERPRETER_VERSION ||
+        in.get<uint64_t>() != config ||
+        in.get<uint64_t>() != hash_source(source) ||
+        in.get<uint64_t>() != source.size()) {
+        return nullptr;
+    }
+
+    auto compiled = std::make_shared<Compiled>();
+    compiled->strings = std::make_unique<intern::Interner>();
+    compiled->exit_code = in.get<int32_t>();
+    compiled->err = in.get_bytes();
+    if (in.get<uint8_t>() == 0) {
+        return in.ok && in.at_end() ? compiled : nullptr;
+    }
+
+    vm::Chunk chunk;
+    chunk.max_stack = in.get<uint64_t>();
+    const string_view code = in.get_bytes();
+    chunk.code.assign(code.begin(), code.end());
+    const auto num_constants = in.get<uint32_t>();
+    for (uint32_t i = 0; i < num_constants && in.ok; ++i) {
+        switch (in.get<rt::EValueType>()) {
+        case rt::EValueType::Nil:
+            chunk.constants.emplace_back();
+            break;
+        case rt::EValueType::Bool:
+            chunk.constants.emplace_back(in.get<uint8_t>() != 0);
+            break;
+        case rt::EValueType::Number:
+            chunk.constants.emplace_back(
+                rt::canonical_number(in.get<double>()));
+            break;
+        case rt::EValueType::String:
+            // Constants are interned, like the literals they came from
+            chunk.constants.emplace_back(
+                compiled->strings->intern(in.get_bytes()));
+            break;
+        default:
+            return nullptr;
+        }
+    }
+    const auto num_marks = in.get<uint32_t>();
+    for (uint32_t i = 0; i < num_marks && in.ok; ++i) {
+        const auto pos = in.get<uint32_t>();
+        chunk.marks.push_back(vm::SourceMark{pos, in.get<uint32_t>()});
+    }
+    if (!in.ok || !in.at_end() || !vm::verify(chunk)) {
+        return nullptr;
+    }
+    compiled->program = std::move(chunk);
+    return compiled;
+}
+
+Cache::Cache(string dir, const size_t max_entries)
+    : dir(std::move(dir)), max_entries(std::max<size_t>(max_entries, 1)) {
+    if (!this->dir.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(this->dir, ec);
+    }
+}
+
+CompiledPtr Cache::find(const string_view source, const uint64_t config) {
+    const Key key{hash_source(source), config};
+    {
+        const std::lock_guard lock(mutex);
+        const auto it = entries.find(key);
+        if (it != entries.end() && it->second.source == source) {
+            stats.hits += 1;
+            return it->second.compiled;
+        }
+        if (dir.empty()) {
+            stats.misses += 1;
+            return nullptr;
+        }
+    }
+
+    // File I/O without holding the lock
+    CompiledPtr loaded;
+    if (const auto file = SourceBuffer::open(path_of(key)); file.has_value()) {
+        loaded = deserialize(file->view(), source, config);
+    }
+    const std::lock_guard lock(mutex);
+    if (loaded == nullptr) {
+        stats.misses += 1;
+        return nullptr;
+    }
+    stats.hits += 1;
+    stats.disk_hits += 1;
+    return add(key, source, std::move(loaded));
+}
+
+CompiledPtr Cache::insert(const string_view source, const uint64_t config,
+                          Compiled compiled) {
+    const Key key{hash_source(source), config};
+    const string bytes = dir.empty() ? "" : serialize(source, config, compiled);
+    CompiledPtr added;
+    {
+        const std::lock_guard lock(mutex);
+        added = add(key, source,
+                    std::make_shared<const Compiled>(std::move(compiled)));
+    }
+    if (bytes.empty()) {
+        return added;
+    }
+
+    // Write then rename, so other processes never load half a file
+    const string path = path_of(key);
+    const string tmp_path =
+        std::format("{}.{}.{}.tmp", path, ::getpid(),
+                    std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    // Failing to persist is only a miss for the next process, never thrown
+    std::error_code ec;
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (!file) {
+            std::filesystem::remove(tmp_path, ec);
+            return added;
+        }
+    }
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp_path, ec);
+    }
+    return added;
+}
+
+Counters Cache::counters() const {
+    const std::lock_guard lock(mutex);
+    return stats;
+}
+
+CompiledPtr Cache::add(const Key key, const string_view source,
+                       CompiledPtr compiled) {
+    if (const auto it = entries.find(key); it != entries.end()) {
+        // Same source: someone else compiled it first. A hash collision:
+        // the newer source takes the slot.
+        if (it->second.source != source) {
+            it->second = Entry{string(source), std::move(compiled)};
+        }
+        return it->second.compiled;
+    }
+    entries.emplace(key, Entry{string(source), compiled});
+    order.push_back(key);
+    if (order.size() > max_entries) {
+        entries.erase(order.front());
+        order.pop_front();
+        stats.evictions += 1;
+    }
+    return compiled;
+}
+
+string Cache::path_of(const Key key) const {
+    return (std::filesystem::path(dir) /
+            std::format("{:016x}-{:016x}.loxc", key.hash, key.config))
+        .string();
+}
+} // namespace cache
@@ -0,0 +1,128 @@
+#pragma once
+/**
+ * Cache of compiled programs, keyed by a hash of their source
+ * A Compiled is everything that happens before evaluation: lexing, parsing,
+ * folding and, for the VM, compiling to bytecode, or the errors any of those
+ * reported. Long-running modes (serve, batch) share one Cache, so a source
+ * seen before goes straight to evaluation.
+ * With a directory, entries that can be written out (bytecode and errors)
+ * are also persisted there, one file each, for later processes to load.
+ * Trees never are, so the CLI only takes a directory with --backend=vm.
+ * Files carry INTERPRETER_VERSION and are ignored, then overwritten, when it
+ * doesn't match.
+ **/
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+
+#include "ast.h"
+#include "intern.h"
+#include "parser.h"
+#include "vm.h"
+
+namespace cache {
+using std::string;
+using std::string_view;
+
+// Bump whenever lexing, parsing, folding or the bytecode change what they
+// produce for the same source, to invalidate persisted entries
+constexpr uint32_t INTERPRETER_VERSION = 5;
+
+// Entries kept in memory by default, the oldest ones go first
+constexpr size_t DEFAULT_MAX_ENTRIES = 4096;
+
+// 64-bit FNV-1a, the same in every process and build
+[[nodiscard]]
+uint64_t hash_source(string_view source);
+
+struct Compiled {
+    // Exit code and stderr output of everything before evaluation.
+    // Only a zero exit code has a program to evaluate.
+    int exit_code = 0;
+    string err;
+    // The program's strings, interned apart from every other entry's so
+    // they're freed when it's evicted
+    std::unique_ptr<intern::Interner> strings;
+    // Tree: the Expr tree, VM: its bytecode, Flat: the arena AST
+    std::variant<std::monostate, ExprPtr, vm::Chunk, ast::Ast> program;
+};
+// Shared by every evaluation of the same source, possibly on several threads
+using CompiledPtr = std::shared_ptr<const Compiled>;
+
+struct Counters {
+    size_t hits = 0;
+    size_t misses = 0;
+    // Hits that had to be loaded from the directory first
+    size_t disk_hits = 0;
+    size_t evictions = 0;
+};
+
+// "cache: hits=... misses=... disk_hits=... evictions=..."
+[[nodiscard]]
+string format_counters(Counters const& counters);
+
+// Safe to share between threads
+class Cache {
+  public:
+    // Without a directory, nothing is persisted
+    explicit Cache(string dir = "", size_t max_entries = DEFAULT_MAX_ENTRIES);
+
+    // `config` tells apart compiled forms of the same source, e.g. for
+    // different backends. Null (and counted as a miss) if not cached.
+    [[nodiscard]]
+    CompiledPtr find(string_view source, uint64_t config);
+    // Returns what ends up cached, which is the existing entry if another
+    // thread got there first
+    CompiledPtr insert(string_view source, uint64_t config, Compiled compiled);
+
+    [[nodiscard]]
+    Counters counters() const;
+
+  private:
+    struct Key {
+        uint64_t hash;
+        uint64_t config;
+        bool operator==(Key const&) const = default;
+    };
+    struct KeyHash {
+        size_t operator()(Key const& key) const {
+            return key.hash ^ (key.config * 0x9e3779b97f4a7c15);
+        }
+    };
+    struct Entry {
+        // To tell hash collisions apart
+        string source;
+        CompiledPtr compiled;
+    };
+
+    string dir;
+    size_t max_entries;
+    mutable std::mutex mutex;
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    // Insertion order, for eviction
+    std::deque<Key> order;
+    Counters stats;
+
+    // Expects the mutex to be held
+    CompiledPtr add(Key key, string_view source, CompiledPtr compiled);
+    [[nodiscard]]
+    string path_of(Key key) const;
+};
+
+// The file format of persisted entries: a header with the version, config
+// and source hash and length, then the errors and bytecode. Empty for
+// entries that aren't written out (Expr trees and arena ASTs).
+[[nodiscard]]
+string serialize(string_view source, uint64_t config, Compiled const& compiled);
+// Null if `bytes` isn't an entry of this version for `source` and `config`.
+// The bytecode is verified before it's returned.
+[[nodiscard]]
+CompiledPtr deserialize(string_view bytes, string_view source, uint64_t config);
+} // namespace cache
@@ -0,0 +1,536 @@
+#include "driver.h"
+
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#include "ast.h"
+#include "ast_file.h"
+#include "eval.h"
+#include "lexer.h"
+#include "optimize.h"
+#include "resolver.h"
+#include "runtime.h"
+#include "source.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "vm.h"
+
+namespace driver {
+namespace fs = std::filesystem;
+
+template <typename... Args>
+static void append_line(string& out, std::format_string<Args...> fmt,
+                        Args&&... args) {
+    std::format_to(std::back_inserter(out), fmt, std::forward<Args>(args)...);
+    out += '\n';
+}
+
+// Runs `stage` for one source. An exception out of it (a bug, or running out
+// of memory) fails only that source, not the server or batch around it.
+template <typename F> static void guarded(Output& output, F&& stage) {
+    try {
+        stage();
+    } catch (std::exception const& e) {
+        output.exit_code = RUNTIME_ERR_RETURN_CODE;
+        append_line(output.err, "Internal error: {}", e.what());
+    }
+}
+
+// Offsets into the source are 32-bit, see MAX_SOURCE_SIZE. True if it's
+// too large, which is reported like a lex error.
+static bool report_too_large(const std::string_view source, Output& output) {
+    if (source.size() <= MAX_SOURCE_SIZE) {
+        return false;
+    }
+    append_line(output.err, "Source is {} bytes, the limit is {}",
+                source.size(), MAX_SOURCE_SIZE);
+    output.exit_code = INTERP_ERR_RETURN_CODE;
+    return true;
+}
+
+// Finish lexing and report every lex error, true if there were any
+static bool report_lex_errors(TokenStream& tokens, Output& output) {
+    // Lex errors take precedence, and all of them get reported
+    tokens.drain();
+    for (const auto& err : tokens.errors()) {
+        append_line(output.err, "{}", err);
+    }
+    if (tokens.errors().empty()) {
+        return false;
+    }
+    output.exit_code = INTERP_ERR_RETURN_CODE;
+    return true;
+}
+
+// Errors are only turned into messages here, once they're printed. `lines`
+// is of `source`, which they come from.
+static void report_parse_error(grammar::ParseError const& err,
+                               const std::string_view source,
+                               LineIndex& lines, Output& output) {
+    append_line(output.err, "[line {}] Error at {}: {}",
+                lines.line_of(err.offset), grammar::error_message(err, source),
+                grammar::expected_message(err));
+    output.exit_code = INTERP_ERR_RETURN_CODE;
+}
+
+// Variables aren't named in errors, their name is the token at the error's
+// offset
+static std::string_view name_at(const std::string_view source,
+                                const uint32_t offset) {
+    Lexer lexer(source.substr(offset));
+    return lexer.next().has_value() ? lexer.last_lexeme() : "";
+}
+
+static void report_value(ValueResult const& value, LineIndex& lines,
+                         Output& output) {
+    if (value.has_value()) {
+        rt::append_value(output.out, value.value());
+        output.out += '\n';
+    } else {
+        append_line(output.err, "{}\n[line {}]",
+                    rt::error_message(value.error().code),
+                    lines.line_of(value.error().offset));
+        output.exit_code = RUNTIME_ERR_RETURN_CODE;
+    }
+}
+
+// Lex everything up front, for timing lexing on its own.
+// Reports errors the same way as report_lex_errors().
+static std::optional<TokenVec> lex_all(const std::string_view source,
+                                       Output& output) {
+    size_t num_errs = 0;
+    FaultyTokenVec faulty_tokens;
+    {
+        const stats::StageTimer timer(stats::EStage::Lex);
+        faulty_tokens = lex(source, num_errs);
+    }
+    stats::add_tokens(faulty_tokens.size() - num_errs);
+    if (num_errs > 0) {
+        for (const auto& exp_tok : faulty_tokens) {
+            if (!exp_tok.has_value()) {
+                append_line(output.err, "{}", exp_tok.error());
+            }
+        }
+        output.exit_code = INTERP_ERR_RETURN_CODE;
+        return std::nullopt;
+    }
+    const stats::StageTimer timer(stats::EStage::Lift);
+    return lift(faulty_tokens).value();
+}
+
+std::optional<ExprPtr> parse(const std::string_view source,
+                             Options const& options, Output& output) {
+    if (report_too_large(source, output)) {
+        return std::nullopt;
+    }
+    std::expected<ExprPtr, grammar::ParseError> opt_parsed;
+    if (stats::ENABLED && options.stats) {
+        const auto tokens = lex_all(source, output);
+        if (!tokens.has_value()) {
+            return std::nullopt;
+        }
+        const stats::StageTimer timer(stats::EStage::Parse);
+        opt_parsed = ::parse(tokens.value(), options.max_depth);
+    } else {
+        // Tokens are lexed as the parser asks for them
+        TokenStream tokens(source);
+        opt_parsed = ::parse(tokens, options.max_depth);
+        if (report_lex_errors(tokens, output)) {
+            return std::nullopt;
+        }
+    }
+    if (!opt_parsed.has_value()) {
+        LineIndex lines(source);
+        report_parse_error(opt_parsed.error(), source, lines, output);
+        return std::nullopt;
+    }
+    auto parsed = std::move(opt_parsed.value());
+    if (stats::ENABLED && options.stats) {
+        stats::add_nodes(opt::count_nodes(*parsed));
+    }
+
+    if (options.optimize) {
+        const stats::StageTimer timer(stats::EStage::Fold);
+        const size_t nodes_before = opt::count_nodes(*parsed);
+        parsed = opt::fold_constants(*parsed);
+        // stderr, so the regular output stays the same
+        append_line(output.err, "Constant folding: {} -> {} nodes",
+                    nodes_before, opt::count_nodes(*parsed));
+    }
+    return parsed;
+}
+
+// Lex + parse with the flat parser into `ast`, false if that failed
+static bool parse_flat(const std::string_view source, Options const& options,
+                       Output& output, ast::Ast& ast) {
+    if (report_too_large(source, output)) {
+        return false;
+    }
+    std::expected<void, grammar::ParseError> parsed;
+    if (stats::ENABLED && options.stats) {
+        const auto tokens = lex_all(source, output);
+        if (!tokens.has_value()) {
+            return false;
+        }
+        const stats::StageTimer timer(stats::EStage::Parse);
+        auto fresh = ast::parse(tokens.value(), options.max_depth);
+        if (fresh.has_value()) {
+            ast = std::move(fresh.value());
+        } else {
+            parsed = std::unexpected(fresh.error());
+        }
+    } else {
+        TokenStream tokens(source);
+        parsed = ast::parse_into(tokens, ast, options.max_depth);
+        if (report_lex_errors(tokens, output)) {
+            return false;
+        }
+    }
+    if (!parsed.has_value()) {
+        LineIndex lines(source);
+        report_parse_error(parsed.error(), source, lines, output);
+        return false;
+    }
+    stats::add_nodes(ast.size());
+    return true;
+}
+
+std::optional<ast::Ast> parse_arena(const std::string_view source,
+                                    Options const& options, Output& output) {
+    if (options.backend == EBackend::Flat) {
+        ast::Ast ast;
+        if (!parse_flat(source, options, output, ast)) {
+            return std::nullopt;
+        }
+        return ast;
+    }
+    const auto parsed = parse(source, options, output);
+    if (!parsed.has_value()) {
+        return std::nullopt;
+    }
+    return ast::from_expr(*parsed.value());
+}
+
+cache::Compiled compile(const std::string_view source,
+                        Options const& options) {
+    Output output;
+    cache::Compiled compiled;
+    compiled.strings = std::make_unique<intern::Interner>();
+    const intern::Scope scope(*compiled.strings);
+    if (options.backend == EBackend::Flat) {
+        ast::Ast ast;
+        if (parse_flat(source, options, output, ast)) {
+            compiled.program = std::move(ast);
+        }
+    } else if (auto parsed = parse(source, options, output)) {
+        if (options.backend == EBackend::VM) {
+            // Counted as evaluation, as it is in vm::evaluate()
+            const stats::StageTimer timer(stats::EStage::Eval);
+            compiled.program = vm::compile(*parsed.value());
+        } else {
+            compiled.program = std::move(parsed.value());
+        }
+    }
+    compiled.exit_code = output.exit_code;
+    compiled.err = std::move(output.err);
+    return compiled;
+}
+
+uint64_t cache_config(Options const& options) {
+    // Stats only change how the same result gets timed
+    return static_cast<uint64_t>(options.backend) |
+           static_cast<uint64_t>(options.optimize) << 8 |
+           static_cast<uint64_t>(options.max_depth) << 16;
+}
+
+static void run_compiled(cache::Compiled const& compiled,
+                         const std::string_view source, Output& output,
+                         rt::Heap& heap) {
+    output.exit_code = compiled.exit_code;
+    output.err += compiled.err;
+    if (compiled.exit_code != 0) {
+        return;
+    }
+    const stats::StageTimer timer(stats::EStage::Eval);
+    LineIndex lines(source);
+    if (const auto* chunk = std::get_if<vm::Chunk>(&compiled.program)) {
+        vm::VM machine(heap);
+        report_value(machine.run(*chunk), lines, output);
+    } else if (const auto* ast = std::get_if<ast::Ast>(&compiled.program)) {
+        report_value(eval::evaluate(*ast, heap), lines, output);
+    } else {
+        report_value(eval::evaluate(*std::get<ExprPtr>(compiled.program), heap),
+                     lines, output);
+    }
+}
+
+// Load an AST file into session.ast and evaluate it on options.backend
+static void evaluate_ast_file(const std::string_view bytes,
+                              Options const& options, Session& session) {
+    Output& output = session.output;
+    std::vector<uint32_t> line_starts;
+    if (const auto loaded =
+            ast_file::deserialize(bytes, session.ast, line_starts,
+                                  options.max_depth);
+        !loaded.has_value()) {
+        append_line(output.err, "{}", loaded.error());
+        output.exit_code = INTERP_ERR_RETURN_CODE;
+        return;
+    }
+    // The source is gone, but errors still get their lines
+    LineIndex lines(std::move(line_starts));
+    stats::add_nodes(session.ast.size());
+    if (options.backend == EBackend::Flat) {
+        const stats::StageTimer timer(stats::EStage::Eval);
+        report_value(eval::evaluate(session.ast, session.heap), lines, output);
+        return;
+    }
+
+    ExprPtr expr = ast::to_expr(session.ast);
+    if (options.optimize) {
+        const stats::StageTimer timer(stats::EStage::Fold);
+        const size_t nodes_before = opt::count_nodes(*expr);
+        expr = opt::fold_constants(*expr);
+        append_line(output.err, "Constant folding: {} -> {} nodes",
+                    nodes_before, opt::count_nodes(*expr));
+    }
+    const stats::StageTimer timer(stats::EStage::Eval);
+    report_value(options.backend == EBackend::VM
+                     ? vm::evaluate(std::move(expr), session.heap)
+                     : eval::evaluate(std::move(expr), session.heap),
+                 lines, output);
+}
+
+static void evaluate_source(const std::string_view source,
+                            Options const& options, Session& session) {
+    Output& output = session.output;
+    output.clear();
+    // Strings made while evaluating, only needed until they're formatted
+    rt::Heap& heap = session.heap;
+    heap.clear();
+    session.strings.clear();
+    const intern::Scope scope(session.strings);
+    // Before it gets hashed and copied into the cache
+    if (report_too_large(source, output)) {
+        return;
+    }
+
+    // Already parsed, there's nothing left to cache
+    if (ast_file::is_ast_file(source)) {
+        evaluate_ast_file(source, options, session);
+        return;
+    }
+
+    if (session.cache != nullptr) {
+        const uint64_t config = cache_config(options);
+        auto compiled = session.cache->find(source, config);
+        if (compiled == nullptr) {
+            compiled =
+                session.cache->insert(source, config, compile(source, options));
+        }
+        run_compiled(*compiled, source, output, heap);
+        return;
+    }
+
+    // Only scanned for lines if there's an error to report
+    LineIndex lines(source);
+
+    if (options.backend == EBackend::Flat) {
+        if (!parse_flat(source, options, output, session.ast)) {
+            return;
+        }
+        const stats::StageTimer timer(stats::EStage::Eval);
+        report_value(eval::evaluate(session.ast, heap), lines, output);
+        return;
+    }
+
+    auto parsed = parse(source, options, output);
+    if (!parsed.has_value()) {
+        return;
+    }
+    const stats::StageTimer timer(stats::EStage::Eval);
+    report_value(options.backend == EBackend::VM
+                     ? vm::evaluate(std::move(parsed.value()), heap)
+                     : eval::evaluate(std::move(parsed.value()), heap),
+                 lines, output);
+}
+
+void evaluate(const std::string_view source, Options const& options,
+              Session& session) {
+    guarded(session.output,
+            [&] { evaluate_source(source, options, session); });
+}
+
+Output evaluate(const std::string_view source, Options const& options) {
+    Session session;
+    evaluate(source, options, session);
+    return std::move(session.output);
+}
+
+std::optional<Program> parse_program(const std::string_view source,
+                                     Options const& options, Output& output) {
+    if (report_too_large(source, output)) {
+        return std::nullopt;
+    }
+    std::expected<Program, grammar::ParseError> opt_parsed;
+    if (stats::ENABLED && options.stats) {
+        const auto tokens = lex_all(source, output);
+        if (!tokens.has_value()) {
+            return std::nullopt;
+        }
+        const stats::StageTimer timer(stats::EStage::Parse);
+        opt_parsed = ::parse_program(tokens.value(), options.max_depth);
+    } else {
+        TokenStream tokens(source);
+        opt_parsed = ::parse_program(tokens, options.max_depth);
+        if (report_lex_errors(tokens, output)) {
+            return std::nullopt;
+        }
+    }
+    LineIndex lines(source);
+    if (!opt_parsed.has_value()) {
+        report_parse_error(opt_parsed.error(), source, lines, output);
+        return std::nullopt;
+    }
+    Program program = std::move(opt_parsed.value());
+    if (stats::ENABLED && options.stats) {
+        stats::add_nodes(opt::count_nodes(program));
+    }
+
+    if (options.optimize) {
+        const stats::StageTimer timer(stats::EStage::Fold);
+        const size_t nodes_before = opt::count_nodes(program);
+        opt::fold_constants(program);
+        append_line(output.err, "Constant folding: {} -> {} nodes",
+                    nodes_before, opt::count_nodes(program));
+    }
+
+    // Part of parsing, as far as stats go
+    const stats::StageTimer timer(stats::EStage::Parse);
+    if (const auto resolved = resolve::resolve(program); !resolved) {
+        const uint32_t offset = resolved.error().offset;
+        append_line(output.err, "[line {}] Error at '{}': {}",
+                    lines.line_of(offset), name_at(source, offset),
+                    resolve::error_message(resolved.error().code));
+        output.exit_code = INTERP_ERR_RETURN_CODE;
+        return std::nullopt;
+    }
+    return program;
+}
+
+static void run_source(const std::string_view source, Options const& options,
+                       Session& session) {
+    Output& output = session.output;
+    output.clear();
+    rt::Heap& heap = session.heap;
+    heap.clear();
+    session.strings.clear();
+    const intern::Scope scope(session.strings);
+
+    const auto program = parse_program(source, options, output);
+    if (!program.has_value()) {
+        return;
+    }
+    const stats::StageTimer timer(stats::EStage::Eval);
+    const auto ran = options.backend == EBackend::VM
+                         ? vm::execute(*program, heap, output.out)
+                         : eval::execute(*program, heap, output.out);
+    if (ran.has_value()) {
+        return;
+    }
+    const rt::RuntimeError err = ran.error();
+    LineIndex lines(source);
+    if (err.code == rt::ERuntimeError::UndefinedVariable) {
+        append_line(output.err, "Undefined variable '{}'.\n[line {}]",
+                    name_at(source, err.offset), lines.line_of(err.offset));
+    } else {
+        append_line(output.err, "{}\n[line {}]", rt::error_message(err.code),
+                    lines.line_of(err.offset));
+    }
+    output.exit_code = RUNTIME_ERR_RETURN_CODE;
+}
+
+void run(const std::string_view source, Options const& options,
+         Session& session) {
+    guarded(session.output, [&] { run_source(source, options, session); });
+}
+
+Output run(const std::string_view source, Options const& options) {
+    Session session;
+    run(source, options, session);
+    return std::move(session.output);
+}
+
+std::expected<std::vector<string>, string> batch_inputs(string const& path) {
+    std::error_code ec;
+    std::vector<string> paths;
+
+    if (fs::is_directory(path, ec)) {
+        for (const auto& entry : fs::directory_iterator(path, ec)) {
+            if (entry.is_regular_file() &&
+                entry.path().extension() == ".lox") {
+                paths.push_back(entry.path().string());
+            }
+        }
+        if (ec) {
+            return std::unexpected(
+                std::format("Could not read {}: {}", path, ec.message()));
+        }
+        std::ranges::sort(paths);
+        return paths;
+    }
+
+    std::ifstream manifest(path);
+    if (!manifest) {
+        return std::unexpected(std::format("Could not open {}", path));
+    }
+    const fs::path base = fs::path(path).parent_path();
+    string line;
+    while (std::getline(manifest, line)) {
+        const auto first = line.find_first_not_of(" \t\r");
+        if (first == string::npos || line[first] == '#') {
+            continue;
+        }
+        const auto last = line.find_last_not_of(" \t\r");
+        const fs::path entry = line.substr(first, last - first + 1);
+        paths.push_back(entry.is_absolute() ? entry.string()
+                                            : (base / entry).string());
+    }
+    return paths;
+}
+
+std::vector<Output> evaluate_batch(std::vector<string> const& paths,
+                                   Options const& options,
+                                   const size_t num_threads,
+                                   cache::Cache* cache) {
+    // One slot per file, each task only writes its own
+    std::vector<Output> outputs(paths.size());
+    ThreadPool pool(num_threads);
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+        pool.submit([&paths, &options, &outputs, cache, i] {
+            // Tokens point into the source, so it lives for the whole run
+            const auto source = [&] {
+                const stats::StageTimer timer(stats::EStage::Read);
+                return SourceBuffer::open(paths[i]);
+            }();
+            if (!source.has_value()) {
+                outputs[i].exit_code = 1;
+                append_line(outputs[i].err, "{}", source.error());
+                return;
+            }
+            Session session;
+            session.cache = cache;
+            evaluate(source->view(), options, session);
+            outputs[i] = std::move(session.output);
+        });
+    }
+    pool.wait();
+    return outputs;
+}
+} // namespace driver
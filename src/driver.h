@@ -0,0 +1,127 @@
+#pragma once
+/**
+ * The parse and evaluate commands, minus the process around them
+ * evaluate() runs lex -> parse -> eval on one source and captures what the
+ * CLI would print into an Output instead of writing it, so many sources can
+ * be evaluated in one process, on several threads, and printed in order.
+ * Sources can also be AST files written by the compile command, which are
+ * evaluated without lexing or parsing.
+ **/
+
+#include <cstddef>
+#include <expected>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.h"
+#include "cache.h"
+#include "intern.h"
+#include "parser.h"
+#include "runtime.h"
+
+namespace driver {
+using std::string;
+
+constexpr int INTERP_ERR_RETURN_CODE = 65;
+constexpr int RUNTIME_ERR_RETURN_CODE = 70;
+
+// Tree and VM evaluate the Expr tree, Flat parses into an ast::Ast with the
+// non-recursive parser and evaluates that. Programs only run on Tree and VM.
+enum class EBackend { Tree, VM, Flat };
+
+struct Options {
+    EBackend backend = EBackend::Tree;
+    // Run the constant folding pass after parsing, not supported by Flat
+    bool optimize = false;
+    // Deepest tree the parser accepts, see grammar::DEFAULT_MAX_DEPTH
+    size_t max_depth = grammar::DEFAULT_MAX_DEPTH;
+    // Record stats.h counters. Tokens are then lexed up front instead of
+    // streamed, so lexing and parsing can be timed apart.
+    bool stats = false;
+};
+
+// What one run would have printed, and its exit code
+struct Output {
+    int exit_code = 0;
+    string out;
+    string err;
+
+    // Keeps the strings' capacity
+    void clear() {
+        exit_code = 0;
+        out.clear();
+        err.clear();
+    }
+};
+
+// What evaluate() keeps warm between calls when running many sources in a
+// row: the flat AST arena and output buffers keep their capacity
+struct Session {
+    rt::Heap heap;
+    // Strings interned for the last source, freed when the next one starts.
+    // Cached sources have their own, see cache::Compiled.
+    intern::Interner strings;
+    ast::Ast ast;
+    Output output;
+    // When set, sources are compiled once and then looked up here
+    cache::Cache* cache = nullptr;
+};
+
+// Lex + parse into an Expr tree, folded if options.optimize. Lex and parse
+// errors end up in `output`, together with the exit code. So does a source
+// over MAX_SOURCE_SIZE, here and in every other entry point.
+[[nodiscard]]
+std::optional<ExprPtr> parse(std::string_view source, Options const& options,
+                             Output& output);
+
+// Lex + parse into an arena, for the compile command: the flat parser for
+// Flat, otherwise parse() (so folded with options.optimize) converted
+[[nodiscard]]
+std::optional<ast::Ast> parse_arena(std::string_view source,
+                                    Options const& options, Output& output);
+
+// Everything evaluate() does before evaluating, for the backend in options
+[[nodiscard]]
+cache::Compiled compile(std::string_view source, Options const& options);
+// What tells apart compiled forms of one source, see cache::Cache::find()
+[[nodiscard]]
+uint64_t cache_config(Options const& options);
+
+// An exception while evaluating (a bug, or running out of memory) ends up
+// in the Output as an internal error with RUNTIME_ERR_RETURN_CODE, like
+// every other failure of this one source.
+[[nodiscard]]
+Output evaluate(std::string_view source, Options const& options);
+// Same, with the result left in session.output
+void evaluate(std::string_view source, Options const& options,
+              Session& session);
+
+// Lex + parse a program and resolve its variables, folded if
+// options.optimize. Errors end up in `output`, together with the exit code.
+[[nodiscard]]
+std::optional<Program> parse_program(std::string_view source,
+                                     Options const& options, Output& output);
+
+// The run command: runs the program in `source` on the tree or the VM, what
+// it prints ends up in output.out. Never cached, and guarded like evaluate().
+[[nodiscard]]
+Output run(std::string_view source, Options const& options);
+// Same, with the result left in session.output
+void run(std::string_view source, Options const& options, Session& session);
+
+// Sources listed by `path`: either a directory, whose *.lox files are taken
+// in name order, or a manifest file with one path per line. Blank lines and
+// lines starting with '#' are skipped, relative paths are relative to the
+// manifest.
+[[nodiscard]]
+std::expected<std::vector<string>, string> batch_inputs(string const& path);
+
+// Evaluate every file on a pool of num_threads (0: one per hardware thread).
+// Results are in the same order as `paths`.
+[[nodiscard]]
+std::vector<Output> evaluate_batch(std::vector<string> const& paths,
+                                   Options const& options, size_t num_threads,
+                                   cache::Cache* cache = nullptr);
+} // namespace driver
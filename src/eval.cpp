@@ -6,19 +6,25 @@
 #include <utility>
 #include <variant>
 
-using std::holds_alternative;
-
 namespace eval {
+using rt::ERuntimeError;
+using rt::RuntimeError;
+
 ValueResult Visitor_Eval::visit_literal(Expr_Literal const& literal) const {
+    return literal_value(literal.inner);
+}
+
+Value literal_value(Expr_Literal::LiteralVariant const& literal) {
     return std::visit(
-        [this](auto&& var) -> Value {
+        [](auto&& var) -> Value {
             using T = std::decay_t<decltype(var)>;
             using std::is_same_v;
 
             if constexpr (is_same_v<T, Expr_Literal::Number>) {
                 return var.value;
             } else if constexpr (is_same_v<T, Expr_Literal::String>) {
-                return var.value;
+                // Shares the interned string, nothing to allocate
+                return var.value.get();
             } else if constexpr (is_same_v<T, Expr_Literal::True>) {
                 return true;
             } else if constexpr (is_same_v<T, Expr_Literal::False>) {
@@ -30,78 +36,94 @@ ValueResult Visitor_Eval::visit_literal(Expr_Literal const& literal) const {
                 return std::monostate{};
             }
         },
-        literal.inner);
+        literal);
 }
 
 ValueResult Visitor_Eval::visit_unary(Expr_Unary const& unary) const {
-    const ValueResult res_inner_val = unary.inner->accept(*this);
-    if (!res_inner_val) {
-        return res_inner_val.error();
+    const ValueResult res_inner_val = visit_expr(*unary.inner, *this);
+    UNWRAP(res_inner_val);
+
+    Value out;
+    const ERuntimeError err = apply_unary(unary.op, res_inner_val.value(), out);
+    if (err != ERuntimeError::None) {
+        return std::unexpected(RuntimeError{err, unary.offset});
     }
+    return out;
+}
 
-    const Value inner_val = res_inner_val.value();
-    switch (unary.op) {
+ERuntimeError apply_unary(Expr_Unary::EUnaryOperator op, const Value inner_val,
+                          Value& out) {
+    switch (op) {
     case Expr_Unary::EUnaryOperator::Minus:
         // Should never fail
-        if (holds_alternative<double>(inner_val)) {
-            return -1.0 * std::get<double>(inner_val);
+        if (inner_val.holds<double>()) {
+            out = -1.0 * inner_val.get<double>();
+            return ERuntimeError::None;
         } else {
-            return std::unexpected("Operand must be a number");
+            return ERuntimeError::OperandMustBeNumber;
         }
     case Expr_Unary::EUnaryOperator::Bang:
-        if (holds_alternative<bool>(inner_val)) {
-            return !std::get<bool>(inner_val);
-        } else if (holds_alternative<std::monostate>(inner_val)) {
-            return true;
-        } else if (holds_alternative<double>(inner_val)) {
-            // Negating any number is false-ey, incl 0
-            return false;
+        if (inner_val.holds<bool>()) {
+            out = !inner_val.get<bool>();
+        } else if (inner_val.holds<std::monostate>()) {
+            out = true;
         } else {
-            throw std::runtime_error("Unexpected unary type");
+            // Numbers and strings are truthy, incl 0 and ""
+            out = false;
         }
+        return ERuntimeError::None;
     }
+    std::unreachable();
 }
 
-double binary_value(Value const& val) {
-    if (holds_alternative<bool>(val)) {
-        return std::get<bool>(val) ? 1.0 : 0.0;
-    } else if (holds_alternative<std::monostate>(val)) {
+double binary_value(const Value val) {
+    if (val.holds<bool>()) {
+        return val.get<bool>() ? 1.0 : 0.0;
+    } else if (val.holds<std::monostate>()) {
         return 0.0;
     } else {
-        return std::get<double>(val);
+        return val.get<double>();
     }
 }
 
 ValueResult Visitor_Eval::visit_binary(Expr_Binary const& binary) const {
-    enum class EOperationKind { Arithmetic, StrConcat, Cmp, Relation };
-    EOperationKind op_kind;
-
-    const ValueResult res_left_v = binary.left->accept(*this);
+    const ValueResult res_left_v = visit_expr(*binary.left, *this);
     UNWRAP(res_left_v);
-    const Value left_v = res_left_v.value();
-    const ValueResult res_right_v = binary.right->accept(*this);
+    const ValueResult res_right_v = visit_expr(*binary.right, *this);
     UNWRAP(res_right_v);
-    const Value right_v = res_right_v.value();
 
-    switch (binary.op) {
+    Value out;
+    const ERuntimeError err = apply_binary(binary.op, res_left_v.value(),
+                                           res_right_v.value(), out, heap);
+    if (err != ERuntimeError::None) {
+        return std::unexpected(RuntimeError{err, binary.offset});
+    }
+    return out;
+}
+
+ERuntimeError apply_binary(Expr_Binary::EBinaryOperator op, const Value left_v,
+                           const Value right_v, Value& out, rt::Heap& heap) {
+    enum class EOperationKind { Arithmetic, StrConcat, Cmp, Relation };
+    EOperationKind op_kind;
+
+    switch (op) {
     case Expr_Binary::EBinaryOperator::Plus:
         // Both are strings
-        if (both_values_are<string>(left_v, right_v)) {
+        if (both_values_are<StringPtr>(left_v, right_v)) {
             op_kind = EOperationKind::StrConcat;
             break;
         } else if (both_values_are<double>(left_v, right_v)) {
             op_kind = EOperationKind::Arithmetic;
             break;
         } else {
-            return std::unexpected(
-                "Operands must be two numbers or two strings");
+            return ERuntimeError::OperandsMustBeNumbersOrStrings;
         }
     case Expr_Binary::EBinaryOperator::Minus:
         if (both_values_are<double>(left_v, right_v)) {
             op_kind = EOperationKind::Arithmetic;
             break;
         } else {
-            return std::unexpected("Operands must be numbers");
+            return ERuntimeError::OperandsMustBeNumbers;
         }
     case Expr_Binary::EBinaryOperator::Mul:
     case Expr_Binary::EBinaryOperator::Div:
@@ -116,60 +138,68 @@ ValueResult Visitor_Eval::visit_binary(Expr_Binary const& binary) const {
     }
 
     if (op_kind == EOperationKind::Arithmetic) {
-        if (!holds_alternative<double>(left_v) ||
-            !holds_alternative<double>(right_v)) {
-            return std::unexpected("Operands must be numbers.");
+        if (!left_v.holds<double>() || !right_v.holds<double>()) {
+            return ERuntimeError::OperandsMustBeNumbers;
         }
-        const double left = std::get<double>(left_v);
-        const double right = std::get<double>(right_v);
+        const double left = left_v.get<double>();
+        const double right = right_v.get<double>();
 
-        switch (binary.op) {
+        switch (op) {
         case Expr_Binary::EBinaryOperator::Plus:
-            return left + right;
+            out = left + right;
+            return ERuntimeError::None;
         case Expr_Binary::EBinaryOperator::Minus:
-            return left - right;
+            out = left - right;
+            return ERuntimeError::None;
         case Expr_Binary::EBinaryOperator::Mul:
-            return left * right;
+            out = left * right;
+            return ERuntimeError::None;
         case Expr_Binary::EBinaryOperator::Div:
-            return left / right;
+            out = left / right;
+            return ERuntimeError::None;
         default:
             std::unreachable();
         }
     } else if (op_kind == EOperationKind::StrConcat) {
-        const string left = std::get<string>(left_v);
-        const string right = std::get<string>(right_v);
-
-        return left + right;
+        out = heap.concat(left_v.get<StringPtr>(), right_v.get<StringPtr>());
+        return ERuntimeError::None;
     } else if (op_kind == EOperationKind::Cmp) {
-        // They don't hold the same variant type
-        if (left_v.index() != right_v.index()) {
-            // Diff variants are always NOT equal
-            switch (binary.op) {
+        // They don't hold the same type
+        if (left_v.type() != right_v.type()) {
+            // Diff types are always NOT equal
+            switch (op) {
             case Expr_Binary::EBinaryOperator::EqEq:
-                return false;
+                out = false;
+                return ERuntimeError::None;
             case Expr_Binary::EBinaryOperator::NotEq:
-                return true;
+                out = true;
+                return ERuntimeError::None;
             default:
                 std::unreachable();
             }
         } else {
-            // They hold the same variant type
-            if (holds_alternative<std::monostate>(left_v)) {
+            // They hold the same type
+            if (left_v.holds<std::monostate>()) {
                 // monostates are always equal
-                switch (binary.op) {
+                switch (op) {
                 case Expr_Binary::EBinaryOperator::EqEq:
-                    return true;
+                    out = true;
+                    return ERuntimeError::None;
                 case Expr_Binary::EBinaryOperator::NotEq:
-                    return false;
+                    out = false;
+                    return ERuntimeError::None;
                 default:
                     std::unreachable();
                 }
-            } else if (holds_alternative<bool>(left_v)) {
-                return compare_values<bool>(binary.op, left_v, right_v);
-            } else if (holds_alternative<double>(left_v)) {
-                return compare_values<double>(binary.op, left_v, right_v);
-            } else if (holds_alternative<string>(left_v)) {
-                return compare_values<string>(binary.op, left_v, right_v);
+            } else if (left_v.holds<bool>()) {
+                out = compare_values<bool>(op, left_v, right_v);
+                return ERuntimeError::None;
+            } else if (left_v.holds<double>()) {
+                out = compare_values<double>(op, left_v, right_v);
+                return ERuntimeError::None;
+            } else if (left_v.holds<StringPtr>()) {
+                out = compare_values<StringPtr>(op, left_v, right_v);
+                return ERuntimeError::None;
             }
         }
 
@@ -177,25 +207,31 @@ ValueResult Visitor_Eval::visit_binary(Expr_Binary const& binary) const {
         // We could be handling weak typing here,
         // but per spec we only compare numbers
         if (!both_values_are<double>(left_v, right_v)) {
-            return std::unexpected("Operands must be numbers.");
+            return ERuntimeError::OperandsMustBeNumbers;
         }
 
         const double left = binary_value(left_v);
         const double right = binary_value(right_v);
 
-        switch (binary.op) {
+        switch (op) {
         case Expr_Binary::EBinaryOperator::EqEq:
-            return left == right;
+            out = left == right;
+            return ERuntimeError::None;
         case Expr_Binary::EBinaryOperator::NotEq:
-            return left != right;
+            out = left != right;
+            return ERuntimeError::None;
         case Expr_Binary::EBinaryOperator::Less:
-            return left < right;
+            out = left < right;
+            return ERuntimeError::None;
         case Expr_Binary::EBinaryOperator::LessOrEq:
-            return left <= right;
+            out = left <= right;
+            return ERuntimeError::None;
         case Expr_Binary::EBinaryOperator::Greater:
-            return left > right;
+            out = left > right;
+            return ERuntimeError::None;
         case Expr_Binary::EBinaryOperator::GreaterOrEq:
-            return left >= right;
+            out = left >= right;
+            return ERuntimeError::None;
         default:
             std::unreachable();
             break;
@@ -205,18 +241,144 @@ ValueResult Visitor_Eval::visit_binary(Expr_Binary const& binary) const {
     throw std::runtime_error("Unexpected control path");
 }
 ValueResult Visitor_Eval::visit_grouping(Expr_Grouping const& grouping) const {
-    return grouping.inner->accept(*this);
+    return visit_expr(*grouping.inner, *this);
+}
+
+Value* Visitor_Eval::defined(const Slot slot) const {
+    Value* const val = vars != nullptr ? vars->at(slot) : nullptr;
+    return val != nullptr && !val->is_undefined() ? val : nullptr;
+}
+
+ValueResult Visitor_Eval::visit_variable(Expr_Variable const& variable) const {
+    if (const Value* val = defined(variable.slot)) {
+        return *val;
+    }
+    return std::unexpected(
+        RuntimeError{ERuntimeError::UndefinedVariable, variable.offset});
+}
+
+ValueResult Visitor_Eval::visit_assign(Expr_Assign const& assign) const {
+    const ValueResult value = visit_expr(*assign.value, *this);
+    UNWRAP(value);
+
+    // Assigning doesn't define a global, only var does
+    Value* const target = defined(assign.slot);
+    if (target == nullptr) {
+        return std::unexpected(
+            RuntimeError{ERuntimeError::UndefinedVariable, assign.offset});
+    }
+    *target = value.value();
+    return value;
+}
+
+ExecResult Visitor_Exec::visit_expression(Stmt_Expression const& stmt) const {
+    const ValueResult value = visit_expr(*stmt.expr, eval);
+    if (!value) {
+        return std::unexpected(value.error());
+    }
+    return {};
 }
 
-std::expected<Value, string> evaluate(ExprPtr ast) {
+ExecResult Visitor_Exec::visit_print(Stmt_Print const& stmt) const {
+    const ValueResult value = visit_expr(*stmt.expr, eval);
+    if (!value) {
+        return std::unexpected(value.error());
+    }
+    rt::append_value(out, value.value());
+    out += '\n';
+    return {};
+}
+
+ExecResult Visitor_Exec::visit_var(Stmt_Var const& stmt) const {
+    Value init;
+    if (stmt.init != nullptr) {
+        const ValueResult value = visit_expr(*stmt.init, eval);
+        if (!value) {
+            return std::unexpected(value.error());
+        }
+        init = value.value();
+    }
+    Value* const target = vars.at(stmt.slot);
+    if (target == nullptr) {
+        return std::unexpected(
+            RuntimeError{ERuntimeError::UndefinedVariable, stmt.name_offset});
+    }
+    *target = init;
+    return {};
+}
+
+ExecResult Visitor_Exec::visit_block(Stmt_Block const& stmt) const {
+    // Locals already have their slots, there's no scope to set up
+    for (StmtPtr const& inner : stmt.stmts) {
+        const ExecResult res = visit_stmt(*inner, *this);
+        UNWRAP(res);
+    }
+    return {};
+}
+
+ValueResult Visitor_Eval::visit_ast(ast::Ast const& ast) const {
+    if (ast.size() == 0) {
+        return std::unexpected(RuntimeError{ERuntimeError::NilAst});
+    }
+
+    // One slot per node, children always come before their parent
+    std::vector<Value> values(ast.size());
+    for (ast::NodeId id = 0; id < ast.size(); ++id) {
+        ast::Node const& node = ast[id];
+        ERuntimeError err = ERuntimeError::None;
+
+        switch (node.kind) {
+        case ast::ENodeKind::Literal:
+            values[id] = literal_value(ast.literals[node.lhs]);
+            break;
+        case ast::ENodeKind::Grouping:
+            values[id] = values[node.lhs];
+            break;
+        case ast::ENodeKind::Unary:
+            err = apply_unary(node.unary_op(), values[node.lhs], values[id]);
+            break;
+        case ast::ENodeKind::Binary:
+            err = apply_binary(node.binary_op(), values[node.lhs],
+                               values[node.rhs], values[id], heap);
+            break;
+        }
+
+        if (err != ERuntimeError::None) {
+            return std::unexpected(RuntimeError{err, ast.offsets[id]});
+        }
+    }
+
+    return values[ast.root];
+}
+
+ValueResult evaluate(ExprPtr ast, rt::Heap& heap) {
     if (ast == nullptr) {
-        return std::unexpected("Input AST is nil");
+        return std::unexpected(RuntimeError{ERuntimeError::NilAst});
     }
-    Visitor_Eval eval_visitor;
+    return evaluate(*ast, heap);
+}
+
+ValueResult evaluate(Expr const& ast, rt::Heap& heap) {
+    Visitor_Eval eval_visitor(heap);
     // TODO this assumes no failures are possible inside evaluation code
-    const auto value = ast->accept(eval_visitor);
+    const auto value = visit_expr(ast, eval_visitor);
 
     return value;
 }
 
+ValueResult evaluate(ast::Ast const& ast, rt::Heap& heap) {
+    Visitor_Eval eval_visitor(heap);
+    return eval_visitor.visit_ast(ast);
+}
+
+ExecResult execute(Program const& program, rt::Heap& heap, string& out) {
+    Variables vars(program);
+    const Visitor_Exec exec(heap, vars, out);
+    for (StmtPtr const& stmt : program.stmts) {
+        const ExecResult res = visit_stmt(*stmt, exec);
+        UNWRAP(res);
+    }
+    return {};
+}
+
 } // namespace eval
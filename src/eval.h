@@ -3,37 +3,116 @@
  * Evaluator for the Lox interpreter
  **/
 
+#include "ast.h"
 #include "parser.h"
 #include "runtime.h"
 #include <expected>
 #include <string>
 #include <variant>
+#include <vector>
 
 namespace eval {
 using std::expected;
 using std::monostate;
 using std::string;
 
+using rt::StringPtr;
 using rt::Value;
 
-class Visitor_Eval : public Visitor<ValueResult> {
-    virtual ValueResult visit_unary(Expr_Unary const& unary) const override;
-    virtual ValueResult
-    visit_literal(Expr_Literal const& literal) const override;
-    virtual ValueResult visit_binary(Expr_Binary const& binary) const override;
-    virtual ValueResult
-    visit_grouping(Expr_Grouping const& grouping) const override;
+using ExecResult = expected<void, rt::RuntimeError>;
+
+// Variables of a running program, at the slots resolve::resolve() gave them.
+// Globals start out undefined, locals are always assigned before they're
+// read.
+struct Variables {
+    std::vector<Value> globals;
+    std::vector<Value> locals;
+
+    // Sized for `program`
+    explicit Variables(Program const& program)
+        : globals(program.num_globals, Value::undefined()),
+          locals(program.num_locals) {}
+
+    // Where the variable in `slot` is kept, null if it isn't resolved
+    [[nodiscard]]
+    Value* at(const Slot slot) {
+        switch (slot.scope) {
+        case EScope::Global:
+            return &globals[slot.index];
+        case EScope::Local:
+            return &locals[slot.index];
+        case EScope::Unresolved:
+            return nullptr;
+        }
+        std::unreachable();
+    }
+};
+
+class Visitor_Eval {
+  public:
+    // Strings created during evaluation are allocated from `heap`
+    explicit Visitor_Eval(rt::Heap& heap) : heap(heap) {}
+    // Same, for the expressions of a program, reading and assigning `vars`
+    Visitor_Eval(rt::Heap& heap, Variables& vars) : heap(heap), vars(&vars) {}
+
+    // Evaluates a flat arena AST.
+    // Nodes are stored children-first, so this is a single linear sweep
+    // instead of a recursive walk.
+    ValueResult visit_ast(ast::Ast const& ast) const;
+
+    // For visit_expr()
+    ValueResult visit_unary(Expr_Unary const& unary) const;
+    ValueResult visit_literal(Expr_Literal const& literal) const;
+    ValueResult visit_binary(Expr_Binary const& binary) const;
+    ValueResult visit_grouping(Expr_Grouping const& grouping) const;
+    ValueResult visit_variable(Expr_Variable const& variable) const;
+    ValueResult visit_assign(Expr_Assign const& assign) const;
+
+  private:
+    rt::Heap& heap;
+    // Expressions on their own have no variables
+    Variables* vars = nullptr;
+
+    // The defined variable in `slot`, null if there isn't one
+    [[nodiscard]]
+    Value* defined(Slot slot) const;
+};
+
+// Runs the statements of a program, for visit_stmt()
+class Visitor_Exec {
+  public:
+    // Printed values are appended to `out`
+    Visitor_Exec(rt::Heap& heap, Variables& vars, string& out)
+        : eval(heap, vars), vars(vars), out(out) {}
+
+    ExecResult visit_expression(Stmt_Expression const& stmt) const;
+    ExecResult visit_print(Stmt_Print const& stmt) const;
+    ExecResult visit_var(Stmt_Var const& stmt) const;
+    ExecResult visit_block(Stmt_Block const& stmt) const;
+
+  private:
+    Visitor_Eval eval;
+    Variables& vars;
+    string& out;
 };
 
 template <typename T>
 [[nodiscard]]
-bool compare_values(Expr_Binary::EBinaryOperator op, Value const& left,
-                    Value const& right) {
+bool compare_values(Expr_Binary::EBinaryOperator op, const Value left,
+                    const Value right) {
+    bool is_equal;
+    if constexpr (std::is_same_v<T, StringPtr>) {
+        // Compare contents, not where the strings live
+        is_equal = *left.get<T>() == *right.get<T>();
+    } else {
+        is_equal = left.get<T>() == right.get<T>();
+    }
+
     switch (op) {
     case Expr_Binary::EBinaryOperator::EqEq:
-        return std::get<T>(left) == std::get<T>(right);
+        return is_equal;
     case Expr_Binary::EBinaryOperator::NotEq:
-        return std::get<T>(left) != std::get<T>(right);
+        return !is_equal;
     default:
         std::unreachable();
     }
@@ -41,9 +120,30 @@ bool compare_values(Expr_Binary::EBinaryOperator op, Value const& left,
 
 template <typename T>
 [[nodiscard]]
-bool both_values_are(Value const& left, Value const& right) {
-    return std::holds_alternative<T>(left) && std::holds_alternative<T>(right);
+bool both_values_are(const Value left, const Value right) {
+    return left.holds<T>() && right.holds<T>();
 }
 
-std::expected<Value, string> evaluate(ExprPtr ast);
+[[nodiscard]]
+Value literal_value(Expr_Literal::LiteralVariant const& literal);
+
+// Operator semantics shared by Visitor_Eval and the bytecode VM.
+// Returns ERuntimeError::None and writes the result to `out` on success,
+// otherwise returns the runtime error.
+// String results are allocated from `heap`.
+[[nodiscard]]
+rt::ERuntimeError apply_unary(Expr_Unary::EUnaryOperator op, Value inner_val,
+                              Value& out);
+[[nodiscard]]
+rt::ERuntimeError apply_binary(Expr_Binary::EBinaryOperator op, Value left_v,
+                               Value right_v, Value& out, rt::Heap& heap);
+
+// The returned value may point into `heap`
+ValueResult evaluate(ExprPtr ast, rt::Heap& heap);
+ValueResult evaluate(Expr const& ast, rt::Heap& heap);
+ValueResult evaluate(ast::Ast const& ast, rt::Heap& heap);
+
+// Runs a program that has been through resolve::resolve(), appending what it
+// prints to `out`, up to the error if there is one
+ExecResult execute(Program const& program, rt::Heap& heap, string& out);
 } // namespace eval
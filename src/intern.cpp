@@ -0,0 +1,39 @@
+#include "intern.h"
+
+#include <utility>
+
+namespace intern {
+rt::StringPtr Interner::intern(const std::string_view str) {
+    const std::lock_guard lock(mutex);
+    if (const auto it = index.find(str); it != index.end()) {
+        return it->second;
+    }
+
+    rt::String const& interned =
+        strings.emplace_back(std::string(str), true);
+    index.emplace(interned.flat(), &interned);
+    total_bytes += str.size();
+    return &interned;
+}
+
+void Interner::clear() {
+    const std::lock_guard lock(mutex);
+    index.clear();
+    strings.clear();
+    total_bytes = 0;
+}
+
+Interner& global() {
+    static Interner interner;
+    return interner;
+}
+
+// Null outside of any Scope
+static thread_local Interner* scoped = nullptr;
+
+Interner& current() { return scoped != nullptr ? *scoped : global(); }
+
+Scope::Scope(Interner& interner) : previous(std::exchange(scoped, &interner)) {}
+
+Scope::~Scope() { scoped = previous; }
+} // namespace intern
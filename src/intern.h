@@ -0,0 +1,99 @@
+#pragma once
+/**
+ * String interning for the Lox interpreter
+ * Identifiers and string literals are interned once at lex time. Tokens, AST
+ * literals and runtime string values then all point at the same rt::String,
+ * and two interned strings are equal iff they are the same pointer.
+ * An Interner is safe to share between threads.
+ * Strings go to the process-wide global() interner, unless a Scope points
+ * this thread at another one. Long-running modes do that per request and
+ * per cache entry, so their strings are freed along with what uses them.
+ **/
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "runtime.h"
+
+namespace intern {
+
+class Interner {
+  public:
+    // Returns the unique interned copy of `str`, creating it if needed.
+    // The result stays valid for the lifetime of the interner.
+    [[nodiscard]]
+    rt::StringPtr intern(std::string_view str);
+
+    // Number of unique strings
+    [[nodiscard]]
+    size_t size() const {
+        const std::lock_guard lock(mutex);
+        return strings.size();
+    }
+    // Bytes of string contents held, excluding bookkeeping
+    [[nodiscard]]
+    size_t content_bytes() const {
+        const std::lock_guard lock(mutex);
+        return total_bytes;
+    }
+
+    // Frees every string, nothing may point at them anymore
+    void clear();
+
+  private:
+    // Parsing on several threads interns into the same global() table
+    mutable std::mutex mutex;
+    // deque: growing it never moves existing strings,
+    // so the views used as keys below stay valid
+    std::deque<rt::String> strings;
+    std::unordered_map<std::string_view, rt::StringPtr> index;
+    size_t total_bytes = 0;
+};
+
+// Process-wide interner, strings in it are never freed
+[[nodiscard]]
+Interner& global();
+
+// The innermost Scope's interner on this thread, else global()
+[[nodiscard]]
+Interner& current();
+
+// Points current() at `interner` on this thread while alive, scopes nest
+class Scope {
+  public:
+    explicit Scope(Interner& interner);
+    ~Scope();
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+
+  private:
+    Interner* previous;
+};
+
+// Handle to a string in the current() interner.
+// Copying it is copying a pointer, and comparing two handles is a pointer
+// compare.
+class IStr {
+  public:
+    IStr(std::string_view str) : ptr(current().intern(str)) {}
+
+    [[nodiscard]]
+    std::string_view view() const {
+        return ptr->flat();
+    }
+    [[nodiscard]]
+    rt::StringPtr get() const {
+        return ptr;
+    }
+
+    bool operator==(IStr const& other) const { return ptr == other.ptr; }
+    bool operator==(std::string_view other) const { return view() == other; }
+
+  private:
+    rt::StringPtr ptr;
+};
+
+} // namespace intern
@@ -1,63 +1,72 @@
-#include <cmath>
-#include <optional>
-#include <print>
-#include <unordered_set>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstdlib>
+#include <iterator>
 
 #include "lexer.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using impl::TokenList;
 using std::format;
-using std::holds_alternative;
 using std::string;
-using std::unordered_set;
-
-// Note: Order matters. Go from longer toks to shorter,
-// e.g. making sure that /= is before /
-using AllStrTokens =
-    TokenList<Equals, NotEquals, LessOrEq, GreaterOrEq, And, Class, Else, False,
-              For, Fun, If, Nil, Or, Print, Return, Super, This, True, Var,
-              While, LeftParen, RightParen, LeftBrace, RightBrace, Star, Dot,
-              Comma, Minus, Plus, Semicol, Assign, Bang, Less, Greater, Slash>;
-
-double NumberLiteral::parse_float(std::string const& str) {
-    std::string inner_str = str;
-    int32_t dot_digit = 0;
-    // Trim trailing 0s, if there's '.'
-    if (inner_str.contains('.')) {
-        for (auto it = str.end() - 1; it >= str.begin(); --it) {
-            if (*it == '0') {
-                // Remove 0 from the end
-                inner_str.pop_back();
-                --dot_digit;
-            } else {
-                // Stop as soon as we see non-0
-                break;
-            }
-        }
-        // If after trimming the last thing is dot, we kick out the dot too
-        if (inner_str.back() == '.') {
-            // reset it
-            dot_digit = 0;
-            inner_str.pop_back();
-        }
+using std::string_view;
+
+namespace {
+// Powers of ten a double holds exactly
+constexpr double EXACT_POW10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+constexpr uint64_t MAX_EXACT_INT = uint64_t{1} << 53;
+
+// Skips digits, accumulating them into `digits`. Only meaningful for up to
+// 19 digits, past that it wraps around.
+const char* scan_digits(const char* p, const char* const end,
+                        uint64_t& digits) {
+    while (p < end && impl::is_digit(*p)) {
+        digits = digits * 10 + static_cast<uint64_t>(*p - '0');
+        ++p;
     }
+    return p;
+}
 
-    double output = 0.0;
-    for (int32_t i = 0; i < inner_str.size(); ++i) {
-        if (inner_str[i] == '.') {
-            // Note "+" here, not assignment
-            // That's because trailing 0 deletion affects this
-            dot_digit += i;
-        } else {
-            output *= 10.0;
-            output += static_cast<double>(inner_str[i] - '0');
-        }
+// `digits` are all of the literal's digits, `frac_digits` of them after
+// the dot
+double number_value(const std::string_view literal, const uint64_t digits,
+                    const size_t frac_digits) {
+    const size_t num_digits = literal.size() - (frac_digits > 0 ? 1 : 0);
+    // Clinger's fast path: the digits and the power of ten are both exact,
+    // so the one division is correctly rounded
+    if (num_digits <= 19 && digits <= MAX_EXACT_INT &&
+        frac_digits < std::size(EXACT_POW10)) {
+        return static_cast<double>(digits) / EXACT_POW10[frac_digits];
     }
-    if (dot_digit != 0) {
-        output /= static_cast<double>(std::pow(10, dot_digit));
+    double value = 0.0;
+    const auto [end, ec] = std::from_chars(
+        literal.data(), literal.data() + literal.size(), value);
+    if (ec == std::errc::result_out_of_range) {
+        // from_chars leaves the value alone, strtod gives inf or rounds
+        // towards 0
+        return std::strtod(string(literal).c_str(), nullptr);
     }
+    return value;
+}
+} // namespace
 
-    return output;
+double NumberLiteral::parse_float(const std::string_view str) {
+    const char* const end = str.data() + str.size();
+    uint64_t digits = 0;
+    const char* p = scan_digits(str.data(), end, digits);
+    size_t frac_digits = 0;
+    if (p != end) {
+        // Past the dot
+        frac_digits = scan_digits(p + 1, end, digits) - (p + 1);
+    }
+    return number_value(str, digits, frac_digits);
 }
 
 std::expected<TokenVec, std::string> lift(FaultyTokenVec const& faulty_tokens) {
@@ -73,189 +82,383 @@ std::expected<TokenVec, std::string> lift(FaultyTokenVec const& faulty_tokens) {
     return out_vec;
 }
 
-void print_token_variant(const TokenVariant& tok) {
-    std::visit(
-        [](const auto& token) {
-            std::println("{}", impl::stringify_token(token));
-        },
-        tok);
+void print_token_variant(const TokenVariant& tok, sink::Sink& out) {
+    out.append([&tok](string& buffer) {
+        std::visit(
+            [&buffer](const auto& token) {
+                impl::append_token(buffer, token);
+            },
+            tok);
+        buffer += '\n';
+    });
 }
 
-constexpr bool DEBUG_LOG_LEXER = false;
-static const unordered_set<char> ignored_chars = {' ', '\t', '\r'};
-
-static const auto dbg = [](auto const& text) {
-    if constexpr (DEBUG_LOG_LEXER) {
-        println("{}", text);
-    }
+namespace {
+// What a byte can start, drives the dispatch in lex()
+enum class ECharClass : uint8_t {
+    Invalid,
+    // ' ', '\t', '\r'
+    Blank,
+    Newline,
+    // Ident or keyword
+    Alpha,
+    Digit,
+    Quote,
+    // Division or a comment
+    Slash,
+    // Always a one-char token
+    Punct,
+    // One-char token, or a two-char one if followed by '='
+    PunctOrEq,
 };
 
-// TODO if they have identical forms - just move things to enum
-struct ParsedIdent {
-    string value;
+using MakeToken = TokenVariant (*)();
+template <StrToken T> TokenVariant make_token() { return T(); }
 
-    ParsedIdent(const char c) { value = c; }
-};
-struct ParsedString {
-    string value;
+struct CharTables {
+    std::array<ECharClass, 256> classes{};
+    // Chars that can continue an ident: letters, digits and '_'
+    std::array<bool, 256> ident_tail{};
+    std::array<MakeToken, 256> single{};
+    // For PunctOrEq, the token when followed by '='
+    std::array<MakeToken, 256> with_eq{};
 };
-struct ParsedNum {
-    string value;
 
-    ParsedNum(const char digit_char) { value = digit_char; }
+constexpr size_t idx(const char c) { return static_cast<unsigned char>(c); }
+
+template <StrToken... Ts>
+constexpr void add_puncts(CharTables& tables, TokenList<Ts...>) {
+    ((tables.classes[idx(Ts::LEXEME[0])] = ECharClass::Punct,
+      tables.single[idx(Ts::LEXEME[0])] = &make_token<Ts>),
+     ...);
+}
+
+template <StrToken One, StrToken Two>
+constexpr void add_punct_or_eq(CharTables& tables) {
+    static_assert(One::LEXEME.size() == 1 && Two::LEXEME.size() == 2);
+    static_assert(Two::LEXEME[0] == One::LEXEME[0] && Two::LEXEME[1] == '=');
+    const size_t c = idx(One::LEXEME[0]);
+    tables.classes[c] = ECharClass::PunctOrEq;
+    tables.single[c] = &make_token<One>;
+    tables.with_eq[c] = &make_token<Two>;
+}
+
+constexpr CharTables CHAR_TABLES = [] {
+    CharTables tables;
+    for (char c = 'a'; c <= 'z'; ++c) {
+        tables.classes[idx(c)] = ECharClass::Alpha;
+        tables.ident_tail[idx(c)] = true;
+    }
+    for (char c = 'A'; c <= 'Z'; ++c) {
+        tables.classes[idx(c)] = ECharClass::Alpha;
+        tables.ident_tail[idx(c)] = true;
+    }
+    tables.classes[idx('_')] = ECharClass::Alpha;
+    tables.ident_tail[idx('_')] = true;
+    for (char c = '0'; c <= '9'; ++c) {
+        tables.classes[idx(c)] = ECharClass::Digit;
+        tables.ident_tail[idx(c)] = true;
+    }
+
+    tables.classes[idx(' ')] = ECharClass::Blank;
+    tables.classes[idx('\t')] = ECharClass::Blank;
+    tables.classes[idx('\r')] = ECharClass::Blank;
+    tables.classes[idx('\n')] = ECharClass::Newline;
+    tables.classes[idx('"')] = ECharClass::Quote;
+    tables.classes[idx('/')] = ECharClass::Slash;
+
+    add_puncts(tables, TokenList<LeftParen, RightParen, LeftBrace, RightBrace,
+                                 Star, Dot, Comma, Minus, Plus, Semicol>());
+    add_punct_or_eq<Assign, Equals>(tables);
+    add_punct_or_eq<Bang, NotEquals>(tables);
+    add_punct_or_eq<Less, LessOrEq>(tables);
+    add_punct_or_eq<Greater, GreaterOrEq>(tables);
+    return tables;
+}();
+
+// Keywords are found with a perfect hash over the first and last char and
+// the length. The constants were brute-forced, the static_assert below
+// catches a collision if a keyword gets added.
+using Keywords = TokenList<And, Class, Else, False, For, Fun, If, Nil, Or,
+                           Print, Return, Super, This, True, Var, While>;
+constexpr size_t KEYWORD_TABLE_SIZE = 32;
+
+constexpr size_t keyword_hash(const string_view word) {
+    return (idx(word.front()) + idx(word.back()) * 5 + word.size()) %
+           KEYWORD_TABLE_SIZE;
+}
+
+struct KeywordEntry {
+    string_view lexeme;
+    MakeToken make = nullptr;
 };
 
-struct LexerState {
-    size_t line_num = 1;
-    std::variant<ParsedString, ParsedNum, ParsedIdent, std::monostate> parsed;
+template <StrToken... Ts>
+constexpr auto make_keyword_table(TokenList<Ts...>) {
+    std::array<KeywordEntry, KEYWORD_TABLE_SIZE> table{};
+    ((table[keyword_hash(Ts::LEXEME)] = KeywordEntry{Ts::LEXEME, &make_token<Ts>}),
+     ...);
+    return table;
+}
+constexpr auto KEYWORD_TABLE = make_keyword_table(Keywords());
+
+template <StrToken... Ts>
+constexpr bool keyword_hash_is_perfect(TokenList<Ts...>) {
+    return ((KEYWORD_TABLE[keyword_hash(Ts::LEXEME)].lexeme == Ts::LEXEME) &&
+            ...);
+}
+static_assert(keyword_hash_is_perfect(Keywords()),
+              "Keyword hash collision, pick new constants");
+
+// `word` must be non-empty
+TokenVariant ident_or_keyword(const string_view word) {
+    KeywordEntry const& entry = KEYWORD_TABLE[keyword_hash(word)];
+    if (entry.lexeme == word) {
+        return entry.make();
+    }
+    return Ident(word);
+}
+
+// Scanning loops over runs of bytes. With SSE2 they test 16 bytes at a time,
+// the scalar loop then handles the tail (or everything, without SSE2).
+
+#if defined(__SSE2__)
+inline __m128i load16(const char* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+// Bit i is set if byte i of `chunk` equals `c`
+inline uint32_t match_mask(const __m128i chunk, const char c) {
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(c))));
+}
+#endif
+
+inline bool is_blank(const char c) {
+    return CHAR_TABLES.classes[idx(c)] == ECharClass::Blank;
+}
+
+// First non-blank char in [p, end), or end
+const char* skip_blanks(const char* p, const char* const end) {
+#if defined(__SSE2__)
+    while (end - p >= 16) {
+        const __m128i chunk = load16(p);
+        const uint32_t blanks = match_mask(chunk, ' ') |
+                                match_mask(chunk, '\t') |
+                                match_mask(chunk, '\r');
+        if (blanks != 0xFFFF) {
+            return p + std::countr_one(blanks);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && is_blank(*p)) {
+        ++p;
+    }
+    return p;
+}
 
-    LexerState() { parsed = std::monostate{}; }
-    void reset() { parsed = std::monostate{}; }
-    bool is_empty() const {
-        return holds_alternative<std::monostate>(this->parsed);
+// First '\n' in [p, end), or end
+const char* find_newline(const char* p, const char* const end) {
+#if defined(__SSE2__)
+    while (end - p >= 16) {
+        const uint32_t newlines = match_mask(load16(p), '\n');
+        if (newlines != 0) {
+            return p + std::countr_zero(newlines);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '\n') {
+        ++p;
     }
+    return p;
+}
+
+struct StringScan {
+    // The closing quote, or end if unterminated
+    const char* close;
+    size_t newlines = 0;
 };
 
+// String contents starting at `p`, i.e. after the opening quote
+StringScan scan_string(const char* p, const char* const end) {
+    StringScan scan{end};
+#if defined(__SSE2__)
+    while (end - p >= 16) {
+        const __m128i chunk = load16(p);
+        const uint32_t quotes = match_mask(chunk, '"');
+        uint32_t newlines = match_mask(chunk, '\n');
+        if (quotes != 0) {
+            // Only count newlines before the closing quote
+            newlines &= (quotes & -quotes) - 1;
+        }
+        scan.newlines += std::popcount(newlines);
+        if (quotes != 0) {
+            scan.close = p + std::countr_zero(quotes);
+            return scan;
+        }
+        p += 16;
+    }
+#endif
+    for (; p < end; ++p) {
+        if (*p == '"') {
+            scan.close = p;
+            return scan;
+        }
+        if (*p == '\n') {
+            scan.newlines += 1;
+        }
+    }
+    return scan;
+}
+} // namespace
+
 bool impl::is_ident(const char& c) noexcept {
-    return (c == '_') || ((c >= 'a') && (c <= 'z')) ||
-           ((c >= 'A') && (c <= 'Z'));
+    return CHAR_TABLES.classes[idx(c)] == ECharClass::Alpha;
+}
+bool impl::is_digit(const char& c) noexcept {
+    return CHAR_TABLES.classes[idx(c)] == ECharClass::Digit;
 }
-bool impl::is_digit(const char& c) noexcept { return c >= '0' && c <= '9'; }
 
-// TODO lookeahead parsing?
-[[nodiscard]]
-FaultyTokenVec lex(const string& file_contents, size_t& out_num_errs) {
-    TokenVariant token;
-    FaultyTokenVec tokens;
-    // Keeping track for print errors
-    LexerState state;
-
-    using impl::is_digit;
-    using impl::is_ident;
-
-    auto it = file_contents.begin();
-    while (it != file_contents.end()) {
-        const char& c = *it;
-        dbg(format("Checking {}", c));
-
-        if (holds_alternative<ParsedIdent>(state.parsed)) {
-            ParsedIdent& ident = std::get<ParsedIdent>(state.parsed);
-            // Could be a digit, cause it's not the starting char
-            // of an ident
-            if (is_ident(c) || is_digit(c)) {
-                ident.value += c;
-                ++it;
-                continue;
-            } else {
-                // if (impl::match_str_toks(ReservedKeywords(), tokens,
-                // file_contents)) {
-                //
-                // } else {
-                tokens.push_back(Ident(ident.value));
-                // }
-                state.reset();
+std::unexpected<string> Lexer::error(string err_msg) {
+    num_errs += 1;
+    return std::unexpected(std::move(err_msg));
+}
+
+std::expected<TokenVariant, string> Lexer::next() {
+    auto tok = scan();
+    if (tok.has_value()) {
+        const Span span = last_span();
+        std::visit([span](auto& tok) { tok.span = span; }, tok.value());
+    }
+    return tok;
+}
+
+std::expected<TokenVariant, string> Lexer::scan() {
+    while (p < end) {
+        tok_start = p;
+        tok_line = line_num;
+        const char c = *p;
+        switch (CHAR_TABLES.classes[idx(c)]) {
+        case ECharClass::Blank:
+            p = skip_blanks(p + 1, end);
+            break;
+        case ECharClass::Newline:
+            ++p;
+            line_num += 1;
+            break;
+        case ECharClass::Alpha: {
+            const char* start = p++;
+            while (p < end && CHAR_TABLES.ident_tail[idx(*p)]) {
+                ++p;
             }
+            return ident_or_keyword(string_view(start, p - start));
         }
-        if (holds_alternative<ParsedNum>(state.parsed)) {
-            ParsedNum& numState = std::get<ParsedNum>(state.parsed);
-            // Dot is only parsed as fractional sign if it's followed by a
-            // number
-            const bool next_char_is_number =
-                ((it + 1) < file_contents.end()) && is_digit(*(it + 1));
-            // ... and this is still a number
-            if (is_digit(c) || (c == '.' && next_char_is_number)) {
-                numState.value += c;
-                ++it;
-                continue;
-            } else {
-                // It's not a number, not a dot either. We just stop parsing a
-                // number and fall thru
-                tokens.push_back(NumberLiteral(numState.value));
-                state.reset();
+        case ECharClass::Digit: {
+            // The value is worked out while scanning, see number_value()
+            const char* start = p;
+            uint64_t digits = 0;
+            p = scan_digits(p, end, digits);
+            size_t frac_digits = 0;
+            // Dot is only the fractional part if it's followed by a digit
+            if (end - p >= 2 && *p == '.' && impl::is_digit(p[1])) {
+                const char* frac_start = p + 1;
+                p = scan_digits(frac_start, end, digits);
+                frac_digits = p - frac_start;
             }
+            const string_view literal(start, p - start);
+            return NumberLiteral(literal,
+                                 number_value(literal, digits, frac_digits),
+                                 Span{});
         }
-        // Are we encountering a number while NOT parsing number or anything
-        // else?
-        if (is_digit(c) && state.is_empty()) {
-            state.parsed = ParsedNum(c);
-            ++it;
-            continue;
-        }
-        // Check for string start/end
-        if (c == '"') {
-            // We are ending a string literal?
-            if (holds_alternative<ParsedString>(state.parsed)) {
-                tokens.emplace_back(StringLiteral(
-                    std::move(std::get<ParsedString>(state.parsed).value)));
-                // reset parsed
-                state.reset();
-            } else {
-                // We are starting a string literal
-                state.parsed.emplace<ParsedString>();
-            }
-            ++it;
-            continue;
-        }
-        // Check for ongoing string
-        if (holds_alternative<ParsedString>(state.parsed)) {
-            std::get<ParsedString>(state.parsed).value += c;
-            ++it;
+        case ECharClass::Quote: {
+            const char* start = p + 1;
+            const StringScan scan = scan_string(start, end);
             // Make sure we are still tracking line num
-            if (c == '\n') {
-                state.line_num += 1;
+            line_num += scan.newlines;
+            if (scan.close == end) {
+                // Forgot to terminate string
+                p = end;
+                return error(
+                    format("[line {}] Error: Unterminated string.", line_num));
             }
-            continue;
+            p = scan.close + 1;
+            return StringLiteral(string_view(start, scan.close - start));
         }
-        // Check for comment, after string
-        if (c == '/' && ((it + 1) < file_contents.end()) && *(it + 1) == '/') {
-            while (it != file_contents.end() && *it != '\n') {
-                ++it;
+        case ECharClass::Slash:
+            if (end - p >= 2 && p[1] == '/') {
+                // Leave the '\n' itself to the Newline case
+                p = find_newline(p + 2, end);
+                break;
             }
-            // increment one last time to drop us to the next line
-            if (it != file_contents.end()) {
-                ++it;
-                state.line_num += 1;
+            ++p;
+            return Slash();
+        case ECharClass::Punct:
+            ++p;
+            return CHAR_TABLES.single[idx(c)]();
+        case ECharClass::PunctOrEq:
+            if (end - p >= 2 && p[1] == '=') {
+                p += 2;
+                return CHAR_TABLES.with_eq[idx(c)]();
             }
-            continue;
-        }
-        if (impl::match_str_toks(AllStrTokens(), tokens, it, file_contents)) {
-            continue;
-        }
-        if (c == '\n') {
-            state.line_num += 1;
-        } else if (ignored_chars.contains(c)) {
-            // Do nothing if we run into ignored characters
-        } else if (is_ident(c)) {
-            state.parsed = ParsedIdent(c);
-        } else {
-            // Failure case. Add as a string.
-            const string err_msg = format(
-                "[line {}] Error: Unexpected character: {}", state.line_num, c);
-            tokens.emplace_back(std::unexpected(err_msg));
-            out_num_errs += 1;
+            ++p;
+            return CHAR_TABLES.single[idx(c)]();
+        case ECharClass::Invalid:
+            ++p;
+            return error(format("[line {}] Error: Unexpected character: {}",
+                                line_num, c));
         }
+    }
+
+    tok_start = p;
+    tok_line = line_num;
+    return EndOfFile();
+}
+
+[[nodiscard]]
+FaultyTokenVec lex(const string_view file_contents, size_t& out_num_errs) {
+    FaultyTokenVec tokens;
+    Lexer lexer(file_contents);
+    do {
+        tokens.push_back(lexer.next());
+    } while (!tokens.back().has_value() ||
+             !std::holds_alternative<EndOfFile>(tokens.back().value()));
 
-        ++it;
+    out_num_errs += lexer.num_errors();
+    return tokens;
+}
+
+TokenVariant const& TokenStream::pull_until(const size_t pos) {
+    while (pulled <= pos) {
+        // Can't read past EndOfFile
+        assert(!reached_eof());
+        pull();
     }
+    return window[pos % LOOKAHEAD];
+}
 
-    // Forgot to terminate string
-    if (holds_alternative<ParsedString>(state.parsed)) {
-        const string err_msg =
-            format("[line {}] Error: Unterminated string.", state.line_num);
-        tokens.emplace_back(std::unexpected(err_msg));
-        out_num_errs += 1;
-        state.reset();
-    } else if (holds_alternative<ParsedNum>(state.parsed)) {
-        // Not actually an error, just gotta dump the number
-        tokens.push_back(
-            NumberLiteral(std::get<ParsedNum>(state.parsed).value));
-        state.reset();
-    } else if (holds_alternative<ParsedIdent>(state.parsed)) {
-        tokens.push_back(Ident(std::get<ParsedIdent>(state.parsed).value));
-        state.reset();
+bool TokenStream::is_past_end_slow(const size_t pos) {
+    while (pulled <= pos && !reached_eof()) {
+        pull();
     }
+    return reached_eof() && pos > eof_pos;
+}
 
-    tokens.emplace_back(EndOfFile());
+void TokenStream::drain() {
+    while (!reached_eof()) {
+        pull();
+    }
+}
 
-    return tokens;
-}
\ No newline at end of file
+void TokenStream::pull() {
+    auto tok = lexer.next();
+    while (!tok.has_value()) {
+        lex_errors.push_back(std::move(tok.error()));
+        tok = lexer.next();
+    }
+    if (std::holds_alternative<EndOfFile>(*tok)) {
+        eof_pos = pulled;
+    }
+    window[pulled % LOOKAHEAD] = std::move(*tok);
+    pulled += 1;
+}
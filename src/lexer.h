@@ -7,12 +7,19 @@
  **/
 
 #include <assert.h>
+#include <cstdint>
 #include <expected>
 #include <format>
+#include <iterator>
 #include <string>
+#include <type_traits>
 #include <variant>
 #include <vector>
 
+#include "runtime.h"
+#include "sink.h"
+#include "source.h"
+
 // "Base" concept for a token, i.e. smth that has a kind
 // e.g. "STAR", "DOT" or "LEFT_PAREN"
 template <typename T>
@@ -34,6 +41,7 @@ concept StrToken = Token<T> && requires {
     struct name_ {                                                             \
         static constexpr std::string_view LEXEME = lexeme;                     \
         static constexpr std::string_view KIND = #kind;                        \
+        Span span;                                                             \
     };                                                                         \
     static_assert(StrToken<name_>);
 
@@ -79,49 +87,58 @@ TOKEN(While, "while", WHILE);
 // EOF is a special token we nonetheless use
 struct EndOfFile {
     static constexpr std::string_view KIND = "EOF";
+    // Empty, at the end of the source
+    Span span;
 };
 // Keeping here for consistency and to avoid surprises later
 static_assert(Token<EndOfFile>);
 
+// Every token has the Span it was lexed from, zero for tokens that weren't
+// lexed from a source. Tokens below also carry a slice of the source buffer
+// rather than an owned copy, so the buffer has to outlive them.
+
 // String literal
 struct StringLiteral {
     static constexpr std::string_view KIND = "STRING";
-    std::string literal;
+    // Contents, without the quotes
+    std::string_view literal;
+    // Including the quotes
+    Span span;
 
-    StringLiteral(std::string literal) : literal(std::move(literal)) {}
+    StringLiteral(std::string_view literal, Span span = {})
+        : literal(literal), span(span) {}
 };
 static_assert(Token<StringLiteral>);
 
 // Number literal
 struct NumberLiteral {
     static constexpr std::string_view KIND = "NUMBER";
-    std::string literal;
+    std::string_view literal;
     double value;
+    Span span;
 
-    NumberLiteral(std::string literal) {
-        this->literal = std::move(literal);
-        // ensure it's a valid format
-        size_t num_dots = 0;
-        for (const char& c : this->literal) {
-            if (c == '.') {
-                ++num_dots;
-            }
-        }
-        assert(num_dots <= 1);
+    NumberLiteral(std::string_view literal, Span span = {})
+        : literal(literal), value(parse_float(literal)), span(span) {}
 
-        this->value = parse_float(this->literal);
-    }
+    // Already parsed, by the lexer or when rebuilt from a TokenBuffer
+    NumberLiteral(std::string_view literal, const double value, Span span)
+        : literal(literal), value(value), span(span) {}
 
-    static double parse_float(std::string const& str);
+    // Correctly rounded, like strtod. `str` is what the lexer accepts as a
+    // number: digits, then optionally a dot and more digits.
+    [[nodiscard]]
+    static double parse_float(std::string_view str);
 };
 static_assert(Token<NumberLiteral>);
 
 // Identifier (e.g. reserved keywords)
 struct Ident {
     static constexpr std::string_view KIND = "IDENTIFIER";
-    std::string literal;
+    std::string_view literal;
+    Span span;
 
-    Ident(std::string literal) : literal(std::move(literal)) {}
+    Ident(std::string_view literal, Span span = {})
+        : literal(literal), span(span) {}
 };
 static_assert(Token<Ident>);
 
@@ -134,6 +151,27 @@ using TokenVariant =
                  For, Fun, If, Nil, Or, Print, Return, Super, This, True, Var,
                  While>;
 
+// Tag of a token, its index in TokenVariant
+using TokenKind = uint8_t;
+static_assert(std::variant_size_v<TokenVariant> <= 256);
+
+namespace impl {
+template <typename T, typename... Ts>
+constexpr TokenKind variant_index(std::variant<Ts...> const*) {
+    constexpr bool matches[] = {std::is_same_v<T, Ts>...};
+    for (TokenKind i = 0; i < sizeof...(Ts); ++i) {
+        if (matches[i]) {
+            return i;
+        }
+    }
+    throw "Not a TokenVariant alternative";
+}
+} // namespace impl
+
+template <Token T>
+constexpr TokenKind token_kind =
+    impl::variant_index<T>(static_cast<TokenVariant const*>(nullptr));
+
 // Ultimately, this is what lexer outputs.
 // Each entry is either a valid token, or a string with an error
 // (keeping it simple for now)
@@ -156,28 +194,34 @@ using std::vector;
 // hence the struct is 0-sized
 template <Token... Ts> struct TokenList {};
 
-template <Token T> inline string stringify_token(const T& token) {
-    return format("{} {} null", T::KIND, T::LEXEME);
+// What tokenize prints for a token, appended to `out` without a newline
+template <Token T> inline void append_token(string& out, const T& token) {
+    std::format_to(std::back_inserter(out), "{} {} null", T::KIND, T::LEXEME);
 }
-template <> inline string stringify_token(const EndOfFile& token) {
-    return format("{}  null", EndOfFile::KIND);
+template <> inline void append_token(string& out, const EndOfFile& token) {
+    std::format_to(std::back_inserter(out), "{}  null", EndOfFile::KIND);
 }
-template <> inline string stringify_token(const StringLiteral& token) {
-    return format("{} \"{}\" {}", StringLiteral::KIND, token.literal,
-                  token.literal);
+template <>
+inline void append_token(string& out, const StringLiteral& token) {
+    std::format_to(std::back_inserter(out), "{} \"{}\" {}",
+                   StringLiteral::KIND, token.literal, token.literal);
 }
-template <> inline string stringify_token(const NumberLiteral& token) {
-    const bool is_fract_part_meaningful =
-        (token.value - static_cast<double>(static_cast<int>(token.value))) >
-        0.0;
-    const string formatted_value = is_fract_part_meaningful
-                                       ? format("{}", token.value)
-                                       : format("{:.1f}", token.value);
-    return format("{} {} {}", NumberLiteral::KIND, token.literal,
-                  formatted_value);
+template <>
+inline void append_token(string& out, const NumberLiteral& token) {
+    std::format_to(std::back_inserter(out), "{} {} ", NumberLiteral::KIND,
+                   token.literal);
+    rt::append_number(out, token.value, rt::ENumberStyle::Literal);
 }
-template <> inline string stringify_token(const Ident& token) {
-    return format("{} {} null", Ident::KIND, token.literal);
+template <> inline void append_token(string& out, const Ident& token) {
+    std::format_to(std::back_inserter(out), "{} {} null", Ident::KIND,
+                   token.literal);
+}
+
+// Same, as a string of its own
+template <Token T> inline string stringify_token(const T& token) {
+    string out;
+    append_token(out, token);
+    return out;
 }
 
 [[nodiscard]]
@@ -185,46 +229,168 @@ bool is_ident(const char& c) noexcept;
 [[nodiscard]]
 bool is_digit(const char& c) noexcept;
 
-// If the token matches TTok's lexeme - we advance the it iterator accordingly,
-// and add the token to tokens
-template <StrToken TTok>
+} // namespace impl
+
+// One line per token, into sink::out() unless told otherwise
+void print_token_variant(const TokenVariant& tok,
+                         sink::Sink& out = sink::out());
+
+// Pull-based lexer, producing one token (or error) per next() call.
+// Dispatches on a per-byte class table, keywords go through a perfect hash,
+// and blanks, comments and string contents are scanned 16 bytes at a time
+// where SSE2 is available.
+class Lexer {
+  public:
+    explicit Lexer(std::string_view source)
+        : p(source.data()), end(source.data() + source.size()),
+          begin(source.data()) {}
+    // For lexing part of a bigger source: `source` has to start at the
+    // beginning of line `first_line`, `first_offset` bytes into it
+    Lexer(std::string_view source, const size_t first_line,
+          const size_t first_offset)
+        : p(source.data()), end(source.data() + source.size()),
+          begin(source.data() - first_offset), line_num(first_line),
+          tok_line(first_line) {}
+
+    // Keeps returning EndOfFile once the source is exhausted
+    [[nodiscard]]
+    std::expected<TokenVariant, std::string> next();
+
+    [[nodiscard]]
+    size_t num_errors() const {
+        return num_errs;
+    }
+
+    // Source slice of the last token next() returned, including the quotes
+    // for strings. Empty for EndOfFile.
+    [[nodiscard]]
+    std::string_view last_lexeme() const {
+        return std::string_view(tok_start, p - tok_start);
+    }
+    // Same, as the token's span
+    [[nodiscard]]
+    Span last_span() const {
+        return Span{static_cast<uint32_t>(tok_start - begin),
+                    static_cast<uint32_t>(p - tok_start)};
+    }
+    // Line the last token starts on
+    [[nodiscard]]
+    size_t last_line() const {
+        return tok_line;
+    }
+
+  private:
+    const char* p;
+    const char* end;
+    // Where offset 0 is, before `p` when lexing part of a source
+    const char* begin;
+    size_t line_num = 1;
+    size_t num_errs = 0;
+    const char* tok_start = p;
+    size_t tok_line = 1;
+
+    // next() without the span
+    std::expected<TokenVariant, std::string> scan();
+    std::unexpected<std::string> error(std::string err_msg);
+};
+
+// Lex the whole source up front, up to and including EndOfFile
 [[nodiscard]]
-inline bool match_str_tok(FaultyTokenVec& tokens, string::const_iterator& it,
-                          const size_t remaining_len) {
-    if (TTok::LEXEME.starts_with(*it)) {
-        constexpr size_t tok_len = TTok::LEXEME.size();
-        if (remaining_len >= tok_len) {
-            const auto substr = string(it, it + tok_len);
-            // Is the char following this tok NOT a num, underscore or letter?
-            // If it was, that means we're inside an ident instead
-            const bool is_not_ident = (remaining_len == tok_len)
-            || tok_len == 1
-            || (!is_ident(*(it + tok_len)) && !is_digit(*(it + tok_len)));
-            if (substr == TTok::LEXEME && is_not_ident) {
-                tokens.push_back(TTok());
-                it += tok_len;
-                return true;
+FaultyTokenVec lex(std::string_view file_contents, size_t& out_num_errs);
+
+// Lexes on demand, for parsing without materializing every token.
+// Only the last LOOKAHEAD tokens are kept around, lex errors are set aside
+// in errors() and skipped over.
+// Iterators mimic the TokenVec ones the parser uses, but only the newest
+// positions can be dereferenced.
+class TokenStream {
+  public:
+    static constexpr size_t LOOKAHEAD = 4;
+
+    explicit TokenStream(std::string_view source) : lexer(source) {}
+    TokenStream(TokenStream const&) = delete;
+    TokenStream& operator=(TokenStream const&) = delete;
+
+    class Iterator {
+      public:
+        Iterator(TokenStream* stream, const size_t pos)
+            : stream(stream), pos(pos) {}
+
+        TokenVariant const& operator*() const { return stream->at(pos); }
+        Iterator& operator+=(const size_t n) {
+            pos += n;
+            return *this;
+        }
+        Iterator operator+(const size_t n) const {
+            return Iterator(stream, pos + n);
+        }
+        // Against end(), this lexes ahead to find out
+        bool operator<(Iterator const& other) const {
+            if (other.pos == END_POS) {
+                return !stream->is_past_end(pos);
             }
+            return pos < other.pos;
+        }
+        bool operator>=(Iterator const& other) const { return !(*this < other); }
+        bool operator==(Iterator const& other) const {
+            return !(*this < other) && !(other < *this);
         }
-    }
 
-    return false;
-}
+      private:
+        static constexpr size_t END_POS = SIZE_MAX;
+        friend class TokenStream;
 
-// Given a list of toks - call match_str_tok() until one of them yields true
-// NOTE: We are assuming that the ones that ret false do NOT modify iterator or
-// TokenVec
-template <StrToken... Ts>
-[[nodiscard]]
-constexpr bool match_str_toks(TokenList<Ts...> tlist, FaultyTokenVec& tokens,
-                              string::const_iterator& it, string const& str) {
-    const size_t remaining_len = std::distance(it, str.end());
-    return (match_str_tok<Ts>(tokens, it, remaining_len) || ...);
-}
+        TokenStream* stream;
+        // Index of the token in the whole stream
+        size_t pos;
+    };
 
-} // namespace impl
+    [[nodiscard]]
+    Iterator begin() {
+        return Iterator(this, 0);
+    }
+    [[nodiscard]]
+    Iterator end() {
+        return Iterator(this, Iterator::END_POS);
+    }
 
-void print_token_variant(const TokenVariant& tok);
+    // Lex the rest of the source, collecting any remaining errors
+    void drain();
 
-[[nodiscard]]
-FaultyTokenVec lex(const std::string& file_contents, size_t& out_num_errs);
+    [[nodiscard]]
+    std::vector<std::string> const& errors() const {
+        return lex_errors;
+    }
+
+  private:
+    Lexer lexer;
+    // Ring buffer, token `pos` lives at window[pos % LOOKAHEAD]
+    TokenVariant window[LOOKAHEAD];
+    // Number of tokens lexed so far
+    size_t pulled = 0;
+    size_t eof_pos = SIZE_MAX;
+    std::vector<std::string> lex_errors;
+
+    [[nodiscard]]
+    bool reached_eof() const {
+        return eof_pos != SIZE_MAX;
+    }
+    // Fast paths inline, the parser asks for the same few tokens a lot
+    TokenVariant const& at(const size_t pos) {
+        if (pos < pulled) {
+            // Older tokens have been dropped already
+            assert(pos + LOOKAHEAD >= pulled);
+            return window[pos % LOOKAHEAD];
+        }
+        return pull_until(pos);
+    }
+    bool is_past_end(const size_t pos) {
+        if (pos < pulled) {
+            return false;
+        }
+        return is_past_end_slow(pos);
+    }
+    TokenVariant const& pull_until(size_t pos);
+    bool is_past_end_slow(size_t pos);
+    void pull();
+};
@@ -1,109 +1,437 @@
+#include <charconv>
+#include <csignal>
+#include <cstdlib>
 #include <fstream>
-#include <iostream>
-#include <print>
-#include <sstream>
+#include <memory>
+#include <new>
+#include <optional>
 #include <string>
+#include <unistd.h>
 
-#include "eval.h"
+#include "ast_file.h"
+#include "cache.h"
+#include "driver.h"
 #include "lexer.h"
+#include "parallel_lexer.h"
 #include "parser.h"
-#include "runtime.h"
+#include "server.h"
+#include "sink.h"
+#include "source.h"
+#include "stats.h"
 
-using std::println;
+using driver::EBackend;
 using std::string;
+using std::string_view;
 
-string read_file_contents(const string& filename);
+// Everything after the command: a filename plus optional --flags
+struct CliArgs {
+    // For batch, the manifest or directory
+    string filename;
+    // compile only, where the AST file goes
+    string out_path;
+    driver::Options options;
+    // batch, serve and tokenize only, 0 is one thread per core.
+    // Unset, tokenize streams on one thread.
+    std::optional<size_t> jobs;
+    // serve only, empty serves stdin
+    string socket_path;
+    // evaluate, batch and serve only: --cache, or --cache-dir to also
+    // persist it (vm backend only)
+    bool use_cache = false;
+    string cache_dir;
+};
 
-constexpr int INTERP_ERR_RETURN_CODE = 65;
-constexpr int RUNTIME_ERR_RETURN_CODE = 70;
+// Flags and the filename can come in any order.
+// Prints the problem and returns nullopt on bad input.
+std::optional<CliArgs> parse_cli_args(const int argc, char* argv[]);
+
+// Evaluate every file listed by args.filename, print results in input order
+int run_batch(CliArgs const& args);
+
+// Parse args.filename and write it to args.out_path as an AST file
+int run_compile(CliArgs const& args, std::string_view source);
+
+// Answer requests on stdin, or on args.socket_path until SIGINT/SIGTERM
+int run_serve(CliArgs const& args);
+
+// The cache asked for by args, if any
+std::unique_ptr<cache::Cache> make_cache(CliArgs const& args);
+
+// Prints the stats line on the way out of main, whichever way that is
+struct StatsReport {
+    bool enabled;
+    ~StatsReport() {
+        if (enabled) {
+            sink::err().println("{}", stats::summary());
+        }
+    }
+};
+
+#ifdef INTERP_STATS
+// Count every heap allocation for --stats
+void* operator new(const size_t size) {
+    stats::record_alloc(size);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+#endif
 
 int main(const int argc, char* argv[]) {
-    // Disable output buffering
-    std::cout << std::unitbuf;
-    std::cerr << std::unitbuf;
+    // All output goes through sink::out() and sink::err(): stdout is
+    // written in large blocks, and flushed before anything goes to stderr
 
     const string command = argv[1];
 
-    if (command == "tokenize" || command == "parse" || command == "evaluate") {
-        if (argc < 3) {
-            println(stderr, "Usage: ./your_program {} <filename>", command);
-            return 1;
-        }
-        string file_contents = read_file_contents(argv[2]);
-        size_t num_errors = 0;
-
-        const auto tokens = lex(file_contents, num_errors);
-        const bool is_tokenizing = command == "tokenize";
-        for (const auto& exp_tok : tokens) {
-            if (exp_tok.has_value()) {
-                if (is_tokenizing) {
-                    print_token_variant(*exp_tok);
-                }
+    if (command == "tokenize" || command == "parse" || command == "evaluate" ||
+        command == "run" || command == "batch" || command == "serve" ||
+        command == "compile") {
+        const auto args = parse_cli_args(argc, argv);
+        if (!args.has_value()) {
+            if (command == "batch") {
+                sink::err().println(
+                    "Usage: ./your_program batch <manifest|directory> "
+                    "[--jobs=N] [--backend=tree|vm|flat] [--opt] "
+                    "[--max-depth=N] [--stats] [--cache] "
+                    "[--cache-dir=DIR (vm only)]");
+            } else if (command == "compile") {
+                sink::err().println(
+                    "Usage: ./your_program compile <filename> <output> "
+                    "[--backend=tree|flat] [--opt] [--max-depth=N] "
+                    "[--stats]");
+            } else if (command == "run") {
+                sink::err().println(
+                    "Usage: ./your_program run <filename> "
+                    "[--backend=tree|vm] [--opt] [--max-depth=N] [--stats]");
+            } else if (command == "serve") {
+                sink::err().println(
+                    "Usage: ./your_program serve [--socket=PATH] "
+                    "[--jobs=N] [--backend=tree|vm|flat] [--opt] "
+                    "[--max-depth=N] [--stats] [--cache] "
+                    "[--cache-dir=DIR (vm only)]");
+            } else if (command == "tokenize") {
+                sink::err().println("Usage: ./your_program tokenize "
+                                    "<filename> [--stats] [--jobs=N]");
+            } else if (command == "parse") {
+                sink::err().println(
+                    "Usage: ./your_program parse <filename> [--opt] "
+                    "[--max-depth=N] [--stats]");
             } else {
-                println(stderr, "{}", exp_tok.error());
+                sink::err().println(
+                    "Usage: ./your_program evaluate <filename> "
+                    "[--backend=tree|vm|flat] [--opt] [--max-depth=N] "
+                    "[--stats] [--cache-dir=DIR (vm only)]");
             }
+            return 1;
+        }
+        const StatsReport report{args->options.stats};
+        if (command == "batch") {
+            return run_batch(*args);
+        }
+        if (command == "serve") {
+            return run_serve(*args);
         }
 
-        if (num_errors > 0) {
-            return INTERP_ERR_RETURN_CODE;
-        } else if (command == "tokenize") {
-            // We are done
-            return 0;
+        // Tokens point into the source, so it's kept for the whole run
+        auto source = [&] {
+            const stats::StageTimer timer(stats::EStage::Read);
+            return SourceBuffer::open(args->filename);
+        }();
+        if (!source.has_value()) {
+            sink::err().println("{}", source.error());
+            return 1;
         }
+        const string_view file_contents = source->view();
 
-        // Parsing
-        auto opt_token_vec = lift(tokens);
-        assert(opt_token_vec.has_value());
+        if (command == "tokenize" && args->jobs.has_value()) {
+            size_t num_errs = 0;
+            FaultyTokenVec tokens;
+            {
+                const stats::StageTimer timer(stats::EStage::Lex);
+                tokens = lex_parallel(file_contents, num_errs, *args->jobs);
+            }
+            stats::add_tokens(tokens.size() - num_errs);
+            for (const auto& exp_tok : tokens) {
+                if (!exp_tok.has_value()) {
+                    sink::err().println("{}", exp_tok.error());
+                    continue;
+                }
+                print_token_variant(*exp_tok);
+            }
+            return num_errs > 0 ? driver::INTERP_ERR_RETURN_CODE : 0;
+        }
+        if (command == "tokenize") {
+            // Lexing and printing are interleaved, so both count as lex
+            const stats::StageTimer timer(stats::EStage::Lex);
+            Lexer lexer(file_contents);
+            size_t num_tokens = 0;
+            while (true) {
+                const auto exp_tok = lexer.next();
+                if (!exp_tok.has_value()) {
+                    sink::err().println("{}", exp_tok.error());
+                    continue;
+                }
+                print_token_variant(*exp_tok);
+                num_tokens += 1;
+                if (std::holds_alternative<EndOfFile>(*exp_tok)) {
+                    break;
+                }
+            }
+            stats::add_tokens(num_tokens);
+            return lexer.num_errors() > 0 ? driver::INTERP_ERR_RETURN_CODE
+                                          : 0;
+        }
 
-        auto opt_parsed = parse(opt_token_vec.value());
-        if (!opt_parsed.has_value()) {
-            // Line 1 hardcoded, as we parse a single expression for now
-            println(stderr, "[line 1] Error at '{}': Expect expression.",
-                    opt_parsed.error());
-            return INTERP_ERR_RETURN_CODE;
+        if (command == "compile") {
+            return run_compile(*args, file_contents);
         }
-        auto parsed = std::move(opt_parsed.value());
 
         if (command == "parse") {
+            driver::Output output;
+            const auto parsed =
+                driver::parse(file_contents, args->options, output);
+            sink::err().write(output.err);
+            if (!parsed.has_value()) {
+                return output.exit_code;
+            }
             pprint::Visitor_PPrint pprinter;
-            parsed->accept(pprinter);
+            visit_expr(*parsed.value(), pprinter);
             // Just newline
-            println("");
+            sink::out().write("\n");
             return 0;
         }
 
         // Eval
         if (command == "evaluate") {
-            auto value = eval::evaluate(std::move(parsed));
-            if (value.has_value()) {
-                // TODO print value
-                rt::print_value(value.value());
-                return 0;
-            } else {
-                println(stderr, "{}\n[line 1]", value.error());
-                return RUNTIME_ERR_RETURN_CODE;
-            }
+            // Only worth it with a directory, for the next run to load
+            const auto cache = make_cache(*args);
+            driver::Session session;
+            session.cache = cache.get();
+            driver::evaluate(file_contents, args->options, session);
+            driver::Output const& output = session.output;
+            sink::out().write(output.out);
+            sink::err().write(output.err);
+            return output.exit_code;
+        }
+
+        if (command == "run") {
+            const driver::Output output =
+                driver::run(file_contents, args->options);
+            // What ran before an error is printed before it
+            sink::out().write(output.out);
+            sink::err().write(output.err);
+            return output.exit_code;
         }
 
     } else {
-        println(stderr, "Unknown command: {}", command);
+        sink::err().println("Unknown command: {}", command);
+        return 1;
+    }
+
+    return 0;
+}
+
+int run_batch(CliArgs const& args) {
+    const auto paths = driver::batch_inputs(args.filename);
+    if (!paths.has_value()) {
+        sink::err().println("{}", paths.error());
         return 1;
     }
 
+    const auto cache = make_cache(args);
+    const auto outputs = driver::evaluate_batch(
+        paths.value(), args.options, args.jobs.value_or(0), cache.get());
+    size_t num_failed = 0;
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        // Everything on stdout, so each file's errors stay next to it
+        sink::out().println("==> {} (exit {})", paths.value()[i],
+                            outputs[i].exit_code);
+        sink::out().write(outputs[i].out);
+        sink::out().write(outputs[i].err);
+        num_failed += outputs[i].exit_code != 0 ? 1 : 0;
+    }
+    sink::err().println("{} of {} files failed", num_failed, outputs.size());
+    if (cache != nullptr) {
+        sink::err().println("{}", cache::format_counters(cache->counters()));
+    }
+    return num_failed > 0 ? 1 : 0;
+}
+
+int run_compile(CliArgs const& args, const std::string_view source) {
+    driver::Output output;
+    const auto ast = driver::parse_arena(source, args.options, output);
+    sink::err().write(output.err);
+    if (!ast.has_value()) {
+        return output.exit_code;
+    }
+    const string bytes =
+        ast_file::serialize(ast.value(), LineIndex(source).line_starts());
+    std::ofstream out(args.out_path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    if (!out) {
+        sink::err().println("Could not write {}", args.out_path);
+        return 1;
+    }
     return 0;
 }
 
-[[nodiscard]]
-string read_file_contents(const string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        println(stderr, "Error reading file: {}", filename);
-        std::exit(1);
+// For the signal handler to stop it
+static server::SocketServer* running_server = nullptr;
+
+int run_serve(CliArgs const& args) {
+    const auto cache = make_cache(args);
+    // On the way out, however serving ended
+    const auto report_cache = [&cache] {
+        if (cache != nullptr) {
+            sink::err().println("{}",
+                                cache::format_counters(cache->counters()));
+        }
+    };
+    if (args.socket_path.empty()) {
+        const auto served = server::serve_fds(STDIN_FILENO, STDOUT_FILENO,
+                                              args.options, cache.get());
+        report_cache();
+        if (!served.has_value()) {
+            sink::err().println("{}", served.error());
+            return 1;
+        }
+        return 0;
     }
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    file.close();
+    server::SocketServer socket_server(args.options, args.jobs.value_or(0),
+                                       cache.get());
+    if (const auto listening = socket_server.listen(args.socket_path);
+        !listening.has_value()) {
+        sink::err().println("{}", listening.error());
+        return 1;
+    }
+    running_server = &socket_server;
+    const auto stop = [](int) { running_server->stop(); };
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+    sink::err().println("Listening on {}", args.socket_path);
+    socket_server.run();
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    running_server = nullptr;
+    report_cache();
+    return 0;
+}
 
-    return buffer.str();
+std::unique_ptr<cache::Cache> make_cache(CliArgs const& args) {
+    if (!args.use_cache) {
+        return nullptr;
+    }
+    return std::make_unique<cache::Cache>(args.cache_dir);
+}
+
+// Parse the N of a --flag=N
+static bool parse_size_flag(const string_view arg, const string_view flag,
+                            size_t& value) {
+    const string_view num = arg.substr(flag.size());
+    const char* num_end = num.data() + num.size();
+    const auto [end, ec] = std::from_chars(num.data(), num_end, value);
+    if (ec != std::errc() || end != num_end || num.empty()) {
+        sink::err().println("Invalid {}: {}",
+                            flag.substr(0, flag.size() - 1), num);
+        return false;
+    }
+    return true;
+}
+
+std::optional<CliArgs> parse_cli_args(const int argc, char* argv[]) {
+    constexpr string_view MAX_DEPTH_FLAG = "--max-depth=";
+    constexpr string_view JOBS_FLAG = "--jobs=";
+    constexpr string_view SOCKET_FLAG = "--socket=";
+    constexpr string_view CACHE_DIR_FLAG = "--cache-dir=";
+    const string_view command = argv[1];
+    const bool is_serve = command == "serve";
+    // tokenize never parses, parse always makes an Expr tree
+    const bool takes_parse_flags = command != "tokenize";
+    const bool takes_backend = takes_parse_flags && command != "parse";
+    const bool takes_jobs =
+        command == "batch" || command == "tokenize" || is_serve;
+    // An in-memory cache only pays off for many sources in one process
+    const bool takes_cache = command == "batch" || is_serve;
+    const bool takes_cache_dir = takes_cache || command == "evaluate";
+    CliArgs args;
+    driver::Options& options = args.options;
+    bool has_filename = false;
+    const bool is_compile = command == "compile";
+
+    for (int i = 2; i < argc; ++i) {
+        const string_view arg = argv[i];
+        if (takes_backend && arg == "--backend=tree") {
+            options.backend = EBackend::Tree;
+        } else if (takes_backend && arg == "--backend=vm") {
+            options.backend = EBackend::VM;
+        } else if (takes_backend && arg == "--backend=flat") {
+            options.backend = EBackend::Flat;
+        } else if (takes_parse_flags && arg == "--opt") {
+            options.optimize = true;
+        } else if (arg == "--stats") {
+            if (!stats::ENABLED) {
+                sink::err().println(
+                    "--stats needs a build with INTERP_STATS on");
+                return std::nullopt;
+            }
+            options.stats = true;
+        } else if (takes_parse_flags && arg.starts_with(MAX_DEPTH_FLAG)) {
+            if (!parse_size_flag(arg, MAX_DEPTH_FLAG, options.max_depth)) {
+                return std::nullopt;
+            }
+        } else if (takes_jobs && arg.starts_with(JOBS_FLAG)) {
+            size_t jobs = 0;
+            if (!parse_size_flag(arg, JOBS_FLAG, jobs)) {
+                return std::nullopt;
+            }
+            args.jobs = jobs;
+        } else if (is_serve && arg.starts_with(SOCKET_FLAG) &&
+                   arg.size() > SOCKET_FLAG.size()) {
+            args.socket_path = arg.substr(SOCKET_FLAG.size());
+        } else if (takes_cache && arg == "--cache") {
+            args.use_cache = true;
+        } else if (takes_cache_dir && arg.starts_with(CACHE_DIR_FLAG) &&
+                   arg.size() > CACHE_DIR_FLAG.size()) {
+            args.use_cache = true;
+            args.cache_dir = arg.substr(CACHE_DIR_FLAG.size());
+        } else if (arg.starts_with("--")) {
+            sink::err().println("Unknown option: {}", arg);
+            return std::nullopt;
+        } else if (!has_filename && !is_serve) {
+            args.filename = arg;
+            has_filename = true;
+        } else if (is_compile && args.out_path.empty()) {
+            args.out_path = arg;
+        } else {
+            sink::err().println("Unexpected argument: {}", arg);
+            return std::nullopt;
+        }
+    }
+
+    if ((!has_filename && !is_serve) || (is_compile && args.out_path.empty())) {
+        return std::nullopt;
+    }
+    if (options.optimize && options.backend == EBackend::Flat) {
+        sink::err().println("--opt only works on the tree and vm backends");
+        return std::nullopt;
+    }
+    // Trees aren't written out, so a directory would only ever hold errors
+    if (!args.cache_dir.empty() && options.backend != EBackend::VM) {
+        sink::err().println("--cache-dir only works on the vm backend");
+        return std::nullopt;
+    }
+    // It writes the parsed tree, the vm would have nothing to add
+    if (is_compile && options.backend == EBackend::VM) {
+        sink::err().println("compile only works on the tree and flat backends");
+        return std::nullopt;
+    }
+    if (command == "run" && options.backend == EBackend::Flat) {
+        sink::err().println("run only works on the tree and vm backends");
+        return std::nullopt;
+    }
+    return args;
 }
@@ -0,0 +1,196 @@
+#include "optimize.h"
+#include "eval.h"
+
+#include <memory>
+#include <utility>
+
+using std::make_unique;
+
+namespace opt {
+// Literal value of `expr`, if it's a literal
+static const Expr_Literal* as_literal(ExprPtr const& expr) {
+    return dynamic_cast<const Expr_Literal*>(expr.get());
+}
+
+static ExprPtr make_literal(const rt::Value value) {
+    switch (value.type()) {
+    case rt::EValueType::Nil:
+        return make_unique<Expr_Literal>(Expr_Literal::Nil());
+    case rt::EValueType::Bool:
+        if (value.get<bool>()) {
+            return make_unique<Expr_Literal>(Expr_Literal::True());
+        }
+        return make_unique<Expr_Literal>(Expr_Literal::False());
+    case rt::EValueType::Number:
+        return make_unique<Expr_Literal>(value.get<double>());
+    case rt::EValueType::String:
+        return make_unique<Expr_Literal>(
+            intern::IStr(value.get<rt::StringPtr>()->flat()));
+    }
+    std::unreachable();
+}
+
+// `expr`, at the same place in the source as `original`
+static ExprPtr placed_like(ExprPtr expr, Expr const& original) {
+    expr->offset = original.offset;
+    return expr;
+}
+
+ExprPtr Visitor_Fold::visit_literal(Expr_Literal const& literal) const {
+    return placed_like(make_unique<Expr_Literal>(literal.inner), literal);
+}
+
+ExprPtr Visitor_Fold::visit_grouping(Expr_Grouping const& grouping) const {
+    return visit_expr(*grouping.inner, *this);
+}
+
+ExprPtr Visitor_Fold::visit_unary(Expr_Unary const& unary) const {
+    ExprPtr inner = visit_expr(*unary.inner, *this);
+
+    if (const auto* literal = as_literal(inner)) {
+        const rt::Value inner_val = eval::literal_value(literal->inner);
+        rt::Value out;
+        if (eval::apply_unary(unary.op, inner_val, out) ==
+            rt::ERuntimeError::None) {
+            return placed_like(make_literal(out), unary);
+        }
+    }
+    return placed_like(make_unique<Expr_Unary>(unary.op, std::move(inner)),
+                       unary);
+}
+
+ExprPtr Visitor_Fold::visit_binary(Expr_Binary const& binary) const {
+    ExprPtr left = visit_expr(*binary.left, *this);
+    ExprPtr right = visit_expr(*binary.right, *this);
+
+    const auto* left_lit = as_literal(left);
+    const auto* right_lit = as_literal(right);
+    if (left_lit != nullptr && right_lit != nullptr) {
+        rt::Value out;
+        const rt::ERuntimeError err = eval::apply_binary(
+            binary.op, eval::literal_value(left_lit->inner),
+            eval::literal_value(right_lit->inner), out, heap);
+        if (err == rt::ERuntimeError::None) {
+            ExprPtr folded = placed_like(make_literal(out), binary);
+            // Concatenations were copied into the intern table
+            heap.clear();
+            return folded;
+        }
+    }
+    return placed_like(make_unique<Expr_Binary>(std::move(left), binary.op,
+                                                std::move(right)),
+                       binary);
+}
+
+ExprPtr Visitor_Fold::visit_variable(Expr_Variable const& variable) const {
+    auto copy = make_unique<Expr_Variable>(variable.name);
+    copy->slot = variable.slot;
+    return placed_like(std::move(copy), variable);
+}
+
+ExprPtr Visitor_Fold::visit_assign(Expr_Assign const& assign) const {
+    auto copy = make_unique<Expr_Assign>(assign.name,
+                                         visit_expr(*assign.value, *this));
+    copy->slot = assign.slot;
+    return placed_like(std::move(copy), assign);
+}
+
+ExprPtr fold_constants(Expr const& expr) {
+    Visitor_Fold folder;
+    return visit_expr(expr, folder);
+}
+
+static void fold_stmt(Stmt& stmt, Visitor_Fold const& folder) {
+    const auto fold = [&folder](ExprPtr& expr) {
+        expr = visit_expr(*expr, folder);
+    };
+    switch (stmt.kind) {
+    case EStmtKind::Expression:
+        fold(static_cast<Stmt_Expression&>(stmt).expr);
+        break;
+    case EStmtKind::Print:
+        fold(static_cast<Stmt_Print&>(stmt).expr);
+        break;
+    case EStmtKind::Var:
+        if (auto& var = static_cast<Stmt_Var&>(stmt); var.init != nullptr) {
+            fold(var.init);
+        }
+        break;
+    case EStmtKind::Block:
+        for (StmtPtr& inner : static_cast<Stmt_Block&>(stmt).stmts) {
+            fold_stmt(*inner, folder);
+        }
+        break;
+    }
+}
+
+void fold_constants(Program& program) {
+    Visitor_Fold folder;
+    for (StmtPtr& stmt : program.stmts) {
+        fold_stmt(*stmt, folder);
+    }
+}
+
+namespace {
+class Visitor_Count {
+  public:
+    void visit_literal(Expr_Literal const&) const {
+        ++count;
+    }
+    void visit_grouping(Expr_Grouping const& grouping) const {
+        ++count;
+        visit_expr(*grouping.inner, *this);
+    }
+    void visit_unary(Expr_Unary const& unary) const {
+        ++count;
+        visit_expr(*unary.inner, *this);
+    }
+    void visit_binary(Expr_Binary const& binary) const {
+        ++count;
+        visit_expr(*binary.left, *this);
+        visit_expr(*binary.right, *this);
+    }
+    void visit_variable(Expr_Variable const&) const {
+        ++count;
+    }
+    void visit_assign(Expr_Assign const& assign) const {
+        ++count;
+        visit_expr(*assign.value, *this);
+    }
+
+    // Statements themselves aren't counted
+    void visit_expression(Stmt_Expression const& stmt) const {
+        visit_expr(*stmt.expr, *this);
+    }
+    void visit_print(Stmt_Print const& stmt) const {
+        visit_expr(*stmt.expr, *this);
+    }
+    void visit_var(Stmt_Var const& stmt) const {
+        if (stmt.init != nullptr) {
+            visit_expr(*stmt.init, *this);
+        }
+    }
+    void visit_block(Stmt_Block const& stmt) const {
+        for (StmtPtr const& inner : stmt.stmts) {
+            visit_stmt(*inner, *this);
+        }
+    }
+
+    mutable size_t count = 0;
+};
+} // namespace
+
+size_t count_nodes(Expr const& expr) {
+    Visitor_Count counter;
+    visit_expr(expr, counter);
+    return counter.count;
+}
+
+size_t count_nodes(Program const& program) {
+    Visitor_Count counter;
+    for (StmtPtr const& stmt : program.stmts) {
+        visit_stmt(*stmt, counter);
+    }
+    return counter.count;
+}
+} // namespace opt
@@ -0,0 +1,45 @@
+#pragma once
+/**
+ * Optimization passes over parsed Expr trees
+ * Constant folding: any subtree whose operands are all literals is evaluated
+ * once, ahead of time, and replaced by its result. Operations that would
+ * fail (e.g. "a" - 1) are left in place, so the error still happens at
+ * runtime, with the same message.
+ **/
+
+#include <cstddef>
+
+#include "parser.h"
+#include "runtime.h"
+
+namespace opt {
+
+class Visitor_Fold {
+  public:
+    ExprPtr visit_literal(Expr_Literal const& literal) const;
+    // Groupings only shape the tree, they're dropped
+    ExprPtr visit_grouping(Expr_Grouping const& grouping) const;
+    ExprPtr visit_unary(Expr_Unary const& unary) const;
+    ExprPtr visit_binary(Expr_Binary const& binary) const;
+    // Variables are never constant, but what gets assigned to them can be
+    ExprPtr visit_variable(Expr_Variable const& variable) const;
+    ExprPtr visit_assign(Expr_Assign const& assign) const;
+
+  private:
+    // Scratch space for string results, which end up interned
+    mutable rt::Heap heap;
+};
+
+// Returns the folded copy, `expr` itself is left untouched
+[[nodiscard]]
+ExprPtr fold_constants(Expr const& expr);
+// Folds every expression of `program` in place
+void fold_constants(Program& program);
+
+// Number of nodes in the tree, groupings included
+[[nodiscard]]
+size_t count_nodes(Expr const& expr);
+// Expression nodes in all of the program's statements
+[[nodiscard]]
+size_t count_nodes(Program const& program);
+} // namespace opt
@@ -0,0 +1,161 @@
+#include "parallel_lexer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include "thread_pool.h"
+
+using std::string_view;
+
+namespace {
+// More chunks than threads, so a slow chunk doesn't hold up the rest
+constexpr size_t CHUNKS_PER_THREAD = 4;
+
+// What the pre-scan learns about one chunk
+struct ChunkScan {
+    // Indexed by whether the chunk starts inside a string literal
+    bool ends_in_string[2] = {false, true};
+    size_t newlines = 0;
+};
+
+const char* find_char(const char* p, const char* end, const char c) {
+    const void* found = std::memchr(p, c, end - p);
+    return found != nullptr ? static_cast<const char*>(found) : end;
+}
+
+// Whether the lexer is inside a string literal at the end of `text`.
+// Only quotes and "//" comments matter: no other token contains either.
+bool ends_in_string(const string_view text, bool in_string) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        if (in_string) {
+            p = find_char(p, end, '"');
+            if (p == end) {
+                return true;
+            }
+            ++p;
+            in_string = false;
+            continue;
+        }
+        while (p < end && *p != '"' && *p != '/') {
+            ++p;
+        }
+        if (p == end) {
+            break;
+        }
+        if (*p == '"') {
+            in_string = true;
+            ++p;
+        } else if (end - p >= 2 && p[1] == '/') {
+            p = find_char(p + 2, end, '\n');
+        } else {
+            ++p;
+        }
+    }
+    return in_string;
+}
+
+// Roughly equal chunks, each starting at the beginning of a line
+std::vector<size_t> candidate_cuts(const string_view source,
+                                   const size_t num_chunks) {
+    std::vector<size_t> cuts = {0};
+    for (size_t i = 1; i < num_chunks; ++i) {
+        const size_t target = source.size() / num_chunks * i;
+        const size_t newline = source.find('\n', std::max(target, cuts.back()));
+        if (newline == string_view::npos || newline + 1 >= source.size()) {
+            break;
+        }
+        cuts.push_back(newline + 1);
+    }
+    cuts.push_back(source.size());
+    return cuts;
+}
+} // namespace
+
+FaultyTokenVec lex_parallel(const string_view source, size_t& out_num_errs,
+                            const size_t num_threads,
+                            const size_t min_chunk_bytes) {
+    ThreadPool pool(num_threads);
+    const size_t num_chunks =
+        std::clamp(source.size() / std::max<size_t>(min_chunk_bytes, 1),
+                   size_t{1}, pool.size() * CHUNKS_PER_THREAD);
+    // The pre-scan and stitching only pay off with threads to spread over
+    if (num_chunks == 1 || pool.size() == 1) {
+        return lex(source, out_num_errs);
+    }
+
+    // Pre-scan every chunk from both possible starting states
+    const std::vector<size_t> cuts = candidate_cuts(source, num_chunks);
+    std::vector<ChunkScan> scans(cuts.size() - 1);
+    for (size_t i = 0; i < scans.size(); ++i) {
+        pool.submit([&source, &cuts, &scans, i] {
+            const string_view chunk =
+                source.substr(cuts[i], cuts[i + 1] - cuts[i]);
+            scans[i].ends_in_string[0] = ends_in_string(chunk, false);
+            scans[i].ends_in_string[1] = ends_in_string(chunk, true);
+            scans[i].newlines = std::ranges::count(chunk, '\n');
+        });
+    }
+    pool.wait();
+
+    // Chain the states: keep the cuts outside of strings, with their line
+    struct Segment {
+        size_t begin;
+        size_t first_line;
+    };
+    std::vector<Segment> segments;
+    bool in_string = false;
+    size_t line = 1;
+    for (size_t i = 0; i < scans.size(); ++i) {
+        if (!in_string) {
+            segments.push_back(Segment{cuts[i], line});
+        }
+        in_string = scans[i].ends_in_string[in_string];
+        line += scans[i].newlines;
+    }
+
+    std::vector<FaultyTokenVec> results(segments.size());
+    std::vector<size_t> num_errs(segments.size(), 0);
+    for (size_t i = 0; i < segments.size(); ++i) {
+        pool.submit([&, i] {
+            const size_t end =
+                i + 1 < segments.size() ? segments[i + 1].begin : source.size();
+            const bool is_last = i + 1 == segments.size();
+            Lexer lexer(source.substr(segments[i].begin,
+                                      end - segments[i].begin),
+                        segments[i].first_line, segments[i].begin);
+            FaultyTokenVec& tokens = results[i];
+            while (true) {
+                auto tok = lexer.next();
+                if (tok.has_value() &&
+                    std::holds_alternative<EndOfFile>(tok.value())) {
+                    // Only the file as a whole ends
+                    if (is_last) {
+                        tokens.push_back(std::move(tok));
+                    }
+                    break;
+                }
+                tokens.push_back(std::move(tok));
+            }
+            num_errs[i] = lexer.num_errors();
+        });
+    }
+    pool.wait();
+
+    size_t total = 0;
+    for (size_t i = 0; i < results.size(); ++i) {
+        total += results[i].size();
+        out_num_errs += num_errs[i];
+    }
+    FaultyTokenVec tokens;
+    tokens.reserve(total);
+    for (auto& result : results) {
+        std::ranges::move(result, std::back_inserter(tokens));
+        // Free as we go, the chunks add up to a second copy otherwise
+        FaultyTokenVec().swap(result);
+    }
+    return tokens;
+}
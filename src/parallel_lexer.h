@@ -0,0 +1,27 @@
+#pragma once
+/**
+ * Multi-threaded lexing of large sources
+ * The source is cut into chunks at line starts, the chunks are lexed on a
+ * thread pool and the results stitched back together. String literals are
+ * the only tokens spanning lines, so a cut is safe unless it lands inside
+ * one. Whether it does is found by a cheap pre-scan of quotes and comments,
+ * also in parallel: every chunk is scanned once assuming it starts outside a
+ * string and once assuming it starts inside one, then the real states are
+ * chained from the start of the file. Chunks starting inside a string are
+ * merged into the previous one.
+ **/
+
+#include <cstddef>
+#include <string_view>
+
+#include "lexer.h"
+
+// Below this, splitting costs more than it saves
+constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+// Same tokens, spans, errors and line numbers as lex(), in the same order.
+// 0 threads means one per hardware thread.
+[[nodiscard]]
+FaultyTokenVec lex_parallel(std::string_view source, size_t& out_num_errs,
+                            size_t num_threads = 0,
+                            size_t min_chunk_bytes = MIN_CHUNK_BYTES);
@@ -1,7 +1,11 @@
 #include "parser.h"
-#include "lexer.h"
 
-#include <cmath>
+#include <algorithm>
+#include <optional>
+
+#include "ast.h"
+#include "lexer.h"
+#include "stats.h"
 
 using std::expected;
 using std::holds_alternative;
@@ -15,27 +19,328 @@ using namespace grammar;
 using EBinOp = Expr_Binary::EBinaryOperator;
 
 #define FAIL(err) return std::unexpected(err)
-#define TODO FAIL("TODO")
 
 // Put successful parse result ExprPtr into `expr`,
 // and assign parse result's iterator to `it
 // Otherwise - early return
 // Includes bounds check.
 #define UNWRAP_AND_ITER(fn, expr, it, end_it)                                  \
-    if (auto res_tmp = bounds_check(fn, it, end_it)) {                         \
+    if (auto res_tmp = bounds_check(RULE(fn), it, end_it)) {                   \
         expr = std::move(res_tmp.value().first);                               \
         it = res_tmp.value().second;                                           \
     } else {                                                                   \
         FAIL(res_tmp.error());                                                 \
     }
 
+// A rule of this Rules instance, as something bounds_check() can call
+#define RULE(fn)                                                               \
+    [this](It const& start_it, It const& end_it) {                            \
+        return fn(start_it, end_it);                                           \
+    }
+
 namespace grammar {
 
-ParseResult expression(TokenIter const& start_it, TokenIter const& end_it) {
-    return bounds_check(equality, start_it, end_it);
+ParseError depth_error(const size_t max_depth, const uint32_t offset) {
+    return ParseError{
+        .code = EParseError::TooDeep, .offset = offset, .max_depth = max_depth};
+}
+
+// Lexeme of the token kind, if it has a fixed one
+template <size_t... Is>
+static std::optional<std::string_view> lexeme_of(const TokenKind kind,
+                                                 std::index_sequence<Is...>) {
+    std::optional<std::string_view> lexeme;
+    (
+        [&] {
+            using T = std::variant_alternative_t<Is, TokenVariant>;
+            if constexpr (StrToken<T>) {
+                if (kind == Is) {
+                    lexeme = T::LEXEME;
+                }
+            }
+        }(),
+        ...);
+    return lexeme;
+}
+
+// The token found instead, quoted, or `end` for EndOfFile
+static string token_message(ParseError const& err,
+                            const std::string_view source) {
+    if (err.token == token_kind<EndOfFile>) {
+        return "end";
+    }
+    if (const auto lexeme = lexeme_of(
+            err.token,
+            std::make_index_sequence<std::variant_size_v<TokenVariant>>())) {
+        return std::format("'{}'", *lexeme);
+    }
+    // Identifiers and literals, as they were written
+    Lexer lexer(source.substr(std::min<size_t>(err.offset, source.size())));
+    (void)lexer.next();
+    return std::format("'{}'", lexer.last_lexeme());
+}
+
+string error_message(ParseError const& err, const std::string_view source) {
+    switch (err.code) {
+    case EParseError::EndOfInput:
+        return "'Reached end iterator'";
+    case EParseError::ExpectedRightParen:
+        return "'After parsing expression in primary(), expected a right "
+               "paren'";
+    case EParseError::TooDeep:
+        return std::format("'Expression nested too deeply, the limit is {}'",
+                           err.max_depth);
+    case EParseError::UnexpectedToken:
+    case EParseError::ExpectedSemicolon:
+    case EParseError::ExpectedVariableName:
+    case EParseError::ExpectedRightBrace:
+    case EParseError::InvalidAssignTarget:
+        return token_message(err, source);
+    }
+    std::unreachable();
+}
+
+std::string_view expected_message(ParseError const& err) {
+    switch (err.code) {
+    case EParseError::ExpectedSemicolon:
+        return "Expect ';' after statement.";
+    case EParseError::ExpectedVariableName:
+        return "Expect variable name.";
+    case EParseError::ExpectedRightBrace:
+        return "Expect '}' after block.";
+    case EParseError::InvalidAssignTarget:
+        return "Invalid assignment target.";
+    default:
+        return "Expect expression.";
+    }
+}
+
+// Kind of the token at `it`
+template <typename It> static TokenKind tok_kind(It const& it) {
+    if constexpr (requires { it.kind(); }) {
+        return it.kind();
+    } else {
+        return static_cast<TokenKind>((*it).index());
+    }
+}
+
+// `code` for what was found at `it` instead
+template <typename It>
+static ParseError expected_error(const EParseError code, It const& it,
+                                 It const& end_it) {
+    if (it >= end_it) {
+        // Past the last token, on the last line
+        return ParseError{.code = code,
+                          .token = token_kind<EndOfFile>,
+                          .offset = UINT32_MAX};
+    }
+    return ParseError{
+        .code = code, .token = tok_kind(it), .offset = tok_span(it).offset};
 }
 
-ParseResult equality(TokenIter const& start_it, TokenIter const& end_it) {
+template <typename It> class Rules {
+  public:
+    using Result = ParseResultOf<It>;
+
+    using StmtResult = StmtResultOf<It>;
+
+    // With `names`, identifiers are variables, as they are in programs
+    explicit Rules(const size_t max_depth, const bool names = false)
+        : max_depth(max_depth), names(names) {}
+
+    StmtResult declaration(It const& start_it, It const& end_it);
+    StmtResult var_declaration(It const& start_it, It const& end_it);
+    StmtResult statement(It const& start_it, It const& end_it);
+    StmtResult block(It const& start_it, It const& end_it);
+
+    Result expression(It const& start_it, It const& end_it);
+    Result assignment(It const& start_it, It const& end_it);
+    Result equality(It const& start_it, It const& end_it);
+    Result comparison(It const& start_it, It const& end_it);
+    Result term(It const& start_it, It const& end_it);
+    Result factor(It const& start_it, It const& end_it);
+    Result unary(It const& start_it, It const& end_it);
+    Result primary(It const& start_it, It const& end_it);
+
+  private:
+    // Parens and unary operators currently open, each one is a few more
+    // frames of recursion
+    size_t depth = 0;
+    // Of the expression the last rule returned in links, a literal or
+    // variable being 0, see grammar::LEVEL_LINKS
+    size_t height = 0;
+    const size_t max_depth;
+    const bool names;
+
+    // Sets `height` to that of a node over children `inner_height` high,
+    // false if that's past max_depth
+    [[nodiscard]]
+    bool grow(const size_t inner_height) {
+        height = nested_height(inner_height);
+        return fits_depth(height, max_depth);
+    }
+    // Same for a binary node over `left_height` and `height`, its right
+    // operand
+    [[nodiscard]]
+    bool grow_binary(const size_t left_height) {
+        height = binary_height(left_height, height);
+        return fits_depth(height, max_depth);
+    }
+
+    // The ';' a statement ends with, at `it`
+    [[nodiscard]]
+    expected<It, ParseError> semicolon(It it, It const& end_it) const {
+        if (it >= end_it || !tok_matches<Semicol>(it)) {
+            return std::unexpected(
+                expected_error(EParseError::ExpectedSemicolon, it, end_it));
+        }
+        return it + 1;
+    }
+
+    // Bumps the depth for as long as it lives
+    struct DepthGuard {
+        size_t& depth;
+        explicit DepthGuard(size_t& depth) : depth(depth) {
+            ++depth;
+            stats::note_depth(depth);
+        }
+        ~DepthGuard() { --depth; }
+    };
+};
+
+template <typename It>
+StmtResultOf<It> Rules<It>::declaration(It const& start_it,
+                                       It const& end_it) {
+    if (tok_matches<Var>(start_it)) {
+        return var_declaration(start_it, end_it);
+    }
+    return statement(start_it, end_it);
+}
+
+template <typename It>
+StmtResultOf<It> Rules<It>::var_declaration(It const& start_it,
+                                           It const& end_it) {
+    // A TokenStream forgets tokens a few places back, so what's needed of
+    // them is copied out before moving on
+    const uint32_t offset = tok_span(start_it).offset;
+    auto it = start_it + 1;
+    if (it >= end_it || !tok_matches<Ident>(it)) {
+        FAIL(expected_error(EParseError::ExpectedVariableName, it, end_it));
+    }
+    const std::string_view name = std::get<Ident>(*it).literal;
+    const uint32_t name_offset = tok_span(it).offset;
+    it += 1;
+
+    ExprPtr init;
+    if (it < end_it && tok_matches<Assign>(it)) {
+        it += 1;
+        UNWRAP_AND_ITER(expression, init, it, end_it);
+    }
+    const auto end = semicolon(it, end_it);
+    if (!end) {
+        FAIL(end.error());
+    }
+    auto stmt = make_unique<Stmt_Var>(intern::IStr(name), std::move(init));
+    stmt->offset = offset;
+    stmt->name_offset = name_offset;
+    return make_pair(std::move(stmt), end.value());
+}
+
+template <typename It>
+StmtResultOf<It> Rules<It>::statement(It const& start_it, It const& end_it) {
+    if (tok_matches<LeftBrace>(start_it)) {
+        return block(start_it, end_it);
+    }
+
+    const uint32_t offset = tok_span(start_it).offset;
+    const bool is_print = tok_matches<Print>(start_it);
+    auto it = is_print ? start_it + 1 : start_it;
+    ExprPtr expr;
+    UNWRAP_AND_ITER(expression, expr, it, end_it);
+    const auto end = semicolon(it, end_it);
+    if (!end) {
+        FAIL(end.error());
+    }
+    StmtPtr stmt;
+    if (is_print) {
+        stmt = make_unique<Stmt_Print>(std::move(expr));
+    } else {
+        stmt = make_unique<Stmt_Expression>(std::move(expr));
+    }
+    stmt->offset = offset;
+    return make_pair(std::move(stmt), end.value());
+}
+
+template <typename It>
+StmtResultOf<It> Rules<It>::block(It const& start_it, It const& end_it) {
+    const uint32_t offset = tok_span(start_it).offset;
+    auto it = start_it + 1;
+    const DepthGuard guard(depth);
+    if (depth > max_depth) {
+        FAIL(depth_error(max_depth, offset));
+    }
+
+    std::vector<StmtPtr> stmts;
+    while (it < end_it && !tok_matches<RightBrace>(it) &&
+           !tok_matches<EndOfFile>(it)) {
+        auto res = declaration(it, end_it);
+        if (!res) {
+            FAIL(res.error());
+        }
+        stmts.push_back(std::move(res.value().first));
+        it = res.value().second;
+    }
+    if (it >= end_it || !tok_matches<RightBrace>(it)) {
+        FAIL(expected_error(EParseError::ExpectedRightBrace, it, end_it));
+    }
+    StmtPtr stmt = make_unique<Stmt_Block>(std::move(stmts));
+    stmt->offset = offset;
+    return make_pair(std::move(stmt), it + 1);
+}
+
+template <typename It>
+ParseResultOf<It> Rules<It>::expression(It const& start_it, It const& end_it) {
+    if (names) {
+        return bounds_check(RULE(assignment), start_it, end_it);
+    }
+    return bounds_check(RULE(equality), start_it, end_it);
+}
+
+// The target is parsed as any expression, and only then has to turn out
+// to be a variable
+template <typename It>
+ParseResultOf<It> Rules<It>::assignment(It const& start_it, It const& end_it) {
+    auto it = start_it;
+    ExprPtr target;
+    UNWRAP_AND_ITER(equality, target, it, end_it);
+    if (it >= end_it || !tok_matches<Assign>(it)) {
+        return make_pair(std::move(target), it);
+    }
+    if (target->kind != EExprKind::Variable) {
+        FAIL(expected_error(EParseError::InvalidAssignTarget, it, end_it));
+    }
+    const uint32_t op_offset = tok_span(it).offset;
+    it += 1;
+    // a = b = c nests to the right
+    const DepthGuard guard(depth);
+    if (depth > max_depth) {
+        FAIL(depth_error(max_depth, op_offset));
+    }
+
+    ExprPtr value;
+    UNWRAP_AND_ITER(assignment, value, it, end_it);
+    if (!grow(height)) {
+        FAIL(depth_error(max_depth, op_offset));
+    }
+    ExprPtr expr = make_unique<Expr_Assign>(
+        static_cast<Expr_Variable const&>(*target).name, std::move(value));
+    // Of the name, so errors about the variable point at it
+    expr->offset = target->offset;
+    return make_pair(std::move(expr), it);
+}
+
+template <typename It>
+ParseResultOf<It> Rules<It>::equality(It const& start_it, It const& end_it) {
     static constexpr impl::TokenList<Equals, NotEquals> tok_list;
 
     // Copying in
@@ -44,18 +349,25 @@ ParseResult equality(TokenIter const& start_it, TokenIter const& end_it) {
     UNWRAP_AND_ITER(comparison, expr, it, end_it);
 
     while (it < end_it && tok_matches_any(tok_list, it)) {
+        const size_t left_height = height;
         EBinOp op = tok_matches<Equals>(it) ? EBinOp::EqEq : EBinOp::NotEq;
+        const uint32_t op_offset = tok_span(it).offset;
         it += 1;
 
         ExprPtr right;
         UNWRAP_AND_ITER(comparison, right, it, end_it);
+        if (!grow_binary(left_height)) {
+            FAIL(depth_error(max_depth, op_offset));
+        }
         expr = make_unique<Expr_Binary>(std::move(expr), op, std::move(right));
+        expr->offset = op_offset;
     }
 
     return make_pair(std::move(expr), it);
 }
 
-ParseResult comparison(TokenIter const& start_it, TokenIter const& end_it) {
+template <typename It>
+ParseResultOf<It> Rules<It>::comparison(It const& start_it, It const& end_it) {
     auto it = start_it;
     static constexpr impl::TokenList<Greater, GreaterOrEq, Less, LessOrEq>
         tok_list;
@@ -63,7 +375,7 @@ ParseResult comparison(TokenIter const& start_it, TokenIter const& end_it) {
     ExprPtr expr;
     UNWRAP_AND_ITER(term, expr, it, end_it);
     while (it < end_it && tok_matches_any(tok_list, it)) {
-
+        const size_t left_height = height;
         EBinOp op;
         if (tok_matches<Greater>(it)) {
             op = EBinOp::Greater;
@@ -75,82 +387,111 @@ ParseResult comparison(TokenIter const& start_it, TokenIter const& end_it) {
             op = EBinOp::LessOrEq;
         }
 
+        const uint32_t op_offset = tok_span(it).offset;
         it += 1;
 
         ExprPtr right;
         UNWRAP_AND_ITER(term, right, it, end_it);
+        if (!grow_binary(left_height)) {
+            FAIL(depth_error(max_depth, op_offset));
+        }
         expr = make_unique<Expr_Binary>(std::move(expr), op, std::move(right));
+        expr->offset = op_offset;
     }
 
     return make_pair(std::move(expr), it);
 }
-ParseResult term(TokenIter const& start_it, TokenIter const& end_it) {
+template <typename It>
+ParseResultOf<It> Rules<It>::term(It const& start_it, It const& end_it) {
     auto it = start_it;
     static constexpr impl::TokenList<Minus, Plus> tok_list;
 
     ExprPtr expr;
     UNWRAP_AND_ITER(factor, expr, it, end_it);
     while (it < end_it && tok_matches_any(tok_list, it)) {
+        const size_t left_height = height;
         EBinOp op = tok_matches<Minus>(it) ? EBinOp::Minus : EBinOp::Plus;
+        const uint32_t op_offset = tok_span(it).offset;
         it += 1;
 
         ExprPtr right;
         UNWRAP_AND_ITER(factor, right, it, end_it);
+        if (!grow_binary(left_height)) {
+            FAIL(depth_error(max_depth, op_offset));
+        }
         expr = make_unique<Expr_Binary>(std::move(expr), op, std::move(right));
+        expr->offset = op_offset;
     }
 
     return make_pair(std::move(expr), it);
 }
-ParseResult factor(TokenIter const& start_it, TokenIter const& end_it) {
+template <typename It>
+ParseResultOf<It> Rules<It>::factor(It const& start_it, It const& end_it) {
     auto it = start_it;
     static constexpr impl::TokenList<Slash, Star> tok_list;
 
     ExprPtr expr;
     UNWRAP_AND_ITER(unary, expr, it, end_it);
     while (it < end_it && tok_matches_any(tok_list, it)) {
+        const size_t left_height = height;
         EBinOp op = tok_matches<Slash>(it) ? EBinOp::Div : EBinOp::Mul;
+        const uint32_t op_offset = tok_span(it).offset;
         it += 1;
 
         ExprPtr right;
         UNWRAP_AND_ITER(unary, right, it, end_it);
+        if (!grow_binary(left_height)) {
+            FAIL(depth_error(max_depth, op_offset));
+        }
         expr = make_unique<Expr_Binary>(std::move(expr), op, std::move(right));
+        expr->offset = op_offset;
     }
 
     return make_pair(std::move(expr), it);
 }
-ParseResult unary(TokenIter const& start_it, TokenIter const& end_it) {
+template <typename It>
+ParseResultOf<It> Rules<It>::unary(It const& start_it, It const& end_it) {
     using EUnaryOp = Expr_Unary::EUnaryOperator;
     auto it = start_it;
 
-    TokenVariant tok = *it;
-
     EUnaryOp unary_op;
-    if (holds_alternative<Bang>(tok)) {
+    if (tok_matches<Bang>(it)) {
         unary_op = EUnaryOp::Bang;
-    } else if (holds_alternative<Minus>(tok)) {
+    } else if (tok_matches<Minus>(it)) {
         unary_op = EUnaryOp::Minus;
     } else {
         // Just pass thru should be sufficient
         // NOTE: not applying bounds check, cause we haven't moved iterator
         return primary(it, end_it);
     }
+    const uint32_t op_offset = tok_span(it).offset;
     ExprPtr inner_expr;
     it += 1;
+    const DepthGuard guard(depth);
+    if (depth > max_depth) {
+        FAIL(depth_error(max_depth, op_offset));
+    }
     UNWRAP_AND_ITER(unary, inner_expr, it, end_it);
-    return make_pair(make_unique<Expr_Unary>(unary_op, std::move(inner_expr)),
-                     it);
+    if (!grow(height)) {
+        FAIL(depth_error(max_depth, op_offset));
+    }
+    ExprPtr expr = make_unique<Expr_Unary>(unary_op, std::move(inner_expr));
+    expr->offset = op_offset;
+    return make_pair(std::move(expr), it);
 }
-ParseResult primary(TokenIter const& start_it, TokenIter const& end_it) {
+template <typename It>
+ParseResultOf<It> Rules<It>::primary(It const& start_it, It const& end_it) {
     auto it = start_it;
 
-    TokenVariant tok = *it;
+    // No copy for TokenVec iterators, packed tokens are built on the fly
+    TokenVariant const& tok = *it;
+    const uint32_t offset = tok_span(it).offset;
 
     enum class EPrimaryMatchResult { Value, LeftParen, Other };
 
     ExprPtr expr;
-    string stringified_err_tok = "TODO";
     EPrimaryMatchResult res = std::visit(
-        [&expr, &stringified_err_tok](auto&& var) {
+        [this, &expr](auto&& var) {
             using T = std::decay_t<decltype(var)>;
             using std::is_same_v;
 
@@ -159,7 +500,8 @@ ParseResult primary(TokenIter const& start_it, TokenIter const& end_it) {
                 return EPrimaryMatchResult::Value;
 
             } else if constexpr (is_same_v<T, StringLiteral>) {
-                expr = make_unique<Expr_Literal>(var.literal);
+                // Interned here, tokens only hold a slice of the source
+                expr = make_unique<Expr_Literal>(intern::IStr(var.literal));
                 return EPrimaryMatchResult::Value;
 
             } else if constexpr (is_same_v<T, True>) {
@@ -174,13 +516,16 @@ ParseResult primary(TokenIter const& start_it, TokenIter const& end_it) {
                 expr = make_unique<Expr_Literal>(Expr_Literal::Nil());
                 return EPrimaryMatchResult::Value;
 
+            } else if constexpr (is_same_v<T, Ident>) {
+                if (names) {
+                    expr = make_unique<Expr_Variable>(
+                        intern::IStr(var.literal));
+                    return EPrimaryMatchResult::Value;
+                }
+
             } else if constexpr (is_same_v<T, LeftParen>) {
                 return EPrimaryMatchResult::LeftParen;
             }
-
-            if constexpr (StrToken<T>) {
-                stringified_err_tok = var.LEXEME;
-            }
             return EPrimaryMatchResult::Other;
         },
         tok);
@@ -189,10 +534,14 @@ ParseResult primary(TokenIter const& start_it, TokenIter const& end_it) {
     case EPrimaryMatchResult::Value:
         // Expr was already given a valid value from inside the std::visit()
         assert(expr != nullptr);
+        expr->offset = offset;
+        height = 0;
         return make_pair(std::move(expr), start_it + 1);
 
     case EPrimaryMatchResult::Other:
-        FAIL(std::move(stringified_err_tok));
+        FAIL((ParseError{.code = EParseError::UnexpectedToken,
+                         .token = static_cast<TokenKind>(tok.index()),
+                         .offset = offset}));
 
     case EPrimaryMatchResult::LeftParen:
         // expr should've been left unfilled
@@ -201,100 +550,212 @@ ParseResult primary(TokenIter const& start_it, TokenIter const& end_it) {
     }
 
     it += 1;
+    const DepthGuard guard(depth);
+    if (depth > max_depth) {
+        FAIL(depth_error(max_depth, offset));
+    }
     UNWRAP_AND_ITER(expression, expr, it, end_it);
 
     // Next one should be right paren
-    if (!std::holds_alternative<RightParen>(*it)) {
-        FAIL("After parsing expression in primary(), expected a right paren");
+    if (it >= end_it || !tok_matches<RightParen>(it)) {
+        FAIL(right_paren_error(it, end_it));
+    }
+    if (!grow(height)) {
+        FAIL(depth_error(max_depth, offset));
     }
     // wrap into grouping
-    return make_pair(make_unique<Expr_Grouping>(std::move(expr)), it + 1);
+    ExprPtr grouping = make_unique<Expr_Grouping>(std::move(expr));
+    grouping->offset = offset;
+    return make_pair(std::move(grouping), it + 1);
 }
 
+#define FORWARD_RULE(rule)                                                     \
+    ParseResult rule(TokenIter const& start_it, TokenIter const& end_it) {     \
+        return Rules<TokenIter>(DEFAULT_MAX_DEPTH).rule(start_it, end_it);     \
+    }
+FORWARD_RULE(expression)
+FORWARD_RULE(equality)
+FORWARD_RULE(comparison)
+FORWARD_RULE(term)
+FORWARD_RULE(factor)
+FORWARD_RULE(unary)
+FORWARD_RULE(primary)
+#undef FORWARD_RULE
+
+ParseResultOf<StreamIter> expression(StreamIter const& start_it,
+                                     StreamIter const& end_it,
+                                     const size_t max_depth) {
+    return Rules<StreamIter>(max_depth).expression(start_it, end_it);
+}
+ParseResultOf<BufferIter> expression(BufferIter const& start_it,
+                                     BufferIter const& end_it,
+                                     const size_t max_depth) {
+    return Rules<BufferIter>(max_depth).expression(start_it, end_it);
+}
 } // namespace grammar
 
 void pprint::Visitor_PPrint::visit_unary(Expr_Unary const& unary) const {
     const char op = unary.op == Expr_Unary::EUnaryOperator::Minus ? '-' : '!';
-    print("({} ", op);
-    unary.inner->accept(*this);
-    print(")");
+    out.print("({} ", op);
+    visit_expr(*unary.inner, *this);
+    out.print(")");
 }
 void pprint::Visitor_PPrint::visit_literal(Expr_Literal const& literal) const {
+    print_literal(literal.inner, out);
+}
+void pprint::Visitor_PPrint::visit_binary(Expr_Binary const& binary) const {
+    out.print("({} ", binary_op_lexeme(binary.op));
+    visit_expr(*binary.left, *this);
+    out.print(" ");
+    visit_expr(*binary.right, *this);
+    out.print(")");
+}
+void pprint::Visitor_PPrint::visit_grouping(
+    Expr_Grouping const& grouping) const {
+    out.print("(group ");
+    visit_expr(*grouping.inner, *this);
+    out.print(")");
+}
+
+void pprint::Visitor_PPrint::visit_variable(
+    Expr_Variable const& variable) const {
+    out.print("{}", variable.name.view());
+}
+void pprint::Visitor_PPrint::visit_assign(Expr_Assign const& assign) const {
+    out.print("(= {} ", assign.name.view());
+    visit_expr(*assign.value, *this);
+    out.print(")");
+}
+
+void pprint::Visitor_PPrint::visit_node(ast::Ast const& ast,
+                                        const ast::NodeId id) const {
+    ast::Node const& node = ast[id];
+    switch (node.kind) {
+    case ast::ENodeKind::Literal:
+        print_literal(ast.literals[node.lhs], out);
+        break;
+    case ast::ENodeKind::Grouping:
+        out.print("(group ");
+        visit_node(ast, node.lhs);
+        out.print(")");
+        break;
+    case ast::ENodeKind::Unary: {
+        const char op =
+            node.unary_op() == Expr_Unary::EUnaryOperator::Minus ? '-' : '!';
+        out.print("({} ", op);
+        visit_node(ast, node.lhs);
+        out.print(")");
+        break;
+    }
+    case ast::ENodeKind::Binary:
+        out.print("({} ", binary_op_lexeme(node.binary_op()));
+        visit_node(ast, node.lhs);
+        out.print(" ");
+        visit_node(ast, node.rhs);
+        out.print(")");
+        break;
+    }
+}
+
+void pprint::print_literal(Expr_Literal::LiteralVariant const& literal,
+                           sink::Sink& out) {
     std::visit(
-        [](auto&& var) {
+        [&out](auto&& var) {
             using T = std::decay_t<decltype(var)>;
             using std::is_same_v;
             if constexpr (is_same_v<T, Expr_Literal::Number>) {
-                // Is it a whole num?
-                if (var.value == std::trunc(var.value)) {
-                    print("{:.1f}", var.value);
-                } else {
-                    print("{}", var.value);
-                }
+                out.append([&var](std::string& buffer) {
+                    rt::append_number(buffer, var.value,
+                                      rt::ENumberStyle::Literal);
+                });
             } else if constexpr (is_same_v<T, Expr_Literal::String>) {
-                print("{}", var.value);
+                out.print("{}", var.value.view());
             } else if constexpr (is_same_v<T, Expr_Literal::True>) {
-                print("true");
+                out.print("true");
             } else if constexpr (is_same_v<T, Expr_Literal::False>) {
-                print("false");
+                out.print("false");
             } else if constexpr (is_same_v<T, Expr_Literal::Nil>) {
-                print("nil");
+                out.print("nil");
             } else {
                 std::unreachable();
             }
         },
-        literal.inner);
+        literal);
 }
-void pprint::Visitor_PPrint::visit_binary(Expr_Binary const& binary) const {
-    std::string op;
-    switch (binary.op) {
+
+std::string_view pprint::binary_op_lexeme(Expr_Binary::EBinaryOperator op) {
+    switch (op) {
     case Expr_Binary::EBinaryOperator::EqEq:
-        op = "==";
-        break;
+        return "==";
     case Expr_Binary::EBinaryOperator::NotEq:
-        op = "!=";
-        break;
+        return "!=";
     case Expr_Binary::EBinaryOperator::Less:
-        op = "<";
-        break;
+        return "<";
     case Expr_Binary::EBinaryOperator::LessOrEq:
-        op = "<=";
-        break;
+        return "<=";
     case Expr_Binary::EBinaryOperator::Greater:
-        op = ">";
-        break;
+        return ">";
     case Expr_Binary::EBinaryOperator::GreaterOrEq:
-        op = ">=";
-        break;
+        return ">=";
     case Expr_Binary::EBinaryOperator::Plus:
-        op = "+";
-        break;
+        return "+";
     case Expr_Binary::EBinaryOperator::Minus:
-        op = "-";
-        break;
+        return "-";
     case Expr_Binary::EBinaryOperator::Mul:
-        op = "*";
-        break;
+        return "*";
     case Expr_Binary::EBinaryOperator::Div:
-        op = "/";
-        break;
+        return "/";
     }
-    print("({} ", op);
-    binary.left->accept(*this);
-    print(" ");
-    binary.right->accept(*this);
-    print(")");
-}
-void pprint::Visitor_PPrint::visit_grouping(
-    Expr_Grouping const& grouping) const {
-    print("(group ");
-    grouping.inner->accept(*this);
-    print(")");
+    std::unreachable();
 }
 
-std::expected<ExprPtr, std::string> parse(TokenVec const& tokens) {
-    auto result = grammar::expression(tokens.begin(), tokens.end());
+template <typename It>
+static std::expected<ExprPtr, ParseError>
+parse_expression(It const& begin, It const& end, const size_t max_depth) {
+    auto result = Rules<It>(max_depth).expression(begin, end);
 
     return std::move(result).transform(
         [](auto&& pair) { return std::move(pair.first); });
 }
+
+std::expected<ExprPtr, ParseError> parse(TokenVec const& tokens,
+                                         const size_t max_depth) {
+    return parse_expression(tokens.begin(), tokens.end(), max_depth);
+}
+
+std::expected<ExprPtr, ParseError> parse(TokenStream& tokens,
+                                         const size_t max_depth) {
+    return parse_expression(tokens.begin(), tokens.end(), max_depth);
+}
+
+std::expected<ExprPtr, ParseError> parse(TokenBuffer const& tokens,
+                                         const size_t max_depth) {
+    return parse_expression(tokens.begin(), tokens.end(), max_depth);
+}
+
+template <typename It>
+static std::expected<Program, ParseError>
+parse_statements(It const& begin, It const& end, const size_t max_depth) {
+    Rules<It> rules(max_depth, true);
+    Program program;
+    auto it = begin;
+    while (it < end && !tok_matches<EndOfFile>(it)) {
+        auto res = rules.declaration(it, end);
+        if (!res) {
+            return std::unexpected(res.error());
+        }
+        program.stmts.push_back(std::move(res.value().first));
+        it = res.value().second;
+    }
+    return program;
+}
+
+std::expected<Program, ParseError> parse_program(TokenStream& tokens,
+                                                 const size_t max_depth) {
+    return parse_statements(tokens.begin(), tokens.end(), max_depth);
+}
+
+std::expected<Program, ParseError> parse_program(TokenVec const& tokens,
+                                                 const size_t max_depth) {
+    return parse_statements(tokens.begin(), tokens.end(), max_depth);
+}
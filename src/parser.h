@@ -3,42 +3,55 @@
  * Parser for the Lox interpreter
  **/
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <expected>
 #include <memory>
-#include <print>
 #include <string>
 #include <utility>
 #include <variant>
+#include <vector>
 
+#include "intern.h"
 #include "lexer.h"
 #include "runtime.h"
+#include "token_buffer.h"
 
 struct Expr_Grouping;
 struct Expr_Literal;
+namespace ast {
+class Ast;
+using NodeId = uint32_t;
+} // namespace ast
 struct Expr_Unary;
 struct Expr_Binary;
-
-using ValueResult = std::expected<rt::Value, std::string>;
-
-template <typename RetVal> class Visitor {
-  public:
-    virtual RetVal visit_literal(Expr_Literal const& literal) const = 0;
-    virtual RetVal visit_grouping(Expr_Grouping const& grouping) const = 0;
-    virtual RetVal visit_unary(Expr_Unary const& unary) const = 0;
-    virtual RetVal visit_binary(Expr_Binary const& binary) const = 0;
-
-    virtual ~Visitor() = default;
+struct Expr_Variable;
+struct Expr_Assign;
+
+using ValueResult = std::expected<rt::Value, rt::RuntimeError>;
+
+// Closed set of node kinds, so visiting is a switch instead of virtual calls
+enum class EExprKind : uint8_t {
+    Literal,
+    Grouping,
+    Unary,
+    Binary,
+    Variable,
+    Assign
 };
 
 // Root expression type
 struct Expr {
-    // Visitor that doesn't return anything
-    virtual void accept(Visitor<void> const& visitor) const = 0;
-    // Visitor returning runtime value
-    virtual ValueResult accept(Visitor<ValueResult> const& visitor) const = 0;
+    const EExprKind kind;
+    // Source offset of the token the node comes from: the literal, the
+    // operator or the opening paren. Sits in what would be padding.
+    uint32_t offset = 0;
 
+    explicit Expr(const EExprKind kind) : kind(kind) {}
     virtual ~Expr() = default;
 };
+static_assert(sizeof(Expr) == 16);
 
 using ExprPtr = std::unique_ptr<Expr>;
 
@@ -48,8 +61,8 @@ struct Expr_Literal : public Expr {
         explicit Number(const double value) : value(value) {}
     };
     struct String {
-        std::string value;
-        explicit String(std::string value) : value(std::move(value)) {}
+        intern::IStr value;
+        explicit String(intern::IStr value) : value(value) {}
     };
     struct True {};
     struct False {};
@@ -58,17 +71,12 @@ struct Expr_Literal : public Expr {
     using LiteralVariant = std::variant<Number, String, True, False, Nil>;
     LiteralVariant inner;
 
-    explicit Expr_Literal(LiteralVariant inner) : inner(std::move(inner)) {}
-    explicit Expr_Literal(const double num) : inner(Number(num)) {}
-    explicit Expr_Literal(std::string s) : inner(String(std::move(s))) {}
-
-    virtual void accept(Visitor<void> const& visitor) const override {
-        visitor.visit_literal(*this);
-    }
-    virtual ValueResult
-    accept(Visitor<ValueResult> const& visitor) const override {
-        return visitor.visit_literal(*this);
-    }
+    explicit Expr_Literal(LiteralVariant inner)
+        : Expr(EExprKind::Literal), inner(std::move(inner)) {}
+    explicit Expr_Literal(const double num)
+        : Expr(EExprKind::Literal), inner(Number(num)) {}
+    explicit Expr_Literal(intern::IStr s)
+        : Expr(EExprKind::Literal), inner(String(s)) {}
 };
 
 // Expression in () parens
@@ -76,15 +84,8 @@ struct Expr_Literal : public Expr {
 struct Expr_Grouping : public Expr {
     ExprPtr inner;
 
-    explicit Expr_Grouping(ExprPtr inner) : inner(std::move(inner)) {}
-
-    virtual void accept(Visitor<void> const& visitor) const override {
-        visitor.visit_grouping(*this);
-    }
-    virtual ValueResult
-    accept(Visitor<ValueResult> const& visitor) const override {
-        return visitor.visit_grouping(*this);
-    }
+    explicit Expr_Grouping(ExprPtr inner)
+        : Expr(EExprKind::Grouping), inner(std::move(inner)) {}
 };
 
 struct Expr_Unary : public Expr {
@@ -99,15 +100,7 @@ struct Expr_Unary : public Expr {
     ExprPtr inner;
 
     explicit Expr_Unary(const EUnaryOperator op, ExprPtr inner)
-        : op(op), inner(std::move(inner)) {}
-
-    virtual void accept(Visitor<void> const& visitor) const override {
-        visitor.visit_unary(*this);
-    }
-    virtual ValueResult
-    accept(Visitor<ValueResult> const& visitor) const override {
-        return visitor.visit_unary(*this);
-    }
+        : Expr(EExprKind::Unary), op(op), inner(std::move(inner)) {}
 };
 
 struct Expr_Binary : public Expr {
@@ -139,27 +132,170 @@ struct Expr_Binary : public Expr {
     ExprPtr right;
 
     explicit Expr_Binary(ExprPtr left, const EBinaryOperator op, ExprPtr right)
-        : left(std::move(left)), op(op), right(std::move(right)) {}
+        : Expr(EExprKind::Binary), left(std::move(left)), op(op),
+          right(std::move(right)) {}
+};
+
+// Where a variable lives while a program runs, given by resolve::resolve()
+enum class EScope : uint8_t {
+    // Not resolved yet, reading or assigning it fails
+    Unresolved,
+    // Index into the program's globals
+    Global,
+    // Index into the locals of the blocks the variable is declared in
+    Local,
+};
+
+struct Slot {
+    EScope scope = EScope::Unresolved;
+    uint32_t index = 0;
+
+    bool operator==(Slot const&) const = default;
+};
 
-    virtual void accept(Visitor<void> const& visitor) const override {
-        visitor.visit_binary(*this);
+// Only in programs, see parse_program()
+struct Expr_Variable : public Expr {
+    intern::IStr name;
+    Slot slot;
+
+    explicit Expr_Variable(intern::IStr name)
+        : Expr(EExprKind::Variable), name(name) {}
+};
+
+// name = value, which is also what it evaluates to
+struct Expr_Assign : public Expr {
+    intern::IStr name;
+    ExprPtr value;
+    Slot slot;
+
+    explicit Expr_Assign(intern::IStr name, ExprPtr value)
+        : Expr(EExprKind::Assign), name(name), value(std::move(value)) {}
+};
+
+// Calls visitor.visit_literal/_grouping/_unary/_binary/_variable/_assign
+// for expr's kind. A visitor is any type with those six methods, returning
+// the same type.
+// Being a template over the visitor, the switch and the visit_* calls are
+// direct, and the compiler can inline them.
+template <typename V>
+decltype(auto) visit_expr(Expr const& expr, V&& visitor) {
+    switch (expr.kind) {
+    case EExprKind::Literal:
+        return visitor.visit_literal(static_cast<Expr_Literal const&>(expr));
+    case EExprKind::Grouping:
+        return visitor.visit_grouping(static_cast<Expr_Grouping const&>(expr));
+    case EExprKind::Unary:
+        return visitor.visit_unary(static_cast<Expr_Unary const&>(expr));
+    case EExprKind::Binary:
+        return visitor.visit_binary(static_cast<Expr_Binary const&>(expr));
+    case EExprKind::Variable:
+        return visitor.visit_variable(static_cast<Expr_Variable const&>(expr));
+    case EExprKind::Assign:
+        return visitor.visit_assign(static_cast<Expr_Assign const&>(expr));
     }
-    virtual ValueResult
-    accept(Visitor<ValueResult> const& visitor) const override {
-        return visitor.visit_binary(*this);
+    std::unreachable();
+}
+
+// Statements, the same way: a closed set of kinds and a switch to visit them
+enum class EStmtKind : uint8_t { Expression, Print, Var, Block };
+
+struct Stmt {
+    const EStmtKind kind;
+    // Source offset of the statement's first token
+    uint32_t offset = 0;
+
+    explicit Stmt(const EStmtKind kind) : kind(kind) {}
+    virtual ~Stmt() = default;
+};
+
+using StmtPtr = std::unique_ptr<Stmt>;
+
+// expr;
+struct Stmt_Expression : public Stmt {
+    ExprPtr expr;
+
+    explicit Stmt_Expression(ExprPtr expr)
+        : Stmt(EStmtKind::Expression), expr(std::move(expr)) {}
+};
+
+// print expr;
+struct Stmt_Print : public Stmt {
+    ExprPtr expr;
+
+    explicit Stmt_Print(ExprPtr expr)
+        : Stmt(EStmtKind::Print), expr(std::move(expr)) {}
+};
+
+// var name = init; or var name; with a null init
+struct Stmt_Var : public Stmt {
+    intern::IStr name;
+    ExprPtr init;
+    Slot slot;
+    // Of the name, where errors about the declaration point
+    uint32_t name_offset = 0;
+
+    explicit Stmt_Var(intern::IStr name, ExprPtr init)
+        : Stmt(EStmtKind::Var), name(name), init(std::move(init)) {}
+};
+
+// { stmts }
+struct Stmt_Block : public Stmt {
+    std::vector<StmtPtr> stmts;
+
+    explicit Stmt_Block(std::vector<StmtPtr> stmts)
+        : Stmt(EStmtKind::Block), stmts(std::move(stmts)) {}
+};
+
+// Calls visitor.visit_expression/_print/_var/_block for stmt's kind
+template <typename V>
+decltype(auto) visit_stmt(Stmt const& stmt, V&& visitor) {
+    switch (stmt.kind) {
+    case EStmtKind::Expression:
+        return visitor.visit_expression(
+            static_cast<Stmt_Expression const&>(stmt));
+    case EStmtKind::Print:
+        return visitor.visit_print(static_cast<Stmt_Print const&>(stmt));
+    case EStmtKind::Var:
+        return visitor.visit_var(static_cast<Stmt_Var const&>(stmt));
+    case EStmtKind::Block:
+        return visitor.visit_block(static_cast<Stmt_Block const&>(stmt));
     }
+    std::unreachable();
+}
+
+struct Program {
+    std::vector<StmtPtr> stmts;
+    // Set by resolve::resolve(): how many globals the program has, and the
+    // most locals that are alive at once
+    uint32_t num_globals = 0;
+    uint32_t num_locals = 0;
 };
 
 namespace pprint {
-using std::print;
 
-class Visitor_PPrint : public Visitor<void> {
+// Prints the tree in prefix form, into sink::out() unless told otherwise
+class Visitor_PPrint {
   public:
-    virtual void visit_unary(Expr_Unary const& unary) const override;
-    virtual void visit_literal(Expr_Literal const& literal) const override;
-    virtual void visit_binary(Expr_Binary const& binary) const override;
-    virtual void visit_grouping(Expr_Grouping const& grouping) const override;
+    explicit Visitor_PPrint(sink::Sink& out = sink::out()) : out(out) {}
+
+    void visit_unary(Expr_Unary const& unary) const;
+    void visit_literal(Expr_Literal const& literal) const;
+    void visit_binary(Expr_Binary const& binary) const;
+    void visit_grouping(Expr_Grouping const& grouping) const;
+    void visit_variable(Expr_Variable const& variable) const;
+    void visit_assign(Expr_Assign const& assign) const;
+
+    // Same output, for a node of the flat arena AST
+    void visit_node(ast::Ast const& ast, ast::NodeId id) const;
+
+  private:
+    sink::Sink& out;
 };
+
+void print_literal(Expr_Literal::LiteralVariant const& literal,
+                   sink::Sink& out);
+[[nodiscard]]
+std::string_view binary_op_lexeme(Expr_Binary::EBinaryOperator op);
 }; // namespace pprint
 
 namespace grammar {
@@ -167,26 +303,112 @@ using std::expected;
 using std::pair;
 using std::string;
 
+// The rules are written once, for any iterator over tokens:
+// TokenIter over a lexed TokenVec, StreamIter lexing on demand, or
+// BufferIter over packed tokens
 using TokenIter = TokenVec::const_iterator;
-using ParseResult = expected<pair<ExprPtr, TokenIter>, string>;
+using StreamIter = TokenStream::Iterator;
+using BufferIter = TokenBuffer::Iterator;
+
+enum class EParseError : uint8_t {
+    EndOfInput,
+    UnexpectedToken,
+    ExpectedRightParen,
+    TooDeep,
+    // Statements only
+    ExpectedSemicolon,
+    ExpectedVariableName,
+    ExpectedRightBrace,
+    InvalidAssignTarget,
+};
+
+// Like rt::RuntimeError, formatted only when it gets printed
+struct ParseError {
+    EParseError code;
+    // UnexpectedToken and the statement errors: the kind of token found
+    // instead
+    TokenKind token = 0;
+    // Source offset of the token the error is at
+    uint32_t offset = 0;
+    // TooDeep: the max_depth that was exceeded
+    size_t max_depth = 0;
+
+    bool operator==(ParseError const&) const = default;
+};
+
+// What gets printed after "Error at": the offending token as written in
+// `source`, quoted, `end` at the end of it, or what went wrong, quoted
+[[nodiscard]]
+string error_message(ParseError const& err, std::string_view source);
+// What was expected instead, printed after that
+[[nodiscard]]
+std::string_view expected_message(ParseError const& err);
+
+template <typename It>
+using ParseResultOf = expected<pair<ExprPtr, It>, ParseError>;
+using ParseResult = ParseResultOf<TokenIter>;
+template <typename It>
+using StmtResultOf = expected<pair<StmtPtr, It>, ParseError>;
+
+// How deep expression trees and blocks may nest. Every paren, unary
+// operator and assignment is a level above what it's made of. The rules
+// recurse a few frames per level, and optimized builds run out of an 8MB
+// stack somewhere past 5000 of those. Trees this deep are also walked
+// recursively later on.
+constexpr size_t DEFAULT_MAX_DEPTH = 1000;
+
+// Tree heights are counted in links, LEVEL_LINKS to a level. Binary
+// operators are parsed in a loop, so each one only adds a link: chains
+// like 1 + 2 + 3 still nest down the left, but later passes recurse just
+// one frame per operator there. A 10000 term sum is 313 levels.
+constexpr size_t LEVEL_LINKS = 32;
+
+// Of a Unary, Grouping or Assign node over `inner`
+[[nodiscard]]
+constexpr size_t nested_height(const size_t inner) {
+    return inner + LEVEL_LINKS;
+}
+// Of a Binary node
+[[nodiscard]]
+constexpr size_t binary_height(const size_t left, const size_t right) {
+    return std::max(left, right) + 1;
+}
+// Whether a tree `height` links high is at most max_depth levels
+[[nodiscard]]
+constexpr bool fits_depth(const size_t height, const size_t max_depth) {
+    return (height + LEVEL_LINKS - 1) / LEVEL_LINKS <= max_depth;
+}
 
-template <Token T> bool tok_matches(TokenVec::const_iterator it) {
-    return std::holds_alternative<T>(*it);
+template <Token T, typename It> bool tok_matches(It const& it) {
+    if constexpr (requires { it.kind(); }) {
+        // Packed token, no need to build the variant
+        return it.kind() == token_kind<T>;
+    } else {
+        return std::holds_alternative<T>(*it);
+    }
+}
+
+// Span of the token at `it`
+template <typename It> Span tok_span(It const& it) {
+    if constexpr (requires { it.span(); }) {
+        // Packed token, no need to build the variant
+        return it.span();
+    } else {
+        return std::visit([](auto const& tok) { return tok.span; }, *it);
+    }
 }
 
-template <Token... Ts>
-bool tok_matches_any(impl::TokenList<Ts...> tokens,
-                     TokenVec::const_iterator& it) {
+template <Token... Ts, typename It>
+bool tok_matches_any(impl::TokenList<Ts...> tokens, It const& it) {
     return (tok_matches<Ts>(it) || ...);
 }
 
 // "Decorate" a function with an iterator bounds check
 // If all g, pass thru the iterators
-template <typename F>
-ParseResult bounds_check(F&& fn, TokenIter const& start_it,
-                         TokenIter const& end_it) {
+template <typename F, typename It>
+ParseResultOf<It> bounds_check(F&& fn, It const& start_it, It const& end_it) {
     if (start_it >= end_it) {
-        return std::unexpected("Reached end iterator");
+        return std::unexpected(ParseError{.code = EParseError::EndOfInput});
     }
 
     return fn(start_it, end_it);
@@ -200,8 +422,53 @@ ParseResult term(TokenIter const& start_it, TokenIter const& end_it);
 ParseResult factor(TokenIter const& start_it, TokenIter const& end_it);
 ParseResult unary(TokenIter const& start_it, TokenIter const& end_it);
 ParseResult primary(TokenIter const& start_it, TokenIter const& end_it);
+
+ParseResultOf<StreamIter>
+expression(StreamIter const& start_it, StreamIter const& end_it,
+           size_t max_depth = DEFAULT_MAX_DEPTH);
+ParseResultOf<BufferIter>
+expression(BufferIter const& start_it, BufferIter const& end_it,
+           size_t max_depth = DEFAULT_MAX_DEPTH);
+
+// Errors shared with ast::parse()
+// Going past max_depth at the operator or paren at `offset`
+[[nodiscard]]
+ParseError depth_error(size_t max_depth, uint32_t offset);
+// A group not closed where `it` is
+template <typename It>
+ParseError right_paren_error(It const& it, It const& end_it) {
+    return ParseError{.code = EParseError::ExpectedRightParen,
+                      .offset = it < end_it ? tok_span(it).offset : 0};
+}
 } // namespace grammar
 
-// Parse a single expression
+// Parse a single expression.
+// Fails cleanly once the tree would be deeper than max_depth, instead of
+// running out of stack then or in whatever walks the tree. An expression on
+// its own has no variables, so identifiers are unexpected tokens.
+[[nodiscard]]
+std::expected<ExprPtr, grammar::ParseError>
+parse(TokenVec const& tokens, size_t max_depth = grammar::DEFAULT_MAX_DEPTH);
+// Same, pulling tokens from the stream as needed.
+// Lex errors are left in tokens.errors().
+[[nodiscard]]
+std::expected<ExprPtr, grammar::ParseError>
+parse(TokenStream& tokens, size_t max_depth = grammar::DEFAULT_MAX_DEPTH);
+// Same, over tokens lexed up front into a buffer. The buffer already
+// set its lex errors aside, check tokens.errors() too.
+[[nodiscard]]
+std::expected<ExprPtr, grammar::ParseError>
+parse(TokenBuffer const& tokens, size_t max_depth = grammar::DEFAULT_MAX_DEPTH);
+
+// Parse a program: statements up to the end of the tokens, where
+// expressions can also read and assign variables. The variables still
+// have to be resolved before it can run, see resolve::resolve().
+// Lex errors are left in tokens.errors().
+[[nodiscard]]
+std::expected<Program, grammar::ParseError>
+parse_program(TokenStream& tokens,
+              size_t max_depth = grammar::DEFAULT_MAX_DEPTH);
 [[nodiscard]]
-std::expected<ExprPtr, std::string> parse(TokenVec const& tokens);
+std::expected<Program, grammar::ParseError>
+parse_program(TokenVec const& tokens,
+              size_t max_depth = grammar::DEFAULT_MAX_DEPTH);
@@ -0,0 +1,201 @@
+#include "resolver.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "util.h"
+
+namespace resolve {
+using Result = std::expected<void, ResolveError>;
+
+std::string_view error_message(const EResolveError code) {
+    switch (code) {
+    case EResolveError::AlreadyDeclared:
+        return "Already a variable with this name in this scope.";
+    case EResolveError::ReadInOwnInitializer:
+        return "Can't read local variable in its own initializer.";
+    case EResolveError::TooManyVariables:
+        return "Too many variables in one program.";
+    }
+    std::unreachable();
+}
+
+namespace {
+class Resolver {
+  public:
+    explicit Resolver(Program& program) : program(program) {}
+
+    Result stmt(Stmt& stmt);
+    Result expr(Expr& expr);
+
+  private:
+    // A local of the blocks currently open, its slot is where it is in
+    // `locals`
+    struct Local {
+        intern::IStr name;
+        // Of the block it's declared in, 1 for the outermost one
+        uint32_t depth;
+        // False while its initializer is being resolved
+        bool is_ready;
+    };
+
+    Program& program;
+    // Interned names are unique, so the pointer is the key
+    std::unordered_map<rt::StringPtr, uint32_t> globals;
+    std::vector<Local> locals;
+    // Blocks currently open, 0 at the top level
+    uint32_t depth = 0;
+
+    Result var(Stmt_Var& var);
+    std::expected<Slot, ResolveError> global(intern::IStr name,
+                                             uint32_t offset);
+    // The innermost local called `name`, otherwise the global. Reading a
+    // local fails until its initializer is done, assigning it doesn't.
+    std::expected<Slot, ResolveError> lookup(intern::IStr name,
+                                             uint32_t offset, bool is_read);
+};
+
+Result Resolver::stmt(Stmt& stmt) {
+    switch (stmt.kind) {
+    case EStmtKind::Expression:
+        return expr(*static_cast<Stmt_Expression&>(stmt).expr);
+    case EStmtKind::Print:
+        return expr(*static_cast<Stmt_Print&>(stmt).expr);
+    case EStmtKind::Var:
+        return var(static_cast<Stmt_Var&>(stmt));
+    case EStmtKind::Block: {
+        depth += 1;
+        for (StmtPtr& inner : static_cast<Stmt_Block&>(stmt).stmts) {
+            const Result res = this->stmt(*inner);
+            UNWRAP(res);
+        }
+        // The block's locals go out of scope, and their slots get reused
+        while (!locals.empty() && locals.back().depth == depth) {
+            locals.pop_back();
+        }
+        depth -= 1;
+        return {};
+    }
+    }
+    std::unreachable();
+}
+
+Result Resolver::var(Stmt_Var& var) {
+    if (depth == 0) {
+        // `var a = a;` reads the global itself, which is fine
+        if (var.init != nullptr) {
+            const Result res = expr(*var.init);
+            UNWRAP(res);
+        }
+        const auto slot = global(var.name, var.name_offset);
+        if (!slot) {
+            return std::unexpected(slot.error());
+        }
+        var.slot = slot.value();
+        return {};
+    }
+
+    for (auto it = locals.rbegin(); it != locals.rend() && it->depth == depth;
+         ++it) {
+        if (it->name == var.name) {
+            return std::unexpected(ResolveError{EResolveError::AlreadyDeclared,
+                                                var.name_offset});
+        }
+    }
+    if (locals.size() == MAX_SLOTS) {
+        return std::unexpected(
+            ResolveError{EResolveError::TooManyVariables, var.name_offset});
+    }
+    const auto index = static_cast<uint32_t>(locals.size());
+    locals.push_back(Local{var.name, depth, false});
+    program.num_locals = std::max(program.num_locals, index + 1);
+    if (var.init != nullptr) {
+        const Result res = expr(*var.init);
+        UNWRAP(res);
+    }
+    locals[index].is_ready = true;
+    var.slot = Slot{EScope::Local, index};
+    return {};
+}
+
+Result Resolver::expr(Expr& expr) {
+    switch (expr.kind) {
+    case EExprKind::Literal:
+        return {};
+    case EExprKind::Grouping:
+        return this->expr(*static_cast<Expr_Grouping&>(expr).inner);
+    case EExprKind::Unary:
+        return this->expr(*static_cast<Expr_Unary&>(expr).inner);
+    case EExprKind::Binary: {
+        auto& binary = static_cast<Expr_Binary&>(expr);
+        const Result res = this->expr(*binary.left);
+        UNWRAP(res);
+        return this->expr(*binary.right);
+    }
+    case EExprKind::Variable: {
+        auto& variable = static_cast<Expr_Variable&>(expr);
+        const auto slot = lookup(variable.name, variable.offset, true);
+        if (!slot) {
+            return std::unexpected(slot.error());
+        }
+        variable.slot = slot.value();
+        return {};
+    }
+    case EExprKind::Assign: {
+        auto& assign = static_cast<Expr_Assign&>(expr);
+        const Result res = this->expr(*assign.value);
+        UNWRAP(res);
+        const auto slot = lookup(assign.name, assign.offset, false);
+        if (!slot) {
+            return std::unexpected(slot.error());
+        }
+        assign.slot = slot.value();
+        return {};
+    }
+    }
+    std::unreachable();
+}
+
+std::expected<Slot, ResolveError> Resolver::global(const intern::IStr name,
+                                                   const uint32_t offset) {
+    if (const auto it = globals.find(name.get()); it != globals.end()) {
+        return Slot{EScope::Global, it->second};
+    }
+    if (program.num_globals == MAX_SLOTS) {
+        return std::unexpected(
+            ResolveError{EResolveError::TooManyVariables, offset});
+    }
+    globals.emplace(name.get(), program.num_globals);
+    return Slot{EScope::Global, program.num_globals++};
+}
+
+std::expected<Slot, ResolveError> Resolver::lookup(const intern::IStr name,
+                                                   const uint32_t offset,
+                                                   const bool is_read) {
+    for (size_t i = locals.size(); i-- > 0;) {
+        if (locals[i].name == name) {
+            if (is_read && !locals[i].is_ready) {
+                return std::unexpected(ResolveError{
+                    EResolveError::ReadInOwnInitializer, offset});
+            }
+            return Slot{EScope::Local, static_cast<uint32_t>(i)};
+        }
+    }
+    // Not declared yet is fine, it may be by the time this runs
+    return global(name, offset);
+}
+} // namespace
+
+Result resolve(Program& program) {
+    program.num_globals = 0;
+    program.num_locals = 0;
+    Resolver resolver(program);
+    for (StmtPtr& stmt : program.stmts) {
+        const Result res = resolver.stmt(*stmt);
+        UNWRAP(res);
+    }
+    return {};
+}
+} // namespace resolve
@@ -0,0 +1,48 @@
+#pragma once
+/**
+ * Resolver for Lox programs
+ * Runs once between parsing and running, and gives every variable a fixed
+ * Slot: a global gets an index into the program's globals, a local the
+ * offset it has among the locals of the blocks around it. Running the
+ * program then reads and writes variables by index, instead of looking
+ * their names up in one scope after another.
+ **/
+
+#include <cstdint>
+#include <expected>
+#include <string_view>
+
+#include "parser.h"
+
+namespace resolve {
+
+// Most globals, and most locals alive at once, one program can have.
+// The VM encodes slots in 2 bytes.
+constexpr uint32_t MAX_SLOTS = UINT16_MAX + 1;
+
+enum class EResolveError : uint8_t {
+    // Declared twice in the same block
+    AlreadyDeclared,
+    // { var a = a; }
+    ReadInOwnInitializer,
+    TooManyVariables,
+};
+
+// Like grammar::ParseError, formatted only when it gets printed
+struct ResolveError {
+    EResolveError code;
+    // Source offset of the variable's name
+    uint32_t offset = 0;
+
+    bool operator==(ResolveError const&) const = default;
+};
+
+[[nodiscard]]
+std::string_view error_message(EResolveError code);
+
+// Fills in the slot of every variable in `program`, and its num_globals and
+// num_locals. Globals are only defined once their var statement runs, so
+// reading one before that is left to fail at runtime.
+[[nodiscard]]
+std::expected<void, ResolveError> resolve(Program& program);
+} // namespace resolve
@@ -1,31 +1,338 @@
 #pragma once
 /**
  * Shared runtime types
+ * Value is NaN-boxed into 8 bytes: any double is stored as-is, and everything
+ * else hides in the payload of a quiet NaN. Strings live in a Heap and values
+ * only point at them, so a Value is trivially copyable and register-sized.
+ * Concatenated strings are ropes until something needs their contents.
  **/
-#include <print>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <limits>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <variant>
+#include <vector>
+
+#include "sink.h"
 
 namespace rt {
 using std::monostate;
-using std::println;
 using std::string;
 
-using Value = std::variant<monostate, bool, double, string>;
+class String;
+using StringPtr = String const*;
+
+// Contents of a string value. Concatenating long strings makes a rope node
+// that only points at its two halves, so a chain of + is linear instead of
+// copying the left side every time. The node is flattened in place the
+// first time its contents are needed: to print, compare or hash it.
+class String {
+  public:
+    explicit String(string value, const bool is_interned = false)
+        : is_interned(is_interned), contents(std::move(value)),
+          length(contents.size()) {}
+    // `left` followed by `right`, both have to outlive the node
+    String(const StringPtr left, const StringPtr right)
+        : left(left), right(right), length(left->size() + right->size()) {}
+
+    // Lives in the intern table, see intern.h. Interned strings are flat.
+    bool is_interned = false;
+
+    [[nodiscard]]
+    size_t size() const {
+        return length;
+    }
+    [[nodiscard]]
+    bool is_rope() const {
+        return left != nullptr;
+    }
+    // The contents, flattening a rope first
+    [[nodiscard]]
+    string const& flat() const {
+        if (is_rope()) {
+            flatten();
+        }
+        return contents;
+    }
+
+    bool operator==(String const& other) const {
+        // Interned strings are unique, so identity is equality
+        if (is_interned && other.is_interned) {
+            return this == &other;
+        }
+        return length == other.length && flat() == other.flat();
+    }
 
-static void print_value(Value const& val) {
-    std::visit(
-        [](auto&& var) {
-            using T = std::decay_t<decltype(var)>;
-            using std::is_same_v;
+  private:
+    mutable string contents;
+    // Both set for a rope that hasn't been flattened yet
+    mutable StringPtr left = nullptr;
+    mutable StringPtr right = nullptr;
+    size_t length;
 
-            if constexpr (is_same_v<T, monostate>) {
-                println("nil");
+    // Iterative, ropes can be as deep as the chain that built them
+    void flatten() const {
+        string out;
+        out.reserve(length);
+        // Right halves wait here while the left ones are walked
+        std::vector<StringPtr> pending{this};
+        while (!pending.empty()) {
+            const StringPtr node = pending.back();
+            pending.pop_back();
+            if (node->is_rope()) {
+                pending.push_back(node->right);
+                pending.push_back(node->left);
             } else {
-                println("{}", var);
+                out += node->contents;
             }
-        },
-        val);
+        }
+        contents = std::move(out);
+        left = nullptr;
+        right = nullptr;
+    }
+};
+
+// Owns every string created while evaluating, freed together with the heap.
+// Whoever runs an evaluation keeps the heap alive for as long as its result.
+class Heap {
+  public:
+    // Results up to this long are copied, longer ones are ropes
+    static constexpr size_t MAX_COPIED_CONCAT = 64;
+
+    [[nodiscard]]
+    StringPtr make_string(string value) {
+        return &strings.emplace_back(std::move(value));
+    }
+    // `left` followed by `right`, without copying either if it's long
+    [[nodiscard]]
+    StringPtr concat(const StringPtr left, const StringPtr right) {
+        if (left->size() + right->size() > MAX_COPIED_CONCAT) {
+            return &strings.emplace_back(left, right);
+        }
+        string out;
+        out.reserve(left->size() + right->size());
+        out += left->flat();
+        out += right->flat();
+        return make_string(std::move(out));
+    }
+    void clear() { strings.clear(); }
+
+  private:
+    // deque: growing it never moves existing strings
+    std::deque<String> strings;
+};
+
+enum class EValueType : uint8_t { Nil, Bool, Number, String };
+
+class Value {
+  public:
+    Value() : bits(NIL_BITS) {}
+    Value(monostate) : bits(NIL_BITS) {}
+    Value(const bool b) : bits(b ? TRUE_BITS : FALSE_BITS) {}
+    // NOTE: NaNs produced by arithmetic never have the QNAN payload bit set,
+    // so they can't be mistaken for a boxed value. Doubles read from files
+    // can, and go through canonical_number() first.
+    Value(const double num) : bits(std::bit_cast<uint64_t>(num)) {}
+    Value(const StringPtr str)
+        : bits(SIGN_BIT | QNAN | reinterpret_cast<uintptr_t>(str)) {}
+
+    // Not a Lox value: what a global holds until its var statement runs.
+    // Only ever stored in a program's globals, which check for it.
+    [[nodiscard]]
+    static Value undefined() {
+        Value val;
+        val.bits = UNDEFINED_BITS;
+        return val;
+    }
+    [[nodiscard]]
+    bool is_undefined() const {
+        return bits == UNDEFINED_BITS;
+    }
+
+    // Mirrors std::holds_alternative / std::get over
+    // monostate, bool, double and StringPtr
+    template <typename T>
+    [[nodiscard]]
+    bool holds() const {
+        if constexpr (std::is_same_v<T, double>) {
+            return (bits & QNAN) != QNAN;
+        } else if constexpr (std::is_same_v<T, monostate>) {
+            return bits == NIL_BITS;
+        } else if constexpr (std::is_same_v<T, bool>) {
+            return (bits | 1) == TRUE_BITS;
+        } else {
+            static_assert(std::is_same_v<T, StringPtr>);
+            return (bits & (SIGN_BIT | QNAN)) == (SIGN_BIT | QNAN);
+        }
+    }
+    template <typename T>
+    [[nodiscard]]
+    T get() const {
+        if constexpr (std::is_same_v<T, double>) {
+            return std::bit_cast<double>(bits);
+        } else if constexpr (std::is_same_v<T, monostate>) {
+            return monostate{};
+        } else if constexpr (std::is_same_v<T, bool>) {
+            return bits == TRUE_BITS;
+        } else {
+            static_assert(std::is_same_v<T, StringPtr>);
+            return reinterpret_cast<StringPtr>(bits & ~(SIGN_BIT | QNAN));
+        }
+    }
+
+    [[nodiscard]]
+    EValueType type() const {
+        if (holds<double>()) {
+            return EValueType::Number;
+        } else if (holds<StringPtr>()) {
+            return EValueType::String;
+        } else if (bits == NIL_BITS) {
+            return EValueType::Nil;
+        }
+        return EValueType::Bool;
+    }
+
+    // Same type and same contents, strings are compared by value
+    bool operator==(Value const& other) const {
+        if (holds<double>() && other.holds<double>()) {
+            return get<double>() == other.get<double>();
+        } else if (holds<StringPtr>() && other.holds<StringPtr>()) {
+            return *get<StringPtr>() == *other.get<StringPtr>();
+        }
+        return bits == other.bits;
+    }
+
+  private:
+    static constexpr uint64_t SIGN_BIT = 0x8000000000000000;
+    static constexpr uint64_t QNAN = 0x7ffc000000000000;
+    static constexpr uint64_t NIL_BITS = QNAN | 1;
+    static constexpr uint64_t FALSE_BITS = QNAN | 2;
+    static constexpr uint64_t TRUE_BITS = QNAN | 3;
+    static constexpr uint64_t UNDEFINED_BITS = QNAN | 4;
+
+    uint64_t bits;
+};
+static_assert(sizeof(Value) == 8);
+static_assert(std::is_trivially_copyable_v<Value>);
+
+// `num`, with any NaN replaced by the plain quiet NaN. A NaN's payload bits
+// could otherwise make a Value of it look like a boxed pointer.
+[[nodiscard]]
+inline double canonical_number(const double num) {
+    return std::isnan(num) ? std::numeric_limits<double>::quiet_NaN() : num;
+}
+
+// Runtime errors are a code and where they happened, the message and the
+// line are only looked up once the error gets printed
+enum class ERuntimeError : uint8_t {
+    // Not an error, for status returns
+    None,
+    OperandMustBeNumber,
+    OperandsMustBeNumbers,
+    OperandsMustBeNumbersOrStrings,
+    NilAst,
+    // Printed with the variable's name, read from the source at the offset
+    UndefinedVariable,
+};
+
+struct RuntimeError {
+    ERuntimeError code;
+    // Source offset of the node that failed, see Expr::offset
+    uint32_t offset = 0;
+
+    bool operator==(RuntimeError const&) const = default;
+};
+static_assert(sizeof(RuntimeError) == 8);
+
+[[nodiscard]]
+constexpr std::string_view error_message(const ERuntimeError code) {
+    switch (code) {
+    case ERuntimeError::None:
+        return "";
+    case ERuntimeError::OperandMustBeNumber:
+        return "Operand must be a number";
+    case ERuntimeError::OperandsMustBeNumbers:
+        return "Operands must be numbers.";
+    case ERuntimeError::OperandsMustBeNumbersOrStrings:
+        return "Operands must be two numbers or two strings";
+    case ERuntimeError::NilAst:
+        return "Input AST is nil";
+    case ERuntimeError::UndefinedVariable:
+        return "Undefined variable";
+    }
+    return "";
+}
+
+enum class ENumberStyle : uint8_t {
+    // What evaluate prints: 3, 2.5, 1e+21
+    Value,
+    // How tokenize and parse show literals: whole numbers written out in
+    // full with a ".0", so 3.0, 2.5, 1000000000000000000000.0
+    Literal,
+};
+
+// Enough for any double in either style, the longest being -DBL_MAX's
+// sign, 309 digits and ".0"
+constexpr size_t MAX_NUMBER_CHARS = 320;
+
+// The shortest digits that read back as the same double, or the whole
+// number for Literal, written at `first`. Returns the end of what was
+// written, at most MAX_NUMBER_CHARS further.
+inline char* format_number(char* const first, const double num,
+                           const ENumberStyle style) {
+    char* const last = first + MAX_NUMBER_CHARS;
+    if (style == ENumberStyle::Literal && std::isfinite(num) &&
+        num == std::trunc(num)) {
+        char* const end =
+            std::to_chars(first, last, num, std::chars_format::fixed).ptr;
+        end[0] = '.';
+        end[1] = '0';
+        return end + 2;
+    }
+    return std::to_chars(first, last, num).ptr;
+}
+
+inline void append_number(string& out, const double num,
+                          const ENumberStyle style) {
+    char buffer[MAX_NUMBER_CHARS];
+    out.append(buffer, format_number(buffer, num, style));
+}
+
+// What print_value() prints, without the newline, appended to `out`
+inline void append_value(string& out, Value const& val) {
+    switch (val.type()) {
+    case EValueType::Nil:
+        out += "nil";
+        break;
+    case EValueType::Bool:
+        out += val.get<bool>() ? "true" : "false";
+        break;
+    case EValueType::Number:
+        append_number(out, val.get<double>(), ENumberStyle::Value);
+        break;
+    case EValueType::String:
+        out += val.get<StringPtr>()->flat();
+        break;
+    }
+}
+
+[[nodiscard]]
+inline string format_value(Value const& val) {
+    string out;
+    append_value(out, val);
+    return out;
+}
+
+inline void print_value(Value const& val, sink::Sink& out = sink::out()) {
+    out.append([&val](string& buffer) {
+        append_value(buffer, val);
+        buffer += '\n';
+    });
 }
 
 } // namespace rt
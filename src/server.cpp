@@ -0,0 +1,260 @@
+#include "server.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <iterator>
+#include <optional>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace server {
+namespace {
+constexpr size_t READ_BUFFER_BYTES = 64 * 1024;
+// Refused rather than buffered
+constexpr size_t MAX_REQUEST_BYTES = 256 * 1024 * 1024;
+// Enough for any size_t
+constexpr size_t MAX_LENGTH_DIGITS = 20;
+
+// Buffered reads straight from a file descriptor
+class FdReader {
+  public:
+    explicit FdReader(const int fd) : fd(fd) {}
+
+    // The next byte, nullopt once the stream ended (or broke)
+    std::optional<char> get() {
+        if (pos == len && !fill()) {
+            return std::nullopt;
+        }
+        return buffer[pos++];
+    }
+
+    // Append exactly n bytes to out, false if the stream ends first
+    bool read(size_t n, std::string& out) {
+        const size_t buffered = std::min(n, len - pos);
+        out.append(buffer.data() + pos, buffered);
+        pos += buffered;
+        n -= buffered;
+
+        // The rest goes straight into `out`, skipping the buffer
+        size_t done = out.size();
+        out.resize(out.size() + n);
+        while (n > 0) {
+            const ssize_t got = ::read(fd, out.data() + done, n);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got <= 0) {
+                return false;
+            }
+            done += got;
+            n -= got;
+        }
+        return true;
+    }
+
+  private:
+    int fd;
+    std::array<char, READ_BUFFER_BYTES> buffer;
+    size_t pos = 0;
+    size_t len = 0;
+
+    bool fill() {
+        while (true) {
+            const ssize_t got = ::read(fd, buffer.data(), buffer.size());
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            pos = 0;
+            len = got > 0 ? got : 0;
+            return got > 0;
+        }
+    }
+};
+
+// The "<length>\n" request header. nullopt at a clean end of stream.
+std::expected<std::optional<size_t>, std::string>
+read_length(FdReader& reader) {
+    size_t length = 0;
+    size_t digits = 0;
+    while (true) {
+        const auto c = reader.get();
+        if (!c.has_value()) {
+            if (digits == 0) {
+                return std::nullopt;
+            }
+            return std::unexpected("Stream ended inside a request header");
+        }
+        if (*c == '\n' && digits > 0) {
+            break;
+        }
+        if (*c < '0' || *c > '9' || digits == MAX_LENGTH_DIGITS) {
+            return std::unexpected("Malformed request header");
+        }
+        length = length * 10 + (*c - '0');
+        digits += 1;
+    }
+    if (length > MAX_REQUEST_BYTES) {
+        return std::unexpected(std::format(
+            "Request of {} bytes is over the {} byte limit", length,
+            MAX_REQUEST_BYTES));
+    }
+    return length;
+}
+
+bool write_all(const int fd, std::string_view data) {
+    while (!data.empty()) {
+        // No SIGPIPE when the client hung up, just an error
+        ssize_t written = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (written < 0 && errno == ENOTSOCK) {
+            written = ::write(fd, data.data(), data.size());
+        }
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data.remove_prefix(written);
+    }
+    return true;
+}
+} // namespace
+
+std::expected<void, std::string> serve_fds(const int in_fd, const int out_fd,
+                                           driver::Options const& options,
+                                           cache::Cache* cache) {
+    FdReader reader(in_fd);
+    driver::Session session;
+    session.cache = cache;
+    // Reused for every request, like the session
+    std::string source;
+    std::string response;
+
+    while (true) {
+        const auto length = read_length(reader);
+        if (!length.has_value()) {
+            return std::unexpected(length.error());
+        }
+        if (!length->has_value()) {
+            return {};
+        }
+        source.clear();
+        if (!reader.read(**length, source)) {
+            return std::unexpected("Stream ended inside a request");
+        }
+
+        driver::evaluate(source, options, session);
+
+        driver::Output const& output = session.output;
+        response.clear();
+        std::format_to(std::back_inserter(response), "{} {} {}\n",
+                       output.exit_code, output.out.size(), output.err.size());
+        response += output.out;
+        response += output.err;
+        if (!write_all(out_fd, response)) {
+            return std::unexpected("Could not write a response");
+        }
+    }
+}
+
+SocketServer::SocketServer(driver::Options options, const size_t num_threads,
+                           cache::Cache* cache)
+    : options(std::move(options)), cache(cache), pool(num_threads) {}
+
+SocketServer::~SocketServer() {
+    if (listen_fd >= 0) {
+        ::close(listen_fd);
+        ::unlink(socket_path.c_str());
+    }
+}
+
+std::expected<void, std::string>
+SocketServer::listen(std::string const& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        return std::unexpected(std::format("Socket path too long: {}", path));
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    // A socket there was left behind by a server that didn't shut down
+    // cleanly. Anything else is likely a typo in the path, and kept.
+    struct stat st{};
+    if (::lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            return std::unexpected(std::format(
+                "Could not listen on {}: exists and is not a socket", path));
+        }
+        ::unlink(path.c_str());
+    } else if (errno != ENOENT) {
+        return std::unexpected(std::format("Could not listen on {}: {}", path,
+                                           std::strerror(errno)));
+    }
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return std::unexpected(
+            std::format("Could not create socket: {}", std::strerror(errno)));
+    }
+    if (::bind(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) <
+            0 ||
+        ::listen(fd, SOMAXCONN) < 0) {
+        const int err = errno;
+        ::close(fd);
+        return std::unexpected(std::format("Could not listen on {}: {}", path,
+                                           std::strerror(err)));
+    }
+    listen_fd = fd;
+    socket_path = path;
+    return {};
+}
+
+void SocketServer::run() {
+    while (!stopping) {
+        const int conn = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            // Including the listening socket being shut down by stop()
+            break;
+        }
+        {
+            const std::lock_guard lock(conns_mutex);
+            conns.insert(conn);
+        }
+        pool.submit([this, conn] {
+            // A broken connection only ends that connection
+            (void)serve_fds(conn, conn, options, cache);
+            // Closed under the lock, so the fd can't be reused by another
+            // connection while the loop below shuts it down
+            const std::lock_guard lock(conns_mutex);
+            conns.erase(conn);
+            ::close(conn);
+        });
+    }
+
+    // Idle clients would otherwise keep the pool busy forever. Shutting
+    // their connections down ends serve_fds() at the next read, answered
+    // requests are still written back.
+    {
+        const std::lock_guard lock(conns_mutex);
+        for (const int conn : conns) {
+            ::shutdown(conn, SHUT_RD);
+        }
+    }
+    pool.wait();
+}
+
+void SocketServer::stop() {
+    stopping = true;
+    // Wakes up a blocked accept()
+    ::shutdown(listen_fd, SHUT_RDWR);
+}
+
+} // namespace server
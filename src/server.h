@@ -0,0 +1,68 @@
+#pragma once
+/**
+ * The serve command: one warm interpreter answering many requests
+ * Requests and responses are length-prefixed, so sources can hold any bytes:
+ *   request:  "<source bytes>\n" <source>
+ *   response: "<exit code> <stdout bytes> <stderr bytes>\n" <stdout> <stderr>
+ * where stdout/stderr are what `evaluate` would have printed. Every stream
+ * gets a driver::Session that's reused from one request to the next, and
+ * interned strings, and the compiled program cache if any, are shared by all
+ * of them.
+ **/
+
+#include <atomic>
+#include <cstddef>
+#include <expected>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#include "driver.h"
+#include "thread_pool.h"
+
+namespace server {
+
+// Answer requests read from in_fd on out_fd, until in_fd ends.
+// Fails on a malformed request or a broken stream.
+[[nodiscard]]
+std::expected<void, std::string> serve_fds(int in_fd, int out_fd,
+                                           driver::Options const& options,
+                                           cache::Cache* cache = nullptr);
+
+// Serves every connection on a Unix domain socket with serve_fds(), each as
+// a task on a pool of num_threads (0: one per hardware thread). Connections
+// beyond that many wait for a free thread.
+class SocketServer {
+  public:
+    SocketServer(driver::Options options, size_t num_threads,
+                 cache::Cache* cache = nullptr);
+    // Closes the socket and removes its file
+    ~SocketServer();
+
+    SocketServer(SocketServer const&) = delete;
+    SocketServer& operator=(SocketServer const&) = delete;
+
+    // Bind to `path`, replacing a stale socket file there. Fails if
+    // something else is at `path`.
+    [[nodiscard]]
+    std::expected<void, std::string> listen(std::string const& path);
+    // Accept connections until stop(), then end the open ones once their
+    // current request is answered
+    void run();
+    // Callable from other threads and from signal handlers
+    void stop();
+
+  private:
+    driver::Options options;
+    cache::Cache* cache;
+    ThreadPool pool;
+    std::string socket_path;
+    int listen_fd = -1;
+    std::atomic<bool> stopping = false;
+    // Accepted and not yet closed. Only touched by run() and its tasks,
+    // stop() has to stay async-signal-safe.
+    std::mutex conns_mutex;
+    std::unordered_set<int> conns;
+};
+
+} // namespace server
@@ -0,0 +1,44 @@
+#include "sink.h"
+
+#include <cerrno>
+#include <unistd.h>
+
+namespace sink {
+
+Sink::Sink(const int fd, const size_t block_bytes, Sink* tied)
+    : fd(fd), block_bytes(block_bytes), tied(tied) {
+    buffer.reserve(block_bytes);
+}
+
+void Sink::flush() {
+    if (tied != nullptr) {
+        tied->flush();
+    }
+    std::string_view data = buffer;
+    while (!data.empty()) {
+        const ssize_t written = ::write(fd, data.data(), data.size());
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        writes += 1;
+        if (written <= 0) {
+            break;
+        }
+        data.remove_prefix(written);
+    }
+    // Keeps the capacity
+    buffer.clear();
+}
+
+Sink& out() {
+    static Sink sink(STDOUT_FILENO);
+    return sink;
+}
+
+Sink& err() {
+    // Constructed after out(), so destroyed and flushed before it
+    static Sink sink(STDERR_FILENO, 0, &out());
+    return sink;
+}
+
+} // namespace sink
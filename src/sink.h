@@ -0,0 +1,87 @@
+#pragma once
+/**
+ * Buffered output for the command line
+ * Output is formatted straight into one reusable buffer and written out in
+ * large blocks, instead of a write (and a temporary string) per line.
+ * stderr is tied to stdout: pending stdout output is written before anything
+ * goes to stderr, so the two interleave in the order they were printed.
+ **/
+
+#include <cstddef>
+#include <format>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace sink {
+
+class Sink {
+  public:
+    // Buffered output is written out once it grows past this
+    static constexpr size_t BLOCK_BYTES = 64 * 1024;
+
+    // A `block_bytes` of 0 writes through. `tied`, if any, is flushed
+    // before every write of this sink.
+    explicit Sink(int fd, size_t block_bytes = BLOCK_BYTES,
+                  Sink* tied = nullptr);
+    Sink(Sink const&) = delete;
+    Sink& operator=(Sink const&) = delete;
+    ~Sink() { flush(); }
+
+    template <typename... Args>
+    void print(std::format_string<Args...> fmt, Args&&... args) {
+        std::format_to(std::back_inserter(buffer), fmt,
+                       std::forward<Args>(args)...);
+        wrote();
+    }
+    template <typename... Args>
+    void println(std::format_string<Args...> fmt, Args&&... args) {
+        std::format_to(std::back_inserter(buffer), fmt,
+                       std::forward<Args>(args)...);
+        buffer += '\n';
+        wrote();
+    }
+    void write(const std::string_view bytes) {
+        buffer += bytes;
+        wrote();
+    }
+    // For formatting without a format string: `fill` appends to the
+    // buffer directly
+    template <typename F> void append(F&& fill) {
+        std::forward<F>(fill)(buffer);
+        wrote();
+    }
+
+    // Writes out everything buffered. Output that can't be written (a
+    // closed pipe, a full disk) is dropped.
+    void flush();
+
+    // write() calls so far, for the benchmarks
+    [[nodiscard]]
+    size_t num_writes() const {
+        return writes;
+    }
+
+  private:
+    int fd;
+    size_t block_bytes;
+    Sink* tied;
+    std::string buffer;
+    size_t writes = 0;
+
+    void wrote() {
+        if (buffer.size() >= block_bytes) {
+            flush();
+        }
+    }
+};
+
+// stdout, buffered until a block is full or the process exits
+[[nodiscard]]
+Sink& out();
+// stderr, written through, tied to out()
+[[nodiscard]]
+Sink& err();
+
+} // namespace sink
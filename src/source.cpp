@@ -0,0 +1,119 @@
+#include "source.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fcntl.h>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+LineIndex::LineIndex(std::vector<uint32_t> starts) : starts(std::move(starts)) {
+    assert(!this->starts.empty() && this->starts.front() == 0);
+}
+
+SourcePos LineIndex::locate(const uint32_t offset) {
+    std::vector<uint32_t> const& lines = line_starts();
+    // First line starting after `offset`, the one before holds it
+    const auto after = std::ranges::upper_bound(lines, offset);
+    const auto line = static_cast<uint32_t>(after - lines.begin());
+    return SourcePos{line, offset - *(after - 1) + 1};
+}
+
+std::vector<uint32_t> const& LineIndex::line_starts() {
+    if (starts.empty()) {
+        // Offsets are 32-bit
+        assert(source.size() <= UINT32_MAX);
+        starts.push_back(0);
+        for (size_t i = source.find('\n'); i != std::string_view::npos;
+             i = source.find('\n', i + 1)) {
+            starts.push_back(static_cast<uint32_t>(i + 1));
+        }
+    }
+    return starts;
+}
+
+static std::string too_large(std::string const& path) {
+    return std::format("Error reading file: {} is larger than {} bytes", path,
+                       MAX_SOURCE_SIZE);
+}
+
+std::expected<SourceBuffer, std::string>
+SourceBuffer::open(std::string const& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return std::unexpected("Error reading file: " + path);
+    }
+
+    struct stat st {};
+    const bool is_file = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    if (is_file && static_cast<uint64_t>(st.st_size) > MAX_SOURCE_SIZE) {
+        ::close(fd);
+        return std::unexpected(too_large(path));
+    }
+    if (is_file && st.st_size > 0) {
+        const auto size = static_cast<size_t>(st.st_size);
+        void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            // The mapping stays valid after closing the descriptor
+            ::close(fd);
+            // Lexing is one front-to-back pass
+            ::madvise(data, size, MADV_SEQUENTIAL);
+
+            SourceBuffer buffer;
+            buffer.mapped_data = static_cast<const char*>(data);
+            buffer.mapped_size = size;
+            buffer.is_mapped = true;
+            return buffer;
+        }
+    }
+    ::close(fd);
+
+    // Not mappable: fall back to reading it in
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return std::unexpected("Error reading file: " + path);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    std::string read = std::move(contents).str();
+    if (read.size() > MAX_SOURCE_SIZE) {
+        return std::unexpected(too_large(path));
+    }
+    return from_string(std::move(read));
+}
+
+SourceBuffer SourceBuffer::from_string(std::string contents) {
+    SourceBuffer buffer;
+    buffer.owned = std::move(contents);
+    return buffer;
+}
+
+SourceBuffer::SourceBuffer(SourceBuffer&& other) noexcept
+    : mapped_data(std::exchange(other.mapped_data, nullptr)),
+      mapped_size(std::exchange(other.mapped_size, 0)),
+      is_mapped(std::exchange(other.is_mapped, false)),
+      owned(std::move(other.owned)) {}
+
+SourceBuffer& SourceBuffer::operator=(SourceBuffer&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        mapped_data = std::exchange(other.mapped_data, nullptr);
+        mapped_size = std::exchange(other.mapped_size, 0);
+        is_mapped = std::exchange(other.is_mapped, false);
+        owned = std::move(other.owned);
+    }
+    return *this;
+}
+
+SourceBuffer::~SourceBuffer() { unmap(); }
+
+void SourceBuffer::unmap() {
+    if (is_mapped) {
+        ::munmap(const_cast<char*>(mapped_data), mapped_size);
+        is_mapped = false;
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+/**
+ * Source files and positions in them for the Lox interpreter
+ * Regular files are mmap'd read-only, so loading is zero-copy and the lexer
+ * hands out string_views straight into the mapping. Anything that can't be
+ * mapped (pipes, empty files) is read into an owned buffer instead.
+ * Tokens and nodes only remember byte offsets into the source. Lines and
+ * columns are looked up from a LineIndex, once something gets reported.
+ **/
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Offsets are 32-bit, larger sources are refused before they get lexed
+constexpr size_t MAX_SOURCE_SIZE = UINT32_MAX;
+
+// Bytes [offset, offset + length) of the source
+struct Span {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+
+    bool operator==(Span const&) const = default;
+};
+
+// Line and column, both 1-based
+struct SourcePos {
+    uint32_t line = 0;
+    uint32_t column = 0;
+
+    bool operator==(SourcePos const&) const = default;
+};
+
+// Where each line of a source starts, to turn offsets into positions.
+// The lines are only scanned for on the first lookup.
+class LineIndex {
+  public:
+    // `source` has to outlive the index
+    explicit LineIndex(std::string_view source) : source(source) {}
+    // From line_starts() of an earlier index, once the source is gone
+    explicit LineIndex(std::vector<uint32_t> starts);
+
+    // Binary search over the line starts. Offsets past the end are on the
+    // last line.
+    [[nodiscard]]
+    SourcePos locate(uint32_t offset);
+    [[nodiscard]]
+    uint32_t line_of(const uint32_t offset) {
+        return locate(offset).line;
+    }
+
+    // Offset of each line's first char, the first one is always 0
+    [[nodiscard]]
+    std::vector<uint32_t> const& line_starts();
+
+  private:
+    std::string_view source;
+    std::vector<uint32_t> starts;
+};
+
+class SourceBuffer {
+  public:
+    // Fails for files over MAX_SOURCE_SIZE
+    [[nodiscard]]
+    static std::expected<SourceBuffer, std::string>
+    open(std::string const& path);
+
+    // Wrap an in-memory string, e.g. for tests
+    [[nodiscard]]
+    static SourceBuffer from_string(std::string contents);
+
+    SourceBuffer(SourceBuffer&& other) noexcept;
+    SourceBuffer& operator=(SourceBuffer&& other) noexcept;
+    SourceBuffer(SourceBuffer const&) = delete;
+    SourceBuffer& operator=(SourceBuffer const&) = delete;
+    ~SourceBuffer();
+
+    // Valid for as long as this buffer lives
+    [[nodiscard]]
+    std::string_view view() const {
+        return is_mapped ? std::string_view(mapped_data, mapped_size)
+                         : std::string_view(owned);
+    }
+    [[nodiscard]]
+    bool mapped() const {
+        return is_mapped;
+    }
+
+  private:
+    SourceBuffer() = default;
+    void unmap();
+
+    const char* mapped_data = nullptr;
+    size_t mapped_size = 0;
+    bool is_mapped = false;
+    // Fallback storage when the file couldn't be mapped
+    std::string owned;
+};
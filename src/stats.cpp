@@ -0,0 +1,66 @@
+#include "stats.h"
+
+#ifdef INTERP_STATS
+
+#include <atomic>
+#include <format>
+#include <iterator>
+
+namespace stats {
+namespace {
+constexpr const char* STAGE_NAMES[NUM_STAGES] = {"read",  "lex",  "lift",
+                                                 "parse", "fold", "eval"};
+
+std::atomic<uint64_t> stage_ns[NUM_STAGES];
+std::atomic<size_t> tokens;
+std::atomic<size_t> nodes;
+std::atomic<size_t> max_depth;
+std::atomic<size_t> allocs;
+std::atomic<size_t> alloc_bytes;
+} // namespace
+
+void add_stage_time(const EStage stage,
+                    const std::chrono::nanoseconds elapsed) {
+    stage_ns[static_cast<size_t>(stage)].fetch_add(elapsed.count(),
+                                                   std::memory_order_relaxed);
+}
+
+void add_tokens(const size_t count) {
+    tokens.fetch_add(count, std::memory_order_relaxed);
+}
+
+void add_nodes(const size_t count) {
+    nodes.fetch_add(count, std::memory_order_relaxed);
+}
+
+void note_depth(const size_t depth) {
+    size_t seen = max_depth.load(std::memory_order_relaxed);
+    while (depth > seen && !max_depth.compare_exchange_weak(
+                               seen, depth, std::memory_order_relaxed)) {
+    }
+}
+
+void record_alloc(const size_t bytes) {
+    allocs.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+std::string summary() {
+    std::string line = "stats:";
+    auto out = std::back_inserter(line);
+    for (size_t i = 0; i < NUM_STAGES; ++i) {
+        std::format_to(out, " {}_ns={}", STAGE_NAMES[i],
+                       stage_ns[i].load(std::memory_order_relaxed));
+    }
+    std::format_to(out, " tokens={} nodes={} max_depth={} allocs={} "
+                        "alloc_bytes={}",
+                   tokens.load(std::memory_order_relaxed),
+                   nodes.load(std::memory_order_relaxed),
+                   max_depth.load(std::memory_order_relaxed),
+                   allocs.load(std::memory_order_relaxed),
+                   alloc_bytes.load(std::memory_order_relaxed));
+    return line;
+}
+} // namespace stats
+
+#endif
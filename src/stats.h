@@ -0,0 +1,79 @@
+#pragma once
+/**
+ * Per-stage timing and allocation counters behind --stats
+ * Only built in with -DINTERP_STATS (the INTERP_STATS CMake option). Without
+ * it every hook below is an empty inline function and StageTimer an empty
+ * object, so instrumented code compiles to exactly what it was before.
+ * Counters are process-wide atomics: a batch run sums them over all files
+ * and threads.
+ **/
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef INTERP_STATS
+#include <chrono>
+#endif
+
+namespace stats {
+
+#ifdef INTERP_STATS
+constexpr bool ENABLED = true;
+#else
+constexpr bool ENABLED = false;
+#endif
+
+enum class EStage : uint8_t { Read, Lex, Lift, Parse, Fold, Eval };
+constexpr size_t NUM_STAGES = 6;
+
+#ifdef INTERP_STATS
+
+void add_stage_time(EStage stage, std::chrono::nanoseconds elapsed);
+void add_tokens(size_t count);
+void add_nodes(size_t count);
+// Parser nesting, which is also how deep the tree evaluator recurses
+void note_depth(size_t depth);
+// Called by the global operator new replacement in main.cpp
+void record_alloc(size_t bytes);
+
+// Adds the time from construction to destruction to `stage`
+class StageTimer {
+  public:
+    explicit StageTimer(const EStage stage)
+        : stage(stage), start(std::chrono::steady_clock::now()) {}
+    ~StageTimer() {
+        add_stage_time(stage, std::chrono::steady_clock::now() - start);
+    }
+    StageTimer(StageTimer const&) = delete;
+    StageTimer& operator=(StageTimer const&) = delete;
+
+  private:
+    EStage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+// One line of key=value pairs, e.g. "stats: read_ns=1200 lex_ns=..."
+[[nodiscard]]
+std::string summary();
+
+#else
+
+inline void add_tokens(size_t) {}
+inline void add_nodes(size_t) {}
+inline void note_depth(size_t) {}
+inline void record_alloc(size_t) {}
+
+class StageTimer {
+  public:
+    explicit StageTimer(EStage) {}
+};
+
+[[nodiscard]]
+inline std::string summary() {
+    return "";
+}
+
+#endif
+
+} // namespace stats
@@ -0,0 +1,98 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t num_threads) {
+    if (num_threads == 0) {
+        num_threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    // Only once all queues exist, workers steal from each other
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        const std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    has_work.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    unfinished += 1;
+    {
+        // Counted before it's pushed, so taking it can't underflow `queued`.
+        // Under the lock, so a worker about to sleep can't miss it.
+        const std::lock_guard lock(mutex);
+        queued += 1;
+    }
+    Queue& queue = *queues[next_queue];
+    next_queue = (next_queue + 1) % queues.size();
+    {
+        const std::lock_guard lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    has_work.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock lock(mutex);
+    all_done.wait(lock, [this] { return unfinished == 0; });
+}
+
+std::optional<ThreadPool::Task> ThreadPool::take(const size_t idx) {
+    {
+        Queue& own = *queues[idx];
+        const std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            Task task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return task;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); ++i) {
+        Queue& victim = *queues[(idx + i) % queues.size()];
+        const std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            Task task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return task;
+        }
+    }
+    return std::nullopt;
+}
+
+void ThreadPool::worker_loop(const size_t idx) {
+    while (true) {
+        if (auto task = take(idx)) {
+            queued -= 1;
+            // Tasks report their own errors. One that throws anyway is
+            // dropped, instead of terminating the process and leaving
+            // wait() hanging.
+            try {
+                (*task)();
+            } catch (...) {
+            }
+            if (unfinished.fetch_sub(1) == 1) {
+                const std::lock_guard lock(mutex);
+                all_done.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock lock(mutex);
+        has_work.wait(lock, [this] { return queued > 0 || stopping; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+/**
+ * Work-stealing thread pool for the Lox interpreter
+ * Each worker has its own task deque. Workers take their newest task first
+ * and, once they run dry, steal the oldest task of another worker, so uneven
+ * tasks (one huge file among many small ones) still keep every thread busy.
+ **/
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+  public:
+    using Task = std::function<void()>;
+
+    // 0 threads means one per hardware thread
+    explicit ThreadPool(size_t num_threads = 0);
+    // Runs whatever is still queued, then joins the workers
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    // Tasks are spread round-robin over the workers' deques. An exception
+    // out of a task is swallowed, it still counts as finished.
+    void submit(Task task);
+    // Blocks until every submitted task has finished
+    void wait();
+
+    [[nodiscard]]
+    size_t size() const {
+        return workers.size();
+    }
+
+  private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    size_t next_queue = 0;
+
+    // Guards sleeping and waking up, the counters below are read under it
+    std::mutex mutex;
+    std::condition_variable has_work;
+    std::condition_variable all_done;
+    // Submitted but not yet taken by a worker
+    std::atomic<size_t> queued = 0;
+    // Submitted but not yet finished
+    std::atomic<size_t> unfinished = 0;
+    bool stopping = false;
+
+    void worker_loop(size_t idx);
+    // Own deque first (newest task), then the others (oldest task)
+    std::optional<Task> take(size_t idx);
+};
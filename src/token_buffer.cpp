@@ -0,0 +1,73 @@
+#include "token_buffer.h"
+
+#include <array>
+#include <cassert>
+#include <utility>
+
+using std::string_view;
+
+namespace {
+using Rebuild = TokenVariant (*)(TokenBuffer const&, size_t);
+
+template <typename T>
+TokenVariant rebuild(TokenBuffer const& buffer, const size_t idx) {
+    if constexpr (std::is_same_v<T, StringLiteral>) {
+        // Drop the quotes
+        const string_view lexeme = buffer.lexeme(idx);
+        return StringLiteral(lexeme.substr(1, lexeme.size() - 2),
+                             buffer.span(idx));
+    } else if constexpr (std::is_same_v<T, NumberLiteral>) {
+        return NumberLiteral(buffer.lexeme(idx), buffer.number(idx),
+                             buffer.span(idx));
+    } else if constexpr (std::is_same_v<T, Ident>) {
+        return Ident(buffer.lexeme(idx), buffer.span(idx));
+    } else {
+        return T{buffer.span(idx)};
+    }
+}
+
+// Indexed by TokenKind
+template <size_t... Is>
+constexpr auto make_rebuild_table(std::index_sequence<Is...>) {
+    return std::array<Rebuild, sizeof...(Is)>{
+        &rebuild<std::variant_alternative_t<Is, TokenVariant>>...};
+}
+constexpr auto REBUILD_TABLE = make_rebuild_table(
+    std::make_index_sequence<std::variant_size_v<TokenVariant>>());
+} // namespace
+
+TokenBuffer::TokenBuffer(const string_view source) : source(source) {
+    // Offsets are 32-bit
+    assert(source.size() <= UINT32_MAX);
+
+    Lexer lexer(source);
+    while (true) {
+        auto tok = lexer.next();
+        if (!tok.has_value()) {
+            lex_errors.push_back(std::move(tok.error()));
+            continue;
+        }
+        push(*tok, lexer.last_span());
+        if (std::holds_alternative<EndOfFile>(*tok)) {
+            break;
+        }
+    }
+}
+
+void TokenBuffer::push(TokenVariant const& tok, const Span span) {
+    kinds.push_back(static_cast<TokenKind>(tok.index()));
+    offsets.push_back(span.offset);
+    lengths.push_back(span.length);
+    const auto* num = std::get_if<NumberLiteral>(&tok);
+    numbers.push_back(num != nullptr ? num->value : 0.0);
+}
+
+TokenVariant TokenBuffer::token(const size_t idx) const {
+    return REBUILD_TABLE[kinds[idx]](*this, idx);
+}
+
+size_t TokenBuffer::memory_bytes() const {
+    return kinds.size() * sizeof(TokenKind) +
+           (offsets.size() + lengths.size()) * sizeof(uint32_t) +
+           numbers.size() * sizeof(double);
+}
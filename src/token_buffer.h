@@ -0,0 +1,119 @@
+#pragma once
+/**
+ * Packed token storage for the Lox interpreter
+ * A TokenBuffer holds lexed tokens as a struct of arrays: a 1-byte kind (the
+ * token's TokenVariant index), the source offset and length, plus the
+ * pre-parsed value of number literals. That's 17 bytes per token instead of
+ * a 40-byte TokenVariant. Tokens are turned back into TokenVariants on
+ * demand, and the Token/StrToken concepts keep working via token_kind<T>.
+ **/
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lexer.h"
+
+class TokenBuffer {
+  public:
+    // Lex all of `source`, which has to outlive the buffer.
+    // Lex errors are set aside in errors(), like TokenStream does.
+    explicit TokenBuffer(std::string_view source);
+
+    [[nodiscard]]
+    size_t size() const {
+        return kinds.size();
+    }
+    [[nodiscard]]
+    TokenKind kind(const size_t idx) const {
+        return kinds[idx];
+    }
+    // Rebuilt from the packed fields
+    [[nodiscard]]
+    TokenVariant token(size_t idx) const;
+    // Including the quotes for strings
+    [[nodiscard]]
+    std::string_view lexeme(const size_t idx) const {
+        return source.substr(offsets[idx], lengths[idx]);
+    }
+    [[nodiscard]]
+    Span span(const size_t idx) const {
+        return Span{offsets[idx], lengths[idx]};
+    }
+    // Value of a NumberLiteral token
+    [[nodiscard]]
+    double number(const size_t idx) const {
+        return numbers[idx];
+    }
+
+    [[nodiscard]]
+    std::vector<std::string> const& errors() const {
+        return lex_errors;
+    }
+
+    // Bytes used by the columns, without vector growth slack.
+    // For comparing against a TokenVec.
+    [[nodiscard]]
+    size_t memory_bytes() const;
+
+    // Random access, like a TokenVec iterator. Dereferencing builds the
+    // TokenVariant, kind() is enough to classify it.
+    class Iterator {
+      public:
+        Iterator(TokenBuffer const* buffer, const size_t idx)
+            : buffer(buffer), idx(idx) {}
+
+        TokenVariant operator*() const { return buffer->token(idx); }
+        [[nodiscard]]
+        TokenKind kind() const {
+            return buffer->kind(idx);
+        }
+        [[nodiscard]]
+        Span span() const {
+            return buffer->span(idx);
+        }
+
+        Iterator& operator+=(const size_t n) {
+            idx += n;
+            return *this;
+        }
+        Iterator operator+(const size_t n) const {
+            return Iterator(buffer, idx + n);
+        }
+        bool operator<(Iterator const& other) const { return idx < other.idx; }
+        bool operator>=(Iterator const& other) const {
+            return idx >= other.idx;
+        }
+        bool operator==(Iterator const& other) const {
+            return idx == other.idx;
+        }
+
+      private:
+        TokenBuffer const* buffer;
+        size_t idx;
+    };
+
+    [[nodiscard]]
+    Iterator begin() const {
+        return Iterator(this, 0);
+    }
+    [[nodiscard]]
+    Iterator end() const {
+        return Iterator(this, size());
+    }
+
+  private:
+    std::string_view source;
+
+    // One entry per token
+    std::vector<TokenKind> kinds;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    // Only meaningful for NumberLiterals
+    std::vector<double> numbers;
+
+    std::vector<std::string> lex_errors;
+
+    void push(TokenVariant const& tok, Span span);
+};
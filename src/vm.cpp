@@ -0,0 +1,486 @@
+#include "vm.h"
+#include "eval.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <utility>
+#include <variant>
+
+namespace vm {
+using EBinOp = Expr_Binary::EBinaryOperator;
+using EUnaryOp = Expr_Unary::EUnaryOperator;
+
+void Chunk::write_constant(Value value) {
+    const size_t idx = constants.size();
+    constants.push_back(std::move(value));
+
+    if (idx <= UINT8_MAX) {
+        write(OpCode::Constant);
+        code.push_back(static_cast<uint8_t>(idx));
+    } else {
+        assert(idx <= UINT32_MAX);
+        write(OpCode::ConstantLong);
+        for (size_t byte = 0; byte < 4; ++byte) {
+            code.push_back(static_cast<uint8_t>(idx >> (byte * 8)));
+        }
+    }
+}
+
+void Chunk::write_slot(const OpCode op, const uint32_t index) {
+    assert(index <= UINT16_MAX);
+    write(op);
+    code.push_back(static_cast<uint8_t>(index));
+    code.push_back(static_cast<uint8_t>(index >> 8));
+}
+
+uint32_t Chunk::offset_at(const size_t pos) const {
+    const auto it = std::ranges::lower_bound(marks, pos, {}, &SourceMark::pos);
+    return it != marks.end() && it->pos == pos ? it->offset : 0;
+}
+
+// Emits code in post-order: operands first, then the operator
+class Compiler {
+  public:
+    explicit Compiler(Chunk& chunk) : chunk(chunk) {}
+
+    void visit_literal(Expr_Literal const& literal) const {
+        std::visit(
+            [this](auto&& var) {
+                using T = std::decay_t<decltype(var)>;
+                using std::is_same_v;
+
+                if constexpr (is_same_v<T, Expr_Literal::Number>) {
+                    chunk.write_constant(var.value);
+                } else if constexpr (is_same_v<T, Expr_Literal::String>) {
+                    // Interned, so the constant is just the pointer
+                    chunk.write_constant(var.value.get());
+                } else if constexpr (is_same_v<T, Expr_Literal::True>) {
+                    chunk.write(OpCode::True);
+                } else if constexpr (is_same_v<T, Expr_Literal::False>) {
+                    chunk.write(OpCode::False);
+                } else if constexpr (is_same_v<T, Expr_Literal::Nil>) {
+                    chunk.write(OpCode::Nil);
+                } else {
+                    std::unreachable();
+                }
+            },
+            literal.inner);
+        push();
+    }
+    void visit_grouping(Expr_Grouping const& grouping) const {
+        // Groupings only matter for the tree shape, nothing to emit
+        visit_expr(*grouping.inner, *this);
+    }
+    void visit_unary(Expr_Unary const& unary) const {
+        visit_expr(*unary.inner, *this);
+        chunk.mark(unary.offset);
+        chunk.write(unary.op == EUnaryOp::Minus ? OpCode::Negate
+                                                : OpCode::Not);
+    }
+    void visit_binary(Expr_Binary const& binary) const {
+        visit_expr(*binary.left, *this);
+        visit_expr(*binary.right, *this);
+        chunk.mark(binary.offset);
+        chunk.write(binary_opcode(binary.op));
+        // Two operands in, one result out
+        --depth;
+    }
+    void visit_variable(Expr_Variable const& variable) const {
+        const Slot slot = resolved(variable.slot);
+        if (slot.scope == EScope::Global) {
+            // Fails while the global is undefined
+            chunk.mark(variable.offset);
+            chunk.write_slot(OpCode::GetGlobal, slot.index);
+        } else {
+            chunk.write_slot(OpCode::GetLocal, slot.index);
+        }
+        push();
+    }
+    void visit_assign(Expr_Assign const& assign) const {
+        visit_expr(*assign.value, *this);
+        const Slot slot = resolved(assign.slot);
+        if (slot.scope == EScope::Global) {
+            chunk.mark(assign.offset);
+            chunk.write_slot(OpCode::SetGlobal, slot.index);
+        } else {
+            chunk.write_slot(OpCode::SetLocal, slot.index);
+        }
+    }
+
+    // Statements leave the stack as they found it
+    void visit_expression(Stmt_Expression const& stmt) const {
+        visit_expr(*stmt.expr, *this);
+        chunk.write(OpCode::Pop);
+        --depth;
+    }
+    void visit_print(Stmt_Print const& stmt) const {
+        visit_expr(*stmt.expr, *this);
+        chunk.write(OpCode::Print);
+        --depth;
+    }
+    void visit_var(Stmt_Var const& stmt) const {
+        if (stmt.init != nullptr) {
+            visit_expr(*stmt.init, *this);
+        } else {
+            chunk.write(OpCode::Nil);
+            push();
+        }
+        const Slot slot = resolved(stmt.slot);
+        if (slot.scope == EScope::Global) {
+            chunk.write_slot(OpCode::DefineGlobal, slot.index);
+        } else {
+            chunk.write_slot(OpCode::SetLocal, slot.index);
+            chunk.write(OpCode::Pop);
+        }
+        --depth;
+    }
+    void visit_block(Stmt_Block const& stmt) const {
+        for (StmtPtr const& inner : stmt.stmts) {
+            visit_stmt(*inner, *this);
+        }
+    }
+    // Every statement, then nil to return
+    void visit_program(Program const& program) const {
+        chunk.num_globals = program.num_globals;
+        chunk.num_locals = program.num_locals;
+        for (StmtPtr const& stmt : program.stmts) {
+            visit_stmt(*stmt, *this);
+        }
+        chunk.write(OpCode::Nil);
+        push();
+    }
+
+  private:
+    Chunk& chunk;
+    mutable size_t depth = 0;
+
+    void push() const {
+        ++depth;
+        chunk.max_stack = std::max(chunk.max_stack, depth);
+    }
+
+    static Slot resolved(const Slot slot) {
+        if (slot.scope == EScope::Unresolved) {
+            throw std::invalid_argument(
+                "Variables have to be resolved before compiling");
+        }
+        return slot;
+    }
+
+    static OpCode binary_opcode(const EBinOp op) {
+        switch (op) {
+        case EBinOp::EqEq:
+            return OpCode::Equal;
+        case EBinOp::NotEq:
+            return OpCode::NotEqual;
+        case EBinOp::Less:
+            return OpCode::Less;
+        case EBinOp::LessOrEq:
+            return OpCode::LessOrEq;
+        case EBinOp::Greater:
+            return OpCode::Greater;
+        case EBinOp::GreaterOrEq:
+            return OpCode::GreaterOrEq;
+        case EBinOp::Plus:
+            return OpCode::Add;
+        case EBinOp::Minus:
+            return OpCode::Subtract;
+        case EBinOp::Mul:
+            return OpCode::Multiply;
+        case EBinOp::Div:
+            return OpCode::Divide;
+        }
+        std::unreachable();
+    }
+};
+
+Chunk compile(Expr const& ast) {
+    Chunk chunk;
+    visit_expr(ast, Compiler(chunk));
+    chunk.write(OpCode::Return);
+    return chunk;
+}
+
+Chunk compile(Program const& program) {
+    Chunk chunk;
+    Compiler(chunk).visit_program(program);
+    chunk.write(OpCode::Return);
+    return chunk;
+}
+
+bool verify(Chunk const& chunk) {
+    for (size_t i = 0; i < chunk.marks.size(); ++i) {
+        if (chunk.marks[i].pos >= chunk.code.size() ||
+            (i > 0 && chunk.marks[i].pos <= chunk.marks[i - 1].pos)) {
+            return false;
+        }
+    }
+
+    size_t depth = 0;
+    size_t pos = 0;
+    while (pos < chunk.code.size()) {
+        const auto op = static_cast<OpCode>(chunk.code[pos++]);
+        switch (op) {
+        case OpCode::Constant:
+        case OpCode::ConstantLong: {
+            const size_t width = op == OpCode::Constant ? 1 : 4;
+            if (chunk.code.size() - pos < width) {
+                return false;
+            }
+            size_t idx = 0;
+            for (size_t byte = 0; byte < width; ++byte) {
+                idx |= static_cast<size_t>(chunk.code[pos++]) << (byte * 8);
+            }
+            if (idx >= chunk.constants.size()) {
+                return false;
+            }
+            depth += 1;
+            break;
+        }
+        case OpCode::Nil:
+        case OpCode::True:
+        case OpCode::False:
+            depth += 1;
+            break;
+        case OpCode::Negate:
+        case OpCode::Not:
+            if (depth < 1) {
+                return false;
+            }
+            break;
+        case OpCode::Add:
+        case OpCode::Subtract:
+        case OpCode::Multiply:
+        case OpCode::Divide:
+        case OpCode::Equal:
+        case OpCode::NotEqual:
+        case OpCode::Less:
+        case OpCode::LessOrEq:
+        case OpCode::Greater:
+        case OpCode::GreaterOrEq:
+            if (depth < 2) {
+                return false;
+            }
+            depth -= 1;
+            break;
+        case OpCode::Return:
+            return depth == 1 && pos == chunk.code.size();
+        case OpCode::DefineGlobal:
+        case OpCode::GetGlobal:
+        case OpCode::SetGlobal:
+        case OpCode::GetLocal:
+        case OpCode::SetLocal: {
+            if (chunk.code.size() - pos < 2) {
+                return false;
+            }
+            const size_t idx = chunk.code[pos] |
+                               static_cast<size_t>(chunk.code[pos + 1]) << 8;
+            pos += 2;
+            const bool is_global = op == OpCode::DefineGlobal ||
+                                   op == OpCode::GetGlobal ||
+                                   op == OpCode::SetGlobal;
+            if (idx >= (is_global ? chunk.num_globals : chunk.num_locals)) {
+                return false;
+            }
+            if (op == OpCode::GetGlobal || op == OpCode::GetLocal) {
+                depth += 1;
+            } else if (depth < 1) {
+                return false;
+            } else if (op == OpCode::DefineGlobal) {
+                depth -= 1;
+            }
+            break;
+        }
+        case OpCode::Pop:
+        case OpCode::Print:
+            if (depth < 1) {
+                return false;
+            }
+            depth -= 1;
+            break;
+        default:
+            return false;
+        }
+        if (depth > chunk.max_stack) {
+            return false;
+        }
+    }
+    // No Return
+    return false;
+}
+
+// Pop two operands, push the result in place of the left one.
+// Two numbers are handled inline, anything else falls back to
+// eval::apply_binary() so both backends share the exact same semantics.
+#define BINARY_OP(bin_op, num_expr)                                            \
+    {                                                                          \
+        const Value left = sp[-2];                                             \
+        const Value right = sp[-1];                                            \
+        if (left.holds<double>() && right.holds<double>()) {                   \
+            const double a = left.get<double>();                               \
+            const double b = right.get<double>();                              \
+            sp[-2] = (num_expr);                                               \
+        } else if (const auto err = eval::apply_binary(bin_op, left, right,    \
+                                                       sp[-2], heap);          \
+                   err != rt::ERuntimeError::None) {                           \
+            return std::unexpected(rt::RuntimeError{                           \
+                err, chunk.offset_at(ip - 1 - chunk.code.data())});            \
+        }                                                                      \
+        --sp;                                                                  \
+        break;                                                                 \
+    }
+
+// Replace the top of the stack with the operator applied to it
+#define UNARY_OP(unary_op)                                                     \
+    {                                                                          \
+        if (const auto err = eval::apply_unary(unary_op, sp[-1], sp[-1]);      \
+            err != rt::ERuntimeError::None) {                                  \
+            return std::unexpected(rt::RuntimeError{                           \
+                err, chunk.offset_at(ip - 1 - chunk.code.data())});            \
+        }                                                                      \
+        break;                                                                 \
+    }
+
+// The 2-byte slot index following a variable instruction
+#define READ_SLOT()                                                            \
+    (ip += 2,                                                                  \
+     static_cast<uint32_t>(ip[-2]) | static_cast<uint32_t>(ip[-1]) << 8)
+
+// Fail with UndefinedVariable at the variable instruction just read
+#define UNDEFINED_VARIABLE()                                                   \
+    return std::unexpected(                                                    \
+        rt::RuntimeError{rt::ERuntimeError::UndefinedVariable,                 \
+                         chunk.offset_at(ip - 3 - chunk.code.data())})
+
+ValueResult VM::run(Chunk const& chunk) {
+    // Only programs print
+    string out;
+    return run(chunk, out);
+}
+
+ValueResult VM::run(Chunk const& chunk, string& out) {
+    const size_t stack_size = chunk.num_locals + chunk.max_stack;
+    if (stack.size() < stack_size) {
+        stack.resize(stack_size);
+    }
+    globals.assign(chunk.num_globals, Value::undefined());
+
+    const uint8_t* ip = chunk.code.data();
+    Value* const locals = stack.data();
+    Value* sp = locals + chunk.num_locals;
+
+    for (;;) {
+        switch (static_cast<OpCode>(*ip++)) {
+        case OpCode::Constant:
+            *sp++ = chunk.constants[*ip++];
+            break;
+        case OpCode::ConstantLong: {
+            const uint32_t idx = static_cast<uint32_t>(ip[0]) |
+                                 (static_cast<uint32_t>(ip[1]) << 8) |
+                                 (static_cast<uint32_t>(ip[2]) << 16) |
+                                 (static_cast<uint32_t>(ip[3]) << 24);
+            ip += 4;
+            *sp++ = chunk.constants[idx];
+            break;
+        }
+        case OpCode::Nil:
+            *sp++ = std::monostate{};
+            break;
+        case OpCode::True:
+            *sp++ = true;
+            break;
+        case OpCode::False:
+            *sp++ = false;
+            break;
+
+        case OpCode::Negate:
+            if (sp[-1].holds<double>()) {
+                sp[-1] = -1.0 * sp[-1].get<double>();
+                break;
+            }
+            UNARY_OP(EUnaryOp::Minus);
+        case OpCode::Not:
+            UNARY_OP(EUnaryOp::Bang);
+
+        case OpCode::Add:
+            BINARY_OP(EBinOp::Plus, a + b);
+        case OpCode::Subtract:
+            BINARY_OP(EBinOp::Minus, a - b);
+        case OpCode::Multiply:
+            BINARY_OP(EBinOp::Mul, a * b);
+        case OpCode::Divide:
+            BINARY_OP(EBinOp::Div, a / b);
+        case OpCode::Equal:
+            BINARY_OP(EBinOp::EqEq, a == b);
+        case OpCode::NotEqual:
+            BINARY_OP(EBinOp::NotEq, a != b);
+        case OpCode::Less:
+            BINARY_OP(EBinOp::Less, a < b);
+        case OpCode::LessOrEq:
+            BINARY_OP(EBinOp::LessOrEq, a <= b);
+        case OpCode::Greater:
+            BINARY_OP(EBinOp::Greater, a > b);
+        case OpCode::GreaterOrEq:
+            BINARY_OP(EBinOp::GreaterOrEq, a >= b);
+
+        case OpCode::Return:
+            return sp[-1];
+
+        case OpCode::DefineGlobal:
+            globals[READ_SLOT()] = *--sp;
+            break;
+        case OpCode::GetGlobal: {
+            const Value val = globals[READ_SLOT()];
+            if (val.is_undefined()) {
+                UNDEFINED_VARIABLE();
+            }
+            *sp++ = val;
+            break;
+        }
+        case OpCode::SetGlobal: {
+            Value& target = globals[READ_SLOT()];
+            if (target.is_undefined()) {
+                UNDEFINED_VARIABLE();
+            }
+            target = sp[-1];
+            break;
+        }
+        case OpCode::GetLocal:
+            *sp++ = locals[READ_SLOT()];
+            break;
+        case OpCode::SetLocal:
+            locals[READ_SLOT()] = sp[-1];
+            break;
+        case OpCode::Pop:
+            --sp;
+            break;
+        case OpCode::Print:
+            rt::append_value(out, *--sp);
+            out += '\n';
+            break;
+        }
+    }
+}
+
+ValueResult evaluate(ExprPtr ast, rt::Heap& heap) {
+    if (ast == nullptr) {
+        return std::unexpected(rt::RuntimeError{rt::ERuntimeError::NilAst});
+    }
+    const Chunk chunk = compile(*ast);
+    VM machine(heap);
+    return machine.run(chunk);
+}
+
+std::expected<void, rt::RuntimeError>
+execute(Program const& program, rt::Heap& heap, string& out) {
+    const Chunk chunk = compile(program);
+    VM machine(heap);
+    const ValueResult res = machine.run(chunk, out);
+    if (!res) {
+        return std::unexpected(res.error());
+    }
+    return {};
+}
+
+} // namespace vm
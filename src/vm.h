@@ -0,0 +1,134 @@
+#pragma once
+/**
+ * Bytecode backend for the Lox interpreter
+ * An alternative to eval::Visitor_Eval: the AST is compiled once into a flat
+ * Chunk, which a single dispatch loop then executes on a value stack.
+ * No virtual calls and no per-node expected<> on the execution path.
+ **/
+
+#include <cstdint>
+#include <expected>
+#include <string>
+#include <vector>
+
+#include "parser.h"
+#include "runtime.h"
+
+namespace vm {
+using rt::Value;
+using std::string;
+
+enum class OpCode : uint8_t {
+    // Followed by a 1-byte constant index
+    Constant,
+    // Followed by a 4-byte (little-endian) constant index
+    ConstantLong,
+    Nil,
+    True,
+    False,
+    // Unary
+    Negate,
+    Not,
+    // Binary
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Equal,
+    NotEqual,
+    Less,
+    LessOrEq,
+    Greater,
+    GreaterOrEq,
+    // Pops the top of the stack as the result
+    Return,
+    // Program statements and variables. The variable ones are followed by
+    // a 2-byte (little-endian) slot index, see resolve::resolve().
+    // Pops the initial value into the global
+    DefineGlobal,
+    GetGlobal,
+    // Assignments leave the value on the stack, as the result
+    SetGlobal,
+    // Locals are the first num_locals values on the stack
+    GetLocal,
+    SetLocal,
+    Pop,
+    // Pops the value and appends it to the output
+    Print
+};
+
+// Source offset of the instruction at `pos` in the code
+struct SourceMark {
+    uint32_t pos;
+    uint32_t offset;
+
+    bool operator==(SourceMark const&) const = default;
+};
+
+struct Chunk {
+    std::vector<uint8_t> code;
+    std::vector<Value> constants;
+    // Deepest the value stack gets while running this chunk,
+    // so the VM can size its stack once upfront
+    size_t max_stack = 0;
+    // Slots of a program's variables, 0 for an expression
+    uint32_t num_globals = 0;
+    uint32_t num_locals = 0;
+    // Only for the instructions that can fail, in code order. Looked up
+    // once one does, so running never touches them.
+    std::vector<SourceMark> marks;
+
+    void write(const OpCode op) { code.push_back(static_cast<uint8_t>(op)); }
+    void write_constant(Value value);
+    void write_slot(OpCode op, uint32_t index);
+    // Marks the instruction written next
+    void mark(const uint32_t offset) {
+        marks.push_back(SourceMark{static_cast<uint32_t>(code.size()), offset});
+    }
+    // Source offset of the instruction at `pos`, 0 if it isn't marked
+    [[nodiscard]]
+    uint32_t offset_at(size_t pos) const;
+};
+
+// Compile an expression tree into a chunk ending with OpCode::Return
+[[nodiscard]]
+Chunk compile(Expr const& ast);
+// Compile a program that has been through resolve::resolve(). The chunk
+// returns nil once every statement has run.
+[[nodiscard]]
+Chunk compile(Program const& program);
+
+// Whether `chunk` is safe to run: known opcodes, constant and slot indices
+// in range, a stack that never underflows or outgrows max_stack, one value
+// left for the final Return, and marks in order. For chunks that weren't
+// made by compile().
+[[nodiscard]]
+bool verify(Chunk const& chunk);
+
+class VM {
+  public:
+    // Strings created while running are allocated from `heap`
+    explicit VM(rt::Heap& heap) : heap(heap) {}
+
+    // Runs the chunk to completion.
+    // The stack is kept between runs, to avoid reallocating it.
+    [[nodiscard]]
+    ValueResult run(Chunk const& chunk);
+    // Same, appending what Print prints to `out`
+    [[nodiscard]]
+    ValueResult run(Chunk const& chunk, string& out);
+
+  private:
+    rt::Heap& heap;
+    // Locals, then the values being worked on
+    std::vector<Value> stack;
+    std::vector<Value> globals;
+};
+
+// Compile + run in one go, mirrors eval::evaluate()
+ValueResult evaluate(ExprPtr ast, rt::Heap& heap);
+// Same for a resolved program, mirrors eval::execute()
+[[nodiscard]]
+std::expected<void, rt::RuntimeError> execute(Program const& program,
+                                              rt::Heap& heap, string& out);
+} // namespace vm
@@ -0,0 +1,148 @@
+#include <array>
+#include <bit>
+#include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../src/ast_file.h"
+#include "../src/driver.h"
+#include "../src/source.h"
+
+namespace {
+const char* const SOURCES[] = {
+    "1",
+    "(1 + 2) * -3 / 4 >= 2 == !false",
+    "\"ab\" + \"c\" == \"abc\" != (nil == nil)",
+    "\"\" + \"x\" + \"\"",
+    "-\"a\"",
+    "((((\"deep\"))))",
+    // The error is reported on line 3, without the source
+    "1 +\n\n-\"a\"",
+};
+
+std::string compile_file(std::string const& src,
+                         driver::Options const& options) {
+    driver::Output output;
+    const auto ast = driver::parse_arena(src, options, output);
+    REQUIRE(ast.has_value());
+    return ast_file::serialize(ast.value(), LineIndex(src).line_starts());
+}
+} // namespace
+
+TEST_CASE("AST files evaluate like their source on every backend",
+          "[ast_file]") {
+    for (const char* src : SOURCES) {
+        INFO(src);
+        for (const auto backend : {driver::EBackend::Tree, driver::EBackend::VM,
+                                   driver::EBackend::Flat}) {
+            const driver::Options options{.backend = backend};
+            const std::string bytes = compile_file(src, options);
+            CHECK(ast_file::is_ast_file(bytes));
+
+            const auto expected = driver::evaluate(src, options);
+            const auto output = driver::evaluate(bytes, options);
+            CHECK(output.exit_code == expected.exit_code);
+            CHECK(output.out == expected.out);
+            CHECK(output.err == expected.err);
+        }
+    }
+}
+
+TEST_CASE("AST files hold the same tree whichever parser made them",
+          "[ast_file]") {
+    for (const char* src : SOURCES) {
+        INFO(src);
+        CHECK(compile_file(src, {.backend = driver::EBackend::Tree}) ==
+              compile_file(src, {.backend = driver::EBackend::Flat}));
+    }
+    // Folded with --opt: a single literal
+    ast::Ast ast;
+    std::vector<uint32_t> lines;
+    REQUIRE(ast_file::deserialize(
+        compile_file("(1 + 2) * 3", {.optimize = true}), ast, lines));
+    CHECK(ast.size() == 1);
+}
+
+TEST_CASE("Corrupt AST files are rejected", "[ast_file]") {
+    const std::string bytes =
+        compile_file("(\"a\" + \"b\") == -(1 + 2)",
+                     {.backend = driver::EBackend::Flat});
+    ast::Ast ast;
+    std::vector<uint32_t> lines;
+    REQUIRE(ast_file::deserialize(bytes, ast, lines));
+
+    for (size_t cut = 0; cut < bytes.size(); ++cut) {
+        CHECK_FALSE(ast_file::deserialize(bytes.substr(0, cut), ast, lines));
+    }
+    CHECK_FALSE(ast_file::deserialize(bytes + "x", ast, lines));
+
+    std::string other_version = bytes;
+    other_version[8] += 1;
+    const auto refused = ast_file::deserialize(other_version, ast, lines);
+    REQUIRE_FALSE(refused);
+    CHECK(refused.error() == "Invalid AST file: version 3, expected 2");
+
+    // Any single flipped byte either still loads, or is refused: evaluating
+    // what loaded never crashes
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        for (const uint8_t flip : {0x01, 0x80, 0xff}) {
+            std::string damaged = bytes;
+            damaged[i] = static_cast<char>(damaged[i] ^ flip);
+            for (const auto backend :
+                 {driver::EBackend::Tree, driver::EBackend::Flat}) {
+                const auto output =
+                    driver::evaluate(damaged, {.backend = backend});
+                CHECK(output.exit_code != 1);
+            }
+        }
+    }
+
+    const auto output = driver::evaluate(bytes.substr(0, 40), {});
+    CHECK(output.exit_code == driver::INTERP_ERR_RETURN_CODE);
+    CHECK(output.err == "Invalid AST file: sizes don't match the header\n");
+}
+
+TEST_CASE("NaN literals in AST files stay numbers", "[ast_file]") {
+    std::string bytes =
+        compile_file("1.5", {.backend = driver::EBackend::Flat});
+    // A NaN whose payload is what a boxed string pointer looks like
+    const auto one_and_a_half = std::bit_cast<std::array<char, 8>>(1.5);
+    const auto boxed = std::bit_cast<std::array<char, 8>>(
+        uint64_t{0xfffc000000001000});
+    const auto at = bytes.find(
+        std::string_view(one_and_a_half.data(), one_and_a_half.size()));
+    REQUIRE(at != std::string::npos);
+    bytes.replace(at, boxed.size(), boxed.data(), boxed.size());
+
+    for (const auto backend : {driver::EBackend::Tree, driver::EBackend::VM,
+                               driver::EBackend::Flat}) {
+        const auto output = driver::evaluate(bytes, {.backend = backend});
+        CHECK(output.exit_code == 0);
+        CHECK(output.out == "nan\n");
+    }
+}
+
+TEST_CASE("AST files deeper than max_depth are refused", "[ast_file]") {
+    // A minus per level
+    const size_t depth = grammar::DEFAULT_MAX_DEPTH + 1;
+    const std::string src = std::string(depth, '-') + "1";
+    // Only made with a raised limit, since the source is refused too
+    CHECK(driver::evaluate(src, {}).exit_code ==
+          driver::INTERP_ERR_RETURN_CODE);
+    const std::string bytes = compile_file(
+        src, {.backend = driver::EBackend::Flat, .max_depth = depth});
+
+    const auto refused = driver::evaluate(bytes, {});
+    CHECK(refused.exit_code == driver::INTERP_ERR_RETURN_CODE);
+    CHECK(refused.err ==
+          std::format("AST file nested too deeply, the limit is {}\n",
+                      grammar::DEFAULT_MAX_DEPTH));
+
+    const auto output = driver::evaluate(bytes, {.max_depth = depth});
+    CHECK(output.exit_code == 0);
+    CHECK(output.out == "-1\n");
+}
@@ -0,0 +1,187 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <string>
+#include <utility>
+
+#include "../src/ast.h"
+#include "../src/eval.h"
+#include "../src/lexer.h"
+
+static TokenVec lex_source(std::string const& src) {
+    size_t num_errs = 0;
+    const auto tokens = lex(src, num_errs);
+    REQUIRE(num_errs == 0);
+    auto token_vec = lift(tokens);
+    REQUIRE(token_vec.has_value());
+
+    return std::move(token_vec.value());
+}
+
+TEST_CASE("Flat AST is laid out children-first", "[ast]") {
+    const auto toks = lex_source("-(1 + 2) * 3 == !false");
+
+    const auto res = ast::parse(toks);
+    REQUIRE(res.has_value());
+    ast::Ast const& tree = res.value();
+
+    // 1, 2, +, group, -, 3, *, false, !, ==
+    REQUIRE(tree.size() == 10);
+    CHECK(tree.root == tree.size() - 1);
+    CHECK(tree.literals.size() == 4);
+
+    for (ast::NodeId id = 0; id < tree.size(); ++id) {
+        ast::Node const& node = tree[id];
+        if (node.kind != ast::ENodeKind::Literal) {
+            CHECK(node.lhs < id);
+        }
+        if (node.kind == ast::ENodeKind::Binary) {
+            CHECK(node.rhs < id);
+        }
+    }
+
+    ast::Node const& root = tree[tree.root];
+    REQUIRE(root.kind == ast::ENodeKind::Binary);
+    CHECK(root.binary_op() == Expr_Binary::EBinaryOperator::EqEq);
+    CHECK(tree[root.rhs].kind == ast::ENodeKind::Unary);
+    CHECK(tree[root.rhs].unary_op() == Expr_Unary::EUnaryOperator::Bang);
+}
+
+TEST_CASE("Flat AST evaluates like the ExprPtr tree", "[ast]") {
+    const std::string src = GENERATE(
+        "nil", "\"hello\"", "(10.40 * 2) / 2", "23 + 28 - (-(61 - 99))",
+        "\"foo\" + \"bar\"", "(54 - 67) >= -(114 / 57 + 11)",
+        "61 == \"61\"", "!((false))", "-\"foo\"", "\"foo\" + true",
+        "(\"foo\" + \"bar\") < 42", "1 + (2 * -nil)");
+    INFO(src);
+    const auto toks = lex_source(src);
+    rt::Heap heap;
+
+    auto tree = parse(toks);
+    REQUIRE(tree.has_value());
+    const auto tree_res = eval::evaluate(std::move(tree.value()), heap);
+
+    const auto flat = ast::parse(toks);
+    REQUIRE(flat.has_value());
+    const auto flat_res = eval::evaluate(flat.value(), heap);
+
+    REQUIRE(tree_res.has_value() == flat_res.has_value());
+    if (tree_res.has_value()) {
+        CHECK(tree_res.value() == flat_res.value());
+    } else {
+        CHECK(tree_res.error() == flat_res.error());
+    }
+}
+
+TEST_CASE("Flat AST reports the same parse errors", "[ast]") {
+    const std::string src =
+        GENERATE("(1 + 2", "1 +", "* 2", "()", "-(1 +", "((1) 2", "1 == (",
+                 "!!", "(1 * (2 - 3) >= ");
+    INFO(src);
+    const auto toks = lex_source(src);
+
+    const auto tree = parse(toks);
+    const auto flat = ast::parse(toks);
+    REQUIRE_FALSE(tree.has_value());
+    REQUIRE_FALSE(flat.has_value());
+    CHECK(tree.error() == flat.error());
+}
+
+static std::string nested(const size_t depth, std::string const& open,
+                          std::string const& inner, std::string const& close) {
+    std::string src;
+    for (size_t i = 0; i < depth; ++i) {
+        src += open;
+    }
+    src += inner;
+    for (size_t i = 0; i < depth; ++i) {
+        src += close;
+    }
+    return src;
+}
+
+// 1 + 1 + ..., `ops` operators deep
+static std::string chain(const size_t ops) {
+    std::string src = "1";
+    for (size_t i = 0; i < ops; ++i) {
+        src += " + 1";
+    }
+    return src;
+}
+
+TEST_CASE("Flat AST enforces the same depth limit", "[ast]") {
+    const size_t limit = 50;
+    // Binary operators are a link each
+    const size_t links = limit * grammar::LEVEL_LINKS;
+    const auto [depth, src] = GENERATE_COPY(
+        std::pair<size_t, std::string>{limit, nested(limit, "(", "1", ")")},
+        std::pair<size_t, std::string>{limit + 1,
+                                       nested(limit + 1, "(", "1", ")")},
+        std::pair<size_t, std::string>{limit + 1,
+                                       nested(limit + 1, "-", "1", "")},
+        std::pair<size_t, std::string>{
+            limit + 1, "1 + " + nested(limit / 2 + 1, "(!", "true", ")")},
+        std::pair<size_t, std::string>{
+            limit, "1 - " + nested(limit - 1, "(", "1", ")")},
+        std::pair<size_t, std::string>{limit, chain(links)},
+        std::pair<size_t, std::string>{limit + 1, chain(links + 1)},
+        std::pair<size_t, std::string>{
+            limit, "(" + chain(links - grammar::LEVEL_LINKS) + ")"},
+        std::pair<size_t, std::string>{
+            limit + 1, "(" + chain(links - grammar::LEVEL_LINKS + 1) + ")"},
+        std::pair<size_t, std::string>{limit, "1 == " + chain(links - 1)});
+    INFO(src);
+    const auto toks = lex_source(src);
+
+    const auto tree = parse(toks, limit);
+    const auto flat = ast::parse(toks, limit);
+    if (depth <= limit) {
+        CHECK(tree.has_value());
+        CHECK(flat.has_value());
+    } else {
+        REQUIRE_FALSE(tree.has_value());
+        REQUIRE_FALSE(flat.has_value());
+        CHECK(tree.error().code == grammar::EParseError::TooDeep);
+        CHECK(tree.error().max_depth == limit);
+        CHECK(flat.error() == tree.error());
+    }
+}
+
+TEST_CASE("Flat AST parses and evaluates deep nesting", "[ast]") {
+    // Far deeper than the recursive parser and evaluator could go
+    const size_t depth = 100000;
+    const auto toks = lex_source(nested(depth, "(-", "2", ") * 1"));
+    rt::Heap heap;
+
+    // A paren and a minus per level, and a link for the *
+    const auto flat = ast::parse(toks, depth * 3);
+    REQUIRE(flat.has_value());
+    CHECK(flat->size() == depth * 4 + 1);
+    const auto value = eval::evaluate(flat.value(), heap);
+    REQUIRE(value.has_value());
+    CHECK(value.value().get<double>() == 2.0);
+
+    // Over the default limit is an error, not a crash
+    const auto limited = ast::parse(toks);
+    REQUIRE_FALSE(limited.has_value());
+    CHECK(limited.error().code == grammar::EParseError::TooDeep);
+    CHECK(limited.error().max_depth == grammar::DEFAULT_MAX_DEPTH);
+}
+
+TEST_CASE("from_expr and to_expr keep the tree", "[ast]") {
+    const std::string src = "-(1 + 2) * \"a\" == !(nil != 3 / 4)";
+    const auto parsed = ast::parse(lex_source(src));
+    REQUIRE(parsed.has_value());
+    ast::Ast const& ast = parsed.value();
+    const ExprPtr expr = ast::to_expr(ast);
+    REQUIRE(expr != nullptr);
+
+    const ast::Ast back = ast::from_expr(*expr);
+    CHECK(back.root == ast.root);
+    REQUIRE(back.size() == ast.size());
+    for (ast::NodeId id = 0; id < ast.size(); ++id) {
+        CHECK(back[id].kind == ast[id].kind);
+        CHECK(back[id].op == ast[id].op);
+        CHECK(back[id].lhs == ast[id].lhs);
+        CHECK(back[id].rhs == ast[id].rhs);
+    }
+}
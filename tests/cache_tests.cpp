@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include "../src/cache.h"
+#include "../src/driver.h"
+
+namespace fs = std::filesystem;
+
+TEST_CASE("hash_source is FNV-1a", "[cache]") {
+    CHECK(cache::hash_source("") == 0xcbf29ce484222325);
+    CHECK(cache::hash_source("a") == 0xaf63dc4c8601ec8c);
+    CHECK(cache::hash_source("1 + 2") != cache::hash_source("1 + 3"));
+}
+
+TEST_CASE("Cache counts hits and misses per source and config", "[cache]") {
+    cache::Cache cache;
+    CHECK(cache.find("1 + 2", 0) == nullptr);
+    const auto added =
+        cache.insert("1 + 2", 0, cache::Compiled{.exit_code = 3});
+    CHECK(added->exit_code == 3);
+    CHECK(cache.find("1 + 2", 0) == added);
+    CHECK(cache.find("1 + 2", 1) == nullptr);
+    CHECK(cache.find("1 + 2 ", 0) == nullptr);
+
+    // A second insert keeps the first entry
+    CHECK(cache.insert("1 + 2", 0, cache::Compiled{.exit_code = 4}) == added);
+
+    const auto counters = cache.counters();
+    CHECK(counters.hits == 1);
+    CHECK(counters.misses == 3);
+    CHECK(counters.disk_hits == 0);
+}
+
+TEST_CASE("Cache evicts the oldest entries", "[cache]") {
+    cache::Cache cache("", 2);
+    (void)cache.insert("1", 0, {});
+    (void)cache.insert("2", 0, {});
+    (void)cache.insert("3", 0, {});
+    CHECK(cache.find("1", 0) == nullptr);
+    CHECK(cache.find("2", 0) != nullptr);
+    CHECK(cache.find("3", 0) != nullptr);
+    CHECK(cache.counters().evictions == 1);
+}
+
+TEST_CASE("Compiled entries round-trip through serialize", "[cache]") {
+    const std::string src = "\"a\" + \"b\" == \"ab\" and 1.5 < 2 or nil";
+    const driver::Options options{.backend = driver::EBackend::VM};
+    const auto compiled = driver::compile(src, options);
+    const std::string bytes = cache::serialize(src, 7, compiled);
+    REQUIRE_FALSE(bytes.empty());
+
+    const auto loaded = cache::deserialize(bytes, src, 7);
+    REQUIRE(loaded != nullptr);
+    auto const& chunk = std::get<vm::Chunk>(compiled.program);
+    auto const& loaded_chunk = std::get<vm::Chunk>(loaded->program);
+    CHECK(loaded_chunk.code == chunk.code);
+    // Strings are interned apart, so they're equal by contents only
+    REQUIRE(loaded_chunk.constants.size() == chunk.constants.size());
+    for (size_t i = 0; i < chunk.constants.size(); ++i) {
+        CHECK(rt::format_value(loaded_chunk.constants[i]) ==
+              rt::format_value(chunk.constants[i]));
+    }
+    CHECK(loaded_chunk.max_stack == chunk.max_stack);
+
+    // Another source, config or a damaged file all miss
+    CHECK(cache::deserialize(bytes, src + " ", 7) == nullptr);
+    CHECK(cache::deserialize(bytes, src, 8) == nullptr);
+    for (size_t cut = 0; cut < bytes.size(); ++cut) {
+        CHECK(cache::deserialize(bytes.substr(0, cut), src, 7) == nullptr);
+    }
+    std::string other_version = bytes;
+    other_version[4] += 1;
+    CHECK(cache::deserialize(other_version, src, 7) == nullptr);
+
+    // Errors are persisted, trees aren't
+    const auto error = driver::compile("(1", options);
+    const auto loaded_error =
+        cache::deserialize(cache::serialize("(1", 0, error), "(1", 0);
+    REQUIRE(loaded_error != nullptr);
+    CHECK(loaded_error->exit_code == driver::INTERP_ERR_RETURN_CODE);
+    CHECK(loaded_error->err == error.err);
+    CHECK(cache::serialize(src, 0, driver::compile(src, {})).empty());
+}
+
+TEST_CASE("Cache with a directory loads entries from earlier caches",
+          "[cache]") {
+    const fs::path dir = fs::temp_directory_path() / "interp_cache_tests";
+    fs::remove_all(dir);
+    const driver::Options options{.backend = driver::EBackend::VM};
+    const std::string src = "(1 + 2) * 4";
+
+    {
+        cache::Cache first(dir.string());
+        driver::Session session;
+        session.cache = &first;
+        driver::evaluate(src, options, session);
+        CHECK(session.output.out == "12\n");
+        CHECK(first.counters().misses == 1);
+    }
+
+    cache::Cache second(dir.string());
+    driver::Session session;
+    session.cache = &second;
+    driver::evaluate(src, options, session);
+    CHECK(session.output.out == "12\n");
+    driver::evaluate(src, options, session);
+    CHECK(session.output.out == "12\n");
+    const auto counters = second.counters();
+    CHECK(counters.hits == 2);
+    CHECK(counters.disk_hits == 1);
+    CHECK(counters.misses == 0);
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Cached evaluation matches uncached on every backend", "[cache]") {
+    const char* sources[] = {"1 + 2 * 3", "\"a\" + \"b\"", "-\"a\"", "(1",
+                             "@", "!(nil == false)", "1 +\n\n2 * -nil"};
+    for (const auto backend : {driver::EBackend::Tree, driver::EBackend::VM,
+                               driver::EBackend::Flat}) {
+        for (const bool optimize : {false, true}) {
+            if (optimize && backend == driver::EBackend::Flat) {
+                continue;
+            }
+            const driver::Options options{.backend = backend,
+                                          .optimize = optimize};
+            cache::Cache cache;
+            driver::Session session;
+            session.cache = &cache;
+            // Twice: once compiled, once from the cache
+            for (int round = 0; round < 2; ++round) {
+                for (const char* src : sources) {
+                    INFO(src);
+                    const auto expected = driver::evaluate(src, options);
+                    driver::evaluate(src, options, session);
+                    CHECK(session.output.exit_code == expected.exit_code);
+                    CHECK(session.output.out == expected.out);
+                    CHECK(session.output.err == expected.err);
+                }
+            }
+            CHECK(cache.counters().hits == std::size(sources));
+        }
+    }
+}
+
+TEST_CASE("NaN constants in cache entries stay numbers", "[cache]") {
+    const std::string src = "\"a\" == 1.5";
+    const auto compiled =
+        driver::compile(src, {.backend = driver::EBackend::VM});
+    auto const& chunk = std::get<vm::Chunk>(compiled.program);
+    const auto number = std::ranges::find(chunk.constants, rt::Value(1.5));
+    REQUIRE(number != chunk.constants.end());
+
+    // A NaN whose payload is what a boxed string pointer looks like
+    const auto one_and_a_half = std::bit_cast<std::array<char, 8>>(1.5);
+    const auto boxed = std::bit_cast<std::array<char, 8>>(
+        uint64_t{0xfffc000000001000});
+    std::string bytes = cache::serialize(src, 0, compiled);
+    const auto at = bytes.find(
+        std::string_view(one_and_a_half.data(), one_and_a_half.size()));
+    REQUIRE(at != std::string::npos);
+    bytes.replace(at, boxed.size(), boxed.data(), boxed.size());
+
+    const auto loaded = cache::deserialize(bytes, src, 0);
+    REQUIRE(loaded != nullptr);
+    const rt::Value nan = std::get<vm::Chunk>(loaded->program)
+                              .constants[number - chunk.constants.begin()];
+    REQUIRE(nan.holds<double>());
+    CHECK(std::isnan(nan.get<double>()));
+}
@@ -0,0 +1,307 @@
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <vector>
+
+#include "../src/driver.h"
+#include "../src/source.h"
+
+namespace fs = std::filesystem;
+
+TEST_CASE("driver::evaluate captures output and exit code", "[driver]") {
+    const driver::Options options;
+
+    const auto ok = driver::evaluate("(1 + 2) * 3 == nil", options);
+    CHECK(ok.exit_code == 0);
+    CHECK(ok.out == "false\n");
+    CHECK(ok.err.empty());
+
+    const auto runtime = driver::evaluate("-\"a\"", options);
+    CHECK(runtime.exit_code == driver::RUNTIME_ERR_RETURN_CODE);
+    CHECK(runtime.out.empty());
+    CHECK(runtime.err == "Operand must be a number\n[line 1]\n");
+
+    const auto syntax = driver::evaluate("(1", options);
+    CHECK(syntax.exit_code == driver::INTERP_ERR_RETURN_CODE);
+    CHECK(syntax.err.starts_with("[line 1] Error at '"));
+
+    // Every lex error is reported, and they win over parse errors
+    const auto lex = driver::evaluate("@ (\n$", options);
+    CHECK(lex.exit_code == driver::INTERP_ERR_RETURN_CODE);
+    CHECK(lex.err == "[line 1] Error: Unexpected character: @\n"
+                     "[line 2] Error: Unexpected character: $\n");
+}
+
+TEST_CASE("driver::evaluate gives the same result on every backend",
+          "[driver]") {
+    const std::string src = "\"ab\" + \"c\" == \"abc\"";
+    for (const auto backend :
+         {driver::EBackend::Tree, driver::EBackend::VM,
+          driver::EBackend::Flat}) {
+        const auto output = driver::evaluate(src, {.backend = backend});
+        CHECK(output.exit_code == 0);
+        CHECK(output.out == "true\n");
+
+        // Strings are truthy
+        const auto bang = driver::evaluate("!\"a\"", {.backend = backend});
+        CHECK(bang.exit_code == 0);
+        CHECK(bang.out == "false\n");
+    }
+}
+
+TEST_CASE("driver::evaluate reports the line errors happen on", "[driver]") {
+    for (const auto backend :
+         {driver::EBackend::Tree, driver::EBackend::VM,
+          driver::EBackend::Flat}) {
+        for (const bool optimize : {false, true}) {
+            if (optimize && backend == driver::EBackend::Flat) {
+                continue;
+            }
+            const driver::Options options{.backend = backend,
+                                          .optimize = optimize};
+            INFO(static_cast<int>(backend) << " " << optimize);
+
+            // The operator's line, not the operands'
+            const auto unary = driver::evaluate("1 +\n\n(2 *\n-\n\"a\")",
+                                                options);
+            // With optimize, after the folding summary
+            CHECK(unary.err.ends_with("Operand must be a number\n[line 4]\n"));
+            const auto binary =
+                driver::evaluate("\"a\"\n+\n\n1", options);
+            CHECK(binary.err.ends_with("Operands must be two numbers or two "
+                                       "strings\n[line 2]\n"));
+
+            const auto syntax = driver::evaluate("(1 +\n2\n\n", options);
+            CHECK(syntax.err.starts_with("[line 4] Error at '"));
+            const auto unexpected = driver::evaluate("1 +\n\n)", options);
+            CHECK(unexpected.err.starts_with("[line 3] Error at ')'"));
+        }
+    }
+}
+
+TEST_CASE("driver::evaluate concatenates long chains on every backend",
+          "[driver]") {
+    const size_t terms = 10000;
+    std::string src = "\"start\"";
+    std::string expected = "start";
+    for (size_t i = 0; i < terms; ++i) {
+        const std::string word = "word_" + std::to_string(i % 100);
+        src += " + \"" + word + "\"";
+        expected += word;
+    }
+    for (const auto backend :
+         {driver::EBackend::Tree, driver::EBackend::VM,
+          driver::EBackend::Flat}) {
+        const driver::Options options{.backend = backend};
+        const auto output = driver::evaluate(src, options);
+        CHECK(output.exit_code == 0);
+        CHECK(output.out == expected + "\n");
+
+        const auto compared = driver::evaluate(
+            "(" + src + ") == \"" + expected + "\"", options);
+        CHECK(compared.out == "true\n");
+    }
+}
+
+TEST_CASE("driver::evaluate sums long chains under the default max_depth",
+          "[driver]") {
+    const size_t terms = 10000;
+    std::string src = "0";
+    for (size_t i = 1; i < terms; ++i) {
+        src += " + 1";
+    }
+    for (const auto backend :
+         {driver::EBackend::Tree, driver::EBackend::VM,
+          driver::EBackend::Flat}) {
+        const auto output = driver::evaluate(src, {.backend = backend});
+        CHECK(output.exit_code == 0);
+        CHECK(output.out == "9999\n");
+        if (backend != driver::EBackend::Flat) {
+            const auto program =
+                driver::run("print " + src + ";", {.backend = backend});
+            CHECK(program.exit_code == 0);
+            CHECK(program.out == "9999\n");
+        }
+    }
+}
+
+TEST_CASE("driver::evaluate refuses chains deeper than max_depth",
+          "[driver]") {
+    const size_t terms = 1000000;
+    std::string src = "0";
+    for (size_t i = 0; i < terms; ++i) {
+        src += " + 1";
+    }
+    // Each + nests the tree a link deeper, and the tree and the VM walk it
+    // recursively
+    for (const auto backend :
+         {driver::EBackend::Tree, driver::EBackend::VM,
+          driver::EBackend::Flat}) {
+        const auto output = driver::evaluate(src, {.backend = backend});
+        CHECK(output.exit_code == driver::INTERP_ERR_RETURN_CODE);
+        CHECK(output.err.find("the limit is 1000") != std::string::npos);
+
+        const auto program =
+            driver::run("print " + src + ";", {.backend = backend});
+        CHECK(program.exit_code == driver::INTERP_ERR_RETURN_CODE);
+    }
+
+    // The flat parser and evaluator don't recurse, so they can go deeper
+    const auto flat = driver::evaluate(
+        src, {.backend = driver::EBackend::Flat, .max_depth = terms});
+    CHECK(flat.exit_code == 0);
+    CHECK(flat.out == "1e+06\n");
+}
+
+TEST_CASE("driver::run runs programs on the tree and the VM", "[driver]") {
+    for (const auto backend : {driver::EBackend::Tree, driver::EBackend::VM}) {
+        for (const bool optimize : {false, true}) {
+            const driver::Options options{.backend = backend,
+                                          .optimize = optimize};
+            INFO(static_cast<int>(backend) << " " << optimize);
+
+            const auto ok = driver::run("var a = 1;\n"
+                                        "{ var c = a + 1; print c; }\n"
+                                        "var b = a = \"x\";\n"
+                                        "print a + b;",
+                                        options);
+            CHECK(ok.exit_code == 0);
+            CHECK(ok.out == "2\nxx\n");
+
+            // What it printed before failing is kept
+            const auto undefined =
+                driver::run("print 1;\n{\n  print nope;\n}", options);
+            CHECK(undefined.exit_code == driver::RUNTIME_ERR_RETURN_CODE);
+            CHECK(undefined.out == "1\n");
+            CHECK(undefined.err.ends_with(
+                "Undefined variable 'nope'.\n[line 3]\n"));
+
+            const auto runtime = driver::run("var a;\nprint -a;", options);
+            CHECK(runtime.exit_code == driver::RUNTIME_ERR_RETURN_CODE);
+            CHECK(runtime.err.ends_with(
+                "Operand must be a number\n[line 2]\n"));
+
+            const auto resolve =
+                driver::run("print 1;\n{ var a;\n var a; }", options);
+            CHECK(resolve.exit_code == driver::INTERP_ERR_RETURN_CODE);
+            CHECK(resolve.out.empty());
+            // With optimize, after the folding summary
+            CHECK(resolve.err.ends_with(
+                "[line 3] Error at 'a': Already a variable with this name "
+                "in this scope.\n"));
+
+            const auto syntax = driver::run("print 1\nprint 2;", options);
+            CHECK(syntax.exit_code == driver::INTERP_ERR_RETURN_CODE);
+            CHECK(syntax.err.ends_with(
+                "[line 2] Error at 'print': Expect ';' after statement.\n"));
+
+            const auto not_name = driver::run("print 1;\nvar 2 = 3", options);
+            CHECK(not_name.err.ends_with(
+                "[line 2] Error at '2': Expect variable name.\n"));
+            const auto eof = driver::run("print 1;\nprint 2", options);
+            CHECK(eof.err.ends_with(
+                "[line 2] Error at end: Expect ';' after statement.\n"));
+        }
+    }
+}
+
+// Scratch directory, removed again at the end of the test
+struct TempDir {
+    fs::path path;
+
+    TempDir() : path(fs::temp_directory_path() / "interp_driver_tests") {
+        fs::remove_all(path);
+        fs::create_directories(path);
+    }
+    ~TempDir() { fs::remove_all(path); }
+
+    void write(std::string const& name, std::string const& contents) const {
+        std::ofstream(path / name) << contents;
+    }
+};
+
+TEST_CASE("driver::batch_inputs reads directories and manifests",
+          "[driver]") {
+    const TempDir dir;
+    dir.write("b.lox", "2");
+    dir.write("a.lox", "1");
+    dir.write("notes.txt", "not lox");
+    dir.write("manifest", "# comment\n\n  b.lox  \n/abs/path.lox\n");
+
+    const auto from_dir = driver::batch_inputs(dir.path.string());
+    REQUIRE(from_dir.has_value());
+    CHECK(from_dir.value() == std::vector<std::string>{
+                                  (dir.path / "a.lox").string(),
+                                  (dir.path / "b.lox").string()});
+
+    const auto from_manifest =
+        driver::batch_inputs((dir.path / "manifest").string());
+    REQUIRE(from_manifest.has_value());
+    CHECK(from_manifest.value() ==
+          std::vector<std::string>{(dir.path / "b.lox").string(),
+                                   "/abs/path.lox"});
+
+    CHECK_FALSE(driver::batch_inputs((dir.path / "missing").string()));
+}
+
+TEST_CASE("driver::evaluate_batch keeps input order", "[driver]") {
+    const TempDir dir;
+    std::vector<std::string> paths;
+    for (int i = 0; i < 200; ++i) {
+        const std::string name = std::to_string(i) + ".lox";
+        // Strings get interned by several threads at once
+        dir.write(name, i % 3 == 0 ? "\"shared\" + \"" + std::to_string(i) +
+                                         "\""
+                                   : std::to_string(i) + " * 2");
+        paths.push_back((dir.path / name).string());
+    }
+    paths.push_back((dir.path / "missing.lox").string());
+
+    const auto outputs = driver::evaluate_batch(paths, {}, 4);
+    REQUIRE(outputs.size() == paths.size());
+    for (int i = 0; i < 200; ++i) {
+        INFO(i);
+        CHECK(outputs[i].exit_code == 0);
+        CHECK(outputs[i].out ==
+              (i % 3 == 0 ? "shared" + std::to_string(i)
+                          : std::to_string(i * 2)) +
+                  "\n");
+    }
+    CHECK(outputs.back().exit_code == 1);
+    CHECK_FALSE(outputs.back().err.empty());
+}
+
+TEST_CASE("Sources over MAX_SOURCE_SIZE are refused", "[driver]") {
+    const size_t size = MAX_SOURCE_SIZE + 1;
+    // Sparse, nothing gets written
+    const TempDir dir;
+    dir.write("huge.lox", "");
+    fs::resize_file(dir.path / "huge.lox", size);
+    const auto outputs =
+        driver::evaluate_batch({(dir.path / "huge.lox").string()}, {}, 1);
+    CHECK(outputs[0].exit_code == 1);
+    CHECK(outputs[0].err.find("is larger than") != std::string::npos);
+
+    // Zero pages, only the first one is ever touched
+    void* data = ::mmap(nullptr, size, PROT_READ,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    REQUIRE(data != MAP_FAILED);
+    const std::string_view source(static_cast<const char*>(data), size);
+    const std::string expected =
+        std::format("Source is {} bytes, the limit is {}\n", size,
+                    MAX_SOURCE_SIZE);
+    for (const auto backend : {driver::EBackend::Tree, driver::EBackend::VM,
+                               driver::EBackend::Flat}) {
+        const auto output = driver::evaluate(source, {.backend = backend});
+        CHECK(output.exit_code == driver::INTERP_ERR_RETURN_CODE);
+        CHECK(output.err == expected);
+    }
+    const auto ran = driver::run(source, {});
+    CHECK(ran.exit_code == driver::INTERP_ERR_RETURN_CODE);
+    CHECK(ran.err == expected);
+    ::munmap(data, size);
+}
@@ -0,0 +1,37 @@
+#pragma once
+/**
+ * Helpers shared by the test files
+ * Each fails the calling test, instead of returning an error, when its input
+ * is broken: tests only hand them sources they expect to work.
+ **/
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <utility>
+
+#include "../src/lexer.h"
+#include "../src/parser.h"
+
+namespace test {
+
+// Source -> expression tree, lexed up front like the expression commands
+inline ExprPtr parse_source(std::string const& src) {
+    size_t num_errs = 0;
+    const auto tokens = lex(src, num_errs);
+    REQUIRE(num_errs == 0);
+    const auto token_vec = lift(tokens);
+    REQUIRE(token_vec.has_value());
+    auto parsed = parse(token_vec.value());
+    REQUIRE(parsed.has_value());
+    return std::move(parsed.value());
+}
+
+// Source -> statements, lexed as they're parsed like the run command
+inline Program parse_program_source(std::string const& src) {
+    TokenStream tokens(src);
+    auto parsed = parse_program(tokens);
+    REQUIRE(tokens.errors().empty());
+    REQUIRE(parsed.has_value());
+    return std::move(parsed.value());
+}
+} // namespace test
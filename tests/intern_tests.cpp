@@ -0,0 +1,77 @@
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/intern.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+
+TEST_CASE("Interning returns one copy per string", "[intern]") {
+    intern::Interner interner;
+    const std::string first = "some_ident";
+    const std::string second = "some_" + std::string("ident");
+
+    const auto a = interner.intern(first);
+    const auto b = interner.intern(second);
+    const auto c = interner.intern("other");
+
+    CHECK(a == b);
+    CHECK(a != c);
+    CHECK(a->is_interned);
+    CHECK(a->flat() == "some_ident");
+    CHECK(interner.size() == 2);
+    CHECK(interner.content_bytes() == first.size() + 5);
+}
+
+TEST_CASE("Parsed string literals share interned storage", "[intern]") {
+    const std::string in = "\"bar\" == \"bar\"";
+    size_t num_errs = 0;
+    const auto tokens = lift(lex(in, num_errs));
+    REQUIRE(tokens.has_value());
+    const auto parsed = parse(tokens.value());
+    REQUIRE(parsed.has_value());
+
+    const auto* binary = dynamic_cast<Expr_Binary*>(parsed.value().get());
+    REQUIRE(binary != nullptr);
+    const auto* left = dynamic_cast<Expr_Literal*>(binary->left.get());
+    const auto* right = dynamic_cast<Expr_Literal*>(binary->right.get());
+    REQUIRE(left != nullptr);
+    REQUIRE(right != nullptr);
+
+    const auto& left_str = std::get<Expr_Literal::String>(left->inner).value;
+    const auto& right_str = std::get<Expr_Literal::String>(right->inner).value;
+    CHECK(left_str.get() == right_str.get());
+    CHECK(left_str == "bar");
+}
+
+TEST_CASE("Interned strings compare by identity", "[intern]") {
+    rt::Heap heap;
+    const intern::IStr interned("abc");
+    const rt::StringPtr runtime = heap.make_string("abc");
+
+    CHECK(*interned.get() == *intern::IStr("abc").get());
+    // Runtime strings aren't interned, so they fall back to contents
+    CHECK(*interned.get() == *runtime);
+    CHECK_FALSE(*interned.get() == *intern::IStr("abd").get());
+}
+
+TEST_CASE("Interning from several threads", "[intern]") {
+    intern::Interner interner;
+    std::vector<std::vector<rt::StringPtr>> results(4);
+    {
+        std::vector<std::jthread> threads;
+        for (auto& result : results) {
+            threads.emplace_back([&interner, &result] {
+                for (int i = 0; i < 1000; ++i) {
+                    result.push_back(interner.intern(std::to_string(i % 100)));
+                }
+            });
+        }
+    }
+
+    CHECK(interner.size() == 100);
+    for (const auto& result : results) {
+        CHECK(result == results[0]);
+    }
+}
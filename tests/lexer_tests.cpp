@@ -1,5 +1,9 @@
 #include "../src/lexer.h"
+#include "../src/source.h"
+#include <bit>
 #include <catch2/catch_test_macros.hpp>
+#include <cstdlib>
+#include <random>
 
 TEST_CASE("Lexing empty string", "[lexer]") {
     const std::string in = "";
@@ -68,3 +72,271 @@ TEST_CASE("={===} assignment and figure brackets", "[lexer]") {
 
     REQUIRE(std::holds_alternative<EndOfFile>(out[5].value()));
 }
+
+TEST_CASE("Literal tokens are source slices with spans", "[lexer]") {
+    const std::string in = "foo\n  \"a\nb\" 12.5";
+    size_t num_errs = 0;
+    const auto out = lex(in, num_errs);
+    LineIndex lines(in);
+
+    CHECK( num_errs == 0 );
+    REQUIRE( out.size() == 4 );
+
+    const auto ident = std::get<Ident>(out[0].value());
+    CHECK(ident.literal == "foo");
+    CHECK(ident.literal.data() == in.data());
+    CHECK(ident.span == Span{0, 3});
+    CHECK(lines.locate(ident.span.offset) == SourcePos{1, 1});
+
+    const auto str = std::get<StringLiteral>(out[1].value());
+    CHECK(str.literal == "a\nb");
+    CHECK(str.literal.data() == in.data() + 7);
+    // With the quotes
+    CHECK(str.span == Span{6, 5});
+    CHECK(lines.locate(str.span.offset) == SourcePos{2, 3});
+
+    const auto num = std::get<NumberLiteral>(out[2].value());
+    CHECK(num.literal == "12.5");
+    CHECK(num.span == Span{12, 4});
+    CHECK(lines.locate(num.span.offset) == SourcePos{3, 4});
+
+    const auto eof = std::get<EndOfFile>(out[3].value());
+    CHECK(eof.span == Span{static_cast<uint32_t>(in.size()), 0});
+}
+
+TEST_CASE("LineIndex turns offsets into lines and columns", "[lexer]") {
+    const std::string in = "ab\n\ncd\n";
+    LineIndex lines(in);
+
+    CHECK(lines.line_starts() == std::vector<uint32_t>{0, 3, 4, 7});
+    CHECK(lines.locate(0) == SourcePos{1, 1});
+    CHECK(lines.locate(2) == SourcePos{1, 3});
+    CHECK(lines.locate(3) == SourcePos{2, 1});
+    CHECK(lines.locate(5) == SourcePos{3, 2});
+    // The end, and past it
+    CHECK(lines.locate(7) == SourcePos{4, 1});
+    CHECK(lines.line_of(100) == 4);
+
+    // Rebuilt from the starts alone, as AST files do
+    LineIndex saved(lines.line_starts());
+    CHECK(saved.locate(5) == SourcePos{3, 2});
+    CHECK(LineIndex("").locate(0) == SourcePos{1, 1});
+}
+
+static std::vector<std::string> stringify_all(FaultyTokenVec const& tokens) {
+    std::vector<std::string> out;
+    for (const auto& tok : tokens) {
+        if (tok.has_value()) {
+            out.push_back(std::visit(
+                [](const auto& t) { return impl::stringify_token(t); },
+                tok.value()));
+        } else {
+            out.push_back(tok.error());
+        }
+    }
+    return out;
+}
+
+TEST_CASE("Keywords only match whole words", "[lexer]") {
+    const std::string in = "or orchid or1 _and and while whilst nil";
+    size_t num_errs = 0;
+    const auto out = stringify_all(lex(in, num_errs));
+
+    CHECK( num_errs == 0 );
+    const std::vector<std::string> expected = {
+        "OR or null",         "IDENTIFIER orchid null", "IDENTIFIER or1 null",
+        "IDENTIFIER _and null", "AND and null",         "WHILE while null",
+        "IDENTIFIER whilst null", "NIL nil null",       "EOF  null"};
+    CHECK( out == expected );
+}
+
+TEST_CASE("Two-char operators next to operands", "[lexer]") {
+    const std::string in = "a==b<=1!=!c>=d";
+    size_t num_errs = 0;
+    const auto out = stringify_all(lex(in, num_errs));
+
+    CHECK( num_errs == 0 );
+    const std::vector<std::string> expected = {
+        "IDENTIFIER a null",   "EQUAL_EQUAL == null", "IDENTIFIER b null",
+        "LESS_EQUAL <= null",  "NUMBER 1 1.0",        "BANG_EQUAL != null",
+        "BANG ! null",         "IDENTIFIER c null",   "GREATER_EQUAL >= null",
+        "IDENTIFIER d null",   "EOF  null"};
+    CHECK( out == expected );
+}
+
+TEST_CASE("Numbers stop at a second dot", "[lexer]") {
+    const std::string in = "1.2.3 4.";
+    size_t num_errs = 0;
+    const auto out = stringify_all(lex(in, num_errs));
+
+    CHECK( num_errs == 0 );
+    REQUIRE( out.size() == 6 );
+    CHECK( out[1] == "DOT . null" );
+    CHECK( out[3] == "NUMBER 4 4.0" );
+    CHECK( out[4] == "DOT . null" );
+}
+
+// Checks every number in `literals` lexes to what strtod makes of it
+static void check_against_strtod(std::vector<std::string> const& literals) {
+    std::string in;
+    for (const auto& literal : literals) {
+        in += literal + " ";
+    }
+    size_t num_errs = 0;
+    const auto out = lex(in, num_errs);
+    REQUIRE( num_errs == 0 );
+    REQUIRE( out.size() == literals.size() + 1 );
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < literals.size(); ++i) {
+        const auto num = std::get<NumberLiteral>(out[i].value());
+        const double expected = std::strtod(literals[i].c_str(), nullptr);
+        // Bit for bit, and parse_float() agrees
+        if (std::bit_cast<uint64_t>(num.value) !=
+                std::bit_cast<uint64_t>(expected) ||
+            std::bit_cast<uint64_t>(NumberLiteral::parse_float(
+                literals[i])) != std::bit_cast<uint64_t>(expected)) {
+            UNSCOPED_INFO(literals[i]);
+            mismatches += 1;
+        }
+    }
+    CHECK( mismatches == 0 );
+}
+
+TEST_CASE("Number literals are correctly rounded", "[lexer]") {
+    check_against_strtod({
+        "0", "0.0", "007", "1.5", "0.1", "0.3", "123.456", "2.5000",
+        // 2^53 and the ints around it, the fast path's limit
+        "9007199254740991", "9007199254740992", "9007199254740993",
+        "9007199254740993.0",
+        // 10^22 is the largest exact power of ten
+        "10000000000000000000000", "0.0000000000000000000001",
+        "0.00000000000000000000001",
+        // Around 19 digits, where the digits stop fitting 64 bits
+        "9999999999999999999", "18446744073709551615",
+        "18446744073709551617", "1234567890.123456789",
+        "3.14159265358979323846264338327950288",
+        // Halfway between two doubles
+        "9007199254740993.00000000000000000001",
+        "2.2250738585072011", "2.2250738585072014",
+        "179769313486231570000000000000000000000000000000000000000000000"
+        "000000000000000000000000000000000000000000000000000000000000000"
+        "000000000000000000000000000000000000000000000000000000000000000"
+        "000000000000000000000000000000000000000000000000000000000000000"
+        "000000000000000000000000000000000000000000000000000000000000000",
+        // Out of range: inf, and too small to be anything but 0
+        std::string(400, '9'), "0." + std::string(400, '0') + "1",
+        "0." + std::string(320, '0') + "5",
+    });
+}
+
+// Integer part, dot, fraction: lengths on both sides of the fast path
+TEST_CASE("Random number literals match strtod", "[lexer]") {
+    std::mt19937_64 rng(20240521);
+    std::uniform_int_distribution<int> digit('0', '9');
+    std::uniform_int_distribution<size_t> int_len(1, 24);
+    std::uniform_int_distribution<size_t> frac_len(0, 24);
+    for (int round = 0; round < 20; ++round) {
+        std::vector<std::string> literals;
+        for (int i = 0; i < 100000; ++i) {
+            std::string literal;
+            for (size_t n = int_len(rng); n > 0; --n) {
+                literal += static_cast<char>(digit(rng));
+            }
+            if (const size_t n = frac_len(rng); n > 0) {
+                literal += '.';
+                for (size_t j = 0; j < n; ++j) {
+                    literal += static_cast<char>(digit(rng));
+                }
+            }
+            literals.push_back(std::move(literal));
+        }
+        check_against_strtod(literals);
+    }
+}
+
+// Long runs go through the 16-byte scanning loops, short ones only through
+// the scalar tail, so try lengths on both sides of a chunk
+TEST_CASE("Long blank runs, comments and strings", "[lexer]") {
+    for (const size_t len : {0, 1, 15, 16, 17, 31, 32, 33, 100}) {
+        const std::string pad(len, ' ');
+        const std::string body(len, 'x');
+        const std::string in = pad + "a\t\r" + pad + "// " + body + "\n" +
+                               "\"" + body + "\n" + body + "\" b";
+        size_t num_errs = 0;
+        const auto out = lex(in, num_errs);
+        LineIndex lines(in);
+
+        CHECK( num_errs == 0 );
+        REQUIRE( out.size() == 4 );
+        const auto a = std::get<Ident>(out[0].value());
+        CHECK( a.literal == "a" );
+        CHECK( lines.locate(a.span.offset).column == len + 1 );
+
+        const auto str = std::get<StringLiteral>(out[1].value());
+        CHECK( str.literal == body + "\n" + body );
+        CHECK( lines.line_of(str.span.offset) == 2 );
+        CHECK( str.span.length == str.literal.size() + 2 );
+
+        // Line and column carry on after the newline inside the string
+        const auto b = std::get<Ident>(out[2].value());
+        CHECK( lines.line_of(b.span.offset) == 3 );
+        CHECK( lines.locate(b.span.offset).column == len + 3 );
+    }
+}
+
+TEST_CASE("Errors keep their line numbers", "[lexer]") {
+    const std::string in = "a @\n// comment\n\"multi\nline # " +
+                           std::string(40, 'x') + "\n";
+    size_t num_errs = 0;
+    const auto out = stringify_all(lex(in, num_errs));
+
+    CHECK( num_errs == 2 );
+    const std::vector<std::string> expected = {
+        "IDENTIFIER a null", "[line 1] Error: Unexpected character: @",
+        "[line 5] Error: Unterminated string.", "EOF  null"};
+    CHECK( out == expected );
+}
+
+TEST_CASE("Lexer::next() yields the same tokens as lex()", "[lexer]") {
+    const std::string in = "var x = (1 + 2.5) # \"str\" // c\n!= nil";
+    size_t num_errs = 0;
+    const auto expected = stringify_all(lex(in, num_errs));
+
+    Lexer lexer(in);
+    FaultyTokenVec pulled;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        pulled.push_back(lexer.next());
+    }
+    CHECK( stringify_all(pulled) == expected );
+    CHECK( lexer.num_errors() == num_errs );
+
+    // Stays at EOF
+    REQUIRE( lexer.next().has_value() );
+    CHECK( std::holds_alternative<EndOfFile>(lexer.next().value()) );
+}
+
+TEST_CASE("TokenStream skips lex errors and keeps a bounded window", "[lexer]") {
+    std::string in;
+    for (size_t i = 0; i < 100; ++i) {
+        in += "a @ ";
+    }
+    TokenStream stream(in);
+
+    size_t count = 0;
+    auto it = stream.begin();
+    const auto end = stream.end();
+    while (it < end) {
+        if (count < 100) {
+            CHECK( std::holds_alternative<Ident>(*it) );
+        } else {
+            CHECK( std::holds_alternative<EndOfFile>(*it) );
+        }
+        it += 1;
+        count += 1;
+    }
+    CHECK( count == 101 );
+    CHECK( it == end );
+    CHECK( stream.errors().size() == 100 );
+    CHECK( stream.errors().front() == "[line 1] Error: Unexpected character: @" );
+}
@@ -0,0 +1,94 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <string>
+
+#include "../src/eval.h"
+#include "../src/lexer.h"
+#include "../src/optimize.h"
+#include "../src/parser.h"
+#include "helpers.h"
+
+using test::parse_source;
+
+// Folding must not change the value, or the exact error message
+static void check_fold_preserves(std::string const& src) {
+    INFO(src);
+    const ExprPtr parsed = parse_source(src);
+    ExprPtr folded = opt::fold_constants(*parsed);
+    CHECK(opt::count_nodes(*folded) <= opt::count_nodes(*parsed));
+
+    rt::Heap heap;
+    const auto before = eval::evaluate(parse_source(src), heap);
+    const auto after = eval::evaluate(std::move(folded), heap);
+
+    REQUIRE(before.has_value() == after.has_value());
+    if (before.has_value()) {
+        CHECK(before.value() == after.value());
+    } else {
+        CHECK(before.error() == after.error());
+    }
+}
+
+TEST_CASE("Constant folding preserves values", "[optimize]") {
+    const std::string src = GENERATE(
+        "true", "nil", "\"hello world!\"", "10.40", "(\"hello world!\")",
+        "-73", "!true", "!nil", "!10.40", "!((false))", "42 / 5",
+        "18 * 3 / (3 * 6)", "23 + 28 - (-(61 - 99))",
+        "\"hello\" + \" world!\"", "(\"a\" + \"b\") + \"c\" == \"abc\"",
+        "57 > -65", "(54 - 67) >= -(114 / 57 + 11)", "\"foo\" != \"bar\"",
+        "61 == \"61\"", "nil == nil", "true != false", "1 / 0",
+        "(1 + 2) * 3 == 9");
+
+    check_fold_preserves(src);
+}
+
+TEST_CASE("Constant folding preserves runtime errors", "[optimize]") {
+    const std::string src = GENERATE(
+        "-\"foo\"", "-(\"foo\" + \"bar\")", "\"foo\" * 42", "true / 2",
+        "\"foo\" + true", "42 - true", "\"foo\" - \"bar\"", "true < 2",
+        "(\"foo\" + \"bar\") < 42", "nil <= 1", "1 + (2 * -nil)",
+        "\"a\" - 1", "(1 + 2) * (\"a\" - 1)", "(\"x\" < 1) == (1 + 1)");
+
+    check_fold_preserves(src);
+}
+
+TEST_CASE("Constant folding collapses literal trees", "[optimize]") {
+    const ExprPtr parsed = parse_source("(1 + 2) * 3 == 9");
+    CHECK(opt::count_nodes(*parsed) == 8);
+
+    const ExprPtr folded = opt::fold_constants(*parsed);
+    CHECK(opt::count_nodes(*folded) == 1);
+    const auto* literal = dynamic_cast<Expr_Literal*>(folded.get());
+    REQUIRE(literal != nullptr);
+    CHECK(std::holds_alternative<Expr_Literal::True>(literal->inner));
+}
+
+TEST_CASE("Constant folding concatenates into interned strings",
+          "[optimize]") {
+    const ExprPtr folded = opt::fold_constants(*parse_source("\"a\" + \"b\""));
+    const auto* literal = dynamic_cast<Expr_Literal*>(folded.get());
+    REQUIRE(literal != nullptr);
+    const auto& str = std::get<Expr_Literal::String>(literal->inner);
+    CHECK(str.value == intern::IStr("ab"));
+}
+
+TEST_CASE("Constant folding keeps failing subtrees", "[optimize]") {
+    // Only the failing subtraction is left, its operands are folded
+    const ExprPtr folded =
+        opt::fold_constants(*parse_source("(1 + 2) * (\"a\" - (1 + 1))"));
+    CHECK(opt::count_nodes(*folded) == 5);
+
+    const auto* mul = dynamic_cast<Expr_Binary*>(folded.get());
+    REQUIRE(mul != nullptr);
+    CHECK(dynamic_cast<Expr_Literal*>(mul->left.get()) != nullptr);
+    const auto* minus = dynamic_cast<Expr_Binary*>(mul->right.get());
+    REQUIRE(minus != nullptr);
+    CHECK(dynamic_cast<Expr_Literal*>(minus->right.get()) != nullptr);
+}
+
+TEST_CASE("Constant folding treats strings as truthy", "[optimize]") {
+    const ExprPtr folded = opt::fold_constants(*parse_source("!\"\""));
+    const auto* literal = dynamic_cast<Expr_Literal*>(folded.get());
+    REQUIRE(literal != nullptr);
+    CHECK(std::holds_alternative<Expr_Literal::False>(literal->inner));
+}
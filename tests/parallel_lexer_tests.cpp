@@ -0,0 +1,73 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <string>
+#include <vector>
+
+#include "../src/lexer.h"
+#include "../src/parallel_lexer.h"
+
+// What tokenize prints for each token or error, plus its span
+static std::vector<std::string> describe(FaultyTokenVec const& tokens) {
+    std::vector<std::string> lines;
+    for (const auto& exp_tok : tokens) {
+        if (!exp_tok.has_value()) {
+            lines.push_back(exp_tok.error());
+            continue;
+        }
+        lines.push_back(std::visit(
+            [](const auto& tok) {
+                return impl::stringify_token(tok) + " @" +
+                       std::to_string(tok.span.offset) + "+" +
+                       std::to_string(tok.span.length);
+            },
+            exp_tok.value()));
+    }
+    return lines;
+}
+
+static std::string tricky_source() {
+    std::string src;
+    for (int i = 0; i < 200; ++i) {
+        switch (i % 5) {
+        case 0:
+            src += "var x = \"spans\nthree\nlines\" + " + std::to_string(i) +
+                   ";\n";
+            break;
+        case 1:
+            src += "// a \"quote\" in a comment\n";
+            break;
+        case 2:
+            src += "print \"// not a comment\" != 1.5; @\n";
+            break;
+        case 3:
+            src += "\n\n  \"\n\n\"\n";
+            break;
+        case 4:
+            src += "a/b >= (c) $ // trailing\n";
+            break;
+        }
+    }
+    return src;
+}
+
+TEST_CASE("lex_parallel matches lex()", "[parallel_lexer]") {
+    const std::string src = GENERATE(
+        tricky_source(), tricky_source() + "\"unterminated\nat the end",
+        std::string(""), std::string("no newline"), std::string("\n\n\n"),
+        tricky_source() + "1");
+    const size_t min_chunk = GENERATE(1, 7, 64, 1 << 20);
+    const size_t threads = GENERATE(2, 3);
+
+    size_t seq_errs = 0;
+    const auto expected = describe(lex(src, seq_errs));
+    size_t par_errs = 0;
+    const auto actual =
+        describe(lex_parallel(src, par_errs, threads, min_chunk));
+
+    CHECK(par_errs == seq_errs);
+    REQUIRE(actual.size() == expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        INFO(i);
+        CHECK(actual[i] == expected[i]);
+    }
+}
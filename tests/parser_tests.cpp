@@ -1,6 +1,9 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/generators/catch_generators.hpp>
+#include <algorithm>
 #include <functional>
+#include <string>
+#include <vector>
 
 #include "../src/parser.h"
 
@@ -223,4 +226,204 @@ TEST_CASE("expression() parsing: 2 + 3", "[parser]") {
 
     REQUIRE(std::get<Expr_Literal::Number>(left->inner).value == 2);
     REQUIRE(std::get<Expr_Literal::Number>(right->inner).value == 3);
-}
\ No newline at end of file
+}
+TEST_CASE("parse() over a TokenStream", "[parser]") {
+    const std::string src = "(2 + 3) * -4 == nil";
+    size_t num_errs = 0;
+    const auto tokens = lift(lex(src, num_errs)).value();
+    const auto from_vec = parse(tokens);
+    REQUIRE(from_vec.has_value());
+
+    TokenStream stream(src);
+    const auto from_stream = parse(stream);
+    REQUIRE(from_stream.has_value());
+    CHECK(stream.errors().empty());
+
+    auto as_binary = dynamic_cast<Expr_Binary*>(from_stream.value().get());
+    REQUIRE(as_binary != nullptr);
+    REQUIRE(as_binary->op == EBinOp::EqEq);
+    auto mul = dynamic_cast<Expr_Binary*>(as_binary->left.get());
+    REQUIRE(mul != nullptr);
+    REQUIRE(mul->op == EBinOp::Mul);
+    REQUIRE(dynamic_cast<Expr_Grouping*>(mul->left.get()) != nullptr);
+    REQUIRE(dynamic_cast<Expr_Unary*>(mul->right.get()) != nullptr);
+}
+
+TEST_CASE("parse() over a TokenStream reports the same errors", "[parser]") {
+    auto src = GENERATE(as<std::string>{}, "", "(1 + 2", "1 + )", "* 3");
+    size_t num_errs = 0;
+    const auto tokens = lift(lex(src, num_errs)).value();
+    const auto from_vec = parse(tokens);
+    REQUIRE(!from_vec.has_value());
+
+    TokenStream stream(src);
+    const auto from_stream = parse(stream);
+    REQUIRE(!from_stream.has_value());
+    CHECK(from_stream.error() == from_vec.error());
+}
+
+TEST_CASE("Parse errors are codes, formatted on demand", "[parser]") {
+    using grammar::EParseError;
+    auto [src, code, offset, message] =
+        GENERATE(table<std::string, EParseError, uint32_t, std::string>({
+            {"1 + )", EParseError::UnexpectedToken, 4, "')'"},
+            {"1 + a", EParseError::UnexpectedToken, 4, "'a'"},
+            {"1 +", EParseError::UnexpectedToken, 3, "end"},
+            {"(1 + 2", EParseError::ExpectedRightParen, 6,
+             "'After parsing expression in primary(), expected a right "
+             "paren'"},
+            {"((1))", EParseError::TooDeep, 1,
+             "'Expression nested too deeply, the limit is 1'"},
+        }));
+    INFO(src);
+    TokenStream stream(src);
+    const auto parsed = parse(stream, 1);
+    REQUIRE(!parsed.has_value());
+    CHECK(parsed.error().code == code);
+    // Where the offending token starts
+    CHECK(parsed.error().offset == offset);
+    CHECK(grammar::error_message(parsed.error(), src) == message);
+
+    // Only a TokenVec without an EndOfFile runs out of tokens
+    const auto empty = parse(TokenVec{});
+    REQUIRE(!empty.has_value());
+    CHECK(empty.error().code == EParseError::EndOfInput);
+    CHECK(grammar::error_message(empty.error(), "") ==
+          "'Reached end iterator'");
+}
+
+// Any type with the six visit_* methods works with visit_expr()
+struct Visitor_Height {
+    size_t visit_literal(Expr_Literal const&) const { return 1; }
+    size_t visit_grouping(Expr_Grouping const& grouping) const {
+        return 1 + visit_expr(*grouping.inner, *this);
+    }
+    size_t visit_unary(Expr_Unary const& unary) const {
+        return 1 + visit_expr(*unary.inner, *this);
+    }
+    size_t visit_binary(Expr_Binary const& binary) const {
+        return 1 + std::max(visit_expr(*binary.left, *this),
+                            visit_expr(*binary.right, *this));
+    }
+    size_t visit_variable(Expr_Variable const&) const { return 1; }
+    size_t visit_assign(Expr_Assign const& assign) const {
+        return 1 + visit_expr(*assign.value, *this);
+    }
+};
+
+TEST_CASE("visit_expr() dispatches on the node kind", "[parser]") {
+    TokenStream stream("(2 + 3) * -4 == nil");
+    const auto parsed = parse(stream);
+    REQUIRE(parsed.has_value());
+    Expr const& root = *parsed.value();
+    CHECK(root.kind == EExprKind::Binary);
+    auto const& eq = static_cast<Expr_Binary const&>(root);
+    CHECK(eq.left->kind == EExprKind::Binary);
+    // ==, *, group, +, 2
+    CHECK(visit_expr(root, Visitor_Height{}) == 5);
+}
+
+TEST_CASE("parse_program() parses statements", "[parser]") {
+    const std::string src = "var a = 1;\n"
+                            "print a + 2;\n"
+                            "{ var b; b = a = 3; }\n"
+                            "-a;";
+    size_t num_errs = 0;
+    const auto tokens = lift(lex(src, num_errs)).value();
+    const auto from_vec = parse_program(tokens);
+    REQUIRE(from_vec.has_value());
+
+    TokenStream stream(src);
+    const auto parsed = parse_program(stream);
+    REQUIRE(parsed.has_value());
+    CHECK(stream.errors().empty());
+    std::vector<StmtPtr> const& stmts = parsed.value().stmts;
+    REQUIRE(stmts.size() == 4);
+    CHECK(from_vec.value().stmts.size() == 4);
+
+    REQUIRE(stmts[0]->kind == EStmtKind::Var);
+    auto const& var = static_cast<Stmt_Var const&>(*stmts[0]);
+    CHECK(var.name == "a");
+    CHECK(var.offset == 0);
+    CHECK(var.name_offset == 4);
+    CHECK(var.init->kind == EExprKind::Literal);
+    // Not resolved yet
+    CHECK(var.slot.scope == EScope::Unresolved);
+
+    REQUIRE(stmts[1]->kind == EStmtKind::Print);
+    auto const& print = static_cast<Stmt_Print const&>(*stmts[1]);
+    CHECK(print.offset == 11);
+    REQUIRE(print.expr->kind == EExprKind::Binary);
+    auto const& sum = static_cast<Expr_Binary const&>(*print.expr);
+    REQUIRE(sum.left->kind == EExprKind::Variable);
+    CHECK(static_cast<Expr_Variable const&>(*sum.left).name == "a");
+
+    REQUIRE(stmts[2]->kind == EStmtKind::Block);
+    auto const& block = static_cast<Stmt_Block const&>(*stmts[2]);
+    REQUIRE(block.stmts.size() == 2);
+    CHECK(static_cast<Stmt_Var const&>(*block.stmts[0]).init == nullptr);
+    REQUIRE(block.stmts[1]->kind == EStmtKind::Expression);
+    // Assignments nest to the right
+    auto const& outer = static_cast<Expr_Assign const&>(
+        *static_cast<Stmt_Expression const&>(*block.stmts[1]).expr);
+    CHECK(outer.name == "b");
+    CHECK(outer.offset == 33);
+    REQUIRE(outer.value->kind == EExprKind::Assign);
+    CHECK(static_cast<Expr_Assign const&>(*outer.value).name == "a");
+
+    CHECK(stmts[3]->kind == EStmtKind::Expression);
+}
+
+TEST_CASE("parse_program() errors", "[parser]") {
+    using grammar::EParseError;
+    auto [src, max_depth, code, offset, at, expected] = GENERATE(table<
+        std::string, size_t, EParseError, uint32_t, std::string, std::string>({
+        {"print 1 2;", 1000, EParseError::ExpectedSemicolon, 8, "'2'",
+         "Expect ';' after statement."},
+        {"print 1", 1000, EParseError::ExpectedSemicolon, 7, "end",
+         "Expect ';' after statement."},
+        {"print a \"b\";", 1000, EParseError::ExpectedSemicolon, 8,
+         "'\"b\"'", "Expect ';' after statement."},
+        {"var 1 = 2;", 1000, EParseError::ExpectedVariableName, 4, "'1'",
+         "Expect variable name."},
+        {"var", 1000, EParseError::ExpectedVariableName, 3, "end",
+         "Expect variable name."},
+        {"{ print 1; ", 1000, EParseError::ExpectedRightBrace, 11, "end",
+         "Expect '}' after block."},
+        {"1 + a = 2;", 1000, EParseError::InvalidAssignTarget, 6, "'='",
+         "Invalid assignment target."},
+        {"print;", 1000, EParseError::UnexpectedToken, 5, "';'",
+         "Expect expression."},
+        {"print a = b c;", 1000, EParseError::ExpectedSemicolon, 12, "'c'",
+         "Expect ';' after statement."},
+        {"{ { } }", 1, EParseError::TooDeep, 2,
+         "'Expression nested too deeply, the limit is 1'",
+         "Expect expression."},
+        {"a = b = 1;", 1, EParseError::TooDeep, 6,
+         "'Expression nested too deeply, the limit is 1'",
+         "Expect expression."},
+    }));
+    INFO(src);
+    size_t num_errs = 0;
+    const auto tokens = lift(lex(src, num_errs)).value();
+    const auto from_vec = parse_program(tokens, max_depth);
+    REQUIRE(!from_vec.has_value());
+
+    TokenStream stream(src);
+    const auto parsed = parse_program(stream, max_depth);
+    REQUIRE(!parsed.has_value());
+    CHECK(parsed.error() == from_vec.error());
+    CHECK(parsed.error().code == code);
+    CHECK(parsed.error().offset == offset);
+    CHECK(grammar::error_message(parsed.error(), src) == at);
+    CHECK(grammar::expected_message(parsed.error()) == expected);
+}
+
+TEST_CASE("parse() leaves variables to programs", "[parser]") {
+    const std::string src = GENERATE("a", "a = 1", "1 + a");
+    TokenStream stream(src);
+    const auto parsed = parse(stream);
+    REQUIRE(!parsed.has_value());
+    CHECK(parsed.error().code == grammar::EParseError::UnexpectedToken);
+    CHECK(parsed.error().token == token_kind<Ident>);
+}
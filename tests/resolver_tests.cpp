@@ -0,0 +1,122 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <string>
+#include <vector>
+
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/resolver.h"
+#include "helpers.h"
+
+using test::parse_program_source;
+
+template <typename T>
+static T const& stmt_at(Program const& program, const size_t idx) {
+    return static_cast<T const&>(*program.stmts.at(idx));
+}
+
+// The variable `print x;` at `idx` reads
+static Slot printed_slot(std::vector<StmtPtr> const& stmts, const size_t idx) {
+    auto const& print = static_cast<Stmt_Print const&>(*stmts.at(idx));
+    REQUIRE(print.expr->kind == EExprKind::Variable);
+    return static_cast<Expr_Variable const&>(*print.expr).slot;
+}
+
+TEST_CASE("Globals get an index each, in order of appearance", "[resolver]") {
+    Program program = parse_program_source(
+        "var a = 1;\n"
+        "print b;\n"
+        "var b = a;\n"
+        "var a = 2;\n"
+        "print a;");
+    REQUIRE(resolve::resolve(program).has_value());
+    CHECK(program.num_globals == 2);
+    CHECK(program.num_locals == 0);
+
+    CHECK(stmt_at<Stmt_Var>(program, 0).slot == Slot{EScope::Global, 0});
+    // Read before it's declared, which is only an error if it runs so
+    CHECK(printed_slot(program.stmts, 1) == Slot{EScope::Global, 1});
+    CHECK(stmt_at<Stmt_Var>(program, 2).slot == Slot{EScope::Global, 1});
+    // Declaring a global again is the same global
+    CHECK(stmt_at<Stmt_Var>(program, 3).slot == Slot{EScope::Global, 0});
+    CHECK(printed_slot(program.stmts, 4) == Slot{EScope::Global, 0});
+}
+
+TEST_CASE("Locals are numbered by how many are alive", "[resolver]") {
+    Program program = parse_program_source(
+        "var a = 0;\n"
+        "{\n"
+        "  var a = 1;\n"
+        "  var b = 2;\n"
+        "  {\n"
+        "    var a = a = b;\n"
+        "    print a;\n"
+        "  }\n"
+        "  { var c = 3; print c; print b; }\n"
+        "  print a;\n"
+        "}\n"
+        "print a;");
+    REQUIRE(resolve::resolve(program).has_value());
+    CHECK(program.num_globals == 1);
+    CHECK(program.num_locals == 3);
+
+    auto const& outer = stmt_at<Stmt_Block>(program, 1);
+    CHECK(static_cast<Stmt_Var const&>(*outer.stmts[0]).slot ==
+          Slot{EScope::Local, 0});
+    CHECK(static_cast<Stmt_Var const&>(*outer.stmts[1]).slot ==
+          Slot{EScope::Local, 1});
+
+    auto const& inner = static_cast<Stmt_Block const&>(*outer.stmts[2]);
+    auto const& shadow = static_cast<Stmt_Var const&>(*inner.stmts[0]);
+    CHECK(shadow.slot == Slot{EScope::Local, 2});
+    // Like in jlox, the initializer assigns the a being declared. Only
+    // reading it there is an error.
+    auto const& assign = static_cast<Expr_Assign const&>(*shadow.init);
+    CHECK(assign.slot == Slot{EScope::Local, 2});
+    CHECK(printed_slot(inner.stmts, 1) == Slot{EScope::Local, 2});
+
+    // A sibling block reuses the slot the inner a had
+    auto const& sibling = static_cast<Stmt_Block const&>(*outer.stmts[3]);
+    CHECK(static_cast<Stmt_Var const&>(*sibling.stmts[0]).slot ==
+          Slot{EScope::Local, 2});
+    CHECK(printed_slot(sibling.stmts, 2) == Slot{EScope::Local, 1});
+
+    CHECK(printed_slot(outer.stmts, 4) == Slot{EScope::Local, 0});
+    CHECK(printed_slot(program.stmts, 2) == Slot{EScope::Global, 0});
+}
+
+TEST_CASE("Resolve errors point at the variable's name", "[resolver]") {
+    using resolve::EResolveError;
+    auto [src, code, offset] =
+        GENERATE(table<std::string, EResolveError, uint32_t>({
+            {"{ var a = 1; var a = 2; }", EResolveError::AlreadyDeclared, 17},
+            {"var a = 1; { var a = a + 1; }",
+             EResolveError::ReadInOwnInitializer, 21},
+            {"{ var a; { var b = (a); var b; } }",
+             EResolveError::AlreadyDeclared, 28},
+        }));
+    INFO(src);
+    Program program = parse_program_source(src);
+    const auto resolved = resolve::resolve(program);
+    REQUIRE(!resolved.has_value());
+    CHECK(resolved.error().code == code);
+    CHECK(resolved.error().offset == offset);
+}
+
+TEST_CASE("A program can have MAX_SLOTS globals", "[resolver]") {
+    const bool is_over = GENERATE(false, true);
+    std::string src;
+    for (uint32_t i = 0; i < resolve::MAX_SLOTS + (is_over ? 1 : 0); ++i) {
+        src += "var v" + std::to_string(i) + ";";
+    }
+    Program program = parse_program_source(src);
+    const auto resolved = resolve::resolve(program);
+    if (is_over) {
+        REQUIRE(!resolved.has_value());
+        CHECK(resolved.error().code ==
+              resolve::EResolveError::TooManyVariables);
+    } else {
+        REQUIRE(resolved.has_value());
+        CHECK(program.num_globals == resolve::MAX_SLOTS);
+    }
+}
@@ -0,0 +1,188 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <format>
+#include <limits>
+#include <random>
+#include <string>
+
+#include "../src/runtime.h"
+
+using rt::EValueType;
+using rt::StringPtr;
+using rt::Value;
+
+TEST_CASE("NaN-boxed numbers round-trip", "[runtime]") {
+    const double num = GENERATE(0.0, -0.0, 1.5, -73.0, 1e308, 5e-324,
+                                std::numeric_limits<double>::infinity(),
+                                -std::numeric_limits<double>::infinity());
+    const Value val = num;
+
+    REQUIRE(val.type() == EValueType::Number);
+    CHECK(val.holds<double>());
+    CHECK_FALSE(val.holds<bool>());
+    CHECK_FALSE(val.holds<StringPtr>());
+    CHECK(std::signbit(val.get<double>()) == std::signbit(num));
+    CHECK(val.get<double>() == num);
+}
+
+TEST_CASE("NaN results stay numbers", "[runtime]") {
+    const double zero = 0.0;
+    const Value val = zero / zero;
+
+    REQUIRE(val.type() == EValueType::Number);
+    CHECK(std::isnan(val.get<double>()));
+    CHECK_FALSE(val == val);
+}
+
+TEST_CASE("NaN-boxed nil, bools and strings", "[runtime]") {
+    rt::Heap heap;
+    const StringPtr str = heap.make_string("hello");
+
+    CHECK(Value().type() == EValueType::Nil);
+    CHECK(Value(std::monostate{}).holds<std::monostate>());
+    CHECK(Value(true).type() == EValueType::Bool);
+    CHECK(Value(true).get<bool>());
+    CHECK_FALSE(Value(false).get<bool>());
+
+    const Value str_val = str;
+    REQUIRE(str_val.type() == EValueType::String);
+    CHECK(str_val.get<StringPtr>() == str);
+    CHECK(str_val.get<StringPtr>()->flat() == "hello");
+}
+
+TEST_CASE("Long concatenations are ropes until read", "[runtime]") {
+    rt::Heap heap;
+    const std::string half(rt::Heap::MAX_COPIED_CONCAT / 2, 'x');
+
+    // Short enough to copy
+    const StringPtr short_str =
+        heap.concat(heap.make_string("ab"), heap.make_string("cd"));
+    CHECK_FALSE(short_str->is_rope());
+    CHECK(short_str->flat() == "abcd");
+    const StringPtr exact =
+        heap.concat(heap.make_string(half), heap.make_string(half));
+    CHECK_FALSE(exact->is_rope());
+
+    const StringPtr left = heap.make_string(half + "<");
+    const StringPtr right = heap.make_string(">" + half);
+    const StringPtr rope = heap.concat(left, right);
+    REQUIRE(rope->is_rope());
+    CHECK(rope->size() == half.size() * 2 + 2);
+    // A rope made of the same rope twice
+    const StringPtr twice = heap.concat(rope, rope);
+    CHECK(twice->size() == rope->size() * 2);
+
+    // Compared by contents, flattening both
+    const std::string expected = half + "<>" + half;
+    CHECK(*rope == *heap.make_string(expected));
+    CHECK_FALSE(rope->is_rope());
+    CHECK(rope->flat() == expected);
+    CHECK(twice->flat() == expected + expected);
+    CHECK(rt::format_value(Value(twice)) == expected + expected);
+    // The halves are untouched
+    CHECK(left->flat() == half + "<");
+}
+
+TEST_CASE("Deep ropes flatten without recursing", "[runtime]") {
+    rt::Heap heap;
+    const size_t depth = 1000000;
+    const std::string piece(rt::Heap::MAX_COPIED_CONCAT, '.');
+    StringPtr left_deep = heap.make_string("[");
+    StringPtr right_deep = heap.make_string("]");
+    for (size_t i = 0; i < depth; ++i) {
+        const StringPtr str = heap.make_string(piece);
+        left_deep = heap.concat(left_deep, str);
+        right_deep = heap.concat(str, right_deep);
+    }
+    REQUIRE(left_deep->is_rope());
+    REQUIRE(right_deep->is_rope());
+    CHECK(left_deep->size() == 1 + depth * piece.size());
+
+    std::string const& left_flat = left_deep->flat();
+    CHECK(left_flat.size() == left_deep->size());
+    CHECK(left_flat.starts_with("[."));
+    std::string const& right_flat = right_deep->flat();
+    CHECK(right_flat.size() == right_deep->size());
+    CHECK(right_flat.ends_with(".]"));
+}
+
+TEST_CASE("Value equality", "[runtime]") {
+    rt::Heap heap;
+
+    // Strings compare by contents, not identity
+    CHECK(Value(heap.make_string("a")) == Value(heap.make_string("a")));
+    CHECK_FALSE(Value(heap.make_string("a")) == Value(heap.make_string("b")));
+    CHECK(Value(0.0) == Value(-0.0));
+    CHECK(Value() == Value(std::monostate{}));
+    CHECK_FALSE(Value(false) == Value());
+    CHECK_FALSE(Value(1.0) == Value(true));
+}
+
+TEST_CASE("Numbers format as the shortest round-trip digits", "[runtime]") {
+    using rt::ENumberStyle;
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    auto [num, value, literal] =
+        GENERATE_COPY(table<double, std::string, std::string>({
+            {0.0, "0", "0.0"},
+            {-0.0, "-0", "-0.0"},
+            {3.0, "3", "3.0"},
+            {2.5, "2.5", "2.5"},
+            {0.1 + 0.2, "0.30000000000000004", "0.30000000000000004"},
+            {1e-5, "1e-05", "1e-05"},
+            // Whole numbers past INT_MAX and 2^53
+            {3000000000.0, "3e+09", "3000000000.0"},
+            {3000000000.5, "3000000000.5", "3000000000.5"},
+            {9007199254740993.0, "9007199254740992", "9007199254740992.0"},
+            {1e21, "1e+21", "1000000000000000000000.0"},
+            {-1e22, "-1e+22", "-10000000000000000000000.0"},
+            // Exactly, past the digits needed to round-trip
+            {1e23, "1e+23", "99999999999999991611392.0"},
+            {std::numeric_limits<double>::denorm_min(), "5e-324", "5e-324"},
+            {inf, "inf", "inf"},
+            {-inf, "-inf", "-inf"},
+            {std::nan(""), "nan", "nan"},
+        }));
+    INFO(value);
+    std::string out;
+    rt::append_number(out, num, ENumberStyle::Value);
+    CHECK(out == value);
+    CHECK(rt::format_value(Value(num)) == value);
+    out.clear();
+    rt::append_number(out, num, ENumberStyle::Literal);
+    CHECK(out == literal);
+    CHECK(out.size() <= rt::MAX_NUMBER_CHARS);
+}
+
+TEST_CASE("Whole literals are written out in full", "[runtime]") {
+    const double max = std::numeric_limits<double>::max();
+    std::string out;
+    rt::append_number(out, -max, rt::ENumberStyle::Literal);
+    CHECK(out == std::format("{:.1f}", -max));
+    CHECK(out.size() == 312);
+    CHECK(out.size() <= rt::MAX_NUMBER_CHARS);
+}
+
+TEST_CASE("Formatted numbers read back as the same double", "[runtime]") {
+    std::mt19937_64 rng(7);
+    char buffer[rt::MAX_NUMBER_CHARS + 1];
+    size_t mismatches = 0;
+    for (int i = 0; i < 1000000; ++i) {
+        // Any finite bit pattern
+        const double num = std::bit_cast<double>(rng());
+        if (!std::isfinite(num)) {
+            continue;
+        }
+        for (const auto style :
+             {rt::ENumberStyle::Value, rt::ENumberStyle::Literal}) {
+            *rt::format_number(buffer, num, style) = '\0';
+            if (std::strtod(buffer, nullptr) != num) {
+                UNSCOPED_INFO(buffer);
+                mismatches += 1;
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+}
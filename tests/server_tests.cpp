@@ -0,0 +1,221 @@
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "../src/intern.h"
+#include "../src/server.h"
+
+namespace {
+std::string request(std::string const& source) {
+    return std::to_string(source.size()) + "\n" + source;
+}
+
+void write_all(const int fd, std::string const& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        const ssize_t written =
+            ::write(fd, data.data() + done, data.size() - done);
+        REQUIRE(written > 0);
+        done += written;
+    }
+}
+
+std::string read_all(const int fd) {
+    std::string out;
+    char buffer[4096];
+    ssize_t got = 0;
+    while ((got = ::read(fd, buffer, sizeof(buffer))) > 0) {
+        out.append(buffer, got);
+    }
+    return out;
+}
+
+// Runs serve_fds over a socketpair with all of `input` already sent
+std::pair<std::expected<void, std::string>, std::string>
+serve(std::string const& input, driver::Options const& options = {},
+      cache::Cache* cache = nullptr) {
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    write_all(fds[0], input);
+    ::shutdown(fds[0], SHUT_WR);
+    // Read as it's answered, many responses can fill the socket's buffer
+    std::string responses;
+    std::thread reader([&] { responses = read_all(fds[0]); });
+    auto result = server::serve_fds(fds[1], fds[1], options, cache);
+    ::close(fds[1]);
+    reader.join();
+    ::close(fds[0]);
+    return {std::move(result), std::move(responses)};
+}
+
+int connect_to(std::string const& path) {
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, path.size());
+    REQUIRE(::connect(fd, reinterpret_cast<sockaddr const*>(&addr),
+                      sizeof(addr)) == 0);
+    return fd;
+}
+} // namespace
+
+TEST_CASE("serve_fds answers each request in order", "[server]") {
+    const auto [result, responses] =
+        serve(request("1 + 2") + request("\"a\" + \"b\"") + request("-\"a\"") +
+              request("(1\n"));
+    CHECK(result.has_value());
+
+    // Parse errors are the same as evaluate's, whatever the grammar says
+    const auto syntax = driver::evaluate("(1\n", {});
+    CHECK(responses == "0 2 0\n3\n"
+                       "0 3 0\nab\n"
+                       "70 0 34\nOperand must be a number\n[line 1]\n"
+                       "65 0 " + std::to_string(syntax.err.size()) + "\n" +
+                           syntax.err);
+}
+
+TEST_CASE("serve_fds keeps going after errors and on every backend",
+          "[server]") {
+    for (const auto backend :
+         {driver::EBackend::Tree, driver::EBackend::VM,
+          driver::EBackend::Flat}) {
+        const auto [result, responses] =
+            serve(request("@") + request("2 * 3"), {.backend = backend});
+        CHECK(result.has_value());
+        CHECK(responses == "65 0 40\n[line 1] Error: Unexpected character: @\n"
+                           "0 2 0\n6\n");
+    }
+}
+
+TEST_CASE("serve_fds rejects malformed requests", "[server]") {
+    CHECK(serve("").first.has_value());
+    CHECK(!serve("abc\n1").first.has_value());
+    CHECK(!serve("\n").first.has_value());
+    // Cut short, in the header and in the source
+    CHECK(!serve("12").first.has_value());
+    CHECK(!serve("10\n1 + 2").first.has_value());
+
+    // Requests before the bad one are still answered
+    const auto [result, responses] = serve(request("true") + "x\n");
+    CHECK(!result.has_value());
+    CHECK(responses == "0 5 0\ntrue\n");
+}
+
+TEST_CASE("serve_fds frees the strings of each request", "[server]") {
+    using driver::EBackend;
+    const size_t interned = intern::global().size();
+    // Folded concatenations are interned too
+    for (const driver::Options options :
+         {driver::Options{.backend = EBackend::Tree},
+          driver::Options{.backend = EBackend::Tree, .optimize = true},
+          driver::Options{.backend = EBackend::VM},
+          driver::Options{.backend = EBackend::VM, .optimize = true},
+          driver::Options{.backend = EBackend::Flat}}) {
+        const std::string err =
+            options.optimize ? "Constant folding: 3 -> 1 nodes\n" : "";
+        std::string input;
+        std::string expected;
+        for (int i = 0; i < 1000; ++i) {
+            const std::string n = std::to_string(i);
+            input += request("\"s" + n + "\" + \"t" + n + "\"");
+            const std::string out = "s" + n + "t" + n + "\n";
+            expected += "0 " + std::to_string(out.size()) + " " +
+                        std::to_string(err.size()) + "\n" + out + err;
+        }
+        // Cached entries keep their strings until they're evicted
+        cache::Cache cache("", 16);
+        for (auto* const with : {(cache::Cache*)nullptr, &cache}) {
+            const auto [result, responses] = serve(input, options, with);
+            CHECK(result.has_value());
+            CHECK(responses == expected);
+        }
+    }
+    CHECK(intern::global().size() == interned);
+}
+
+TEST_CASE("SocketServer only replaces sockets", "[server]") {
+    const auto path =
+        std::filesystem::temp_directory_path() / "interp_server_tests.txt";
+    std::ofstream(path) << "keep me";
+    {
+        server::SocketServer socket_server({}, 1);
+        const auto listening = socket_server.listen(path.string());
+        REQUIRE(!listening.has_value());
+        CHECK(listening.error().ends_with("exists and is not a socket"));
+    }
+    CHECK(std::filesystem::file_size(path) == 7);
+    std::filesystem::remove(path);
+
+    // A stale socket, bound and then closed without removing it
+    const std::string stale =
+        (std::filesystem::temp_directory_path() / "interp_server_stale.sock")
+            .string();
+    std::filesystem::remove(stale);
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    stale.copy(addr.sun_path, stale.size());
+    REQUIRE(::bind(fd, reinterpret_cast<sockaddr const*>(&addr),
+                   sizeof(addr)) == 0);
+    ::close(fd);
+
+    server::SocketServer socket_server({}, 1);
+    CHECK(socket_server.listen(stale).has_value());
+}
+
+TEST_CASE("SocketServer serves connections until stopped", "[server]") {
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "interp_server_tests.sock")
+            .string();
+    server::SocketServer socket_server({}, 2);
+    REQUIRE(socket_server.listen(path).has_value());
+    std::thread runner([&] { socket_server.run(); });
+
+    for (int i = 0; i < 3; ++i) {
+        const int fd = connect_to(path);
+        write_all(fd, request("nil") + request("!\"a\""));
+        ::shutdown(fd, SHUT_WR);
+        CHECK(read_all(fd) == "0 4 0\nnil\n0 6 0\nfalse\n");
+        ::close(fd);
+    }
+
+    socket_server.stop();
+    runner.join();
+}
+
+TEST_CASE("SocketServer stops with idle clients connected", "[server]") {
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "interp_server_idle.sock")
+            .string();
+    server::SocketServer socket_server({}, 2);
+    REQUIRE(socket_server.listen(path).has_value());
+    std::thread runner([&] { socket_server.run(); });
+
+    // More than there are threads, so one is still queued. Each has had a
+    // request answered, and then goes quiet without hanging up.
+    std::vector<int> fds;
+    for (int i = 0; i < 2; ++i) {
+        fds.push_back(connect_to(path));
+        write_all(fds.back(), request("1"));
+        std::string response(6, '\0');
+        REQUIRE(::read(fds.back(), response.data(), 6) == 6);
+        CHECK(response == "0 2 0\n");
+    }
+    fds.push_back(connect_to(path));
+
+    socket_server.stop();
+    runner.join();
+    // The rest of the responses, then the end of the stream
+    CHECK(read_all(fds[0]) == "1\n");
+    CHECK(read_all(fds[1]) == "1\n");
+    CHECK(read_all(fds[2]).empty());
+    for (const int fd : fds) {
+        ::close(fd);
+    }
+}
@@ -0,0 +1,106 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/sink.h"
+
+// An unlinked temporary file, to point sinks at
+struct TempFile {
+    std::FILE* file = std::tmpfile();
+
+    TempFile() { REQUIRE(file != nullptr); }
+    ~TempFile() { std::fclose(file); }
+
+    [[nodiscard]]
+    int fd() const {
+        return ::fileno(file);
+    }
+    [[nodiscard]]
+    std::string contents() const {
+        std::string out;
+        char buffer[4096];
+        ssize_t got = 0;
+        while ((got = ::pread(fd(), buffer, sizeof(buffer),
+                              static_cast<off_t>(out.size()))) > 0) {
+            out.append(buffer, got);
+        }
+        return out;
+    }
+};
+
+TEST_CASE("Sink writes in blocks", "[sink]") {
+    TempFile file;
+    {
+        sink::Sink out(file.fd(), 16);
+        out.print("{} + {}", 1, 2);
+        out.println(" = {}", 3);
+        CHECK(file.contents().empty());
+        CHECK(out.num_writes() == 0);
+
+        // Past the block size, everything so far goes out in one write
+        out.write("0123456789");
+        CHECK(file.contents() == "1 + 2 = 3\n0123456789");
+        CHECK(out.num_writes() == 1);
+
+        out.append([](std::string& buffer) { buffer += "tail"; });
+        CHECK(out.num_writes() == 1);
+    }
+    // Flushed when destroyed
+    CHECK(file.contents() == "1 + 2 = 3\n0123456789tail");
+}
+
+TEST_CASE("A tied sink keeps the order things were printed in", "[sink]") {
+    TempFile file;
+    sink::Sink out(file.fd());
+    sink::Sink err(file.fd(), 0, &out);
+
+    out.println("token 1");
+    err.println("error 1");
+    out.println("token 2");
+    out.println("token 3");
+    err.println("error 2");
+    out.println("EOF");
+    out.flush();
+    CHECK(file.contents() ==
+          "token 1\nerror 1\ntoken 2\ntoken 3\nerror 2\nEOF\n");
+    CHECK(err.num_writes() == 2);
+    CHECK(out.num_writes() == 3);
+}
+
+TEST_CASE("Tokens, trees and values print into a given sink", "[sink]") {
+    TempFile file;
+    {
+        sink::Sink out(file.fd());
+        const std::string src = "-(1.5 + \"a\")";
+        size_t num_errs = 0;
+        const auto tokens = lift(lex(src, num_errs));
+        REQUIRE(tokens.has_value());
+        for (TokenVariant const& tok : tokens.value()) {
+            print_token_variant(tok, out);
+        }
+
+        const auto parsed = parse(tokens.value());
+        REQUIRE(parsed.has_value());
+        visit_expr(*parsed.value(), pprint::Visitor_PPrint(out));
+        out.write("\n");
+
+        rt::Heap heap;
+        rt::print_value(rt::Value(2.5), out);
+        rt::print_value(rt::Value(heap.make_string("str")), out);
+        rt::print_value(rt::Value(), out);
+    }
+    CHECK(file.contents() == "MINUS - null\n"
+                             "LEFT_PAREN ( null\n"
+                             "NUMBER 1.5 1.5\n"
+                             "PLUS + null\n"
+                             "STRING \"a\" a\n"
+                             "RIGHT_PAREN ) null\n"
+                             "EOF  null\n"
+                             "(- (group (+ 1.5 a)))\n"
+                             "2.5\n"
+                             "str\n"
+                             "nil\n");
+}
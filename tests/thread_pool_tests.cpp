@@ -0,0 +1,79 @@
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "../src/thread_pool.h"
+
+TEST_CASE("ThreadPool runs every task once", "[thread_pool]") {
+    ThreadPool pool(4);
+    REQUIRE(pool.size() == 4);
+
+    std::vector<std::atomic<int>> runs(1000);
+    for (auto& run : runs) {
+        pool.submit([&run] { run += 1; });
+    }
+    pool.wait();
+    for (const auto& run : runs) {
+        CHECK(run == 1);
+    }
+
+    // Still usable after a wait()
+    std::atomic<int> more = 0;
+    for (int i = 0; i < 10; ++i) {
+        pool.submit([&more] { more += 1; });
+    }
+    pool.wait();
+    CHECK(more == 10);
+}
+
+TEST_CASE("ThreadPool steals from a busy worker", "[thread_pool]") {
+    ThreadPool pool(2);
+    std::atomic<bool> release = false;
+    std::atomic<int> done = 0;
+
+    // Round-robin: the blocker and every other small task go to the same
+    // worker, which is stuck until the rest are done
+    pool.submit([&] {
+        while (!release) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    for (int i = 0; i < 20; ++i) {
+        pool.submit([&done] { done += 1; });
+    }
+    while (done < 20) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    release = true;
+    pool.wait();
+    CHECK(done == 20);
+}
+
+TEST_CASE("ThreadPool survives tasks that throw", "[thread_pool]") {
+    ThreadPool pool(2);
+    std::atomic<int> done = 0;
+    for (int i = 0; i < 10; ++i) {
+        pool.submit([&done, i] {
+            if (i % 2 == 0) {
+                throw std::runtime_error("task failed");
+            }
+            done += 1;
+        });
+    }
+    pool.wait();
+    CHECK(done == 5);
+}
+
+TEST_CASE("ThreadPool finishes queued tasks when destroyed", "[thread_pool]") {
+    std::atomic<int> done = 0;
+    {
+        ThreadPool pool(3);
+        for (int i = 0; i < 100; ++i) {
+            pool.submit([&done] { done += 1; });
+        }
+    }
+    CHECK(done == 100);
+}
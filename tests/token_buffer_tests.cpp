@@ -0,0 +1,87 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <string>
+
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/token_buffer.h"
+
+static std::string stringify(TokenVariant const& tok) {
+    return std::visit([](const auto& t) { return impl::stringify_token(t); },
+                      tok);
+}
+
+TEST_CASE("token_kind matches the TokenVariant index", "[token_buffer]") {
+    CHECK(TokenVariant(LeftParen()).index() == token_kind<LeftParen>);
+    CHECK(TokenVariant(Ident("x")).index() == token_kind<Ident>);
+    CHECK(TokenVariant(While()).index() == token_kind<While>);
+}
+
+TEST_CASE("TokenBuffer rebuilds the tokens lex() produced", "[token_buffer]") {
+    const std::string src = "var total = (12.5 + x1) >= \"multi\nline\" @\n"
+                            "  // comment\n  !nil and \"s\" / 3";
+    size_t num_errs = 0;
+    const auto faulty = lex(src, num_errs);
+    const TokenBuffer buffer(src);
+
+    REQUIRE(buffer.errors().size() == 1);
+    CHECK(buffer.errors()[0] == "[line 2] Error: Unexpected character: @");
+
+    size_t idx = 0;
+    for (const auto& exp_tok : faulty) {
+        if (!exp_tok.has_value()) {
+            continue;
+        }
+        REQUIRE(idx < buffer.size());
+        const TokenVariant& expected = exp_tok.value();
+        const TokenVariant rebuilt = buffer.token(idx);
+        CHECK(buffer.kind(idx) == expected.index());
+        CHECK(stringify(rebuilt) == stringify(expected));
+
+        // Every token keeps its span, literals also their slice
+        CHECK(buffer.span(idx) == std::visit(
+                                      [](const auto& tok) { return tok.span; },
+                                      expected));
+        std::visit(
+            [&rebuilt](const auto& tok) {
+                using T = std::decay_t<decltype(tok)>;
+                const auto& other = std::get<T>(rebuilt);
+                CHECK(other.span == tok.span);
+                if constexpr (requires { tok.literal; }) {
+                    CHECK(other.literal.data() == tok.literal.data());
+                }
+            },
+            expected);
+        ++idx;
+    }
+    CHECK(idx == buffer.size());
+}
+
+TEST_CASE("parse() over a TokenBuffer", "[token_buffer]") {
+    auto src = GENERATE(as<std::string>{}, "(2 + 3) * -4 == nil",
+                        "!true != \"a\" < 2", "", "(1 + 2", "* 3");
+    size_t num_errs = 0;
+    const auto tokens = lift(lex(src, num_errs)).value();
+    const auto from_vec = parse(tokens);
+
+    const TokenBuffer buffer(src);
+    const auto from_buffer = parse(buffer);
+
+    REQUIRE(from_buffer.has_value() == from_vec.has_value());
+    if (!from_vec.has_value()) {
+        CHECK(from_buffer.error() == from_vec.error());
+    }
+}
+
+TEST_CASE("TokenBuffer is smaller than a TokenVec", "[token_buffer]") {
+    std::string src;
+    for (size_t i = 0; i < 1000; ++i) {
+        src += "var x = \"str\" + 12.5 * (y - 3);\n";
+    }
+    size_t num_errs = 0;
+    const auto tokens = lift(lex(src, num_errs)).value();
+    const TokenBuffer buffer(src);
+
+    REQUIRE(buffer.size() == tokens.size());
+    CHECK(buffer.memory_bytes() < tokens.size() * sizeof(TokenVariant));
+}
@@ -0,0 +1,160 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <string>
+
+#include "../src/eval.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/resolver.h"
+#include "../src/vm.h"
+#include "helpers.h"
+
+using test::parse_source;
+
+// Both backends must agree on the value, or on the exact error message
+static void check_backends_agree(std::string const& src) {
+    INFO(src);
+    rt::Heap heap;
+    const auto tree_res = eval::evaluate(parse_source(src), heap);
+    const auto vm_res = vm::evaluate(parse_source(src), heap);
+
+    REQUIRE(tree_res.has_value() == vm_res.has_value());
+    if (tree_res.has_value()) {
+        CHECK(tree_res.value() == vm_res.value());
+    } else {
+        CHECK(tree_res.error() == vm_res.error());
+    }
+}
+
+TEST_CASE("VM matches Visitor_Eval on values", "[vm]") {
+    const std::string src = GENERATE(
+        "true", "false", "nil", "\"hello world!\"", "10.40", "10",
+        "(\"hello world!\")", "(true)", "-73", "!true", "!nil", "!10.40",
+        "!\"\"", "!((false))", "42 / 5", "18 * 3 / (3 * 6)", "(10.40 * 2) / 2",
+        "70 - 65", "69 - 93", "10.40 - 2", "23 + 28 - (-(61 - 99))",
+        "\"hello\" + \" world!\"", "\"42\" + \"24\"", "57 > -65", "11 >= 11",
+        "3 < 2", "3 <= 3", "(54 - 67) >= -(114 / 57 + 11)",
+        "\"hello\" == \"world\"", "\"foo\" != \"bar\"", "\"foo\" == \"foo\"",
+        "61 == \"61\"", "nil == nil", "nil != false", "true != false",
+        "true == true", "1 / 0", "(1 + 2) * 3 == 9");
+
+    check_backends_agree(src);
+}
+
+TEST_CASE("VM matches Visitor_Eval on runtime errors", "[vm]") {
+    const std::string src = GENERATE(
+        "-\"foo\"", "-true", "-(\"foo\" + \"bar\")", "\"foo\" * 42",
+        "true / 2", "(\"foo\" * \"bar\")", "\"foo\" + true", "42 - true",
+        "true + false", "\"foo\" - \"bar\"", "\"foo\" < false", "true < 2",
+        "(\"foo\" + \"bar\") < 42", "false > true", "nil <= 1",
+        "1 + (2 * -nil)");
+
+    check_backends_agree(src);
+}
+
+TEST_CASE("VM handles more than 256 constants", "[vm]") {
+    std::string src = "0";
+    for (int i = 1; i < 300; ++i) {
+        src += " + " + std::to_string(i);
+    }
+
+    const auto chunk = vm::compile(*parse_source(src));
+    CHECK(chunk.constants.size() == 300);
+
+    rt::Heap heap;
+    const auto res = vm::evaluate(parse_source(src), heap);
+    REQUIRE(res.has_value());
+    CHECK(res.value().get<double>() == 299.0 * 300.0 / 2.0);
+}
+
+TEST_CASE("Chunk tracks max stack depth", "[vm]") {
+    // Right-nested: every operand is pushed before any operator runs
+    const auto chunk = vm::compile(*parse_source("1 - (2 - (3 - 4))"));
+    CHECK(chunk.max_stack == 4);
+
+    const auto flat_chunk = vm::compile(*parse_source("1 - 2 - 3 - 4"));
+    CHECK(flat_chunk.max_stack == 2);
+}
+
+TEST_CASE("verify accepts compiled chunks and rejects broken ones", "[vm]") {
+    const auto chunk = vm::compile(*parse_source("-(1 + \"a\") == !nil"));
+    CHECK(vm::verify(chunk));
+
+    auto broken = chunk;
+    broken.max_stack = 1;
+    CHECK_FALSE(vm::verify(broken));
+
+    broken = chunk;
+    broken.constants.pop_back();
+    CHECK_FALSE(vm::verify(broken));
+
+    broken = chunk;
+    broken.code.pop_back();
+    CHECK_FALSE(vm::verify(broken));
+
+    broken = chunk;
+    broken.code.insert(broken.code.begin(),
+                       static_cast<uint8_t>(vm::OpCode::Add));
+    CHECK_FALSE(vm::verify(broken));
+
+    broken = chunk;
+    broken.code[0] = 0xff;
+    CHECK_FALSE(vm::verify(broken));
+}
+
+// Parsed and resolved, failing the test if it doesn't get that far
+static Program program_source(std::string const& src) {
+    TokenStream tokens(src);
+    auto parsed = parse_program(tokens);
+    REQUIRE(tokens.errors().empty());
+    REQUIRE(parsed.has_value());
+    REQUIRE(resolve::resolve(parsed.value()).has_value());
+    return std::move(parsed.value());
+}
+
+TEST_CASE("VM runs programs like Visitor_Exec", "[vm]") {
+    const std::string src = GENERATE(
+        "print 1; print \"a\" + \"b\";", "var a; print a;",
+        "var a = 1; var a = a + 1; print a;",
+        "var a = 1; { var a = 2; { var b = a; } print a; } print a;",
+        "var a = \"g\"; { var b = a + \"l\"; a = b = b + \"!\"; print b; } "
+        "print a;",
+        "{ var a = 1; { var b = a + 1; print b; } { var c; print c; } }",
+        "print a;", "a = 1;", "print 1; { var b = -\"x\"; } print 2;",
+        "var a = 1; a = a + nil; print a;");
+    INFO(src);
+    const Program program = program_source(src);
+    rt::Heap heap;
+    std::string tree_out;
+    const auto tree_res = eval::execute(program, heap, tree_out);
+    std::string vm_out;
+    const auto vm_res = vm::execute(program, heap, vm_out);
+
+    CHECK(tree_out == vm_out);
+    REQUIRE(tree_res.has_value() == vm_res.has_value());
+    if (!tree_res.has_value()) {
+        CHECK(tree_res.error() == vm_res.error());
+    }
+}
+
+TEST_CASE("verify checks the slots of program chunks", "[vm]") {
+    const auto chunk = vm::compile(program_source(
+        "var g = 1; { var l = g; l = l + 1; g = l; print g; }"));
+    CHECK(chunk.num_globals == 1);
+    CHECK(chunk.num_locals == 1);
+    CHECK(vm::verify(chunk));
+
+    auto broken = chunk;
+    broken.num_globals = 0;
+    CHECK_FALSE(vm::verify(broken));
+
+    broken = chunk;
+    broken.num_locals = 0;
+    CHECK_FALSE(vm::verify(broken));
+
+    // Print with nothing to print
+    broken = chunk;
+    broken.code.insert(broken.code.begin(),
+                       static_cast<uint8_t>(vm::OpCode::Print));
+    CHECK_FALSE(vm::verify(broken));
+}